@@ -176,6 +176,19 @@ ece391_vidmap (uint8_t** screen_start)
     return 0;
 }
 
+/* Linux has no back page to give, so draw on the screen directly */
+int32_t 
+ece391_vidmap_buffered (uint8_t** screen_start)
+{
+    return ece391_vidmap (screen_start);
+}
+
+int32_t 
+ece391_vidmap_present (void)
+{
+    return 0;
+}
+
 int32_t 
 ece391_read (int32_t fd, void* buf, int32_t nbytes)
 {
@@ -41,6 +41,7 @@ int main(void)
     for(i=0; i<WAIT; i++) {
         ece391_read(rtc_fd, &garbage, 4);
         mp1_rtc_tasklet(garbage);
+        ece391_vidmap_present();
     }
 
     blink_struct.on_char = 'I';
@@ -54,6 +55,7 @@ int main(void)
     for(i=0; i<WAIT; i++) {
         ece391_read(rtc_fd, &garbage, 4);
         mp1_rtc_tasklet(garbage);
+        ece391_vidmap_present();
     }
 
     mp1_ioctl((40 << 16 | (6*80+60)), RTC_SYNC);
@@ -61,6 +63,7 @@ int main(void)
     for(i=0; i<WAIT; i++) {
         ece391_read(rtc_fd, &garbage, 4);
         mp1_rtc_tasklet(garbage);
+        ece391_vidmap_present();
     }
 
     mp1_ioctl(6*80+60, RTC_REMOVE);
@@ -68,6 +71,7 @@ int main(void)
     for(i=0; i<WAIT; i++) {
         ece391_read(rtc_fd, &garbage, 4);
         mp1_rtc_tasklet(garbage);
+        ece391_vidmap_present();
     }
 
     ece391_close(rtc_fd);
@@ -150,7 +154,8 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 uint8_t*
 mp1_set_video_mode (void)
 {
-    if(ece391_vidmap(&vmem_base_addr) == -1) {
+    /* draw a whole frame before any of it is shown */
+    if(ece391_vidmap_buffered(&vmem_base_addr) == -1) {
         return NULL;
     } else {
         return vmem_base_addr;
@@ -0,0 +1,26 @@
+#ifndef AP_BOOT
+#define AP_BOOT
+
+/* Physical address the real-mode trampoline is copied to (below 1MB, page aligned) */
+#define AP_TRAMPOLINE_ADDR  0x8000
+/* Startup IPI vector: the page number the APs start executing at */
+#define AP_STARTUP_VECTOR   (AP_TRAMPOLINE_ADDR >> 12)
+
+/* Size of the stack each AP boots and idles on */
+#define AP_STACK_SIZE       0x2000
+
+/* CR0 protected mode enable */
+#define CR0_PE              0x00000001
+
+#ifndef ASM
+
+/* Start and end of the trampoline code in the kernel image */
+extern char ap_trampoline[];
+extern char ap_trampoline_end[];
+
+/* GDTR image inside the trampoline, filled in before it is copied */
+extern char ap_gdt_desc[];
+
+#endif /* ASM */
+
+#endif /* AP_BOOT */
@@ -0,0 +1,25 @@
+#ifndef CONTEXT_SWITCH
+#define CONTEXT_SWITCH
+
+/* Byte offsets of the fields of context_t (types.h), used by context_switch.S */
+#define CTX_EBX         0
+#define CTX_ESI         4
+#define CTX_EDI         8
+#define CTX_EBP         12
+#define CTX_ESP         16
+#define CTX_EIP         20
+#define CTX_EFLAGS      24
+
+/* EFLAGS value for a freshly built context: reserved bit 1 set, interrupts off */
+#define CTX_INIT_EFLAGS 0x00000002
+
+#ifndef ASM
+
+#include "types.h"
+
+/* Saves the callee-saved state of the running context into prev and resumes next */
+extern void switch_to(context_t* prev, context_t* next);
+
+#endif /* ASM */
+
+#endif /* CONTEXT_SWITCH */
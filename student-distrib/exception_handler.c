@@ -1,6 +1,7 @@
 #include "exception_handler.h"
 #include "lib.h"
 #include "systemcalls.h"
+#include "klog.h"
 
 /* 
  * _0_divide_error_exception
@@ -12,7 +13,7 @@
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _0_divide_error_exception() {
-    printf("Divide Error Exception\n"); 
+    printk(KLOG_ERR, "Divide Error Exception\n"); 
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -27,7 +28,7 @@ void _0_divide_error_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _1_debug_exception() {
-    printf("Debug Exception\n");
+    printk(KLOG_ERR, "Debug Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -42,7 +43,7 @@ void _1_debug_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _2_nmi_interrupt() {
-    printf("NMI Interrupt\n");
+    printk(KLOG_ERR, "NMI Interrupt\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
     
@@ -58,7 +59,7 @@ void _2_nmi_interrupt() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _3_breakpoint_exception() {
-    printf("Breakpoint Exception\n");
+    printk(KLOG_ERR, "Breakpoint Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -73,7 +74,7 @@ void _3_breakpoint_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _4_overflow_exception() {
-    printf("Overflow Exception\n");
+    printk(KLOG_ERR, "Overflow Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -88,7 +89,7 @@ void _4_overflow_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _5_bound_range_exceeded_exception() {
-    printf("BOUND Range Exceeded Exception\n");
+    printk(KLOG_ERR, "BOUND Range Exceeded Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -103,22 +104,7 @@ void _5_bound_range_exceeded_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _6_invalid_opcode_exception() {
-    printf("Invalid Opcode Exception\n");
-    exception_flag = 1;
-    halt(EXCEPTION_CODE);
-}
-
-/* 
- * _7_device_not_available_exception
- *   DESCRIPTION: Prints a description of exception vector 7 and
- *                returns to the shell.
- *   INPUTS: none
- *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
- */
-void _7_device_not_available_exception() {
-    printf("Device Not Available Exception\n");
+    printk(KLOG_ERR, "Invalid Opcode Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -133,7 +119,7 @@ void _7_device_not_available_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _8_double_fault_exception() {
-    printf("Double Fault Exception\n");
+    printk(KLOG_ERR, "Double Fault Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -148,7 +134,7 @@ void _8_double_fault_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _9_coprocessor_segment_overrun() {
-    printf("Coprocessor Segment Overrun\n");
+    printk(KLOG_ERR, "Coprocessor Segment Overrun\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -163,7 +149,7 @@ void _9_coprocessor_segment_overrun() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _10_invalid_TSS_exception() {
-    printf("Invalid TSS Exception\n");
+    printk(KLOG_ERR, "Invalid TSS Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -178,7 +164,7 @@ void _10_invalid_TSS_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _11_segment_not_present() {
-    printf("Segmant Not Present\n");
+    printk(KLOG_ERR, "Segmant Not Present\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -193,7 +179,7 @@ void _11_segment_not_present() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _12_stack_fault_exception() {
-    printf("Stack Fault Exception\n");
+    printk(KLOG_ERR, "Stack Fault Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -208,7 +194,7 @@ void _12_stack_fault_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _13_general_protection_exception() {
-    printf("General Protection Exception\n");
+    printk(KLOG_ERR, "General Protection Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -223,7 +209,7 @@ void _13_general_protection_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _14_page_fault_exception() {
-    printf("Page Fault Exception\n");
+    printk(KLOG_ERR, "Page Fault Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -238,7 +224,7 @@ void _14_page_fault_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _16_fpu_floating_point_error() {
-    printf("Floating-point error\n");
+    printk(KLOG_ERR, "Floating-point error\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 } 
@@ -253,7 +239,7 @@ void _16_fpu_floating_point_error() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _17_alignment_check_exception() {
-    printf("Alignment Check Exception\n");
+    printk(KLOG_ERR, "Alignment Check Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -268,7 +254,7 @@ void _17_alignment_check_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _18_machine_check_exception() {
-    printf("Machine Check Exception\n");
+    printk(KLOG_ERR, "Machine Check Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -283,7 +269,7 @@ void _18_machine_check_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void _19_simd_floating_point_exception() {
-    printf("SIMD Floating-Point Exception\n");
+    printk(KLOG_ERR, "SIMD Floating-Point Exception\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -298,7 +284,7 @@ void _19_simd_floating_point_exception() {
  *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
  */
 void reserved() {
-    printf("Reserved\n");
+    printk(KLOG_ERR, "Reserved\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
@@ -312,7 +298,23 @@ void reserved() {
  *   SIDE EFFECTS: Writes a message to the screen
  */
 void unreserved() {
-    printf("Unreserved\n");
+    printk(KLOG_ERR, "Unreserved\n");
+    exception_flag = 1;
+    halt(EXCEPTION_CODE);
+}
+
+/* 
+ * sysenter_bad_stack_exception
+ *   DESCRIPTION: Kills a process that entered the kernel with SYSENTER
+ *                and an EBP outside its page, which has no address to
+ *                return to, as if it had faulted.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes a message to the screen and returns to the shell
+ */
+void sysenter_bad_stack_exception() {
+    printk(KLOG_ERR, "SYSENTER Bad User Stack\n");
     exception_flag = 1;
     halt(EXCEPTION_CODE);
 }
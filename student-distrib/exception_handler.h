@@ -6,7 +6,9 @@
 /* Exception code used to return when a process hits exception */
 #define EXCEPTION_CODE      255
 
-volatile uint8_t exception_flag;
+/* Set when an exception kills a process; kept per terminal so the parent
+ * that resumes on any CPU still sees it */
+#define exception_flag      (terminal[sched_term].exception_flag)
 
 /* Exception handler for exception vector 0 */
 void _0_divide_error_exception();
@@ -29,9 +31,6 @@ void _5_bound_range_exceeded_exception();
 /* Exception handler for exception vector 6 */
 void _6_invalid_opcode_exception();
 
-/* Exception handler for exception vector 7 */
-void _7_device_not_available_exception();
-
 /* Exception handler for exception vector 8 */
 void _8_double_fault_exception();
 
@@ -71,4 +70,7 @@ void reserved();
 /* Exception handler for exception vectors 32 thru 255 */
 void unreserved();
 
+/* Kills a SYSENTER caller whose user stack is outside its page */
+void sysenter_bad_stack_exception();
+
 #endif /* EXCEPTION_HANDLER_H */
@@ -0,0 +1,298 @@
+/* fbcon.c - console drawn as glyphs on the VBE framebuffer
+ * vim:ts=4 noexpandtab
+ */
+
+#include "fbcon.h"
+#include "vbe.h"
+#include "paging.h"
+#include "pit.h"
+#include "workqueue.h"
+#include "lib.h"
+
+/* VGA sequencer and graphics controller, an index port and a data port each */
+#define VGA_SEQ_INDEX       0x3C4
+#define VGA_SEQ_MAP_MASK    0x02
+#define VGA_SEQ_MEM_MODE    0x04
+#define VGA_GC_INDEX        0x3CE
+#define VGA_GC_READ_MAP     0x04
+#define VGA_GC_MODE         0x05
+#define VGA_GC_MISC         0x06
+
+/* Register values that put plane 2, where text mode keeps its font, at
+ * VGA_FONT_ADDR as plain memory */
+#define FONT_PLANE          2
+#define FONT_SEQ_MEM_MODE   0x07        /* sequential, no odd/even */
+#define FONT_GC_MODE        0x00        /* no odd/even */
+#define FONT_GC_MISC        0x04        /* planes at 0xA0000, 64KB */
+
+/* Glyphs in plane 2, 32 bytes apart whatever the font height */
+#define VGA_FONT_ADDR       0xA0000
+#define FONT_GLYPHS         256
+#define FONT_GLYPH_STRIDE   32
+#define VGA_FONT_PAGE       (VGA_FONT_ADDR >> PAGE_TABLE_OFFSET)
+#define VGA_FONT_PAGES      (FONT_GLYPHS * FONT_GLYPH_STRIDE / PAGE_SIZE)
+
+/* Glyph rows read out of plane 2, one byte per row with the leftmost pixel
+ * in bit 7. Read once, the VGA cannot give them back in a graphics mode. */
+static uint8_t fbcon_font[FONT_GLYPHS][FONT_HEIGHT];
+
+/* Every row of the font as 8 pixel masks, all ones where the glyph is set,
+ * so a glyph row is drawn without testing bits */
+static uint32_t fbcon_expand[FONT_GLYPHS][FONT_WIDTH];
+
+/* The 16 text mode colors as 32 bpp pixels */
+static const uint32_t fbcon_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+/* Cells as last drawn and the copy being drawn, only the worker uses them */
+static uint16_t fbcon_cells[NUM_ROWS * NUM_COLS];
+static uint16_t fbcon_snap[NUM_ROWS * NUM_COLS];
+
+/* Cell the cursor was last drawn under, -1 if none */
+static int32_t fbcon_cursor = -1;
+
+/* Top left pixel of the console, which is centered on the screen */
+static uint8_t* fbcon_origin;
+
+static volatile uint8_t fbcon_enabled = 0;
+
+/* A redraw is queued on the worker. Only CPU 0's PIT tick sets it. */
+static volatile uint8_t fbcon_queued = 0;
+
+/* Everything has to be drawn again, the framebuffer holds something else */
+static volatile uint8_t fbcon_full = 0;
+
+/*
+ * vga_reg_read
+ *
+ * DESCRIPTION: reads an indexed VGA register
+ *
+ * Inputs: index_port - VGA_SEQ_INDEX or VGA_GC_INDEX, the data port follows it
+ *         reg - register index
+ * Outputs: none
+ * Return values: the register's value
+ *
+ * SIDE EFFECTS: none
+ */
+static uint8_t vga_reg_read(uint16_t index_port, uint8_t reg) {
+    outb(reg, index_port);
+    return inb(index_port + 1);
+}
+
+/*
+ * vga_reg_write
+ *
+ * DESCRIPTION: writes an indexed VGA register
+ *
+ * Inputs: index_port - VGA_SEQ_INDEX or VGA_GC_INDEX, the data port follows it
+ *         reg - register index
+ *         val - value to write
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: changes how the VGA maps its memory
+ */
+static void vga_reg_write(uint16_t index_port, uint8_t reg, uint8_t val) {
+    outb(reg, index_port);
+    outb(val, index_port + 1);
+}
+
+/*
+ * fbcon_load_font
+ *
+ * DESCRIPTION: copies the text mode font out of plane 2 and builds the
+ *              pixel masks of every glyph row. The VGA is put back the way
+ *              it was. Interrupts are off, text memory is not where it
+ *              should be meanwhile.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: fills fbcon_font and fbcon_expand
+ */
+static void fbcon_load_font(void) {
+    const uint8_t* plane = (const uint8_t*) VGA_FONT_ADDR;
+    uint8_t seq_mask, seq_mode, gc_read, gc_mode, gc_misc;
+    int32_t c, r, i;
+
+    seq_mask = vga_reg_read(VGA_SEQ_INDEX, VGA_SEQ_MAP_MASK);
+    seq_mode = vga_reg_read(VGA_SEQ_INDEX, VGA_SEQ_MEM_MODE);
+    gc_read = vga_reg_read(VGA_GC_INDEX, VGA_GC_READ_MAP);
+    gc_mode = vga_reg_read(VGA_GC_INDEX, VGA_GC_MODE);
+    gc_misc = vga_reg_read(VGA_GC_INDEX, VGA_GC_MISC);
+
+    vga_reg_write(VGA_SEQ_INDEX, VGA_SEQ_MAP_MASK, 1 << FONT_PLANE);
+    vga_reg_write(VGA_SEQ_INDEX, VGA_SEQ_MEM_MODE, FONT_SEQ_MEM_MODE);
+    vga_reg_write(VGA_GC_INDEX, VGA_GC_READ_MAP, FONT_PLANE);
+    vga_reg_write(VGA_GC_INDEX, VGA_GC_MODE, FONT_GC_MODE);
+    vga_reg_write(VGA_GC_INDEX, VGA_GC_MISC, FONT_GC_MISC);
+
+    for (i = 0; i < VGA_FONT_PAGES; i++)
+        page_table[VGA_FONT_PAGE + i] |= PRESENT;
+    flush_tlb();
+
+    for (c = 0; c < FONT_GLYPHS; c++) {
+        for (r = 0; r < FONT_HEIGHT; r++)
+            fbcon_font[c][r] = plane[c * FONT_GLYPH_STRIDE + r];
+    }
+
+    for (i = 0; i < VGA_FONT_PAGES; i++)
+        page_table[VGA_FONT_PAGE + i] &= ~PRESENT;
+    flush_tlb();
+
+    vga_reg_write(VGA_SEQ_INDEX, VGA_SEQ_MAP_MASK, seq_mask);
+    vga_reg_write(VGA_SEQ_INDEX, VGA_SEQ_MEM_MODE, seq_mode);
+    vga_reg_write(VGA_GC_INDEX, VGA_GC_READ_MAP, gc_read);
+    vga_reg_write(VGA_GC_INDEX, VGA_GC_MODE, gc_mode);
+    vga_reg_write(VGA_GC_INDEX, VGA_GC_MISC, gc_misc);
+
+    for (c = 0; c < FONT_GLYPHS; c++) {
+        for (i = 0; i < FONT_WIDTH; i++)
+            fbcon_expand[c][i] = (c & (0x80 >> i)) ? 0xFFFFFFFF : 0;
+    }
+}
+
+/*
+ * fbcon_draw_cell
+ *
+ * DESCRIPTION: draws a text cell as a glyph in its colors, blink is
+ *              ignored. Each glyph row is written as 8 consecutive pixels,
+ *              which the write-combining mapping sends as one burst.
+ *
+ * Inputs: i - index of the cell on the screen
+ *         cell - character in the low byte, attribute in the high byte
+ *         cursor - 1 to underline the cell with the cursor
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: draws on the framebuffer
+ */
+static void fbcon_draw_cell(int32_t i, uint16_t cell, int32_t cursor) {
+    uint32_t fg = fbcon_palette[(cell >> 8) & 0x0F];
+    uint32_t bg = fbcon_palette[(cell >> 12) & 0x07];
+    uint8_t* line = fbcon_origin + (i / NUM_COLS) * FONT_HEIGHT * vbe_mode.pitch +
+                    (i % NUM_COLS) * FONT_WIDTH * sizeof(uint32_t);
+    const uint32_t* mask;
+    uint32_t* px;
+    int32_t r, x;
+
+    for (r = 0; r < FONT_HEIGHT; r++, line += vbe_mode.pitch) {
+        if (cursor && r >= FONT_HEIGHT - 2)
+            mask = fbcon_expand[0xFF];
+        else
+            mask = fbcon_expand[fbcon_font[cell & 0xFF][r]];
+
+        px = (uint32_t*) line;
+        for (x = 0; x < FONT_WIDTH; x++)
+            px[x] = bg ^ ((fg ^ bg) & mask[x]);
+    }
+}
+
+/*
+ * fbcon_redraw
+ *
+ * DESCRIPTION: work item queued by fbcon_tick. Draws the cells of the
+ *              displayed terminal that changed since the last redraw, and
+ *              moves the cursor. Nothing is drawn while a process holds the
+ *              framebuffer; everything is once the last one lets go.
+ *
+ * Inputs: arg - unused
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: draws on the framebuffer
+ */
+static void fbcon_redraw(uint32_t arg) {
+    int32_t i, cursor, full;
+
+    /* ticks from here on queue another redraw */
+    fbcon_queued = 0;
+
+    if (vbe_users != 0) {
+        fbcon_full = 1;
+        return;
+    }
+
+    full = fbcon_full;
+    fbcon_full = 0;
+    if (full)
+        memset_dword(vbe_mode.base, 0, vbe_mode.pitch * vbe_mode.height / sizeof(uint32_t));
+
+    cursor = screen_copy_shown(fbcon_snap);
+    if (cursor >= NUM_ROWS * NUM_COLS)
+        cursor = -1;
+
+    for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
+        if (!full && fbcon_snap[i] == fbcon_cells[i] &&
+            (cursor == fbcon_cursor || (i != cursor && i != fbcon_cursor)))
+            continue;
+        fbcon_draw_cell(i, fbcon_snap[i], i == cursor);
+        fbcon_cells[i] = fbcon_snap[i];
+    }
+    fbcon_cursor = cursor;
+}
+
+/*
+ * fbcon_init
+ *
+ * DESCRIPTION: takes the font while the VGA is still in text mode, moves
+ *              the terminals' screens out of text memory and switches to a
+ *              32 bpp mode with room for the 80x25 console in its middle
+ *
+ * Inputs: width, height - resolution in pixels
+ *         bpp - bits per pixel, only 32 is drawn
+ * Outputs: none
+ * Return values: 0 on success, -1 if the mode cannot be used, the VGA stays
+ *                in text mode unless the card refused the mode it was given
+ *
+ * SIDE EFFECTS: text mode is gone for good
+ */
+int32_t fbcon_init(uint32_t width, uint32_t height, uint32_t bpp) {
+    uint32_t flags;
+
+    if (bpp != 32 || width < NUM_COLS * FONT_WIDTH || height < NUM_ROWS * FONT_HEIGHT)
+        return -1;
+    if (vbe_mode_valid(width, height, bpp) == -1)
+        return -1;
+
+    cli_and_save(flags);
+    fbcon_load_font();
+    screen_text_off();
+    if (vbe_set_mode(width, height, bpp) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    restore_flags(flags);
+
+    fbcon_origin = vbe_mode.base +
+                   (height - NUM_ROWS * FONT_HEIGHT) / 2 * vbe_mode.pitch +
+                   (width - NUM_COLS * FONT_WIDTH) / 2 * sizeof(uint32_t);
+    fbcon_full = 1;
+    fbcon_enabled = 1;
+    return 0;
+}
+
+/*
+ * fbcon_tick
+ *
+ * DESCRIPTION: queues a redraw on the worker every FBCON_TICKS. Polling
+ *              finds changes however they were made, by printing or by a
+ *              program writing its vidmap page.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void fbcon_tick(void) {
+    if (!fbcon_enabled || fbcon_queued || pit_ticks % FBCON_TICKS != 0)
+        return;
+
+    fbcon_queued = 1;
+    if (work_queue(fbcon_redraw, 0) == -1)
+        fbcon_queued = 0;
+}
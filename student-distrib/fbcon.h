@@ -0,0 +1,23 @@
+/* fbcon.h - console drawn as glyphs on the VBE framebuffer
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FBCON_H
+#define _FBCON_H
+
+#include "types.h"
+
+/* Glyph size of the VGA text mode font */
+#define FONT_WIDTH          8
+#define FONT_HEIGHT         16
+
+/* The console is redrawn every FBCON_TICKS PIT ticks, 25 times a second */
+#define FBCON_TICKS         4
+
+/* Switches to a graphics mode and draws the displayed terminal there */
+int32_t fbcon_init(uint32_t width, uint32_t height, uint32_t bpp);
+
+/* Queues a redraw every FBCON_TICKS, called on every PIT tick */
+void fbcon_tick(void);
+
+#endif /* _FBCON_H */
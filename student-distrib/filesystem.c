@@ -4,6 +4,7 @@
 
 #include "filesystem.h"
 #include "lib.h"
+#include "scheduler.h"
 
 /* Global variables to store starting addresses */
 uint32_t boot_addr;                 // address pointing to start of boot block
@@ -176,6 +177,67 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
 }
 
 
+/* 
+ * read_data_block
+ * 
+ * DESCRIPTION: finds file data in place in the filesystem image, so it
+ * can be handed on without copying it into a buffer first
+ * 
+ * INPUT: inode - index of the file's inode
+ *        offset - byte offset into the file
+ * OUTPUT: data - address of the byte at offset
+ * RETURN VALUE: bytes from offset to the end of its data block or of the
+ *               file, whichever comes first; 0 at end of file, -1 for a
+ *               bad inode
+ * 
+ * SIDE EFFECT: none
+ */
+int32_t read_data_block(uint32_t inode, uint32_t offset, const uint8_t** data) {
+    uint32_t current_inode_addr = inode_addr + inode * KBYTE_4;
+    uint32_t length, block_num, n;
+
+    if (inode >= num_inodes)
+        return -1;
+
+    length = *((uint32_t*)current_inode_addr);
+    if (offset >= length)
+        return 0;
+
+    // block numbers follow the length word in the inode
+    block_num = *((uint32_t*)(current_inode_addr + (offset / KBYTE_4 + 1) * BYTE_4));
+    if (block_num >= num_data)
+        return -1;
+    *data = (const uint8_t*)(data_addr + KBYTE_4 * block_num + offset % KBYTE_4);
+
+    n = KBYTE_4 - offset % KBYTE_4;
+    if (n > length - offset)
+        n = length - offset;
+    return n;
+}
+
+/* 
+ * fs_is_file
+ * 
+ * DESCRIPTION: tells a regular file's inode from the directory's and the
+ * RTC's, looking it up the same way fs_read does
+ * 
+ * INPUT: inode - inode number stored in a file descriptor
+ * OUTPUT: none
+ * RETURN VALUE: 1 for a regular file, 0 otherwise
+ * 
+ * SIDE EFFECT: none
+ */
+int32_t fs_is_file(uint32_t inode) {
+    int i;
+
+    for (i = 0; i < num_dentries; i++) {
+        if (inode == dentries[i].inode_num)
+            return dentries[i].file_type == FILE_TYPE;
+    }
+    return 0;
+}
+
+
 /* SYSTEM CALLS FOR FILES */
 
 /* 
@@ -409,7 +471,7 @@ int32_t fs_write(int32_t fd, const void* buf, int32_t nbytes) {
  */
 int32_t fs_read(int32_t fd, void* buf, int32_t nbytes) {
     // obtain inode number from file descriptor
-    pcb_t* curr_pcb = terminal[sched_term].curr_pcb;
+    pcb_t* curr_pcb = sched_process();
     uint32_t inode_num = curr_pcb -> fd_array[fd].inode;
     uint32_t offset = curr_pcb -> fd_array[fd].file_position;
     dentry_t* dentry = NULL;  
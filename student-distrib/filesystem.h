@@ -30,6 +30,12 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 /* reads data from a file and puts it in a buffer */
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 
+/* finds file data in place, up to the end of its data block */
+int32_t read_data_block(uint32_t inode, uint32_t offset, const uint8_t** data);
+
+/* checks whether an inode belongs to a regular file */
+int32_t fs_is_file(uint32_t inode);
+
 /* System calls to open, close, write, and read from a file */
 int32_t open_file(const uint8_t* filename);
 int32_t close_file(int32_t fd);
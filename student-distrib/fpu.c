@@ -0,0 +1,211 @@
+/* fpu.c - lazy FPU/SSE state switching for user processes
+ * vim:ts=4 noexpandtab
+ */
+
+#include "fpu.h"
+#include "lib.h"
+
+/* Whether the CPU supports FXSAVE/FXRSTOR (otherwise FNSAVE/FRSTOR is used) */
+static uint8_t fpu_fxsr;
+
+/* Whether the CPU supports SSE */
+static uint8_t fpu_sse;
+
+/* Clean FPU/SSE state given to a process the first time it uses the FPU */
+static uint8_t fpu_init_state[FPU_STATE_SIZE] __attribute__((aligned(FPU_STATE_ALIGN)));
+
+/* Clears CR0.TS so FPU instructions run without trapping */
+static inline void clts(void) {
+    asm volatile ("clts" : : : "memory");
+}
+
+/* Sets CR0.TS so the next FPU instruction raises #NM */
+static inline void stts(void) {
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+}
+
+/* Saves the FPU registers into state */
+static inline void fpu_save(uint8_t* state) {
+    if (fpu_fxsr)
+        asm volatile ("fxsave (%0)" : : "r"(state) : "memory");
+    else
+        asm volatile ("fnsave (%0)" : : "r"(state) : "memory");
+}
+
+/* Loads the FPU registers from state */
+static inline void fpu_restore(const uint8_t* state) {
+    if (fpu_fxsr)
+        asm volatile ("fxrstor (%0)" : : "r"(state) : "memory");
+    else
+        asm volatile ("frstor (%0)" : : "r"(state) : "memory");
+}
+
+/*
+ * fpu_init
+ *
+ * DESCRIPTION: detects FXSAVE/FXRSTOR and SSE support, enables the FPU on
+ *              the boot CPU and captures a clean FPU image for new processes
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: modifies CR0 and CR4
+ */
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t mxcsr = MXCSR_DEFAULT;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    fpu_fxsr = (edx & CPUID_FXSR) ? 1 : 0;
+    fpu_sse = (edx & CPUID_SSE) ? 1 : 0;
+
+    fpu_init_cpu();
+
+    /* record the reset state every process starts from */
+    clts();
+    asm volatile ("fninit");
+    if (fpu_sse)
+        asm volatile ("ldmxcsr %0" : : "m"(mxcsr));
+    fpu_save(fpu_init_state);
+    stts();
+}
+
+/*
+ * fpu_init_cpu
+ *
+ * DESCRIPTION: enables the x87 FPU and, when the CPU supports them,
+ *              FXSAVE/FXRSTOR and SSE on the executing CPU. Leaves CR0.TS
+ *              set, so no process pays for FPU state until it actually
+ *              executes an FPU/SSE instruction.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: modifies CR0 and CR4
+ */
+void fpu_init_cpu(void) {
+    uint32_t cr0, cr4;
+
+    /* use the real FPU, report errors natively and let WAIT honour TS */
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0) : "memory");
+
+    /* tell the CPU we save SSE state and handle SIMD exceptions */
+    if (fpu_fxsr) {
+        asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR;
+        if (fpu_sse)
+            cr4 |= CR4_OSXMMEXCPT;
+        asm volatile ("movl %0, %%cr4" : : "r"(cr4) : "memory");
+    }
+
+    asm volatile ("fninit");
+
+    /* nobody owns this FPU yet */
+    this_cpu()->fpu_owner = NULL;
+    stts();
+}
+
+/*
+ * fpu_switch
+ *
+ * DESCRIPTION: called when this CPU stops running prev and starts running
+ *              next. If prev used the FPU its registers are written back
+ *              to its PCB, so it can resume on any CPU. If next's state is
+ *              still in this CPU's registers it may use them right away,
+ *              otherwise its first FPU instruction traps into
+ *              fpu_intr_handler.
+ *
+ * Inputs: prev - process that stops running here, or NULL
+ *         next - process that is about to run, or NULL
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: sets or clears CR0.TS
+ */
+void fpu_switch(pcb_t* prev, pcb_t* next) {
+    cpu_t* cpu = this_cpu();
+    uint32_t cr0;
+
+    /* TS clear means prev has its state loaded here */
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    if (prev != NULL && prev == cpu->fpu_owner && !(cr0 & CR0_TS))
+        fpu_save(prev->fpu_state);
+
+    if (next != NULL && next == cpu->fpu_owner && next->fpu_cpu == cpu->id)
+        clts();
+    else
+        stts();
+}
+
+/*
+ * fpu_release
+ *
+ * DESCRIPTION: drops the FPU state of a halting process so it is neither
+ *              saved later nor inherited by a process reusing its PCB
+ *
+ * Inputs: pcb - process that is going away
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: may clear fpu_owner
+ */
+void fpu_release(pcb_t* pcb) {
+    cpu_t* cpu = this_cpu();
+
+    if (cpu->fpu_owner == pcb)
+        cpu->fpu_owner = NULL;
+    pcb->fpu_used = 0;
+    pcb->fpu_cpu = FPU_NO_CPU;
+}
+
+/*
+ * fpu_intr_handler
+ *
+ * DESCRIPTION: handles #NM raised by the first FPU/SSE instruction after a
+ *              switch. Loads the current process's state (or a clean state
+ *              on its first use), then returns to retry the instruction.
+ *              The previous owner's registers were already written back by
+ *              fpu_switch when it stopped running.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: clears CR0.TS, changes this CPU's fpu_owner
+ */
+void fpu_intr_handler(void) {
+    uint32_t flags;
+    cpu_t* cpu;
+    pcb_t* curr;
+
+    /* #NM is a trap gate, stay on this CPU while touching its FPU */
+    cli_and_save(flags);
+    cpu = this_cpu();
+    curr = cpu->curr_task->pcb;
+
+    clts();
+
+    /* FPU use outside of any process, or state still loaded */
+    if (curr == NULL || (curr == cpu->fpu_owner && curr->fpu_cpu == cpu->id)) {
+        restore_flags(flags);
+        return;
+    }
+
+    if (curr->fpu_used) {
+        fpu_restore(curr->fpu_state);
+    } else {
+        fpu_restore(fpu_init_state);
+        curr->fpu_used = 1;
+    }
+
+    curr->fpu_cpu = cpu->id;
+    cpu->fpu_owner = curr;
+    restore_flags(flags);
+}
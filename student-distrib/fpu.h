@@ -0,0 +1,47 @@
+/* fpu.h - lazy FPU/SSE state switching for user processes
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+#include "fpu_handler.h"
+
+/* CR0 bits */
+#define CR0_MP          0x00000002      /* monitor coprocessor: WAIT/FWAIT honour TS */
+#define CR0_EM          0x00000004      /* emulate FPU: must be clear to use x87/SSE */
+#define CR0_TS          0x00000008      /* task switched: next FPU use raises #NM */
+#define CR0_NE          0x00000020      /* report x87 errors through vector 16 */
+
+/* CR4 bits */
+#define CR4_OSFXSR      0x00000200      /* OS supports FXSAVE/FXRSTOR and SSE */
+#define CR4_OSXMMEXCPT  0x00000400      /* OS handles SIMD exceptions (vector 19) */
+
+/* CPUID leaf 1 EDX feature bits */
+#define CPUID_FPU       0x00000001
+#define CPUID_FXSR      0x01000000
+#define CPUID_SSE       0x02000000
+
+/* Default MXCSR value: all SIMD exceptions masked */
+#define MXCSR_DEFAULT   0x1F80
+
+/* pcb_t.fpu_cpu of a process whose state is in no CPU's registers */
+#define FPU_NO_CPU      0xFF
+
+/* Detects FPU features and enables the FPU on the boot CPU */
+void fpu_init(void);
+
+/* Enables the FPU (and SSE when present) on the executing CPU with CR0.TS set */
+void fpu_init_cpu(void);
+
+/* Called whenever the CPU is about to stop running prev and run next */
+void fpu_switch(pcb_t* prev, pcb_t* next);
+
+/* Forgets the FPU state of a process that is going away */
+void fpu_release(pcb_t* pcb);
+
+/* Device-not-available (#NM) handler, loads the current process's FPU state */
+void fpu_intr_handler(void);
+
+#endif /* _FPU_H */
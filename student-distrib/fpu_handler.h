@@ -0,0 +1,11 @@
+#ifndef FPU_HANDLER
+#define FPU_HANDLER
+
+#ifndef ASM
+
+/* Device-not-available (#NM) exception handler wrapper */
+extern void fpu_handler();
+
+#endif /* ASM */
+
+#endif /* FPU_HANDLER */
@@ -0,0 +1,124 @@
+/* futex.c - wait queues keyed by user memory words
+ * vim:ts=4 noexpandtab
+ */
+
+#include "futex.h"
+#include "scheduler.h"
+#include "paging.h"
+#include "lib.h"
+
+/* A task sleeping on a word, lives on the sleeper's kernel stack */
+typedef struct futex_waiter {
+    uint32_t key;                   /* physical address of the word */
+    task_t* task;
+    volatile uint8_t woken;         /* set by the waker once unlinked */
+    struct futex_waiter* next;
+} futex_waiter_t;
+
+/* One wait queue, the lock also orders the word check against wakeups */
+typedef struct futex_bucket {
+    spinlock_t lock;
+    futex_waiter_t* head;
+} futex_bucket_t;
+
+static futex_bucket_t futex_table[FUTEX_HASH_SIZE] = {
+    [0 ... FUTEX_HASH_SIZE - 1] = { SPINLOCK_INIT("futex"), NULL }
+};
+
+/*
+ * futex_hash
+ *
+ * DESCRIPTION: picks the wait queue of a word
+ *
+ * Inputs: key - physical address of the word
+ * Outputs: none
+ * Return values: bucket for the word
+ *
+ * SIDE EFFECTS: none
+ */
+static futex_bucket_t* futex_hash(uint32_t key) {
+    /* words are 4 byte aligned, mix in the bits above the alignment */
+    key >>= 2;
+    key ^= key >> 4 ^ key >> 10;
+    return &futex_table[key % FUTEX_HASH_SIZE];
+}
+
+/*
+ * futex
+ *
+ * DESCRIPTION: FUTEX_WAIT sleeps until a FUTEX_WAKE on the same word if the
+ *              word still holds val; the check and the sleep are atomic
+ *              against wakers. FUTEX_WAKE wakes up to val sleepers. Words
+ *              are keyed by physical address so processes mapping the same
+ *              memory at different addresses meet on the same queue.
+ *
+ * Inputs: addr - 4 byte aligned user word
+ *         op - FUTEX_WAIT or FUTEX_WAKE
+ *         val - expected value for WAIT, number to wake for WAKE
+ * Outputs: none
+ * Return values: WAIT: 0 once woken, -1 if the word did not hold val
+ *                WAKE: number of tasks woken
+ *                -1 on a bad address or op
+ *
+ * SIDE EFFECTS: may block the calling task
+ */
+int32_t futex(uint32_t* addr, int32_t op, int32_t val) {
+    uint32_t flags, key;
+    futex_bucket_t* bucket;
+    futex_waiter_t waiter;
+    futex_waiter_t** link;
+    futex_waiter_t* w;
+    int32_t woken = 0;
+
+    if (((uint32_t) addr & (sizeof(uint32_t) - 1)) != 0)
+        return -1;
+    if ((uint32_t) addr < KERNEL_MEM_END)
+        return -1;
+
+    /* the translation is stable while the task runs, its page is its own.
+     * Kernel-only maps such as device registers are refused, the word is
+     * read below on the user's behalf. */
+    if ((key = paging_user_to_phys((uint32_t) addr)) == 0)
+        return -1;
+    bucket = futex_hash(key);
+
+    switch (op) {
+    case FUTEX_WAIT:
+        spin_lock_irqsave(&bucket->lock, flags);
+        if (*(volatile uint32_t*) addr != (uint32_t) val) {
+            spin_unlock_irqrestore(&bucket->lock, flags);
+            return -1;
+        }
+
+        waiter.key = key;
+        waiter.task = sched_current();
+        waiter.woken = 0;
+        waiter.next = bucket->head;
+        bucket->head = &waiter;
+
+        while (!waiter.woken)
+            sched_sleep(&bucket->lock);
+
+        spin_unlock_irqrestore(&bucket->lock, flags);
+        return 0;
+
+    case FUTEX_WAKE:
+        spin_lock_irqsave(&bucket->lock, flags);
+        link = &bucket->head;
+        while ((w = *link) != NULL && woken < val) {
+            if (w->key != key) {
+                link = &w->next;
+                continue;
+            }
+            *link = w->next;
+            w->woken = 1;
+            sched_wakeup(w->task);
+            woken++;
+        }
+        spin_unlock_irqrestore(&bucket->lock, flags);
+        return woken;
+
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,20 @@
+/* futex.h - wait queues keyed by user memory words
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "types.h"
+
+/* futex operations */
+#define FUTEX_WAIT          0   /* sleep if the word still holds val */
+#define FUTEX_WAKE          1   /* wake up to val sleepers on the word */
+
+/* Number of wait queues, words are hashed by physical address */
+#define FUTEX_HASH_SIZE     16
+
+/* Sleeps on or wakes sleepers on the user word at addr */
+int32_t futex(uint32_t* addr, int32_t op, int32_t val);
+
+#endif /* _FUTEX_H */
@@ -9,6 +9,9 @@
 uint8_t master_mask = 0xFF; /* IRQs 0-7  , bitmask all interrupt lines on master */
 uint8_t slave_mask = 0xFF;  /* IRQs 8-15 , bitmask all interrupt lines on slave */
 
+/* Serializes PIC port accesses and mask updates across CPUs */
+static spinlock_t i8259_lock = SPINLOCK_INIT("i8259");
+
 /* 
  * i8259_init 
  *
@@ -19,9 +22,9 @@ uint8_t slave_mask = 0xFF;  /* IRQs 8-15 , bitmask all interrupt lines on slave
  * Return value: none
  */
 void i8259_init(void) {
-	// save flags and clear interrupt flag 
+	// lock the PIC with interrupts off on this CPU
 	uint32_t flags;
-	cli_and_save(flags);
+	spin_lock_irqsave(&i8259_lock, flags);
 
 	// ICW1
 	outb(ICW1, MASTER_COM_PORT);
@@ -43,11 +46,11 @@ void i8259_init(void) {
 	outb(0xFF, MASTER_DATA_PORT);
 	outb(0xFF, SLAVE_DATA_PORT);	
 
+	// unlock the PIC and restore flags
+	spin_unlock_irqrestore(&i8259_lock, flags);
+
 	// unmask interrupt line the Slave PIC (IRQ 2) is connected to on Master PIC
 	enable_irq(SLAVE_LINE);
-
-	// restore flags and interrupt flag
-	restore_flags(flags);
 }
 
 /* 
@@ -59,17 +62,17 @@ void i8259_init(void) {
  * Return value: none
  */
 void enable_irq(uint32_t irq_num) {
-	// save flags and clear interrupt flags
+	// lock the PIC with interrupts off on this CPU
 	uint32_t flags;
-	cli_and_save(flags);
+	spin_lock_irqsave(&i8259_lock, flags);
 
 	// iteration variable
 	int i;
 
 	// validate irq_num to be within range of IRQ values (0 - 15)
 	if (irq_num > 15 || irq_num < 0) {
-		// restore flags and re-enable interrupts
-		restore_flags(flags);
+		// unlock the PIC and restore flags
+		spin_unlock_irqrestore(&i8259_lock, flags);
 
 		// invalid irq_num, return
 		return;
@@ -104,8 +107,8 @@ void enable_irq(uint32_t irq_num) {
 		outb(slave_mask, SLAVE_DATA_PORT);	
 	}
 
-	// restore flags and re-enable interrupts
-	restore_flags(flags);
+	// unlock the PIC and restore flags
+	spin_unlock_irqrestore(&i8259_lock, flags);
 }
 
 /* 
@@ -117,17 +120,17 @@ void enable_irq(uint32_t irq_num) {
  * Return value: none
  */
 void disable_irq(uint32_t irq_num) {
-	// save flags and clear interrupt flags
+	// lock the PIC with interrupts off on this CPU
 	uint32_t flags;
-	cli_and_save(flags);
+	spin_lock_irqsave(&i8259_lock, flags);
 
 	// iteration variable
 	int i;
 
 	// validate irq_num to be within range of irq values on Master/Slave PIC (0 - 15)
 	if (irq_num > 15 || irq_num < 0) {
-		// restore flags and reenable interrupts
-		restore_flags(flags);
+		// unlock the PIC and restore flags
+		spin_unlock_irqrestore(&i8259_lock, flags);
 
 		// invalid irq_num, return
 		return;
@@ -162,8 +165,8 @@ void disable_irq(uint32_t irq_num) {
 		outb(slave_mask, SLAVE_DATA_PORT);	
 	}
 
-	// restore flags and re-enable interrupts
-	restore_flags(flags);
+	// unlock the PIC and restore flags
+	spin_unlock_irqrestore(&i8259_lock, flags);
 }
 
 /* 
@@ -176,14 +179,14 @@ void disable_irq(uint32_t irq_num) {
  * Return value: none
  */
 void send_eoi(uint32_t irq_num) {
-	// save flags and clear interrupt flags
+	// lock the PIC with interrupts off on this CPU
 	uint32_t flags;
-	cli_and_save(flags);
+	spin_lock_irqsave(&i8259_lock, flags);
 
 	// validate irq_num to be within range of irq values (0 - 15)
 	if (irq_num > 15 || irq_num < 0) {
-		// restore flags and re-enable interrupts
-		restore_flags(flags);
+		// unlock the PIC and restore flags
+		spin_unlock_irqrestore(&i8259_lock, flags);
 
 		// invalid irq_num, return
 		return;
@@ -197,7 +200,6 @@ void send_eoi(uint32_t irq_num) {
 		outb((EOI | irq_num) , MASTER_COM_PORT);			// came from Master PIC, send EOI OR'd with irq_num to Master PIC 	
 	}
 
-	// restore flags and re-enable interrupts
-	restore_flags(flags);
-	sti();
+	// unlock the PIC and restore flags
+	spin_unlock_irqrestore(&i8259_lock, flags);
 }
@@ -4,7 +4,10 @@
 #include "exception_handler.h"
 #include "systemcall_handler.h"
 #include "pit_handler.h"
+#include "fpu_handler.h"
+#include "lapic_handler.h"
 #include "keyboard.h"
+#include "serial.h"
 
 /* 
  * IDT_init
@@ -56,7 +59,7 @@ void IDT_init() {
                 SET_IDT_ENTRY(idt[i], _6_invalid_opcode_exception);
                 break;
             case 7:
-                SET_IDT_ENTRY(idt[i], _7_device_not_available_exception);
+                SET_IDT_ENTRY(idt[i], fpu_handler);
                 break;
             case 8:
                 SET_IDT_ENTRY(idt[i], _8_double_fault_exception);
@@ -106,6 +109,15 @@ void IDT_init() {
             case RTC_VECTOR:
                 SET_IDT_ENTRY(idt[i], rtc_handler);               
                 break;
+            case SERIAL_VECTOR:
+                SET_IDT_ENTRY(idt[i], serial_handler);
+                break;
+            case RESCHED_VECTOR:
+                SET_IDT_ENTRY(idt[i], resched_handler);
+                break;
+            case SPURIOUS_VECTOR:
+                SET_IDT_ENTRY(idt[i], spurious_handler);
+                break;
             default:
                 /* Vectors 20-31 are reserved by Intel */
                 if(i < NUM_INTEL_DEFINED_VECTORS) {
@@ -6,7 +6,10 @@
 #define SYSTEM_CALL_VECTOR          0x80    /* Exception vector associated with all system calls */
 #define PIT_VECTOR                  0x20    /* Exception vector associated with all PIT interrupts */
 #define KEYBOARD_VECTOR             0x21    /* Exception vector associated with all keyboard interrupts */
+#define SERIAL_VECTOR               0x24    /* Exception vector associated with all COM1 interrupts */
 #define RTC_VECTOR                  0x28    /* Exception vector associated with all rtc interrupts */
+#define RESCHED_VECTOR              0x40    /* Interrupt vector of the scheduler tick IPI sent by CPU 0 */
+#define SPURIOUS_VECTOR             0xFF    /* Interrupt vector of local APIC spurious interrupts */
 
 /* Initializes the IDT */
 void IDT_init();
@@ -0,0 +1,87 @@
+/* ioring.c - batched system calls through rings in user memory
+ * vim:ts=4 noexpandtab
+ */
+
+#include "ioring.h"
+#include "systemcalls.h"
+#include "paging.h"
+#include "lib.h"
+
+/*
+ * io_run
+ *
+ * DESCRIPTION: carries out one submission the way the matching system
+ *              call would
+ *
+ * Inputs: sqe - copy of the submission
+ * Outputs: none
+ * Return values: result of the operation, -1 for a bad op or buffer
+ *
+ * SIDE EFFECTS: may block like the system call
+ */
+static int32_t io_run(io_sqe_t* sqe) {
+    switch (sqe->op) {
+        case IO_OP_NOP:
+            return 0;
+        case IO_OP_READ:
+            if (sqe->nbytes < 0 || !user_range(sqe->buf, sqe->nbytes))
+                return -1;
+            return read(sqe->fd, sqe->buf, sqe->nbytes);
+        case IO_OP_WRITE:
+            if (sqe->nbytes < 0 || !user_range(sqe->buf, sqe->nbytes))
+                return -1;
+            return write(sqe->fd, sqe->buf, sqe->nbytes);
+        case IO_OP_CLOSE:
+            return close(sqe->fd);
+        default:
+            return -1;
+    }
+}
+
+/*
+ * io_enter
+ *
+ * DESCRIPTION: runs queued submissions in order, posting a completion for
+ *              each, so a batch of small reads and writes costs a single
+ *              trap into the kernel. Stops early when the completion ring
+ *              is full.
+ *
+ * Inputs: ring - the program's rings
+ *         to_submit - most submissions to run
+ * Outputs: ring - sq_head and cq_tail advanced, new completions
+ * Return values: number of submissions run, -1 if ring is bad
+ *
+ * SIDE EFFECTS: operations may block like their system calls
+ */
+int32_t io_enter(io_ring_t* ring, uint32_t to_submit) {
+    uint32_t head, tail, cq_tail, done;
+    io_sqe_t sqe;
+
+    if (ring == NULL || !user_range(ring, sizeof(io_ring_t)))
+        return -1;
+
+    head = ring->sq_head;
+    tail = ring->sq_tail;
+    cq_tail = ring->cq_tail;
+    /* a program that ran sq_tail past the ring has corrupted it */
+    if (tail - head > IO_RING_ENTRIES)
+        return -1;
+
+    for (done = 0; done < to_submit && head != tail; done++) {
+        if (cq_tail - ring->cq_head >= IO_RING_ENTRIES)
+            break;
+
+        /* copy it so the program cannot change it under us */
+        sqe = ring->sqes[head & (IO_RING_ENTRIES - 1)];
+        ring->cqes[cq_tail & (IO_RING_ENTRIES - 1)].user_data = sqe.user_data;
+        ring->cqes[cq_tail & (IO_RING_ENTRIES - 1)].res = io_run(&sqe);
+
+        head++;
+        cq_tail++;
+        /* publish each one, a blocking op after it may take a while */
+        ring->sq_head = head;
+        ring->cq_tail = cq_tail;
+    }
+
+    return done;
+}
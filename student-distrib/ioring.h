@@ -0,0 +1,49 @@
+/* ioring.h - batched system calls through rings in user memory
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IORING_H
+#define _IORING_H
+
+#include "types.h"
+
+/* Entries in each ring, a power of two */
+#define IO_RING_ENTRIES     64
+
+/* Operations a submission can ask for */
+#define IO_OP_NOP           0
+#define IO_OP_READ          1
+#define IO_OP_WRITE         2
+#define IO_OP_CLOSE         3
+
+/* One request, filled in by the program */
+typedef struct io_sqe {
+    uint32_t op;
+    int32_t fd;
+    void* buf;
+    int32_t nbytes;
+    uint32_t user_data;         /* handed back in the completion */
+} io_sqe_t;
+
+/* One result, filled in by the kernel */
+typedef struct io_cqe {
+    uint32_t user_data;
+    int32_t res;                /* what the system call would have returned */
+} io_cqe_t;
+
+/* The submission and completion rings, in the program's own memory. The
+ * program moves sq_tail and cq_head, the kernel sq_head and cq_tail; all
+ * four count up forever and are masked to index the arrays. */
+typedef struct io_ring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    io_sqe_t sqes[IO_RING_ENTRIES];
+    io_cqe_t cqes[IO_RING_ENTRIES];
+} io_ring_t;
+
+/* Runs up to to_submit queued requests, posting a completion for each */
+int32_t io_enter(io_ring_t* ring, uint32_t to_submit);
+
+#endif /* _IORING_H */
@@ -16,12 +16,74 @@
 #include "tests.h"
 #include "pit.h"
 #include "terminal.h"
+#include "fpu.h"
+#include "sysenter.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "workqueue.h"
+#include "serial.h"
+#include "fbcon.h"
 
 #define RUN_TESTS
 
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+/* Boot command line options */
+#define TERMINALS_OPTION "terminals="
+#define CONSOLE_OPTION "console="
+#define VIDEO_OPTION "video="
+
+/* Finds the word of the boot command line that starts with OPTION. Returns
+   what follows OPTION in that word, NULL if there is no such word. */
+static const int8_t* boot_option(const int8_t* cmdline, const int8_t* option) {
+    uint32_t len = strlen(option);
+
+    while (*cmdline != '\0') {
+        if (strncmp(cmdline, option, len) == 0)
+            return cmdline + len;
+
+        /* next word */
+        while (*cmdline != '\0' && *cmdline != ' ')
+            cmdline++;
+        while (*cmdline == ' ')
+            cmdline++;
+    }
+    return NULL;
+}
+
+/* Reads "terminals=N" from the boot command line. Returns N, or
+   TERMINAL_DEFAULT if the option is missing or N is not 1 to TERMINAL_MAX. */
+uint32_t boot_terminal_count(const int8_t* cmdline) {
+    const int8_t* value = boot_option(cmdline, TERMINALS_OPTION);
+    uint32_t n = 0;
+
+    if (value == NULL)
+        return TERMINAL_DEFAULT;
+    for (; *value >= '0' && *value <= '9' && n <= TERMINAL_MAX; value++)
+        n = n * 10 + (*value - '0');
+    return (n >= 1 && n <= TERMINAL_MAX) ? n : TERMINAL_DEFAULT;
+}
+
+/* Reads "video=WxHxBPP" from the boot command line into mode[0..2].
+   Returns 0, or -1 if the option is missing or not three numbers. */
+static int32_t boot_video_mode(const int8_t* cmdline, uint32_t mode[3]) {
+    const int8_t* value = boot_option(cmdline, VIDEO_OPTION);
+    int i;
+
+    if (value == NULL)
+        return -1;
+    for (i = 0; i < 3; i++) {
+        if (*value < '0' || *value > '9')
+            return -1;
+        for (mode[i] = 0; *value >= '0' && *value <= '9' && mode[i] <= 0xFFFF; value++)
+            mode[i] = mode[i] * 10 + (*value - '0');
+        if (i < 2 && *value++ != 'x')
+            return -1;
+    }
+    return 0;
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
@@ -31,6 +93,12 @@ void entry(unsigned long magic, unsigned long addr) {
     /* make a 32-bit word to store address of filesystem (for later) */
     uint32_t fs_addr;
 
+    /* value of a boot command line option */
+    const int8_t* opt;
+
+    /* graphics mode asked for on the command line, width 0 for text mode */
+    uint32_t video[3] = {0, 0, 0};
+
     /* Clear the screen. */
     clear();
 
@@ -57,9 +125,22 @@ void entry(unsigned long magic, unsigned long addr) {
     if (CHECK_FLAG(mbi->flags, 1))
         printf("boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
 
-    /* Is the command line passed? */
-    if (CHECK_FLAG(mbi->flags, 2))
+    /* Is the command line passed? It may size the terminals. */
+    terminal_count = TERMINAL_DEFAULT;
+    if (CHECK_FLAG(mbi->flags, 2)) {
         printf("cmdline = %s\n", (char *)mbi->cmdline);
+        terminal_count = boot_terminal_count((int8_t *)mbi->cmdline);
+
+        /* "console=serial" copies the console to COM1 */
+        opt = boot_option((int8_t *)mbi->cmdline, CONSOLE_OPTION);
+        if (opt != NULL && strncmp(opt, "serial", strlen("serial")) == 0)
+            serial_console = 1;
+
+        /* "video=1024x768x32" draws the console on a VBE framebuffer */
+        if (boot_video_mode((int8_t *)mbi->cmdline, video) == -1)
+            video[0] = 0;
+    }
+    printf("terminals = %u\n", terminal_count);
 
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
@@ -125,27 +206,31 @@ void entry(unsigned long magic, unsigned long addr) {
         lldt(KERNEL_LDT);
     }
 
-    /* Construct a TSS entry in the GDT */
+    /* Construct a TSS entry in the GDT for every CPU */
     {
         seg_desc_t the_tss_desc;
-        the_tss_desc.granularity   = 0x0;
-        the_tss_desc.opsize        = 0x0;
-        the_tss_desc.reserved      = 0x0;
-        the_tss_desc.avail         = 0x0;
-        the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
-        the_tss_desc.present       = 0x1;
-        the_tss_desc.dpl           = 0x0;
-        the_tss_desc.sys           = 0x0;
-        the_tss_desc.type          = 0x9;
-        the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
-
-        SET_TSS_PARAMS(the_tss_desc, &tss, tss_size);
-
-        tss_desc_ptr = the_tss_desc;
-
-        tss.ldt_segment_selector = KERNEL_LDT;
-        tss.ss0 = KERNEL_DS;
-        tss.esp0 = 0x800000;
+        int cpu;
+        for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+            the_tss_desc.granularity   = 0x0;
+            the_tss_desc.opsize        = 0x0;
+            the_tss_desc.reserved      = 0x0;
+            the_tss_desc.avail         = 0x0;
+            the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
+            the_tss_desc.present       = 0x1;
+            the_tss_desc.dpl           = 0x0;
+            the_tss_desc.sys           = 0x0;
+            the_tss_desc.type          = 0x9;
+            the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
+
+            SET_TSS_PARAMS(the_tss_desc, &tss[cpu], tss_size);
+
+            tss_desc_ptr[cpu] = the_tss_desc;
+
+            tss[cpu].ldt_segment_selector = KERNEL_LDT;
+            tss[cpu].ss0 = KERNEL_DS;
+            tss[cpu].esp0 = 0x800000;
+        }
+        /* the boot CPU is CPU 0, the others load theirs in ap_main */
         ltr(KERNEL_TSS);
     }
 
@@ -166,16 +251,39 @@ void entry(unsigned long magic, unsigned long addr) {
 
     /* Initialize Keyboard */
     init_keyboard();
+
+    /* Initialize COM1, console output reaches it from here on */
+    serial_init();
     
     /* Initialize paging and virtual memory */
     paging_init();
 
+    /* Leave text mode if the command line asked, the framebuffer needs paging */
+    if (video[0] != 0) {
+        if (fbcon_init(video[0], video[1], video[2]) == 0)
+            printf("video = %ux%ux%u\n", video[0], video[1], video[2]);
+        else
+            printf("video mode %ux%ux%u not available\n", video[0], video[1], video[2]);
+    }
+
     /* Initialize file system */
     init_fs(fs_addr);
 
     /* Initialize PIT */
     init_pit();
 
+    /* Initialize FPU/SSE with lazy state switching */
+    fpu_init();
+
+    /* Set up the SYSENTER fast system call path when the CPU has it */
+    sysenter_init();
+
+    /* Initialize per-CPU run queues, the boot CPU becomes CPU 0's idle task */
+    sched_init();
+
+    /* Start the kernel worker that runs the interrupt handlers' deferred work */
+    workqueue_init();
+
     /* Enable interrupts */
     /* Do not enable the following until after you have set up your
      * IDT correctly otherwise QEMU will triple fault and simple close
@@ -183,6 +291,9 @@ void entry(unsigned long magic, unsigned long addr) {
     /* printf("Enabling Interrupts\n"); */
     sti();
 
+    /* Start the application processors (needs PIT ticks for its delays) */
+    smp_init();
+
 #ifdef RUN_TESTS
     /* Run tests */
     launch_tests();
@@ -190,9 +301,9 @@ void entry(unsigned long magic, unsigned long addr) {
     /* clears the screen */
     clear();
 
-    /* Execute the first program ("shell") ... */
-    execute((uint8_t*) "shell");
-    
-    /* Spin (nicely, so we don't chew up cycles) */
+    /* Queue a shell for every terminal, spread over the online CPUs */
+    sched_launch_terminals();
+
+    /* Spin (nicely, so we don't chew up cycles) as CPU 0's idle task */
     asm volatile (".1: hlt; jmp .1;");
 }
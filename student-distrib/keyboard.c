@@ -7,12 +7,23 @@
 #include "terminal.h"
 #include "types.h"
 #include "scheduler.h"
+#include "workqueue.h"
+#include "poll.h"
 
-/* Scancode associated with the L and function keys */
-#define L_KEY       0x26
+/* Scancodes of the function keys, F11 and F12 are not after F10 */
 #define F_ONE       0x3B
-#define F_TWO       0x3C
-#define F_THREE     0x3D
+#define F_TEN       0x44
+#define F_ELEVEN    0x57
+#define F_TWELVE    0x58
+
+/* Scancodes of the navigation keys, with or without the 0xE0 prefix */
+#define PAGE_UP     0x49
+#define PAGE_DOWN   0x51
+#define ARROW_UP    0x48
+#define ARROW_DOWN  0x50
+#define ARROW_RIGHT 0x4D
+#define ARROW_LEFT  0x4B
+#define ESCAPE      0x01
 
 /* Flags for modifier keys */
 volatile int ctrl_flag;
@@ -110,6 +121,7 @@ uint8_t scancodes[NUM_PRESSED_SCANCODES][3] =
     {'\0', '\0', '\0'}, // (Keypad) . 
     {'\0', '\0', '\0'}, // No Key 
     {'\0', '\0', '\0'}, // No Key
+    {'\0', '\0', '\0'}, // No Key
     {'\0', '\0', '\0'}, // F11
     {'\0', '\0', '\0'}  // F12
 };
@@ -139,12 +151,14 @@ void init_keyboard(void) {
 /* 
  * keyboard_intr_handler
  * 
- * DESCRIPTION: main C keyboard interrupt handler, handles key presses and prints chars to screen
+ * DESCRIPTION: main C keyboard interrupt handler. Typed keys go straight
+ * into the displayed terminal's key ring; the few keys that redraw the
+ * screen are left to the kernel worker, so the interrupt stays short
  * Input: none
  * Output: none
  * Return Values: none
  * 
- * SIDE EFFECTS: none
+ * SIDE EFFECTS: queues a key event or work
  */
 void keyboard_intr_handler() {
     // obtain the scan code the keyboard sent
@@ -152,6 +166,67 @@ void keyboard_intr_handler() {
 
     /* send EOI signal to PIC */
     send_eoi(KEYBOARD_IRQ);
+
+    keyboard_process(keyboard_scancode);
+}
+
+/* 
+ * fkey_terminal
+ * 
+ * DESCRIPTION: finds the terminal a function key switches to
+ * Input: scancode - key pressed
+ * Output: none
+ * Return Values: terminal of F1 to F12, -1 for other keys and for
+ * terminals that are not open
+ * 
+ * SIDE EFFECTS: none
+ */
+static int32_t fkey_terminal(uint8_t scancode) {
+    int32_t term = -1;
+
+    if (scancode >= F_ONE && scancode <= F_TEN)
+        term = scancode - F_ONE;
+    else if (scancode == F_ELEVEN || scancode == F_TWELVE)
+        term = (F_TEN - F_ONE + 1) + (scancode - F_ELEVEN);
+
+    return (term < (int32_t) terminal_count) ? term : -1;
+}
+
+/* 
+ * keyboard_command
+ * 
+ * DESCRIPTION: runs a terminal switch or history browse key in the kernel
+ * worker with interrupts on
+ * Input: scancode - F1 to F12 pressed with Alt, PageUp or PageDown with Shift
+ * Output: none
+ * Return Values: none
+ * 
+ * SIDE EFFECTS: switches terminals or moves the view through history
+ */
+static void keyboard_command(uint32_t scancode) {
+    switch (scancode) {
+        case PAGE_UP:   screen_browse(NUM_ROWS - 1); break;
+        case PAGE_DOWN: screen_browse(-(NUM_ROWS - 1)); break;
+        default:        terminal_switch(fkey_terminal(scancode)); break;
+    }
+}
+
+/* 
+ * keyboard_process
+ * 
+ * DESCRIPTION: tracks the modifier keys and turns a key press into an
+ * event for the displayed terminal, called from the interrupt handler
+ * Input: scancode - scancode read by keyboard_intr_handler
+ * Output: none
+ * Return Values: none
+ * 
+ * SIDE EFFECTS: queues a key event or work
+ */
+void keyboard_process(uint32_t scancode) {
+    uint8_t keyboard_scancode = (uint8_t) scancode;
+    uint8_t term = curr_term;
+    uint8_t keyboard_output;
+
     /* handles key release scancodes */
     if (keyboard_scancode > RELEASED_OFFSET) {
         /* if shift is released, update flag */
@@ -169,17 +244,12 @@ void keyboard_intr_handler() {
             alt_flag = 0; 
         }
 
-        /* if enter is released, update flag */
-        if ((keyboard_scancode - RELEASED_OFFSET == ENTER)) { 
-            terminal[curr_term].enter_flag = 0; 
-        }
-
         return;
     } 
 
     /* handles key press scancodes */
-    /* holds ASCII of keyboard output */
-    uint8_t keyboard_output = scancodes[keyboard_scancode][0];
+    if (keyboard_scancode >= NUM_PRESSED_SCANCODES)
+        return;
 
     /* if caps lock has been pressed, update flag */
     if (keyboard_scancode == CAPS_LOCK)
@@ -194,6 +264,31 @@ void keyboard_intr_handler() {
     if (keyboard_scancode == LEFT_ALT)
         alt_flag = 1; 
 
+    /* ALT + F1..F12 switch terminals, Shift + PageUp/PageDown browse history */
+    if ((alt_flag && fkey_terminal(keyboard_scancode) != -1) ||
+        (shft_flag && (keyboard_scancode == PAGE_UP || keyboard_scancode == PAGE_DOWN))) {
+        work_queue(keyboard_command, keyboard_scancode);
+        /* run the worker now rather than on the next tick if nothing else is */
+        sched_kick();
+        return;
+    }
+
+    /* keys without a character */
+    switch (keyboard_scancode) {
+        case ENTER:         terminal_key(term, NEWLINE); return;
+        case BACKSPACE:     terminal_key(term, KEY_BACKSPACE); return;
+        case TAB:           terminal_key(term, '\t'); return;
+        case ESCAPE:        terminal_key(term, KEY_ESC); return;
+        case ARROW_UP:      terminal_key(term, KEY_UP); return;
+        case ARROW_DOWN:    terminal_key(term, KEY_DOWN); return;
+        case ARROW_RIGHT:   terminal_key(term, KEY_RIGHT); return;
+        case ARROW_LEFT:    terminal_key(term, KEY_LEFT); return;
+        default:            break;
+    }
+
+    /* holds ASCII of keyboard output */
+    keyboard_output = scancodes[keyboard_scancode][0];
+
     /* handles print output if caps lock is active */
     if (caps_flag)
         /* indexing value from caps lock sub-array (2) */
@@ -204,101 +299,15 @@ void keyboard_intr_handler() {
         /* reverses output if caps pressed with shift */
         keyboard_output = caps_flag ? scancodes[keyboard_scancode][0] : scancodes[keyboard_scancode][1];
 
-    /* handles output if ctrl+L is pressed */
-    if (ctrl_flag && (keyboard_scancode == L_KEY)) {
-        /* make a copy of values in internal buffer and the buffer index */
-        memcpy(placeholder_buf, terminal[curr_term].internal_buffer, MAX_BUFFER_SIZE);
-        placeholder_buf_index = terminal[curr_term].buffer_index;
-        /* clears screen and the internal buffer */
-        clear();
-        memset(terminal[curr_term].internal_buffer, '\0', MAX_BUFFER_SIZE);
-        /* set flags for terminal_read() */
-        ctrl_L_flag = 1;
-        terminal[curr_term].enter_flag = 1;
-
+    if (keyboard_output == '\0')
         return;
-    }
 
-    /* handles output if ALT + F1 is pressed */
-    if (alt_flag && (keyboard_scancode == F_ONE)) {
-        /* switch into corresponding terminal */
-        terminal_switch(0);
-        return;
-    }
-	
-    /* handles output if ALT + F2 is pressed */
-    if (alt_flag && (keyboard_scancode == F_TWO)) {
-        /* switch into corresponding terminal */
-        terminal_switch(1);
-        return;
+    /* ctrl + a letter is its control character, Ctrl+L clears the screen */
+    if (ctrl_flag) {
+        if ((keyboard_output | 0x20) < 'a' || (keyboard_output | 0x20) > 'z')
+            return;
+        keyboard_output &= 0x1F;
     }
-	
-    /* handles output if ALT + F3 is pressed */
-    if (alt_flag && (keyboard_scancode == F_THREE)) {
-        /* switch into corresponding terminal */
-        terminal_switch(2);
-	    return;
-    }
-
-    /* handles output if enter is pressed */
-    if (keyboard_scancode == ENTER) {
-        /* Mark that enter has been pressed */
-        terminal[curr_term].enter_flag = 1;
-
-        /* scroll screen if at bottom */
-        if (terminal[curr_term].screen_y == NUM_ROWS - 1)
-            scroll(curr_term);
-        /* otherwise, move to next line */
-        else
-            set_cursor(0, terminal[curr_term].screen_y + 1, curr_term);
-
-        return;
-    }
-
-    /* handles output if backspace is pressed */
-    if (keyboard_scancode == BACKSPACE && (terminal[curr_term].buffer_index != 0)) {
-        /* check if wraparound is active; backspacing on previous line */
-        if (terminal[curr_term].screen_x == NUM_COLS) {
-            /* clear value in video memory of previous typed character in previous line*/
-            *(uint8_t *) ((char*)VIDEO + (( (terminal[curr_term].screen_y - 1) * NUM_COLS + (NUM_COLS - 1) ) << 1)) = ' ';
-            *(uint8_t *) ((char*)VIDEO + (( (terminal[curr_term].screen_y - 1) * NUM_COLS + (NUM_COLS - 1) ) << 1) + 1) = ATTRIB;
-
-            /* move cursor to last position of previous line */
-            set_cursor(NUM_COLS - 1, terminal[curr_term].screen_y - 1, curr_term);
-        } 
 
-        /* if backspacing on current line */
-        else { 
-            /* clear value in video memory of previous typed character in current line*/
-            *(uint8_t *) ((char*)VIDEO + ((terminal[curr_term].screen_y * NUM_COLS + (terminal[curr_term].screen_x - 1)) << 1)) = ' ';
-            *(uint8_t *) ((char*)VIDEO + ((terminal[curr_term].screen_y * NUM_COLS + (terminal[curr_term].screen_x - 1)) << 1) + 1) = ATTRIB;
-
-            /* move cursor back one x position */
-            set_cursor(terminal[curr_term].screen_x - 1, terminal[curr_term].screen_y, curr_term);
-        }
-
-        /* decrement buffer index and clear character from internal buffer */
-        terminal[curr_term].internal_buffer[ terminal[curr_term].buffer_index-- ] = ' ';
-    }
-
-    /* prints keyboard output to screen*/
-    if (keyboard_output != '\0') {
-        if(keyboard_scancode == TAB) {
-            /* A tab input consists of 4 spaces - so 4 iterations */
-            int i;
-            for(i = 0; i < 4; i++) {
-                /* check if max characters for current line has not been reached */
-                if (terminal[curr_term].buffer_index < MAX_BUFFER_SIZE - 1) {
-                    keyboard_putc(keyboard_output);
-                    terminal[curr_term].internal_buffer[ terminal[curr_term].buffer_index++ ] = keyboard_output;
-                }
-            }
-        } else {
-            /* check if max characters for current line has not been reached */
-            if (terminal[curr_term].buffer_index < MAX_BUFFER_SIZE - 1) {
-                keyboard_putc(keyboard_output);
-                terminal[curr_term].internal_buffer[ terminal[curr_term].buffer_index++ ] = keyboard_output;
-            }
-        }
-    }
+    terminal_key(term, keyboard_output);
 }
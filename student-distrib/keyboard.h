@@ -10,7 +10,7 @@
 #include "keyboard_handler.h"
 
 /* number of scan codes associated with key presses */
-#define NUM_PRESSED_SCANCODES 0x58
+#define NUM_PRESSED_SCANCODES 0x59
 /* keyboard IRQ line on PIC */
 #define KEYBOARD_IRQ 1
 /* offset between start and release scancodes */
@@ -35,4 +35,7 @@ void init_keyboard(void);
 /* main C handler for keyboard */
 void keyboard_intr_handler(void); 
 
+/* turns one scancode into a key event for the displayed terminal */
+void keyboard_process(uint32_t scancode);
+
 #endif  /* end if for _KEYBOARD_H */
@@ -0,0 +1,397 @@
+/* klog.c - kernel log, per-CPU message rings drained by the worker
+ * vim:ts=4 noexpandtab
+ */
+
+#include "klog.h"
+#include "lib.h"
+#include "pit.h"
+#include "workqueue.h"
+#include "scheduler.h"
+#include "systemcalls.h"
+
+/* The PIT ticks at 100Hz */
+#define KLOG_TICKS_PER_SEC  100
+
+/* Longest line a message is formatted into for dmesg */
+#define KLOG_LINE_SIZE      (KLOG_MSG_SIZE + 32)
+
+/* History a dmesg read copies out of the lock at a time */
+#define KLOG_READ_CHUNK     256
+
+/* Console messages a drain takes off the rings before printing them */
+#define KLOG_BATCH          4
+
+/* One logged message */
+typedef struct klog_record {
+    uint32_t seq;               /* order of the message across all CPUs */
+    uint32_t ticks;             /* pit_ticks when it was logged */
+    uint8_t level;
+    uint8_t cpu;
+    uint8_t term;               /* terminal it is put on if it reaches the console */
+    uint8_t len;
+    int8_t text[KLOG_MSG_SIZE];
+} klog_record_t;
+
+/* Messages of one CPU. Only that CPU moves head, with its interrupts off,
+ * and only the drainer moves tail, so the ring needs no lock. */
+typedef struct klog_ring {
+    klog_record_t rec[KLOG_RING_SIZE];
+    volatile uint32_t head;     /* messages logged */
+    volatile uint32_t tail;     /* messages drained */
+    volatile uint32_t dropped;  /* messages lost to a full ring */
+    uint32_t reported;          /* dropped messages the drainer has told about */
+} klog_ring_t;
+
+static klog_ring_t klog_rings[MAX_CPUS];
+
+/* Next message number */
+static volatile uint32_t klog_seq = 0;
+
+/* A drain is queued on the worker */
+static volatile uint32_t klog_queued = 0;
+
+/* Makes whoever drains the only consumer of the rings */
+static spinlock_t klog_drain_lock = SPINLOCK_INIT("klog");
+
+/* Formatted log for dmesg, byte i of the log is at i % KLOG_HISTORY_SIZE.
+ * Only the drainer writes it. */
+static int8_t klog_history[KLOG_HISTORY_SIZE];
+static volatile uint32_t klog_end = 0;
+
+volatile uint32_t klog_console_level = KLOG_INFO;
+
+static const int8_t* klog_level_names[KLOG_DEBUG + 1] = {
+    "emerg", "alert", "crit", "err", "warn", "notice", "info", "debug"
+};
+
+/*
+ * klog_xchg
+ *
+ * DESCRIPTION: atomically swaps a word
+ *
+ * Inputs: word - word to swap
+ *         val - new value
+ * Outputs: none
+ * Return values: the old value
+ *
+ * SIDE EFFECTS: none
+ */
+static inline uint32_t klog_xchg(volatile uint32_t* word, uint32_t val) {
+    asm volatile ("xchgl %0, %1" : "+r"(val), "+m"(*word) : : "memory");
+    return val;
+}
+
+/*
+ * klog_append
+ *
+ * DESCRIPTION: adds text to the end of the dmesg history, the oldest text
+ *              is overwritten. Caller holds klog_drain_lock.
+ *
+ * Inputs: text - characters to add
+ *         len - number of characters
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+static void klog_append(const int8_t* text, uint32_t len) {
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+        klog_history[(klog_end + i) % KLOG_HISTORY_SIZE] = text[i];
+    klog_end += len;
+}
+
+/*
+ * klog_oldest
+ *
+ * DESCRIPTION: finds the ring holding the oldest message not yet drained
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: the ring, NULL if every ring is empty
+ *
+ * SIDE EFFECTS: none
+ */
+static klog_ring_t* klog_oldest(void) {
+    klog_ring_t* oldest = NULL;
+    klog_record_t* rec;
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        klog_ring_t* ring = &klog_rings[cpu];
+
+        if (ring->tail == ring->head)
+            continue;
+        rec = &ring->rec[ring->tail & (KLOG_RING_SIZE - 1)];
+        if (oldest == NULL ||
+            (int32_t) (rec->seq - oldest->rec[oldest->tail & (KLOG_RING_SIZE - 1)].seq) < 0)
+            oldest = ring;
+    }
+    return oldest;
+}
+
+/*
+ * klog_take
+ *
+ * DESCRIPTION: takes messages off the rings in the order they were logged.
+ *              Each one goes into the dmesg history with its time, CPU and
+ *              level, and is copied to batch if it is severe enough for the
+ *              console. Stops once the batch is full, so the console is
+ *              written without the lock. Caller holds klog_drain_lock.
+ *
+ * Inputs: none
+ * Outputs: batch - up to KLOG_BATCH messages for the console
+ * Return values: messages put in batch, KLOG_BATCH if more may be left
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t klog_take(klog_record_t* batch) {
+    int8_t line[KLOG_LINE_SIZE];
+    int32_t args[5];
+    klog_ring_t* ring;
+    klog_record_t* rec;
+    uint32_t cpu, len, dropped, n = 0;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        dropped = klog_rings[cpu].dropped;
+        if (dropped != klog_rings[cpu].reported) {
+            args[0] = cpu;
+            args[1] = dropped - klog_rings[cpu].reported;
+            len = format_string(line, KLOG_LINE_SIZE, "klog: cpu%u dropped %u messages\n", args);
+            klog_append(line, len);
+            klog_rings[cpu].reported = dropped;
+        }
+    }
+
+    while (n < KLOG_BATCH && (ring = klog_oldest()) != NULL) {
+        rec = &ring->rec[ring->tail & (KLOG_RING_SIZE - 1)];
+
+        args[0] = rec->ticks / KLOG_TICKS_PER_SEC;
+        args[1] = '0' + (rec->ticks % KLOG_TICKS_PER_SEC) / 10;
+        args[2] = '0' + rec->ticks % 10;
+        args[3] = rec->cpu;
+        args[4] = (int32_t) klog_level_names[rec->level];
+        len = format_string(line, KLOG_LINE_SIZE, "[%u.%c%c] cpu%u %s: ", args);
+        memcpy(line + len, rec->text, rec->len);
+        len += rec->len;
+        if (rec->len == 0 || rec->text[rec->len - 1] != '\n')
+            line[len++] = '\n';
+        klog_append(line, len);
+
+        if (rec->level <= klog_console_level)
+            memcpy(&batch[n++], rec, sizeof(klog_record_t));
+
+        /* the slot can be reused once it has been copied out */
+        asm volatile ("" : : : "memory");
+        ring->tail++;
+    }
+    return n;
+}
+
+/*
+ * klog_print
+ *
+ * DESCRIPTION: puts messages taken by klog_take on the consoles of the
+ *              terminals that logged them
+ *
+ * Inputs: batch - messages
+ *         n - number of messages
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: prints to the console
+ */
+static void klog_print(klog_record_t* batch, uint32_t n) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        (void) putbuf(batch[i].term, batch[i].text, batch[i].len);
+}
+
+/*
+ * klog_drain
+ *
+ * DESCRIPTION: drains the rings a batch at a time, waiting for anyone
+ *              already taking messages off them. Messages are printed
+ *              with the lock dropped and interrupts as the caller had them.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: prints to the console
+ */
+void klog_drain(void) {
+    klog_record_t batch[KLOG_BATCH];
+    uint32_t flags, n;
+
+    do {
+        spin_lock_irqsave(&klog_drain_lock, flags);
+        n = klog_take(batch);
+        spin_unlock_irqrestore(&klog_drain_lock, flags);
+        klog_print(batch, n);
+    } while (n == KLOG_BATCH);
+}
+
+/*
+ * klog_drain_work
+ *
+ * DESCRIPTION: work item queued by printk
+ *
+ * Inputs: arg - unused
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: drains the rings
+ */
+static void klog_drain_work(uint32_t arg) {
+    /* messages logged from here on queue another drain */
+    klog_queued = 0;
+    klog_drain();
+}
+
+/*
+ * printk
+ *
+ * DESCRIPTION: formats a message into this CPU's ring and leaves the
+ *              console to the worker, so logging costs no screen or serial
+ *              I/O. Errors are drained at once as well, if nobody else is
+ *              draining, so they are not lost if the kernel goes down.
+ *
+ * Inputs: level - KLOG_ERR to KLOG_DEBUG
+ *         format - format string, see printf
+ * Outputs: none
+ * Return values: 0, -1 if the ring was full and the message was dropped
+ *
+ * SIDE EFFECTS: queues a drain on the worker
+ */
+int32_t printk(uint32_t level, int8_t* format, ...) {
+    int32_t* args = (void *)&format;
+    klog_record_t batch[KLOG_BATCH];
+    klog_ring_t* ring;
+    klog_record_t* rec;
+    uint32_t flags, n, seq = 1;
+
+    args++;
+
+    cli_and_save(flags);
+    ring = &klog_rings[cpu_id()];
+    if (ring->head - ring->tail == KLOG_RING_SIZE) {
+        ring->dropped++;
+        restore_flags(flags);
+        return -1;
+    }
+
+    rec = &ring->rec[ring->head & (KLOG_RING_SIZE - 1)];
+    asm volatile ("lock xaddl %0, %1" : "+r"(seq), "+m"(klog_seq) : : "memory", "cc");
+    rec->seq = seq;
+    rec->ticks = pit_ticks;
+    rec->level = (level > KLOG_DEBUG) ? KLOG_DEBUG : level;
+    rec->cpu = cpu_id();
+    rec->term = sched_term;
+    rec->len = format_string(rec->text, KLOG_MSG_SIZE, format, args);
+
+    /* the drainer sees the message only once it is complete */
+    asm volatile ("" : : : "memory");
+    ring->head++;
+    restore_flags(flags);
+
+    cli_and_save(flags);
+    if (level <= KLOG_ERR && spin_trylock(&klog_drain_lock)) {
+        n = klog_take(batch);
+        spin_unlock(&klog_drain_lock);
+        restore_flags(flags);
+        klog_print(batch, n);
+        /* the worker prints whatever did not fit in the batch */
+        if (n < KLOG_BATCH)
+            return 0;
+    } else {
+        restore_flags(flags);
+    }
+
+    if (klog_xchg(&klog_queued, 1) == 0 && work_queue(klog_drain_work, 0) == -1) {
+        klog_queued = 0;
+    }
+    return 0;
+}
+
+/*
+ * klog_open
+ *
+ * DESCRIPTION: open for "dmesg"
+ *
+ * Inputs: filename - name opened
+ * Outputs: none
+ * Return values: 0
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t klog_open(const uint8_t* filename) {
+    return 0;
+}
+
+/*
+ * klog_read
+ *
+ * DESCRIPTION: reads the formatted log like a file, from where this fd
+ *              left off. A reader that fell behind the history skips to
+ *              the oldest text still kept. The history is copied to the
+ *              stack under the lock and to buf after it, a chunk at a time.
+ *
+ * Inputs: fd - file descriptor of the log
+ *         buf - destination
+ *         nbytes - most bytes to read
+ * Outputs: buf - bytes read
+ * Return values: bytes read, 0 at the end of the log, -1 on a bad buffer
+ *
+ * SIDE EFFECTS: drains the rings first so the log is current
+ */
+int32_t klog_read(int32_t fd, void* buf, int32_t nbytes) {
+    fd_array_t* file = &sched_process() -> fd_array[fd];
+    int8_t chunk[KLOG_READ_CHUNK];
+    uint32_t flags, pos, n, i, total = 0;
+
+    if (buf == NULL || nbytes < 0 || !user_range(buf, nbytes))
+        return -1;
+
+    klog_drain();
+    while (total < (uint32_t) nbytes) {
+        spin_lock_irqsave(&klog_drain_lock, flags);
+        pos = file->file_position;
+        if (klog_end - pos > KLOG_HISTORY_SIZE)
+            pos = klog_end - KLOG_HISTORY_SIZE;
+
+        n = klog_end - pos;
+        if (n > nbytes - total)
+            n = nbytes - total;
+        if (n > KLOG_READ_CHUNK)
+            n = KLOG_READ_CHUNK;
+        for (i = 0; i < n; i++)
+            chunk[i] = klog_history[(pos + i) % KLOG_HISTORY_SIZE];
+
+        file->file_position = pos + n;
+        spin_unlock_irqrestore(&klog_drain_lock, flags);
+
+        if (n == 0)
+            break;
+        memcpy((int8_t*) buf + total, chunk, n);
+        total += n;
+    }
+    return total;
+}
+
+/*
+ * klog_close
+ *
+ * DESCRIPTION: close for "dmesg"
+ *
+ * Inputs: fd - file descriptor of the log
+ * Outputs: none
+ * Return values: 0
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t klog_close(int32_t fd) {
+    return 0;
+}
@@ -0,0 +1,42 @@
+/* klog.h - kernel log, per-CPU message rings drained by the worker
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _KLOG_H
+#define _KLOG_H
+
+#include "types.h"
+
+/* Message levels, lower is more severe */
+#define KLOG_ERR            3
+#define KLOG_WARNING        4
+#define KLOG_INFO           6
+#define KLOG_DEBUG          7
+
+/* Characters kept of one message, longer ones are cut */
+#define KLOG_MSG_SIZE       96
+
+/* Messages each CPU can log before the worker drains them, a power of two */
+#define KLOG_RING_SIZE      64
+
+/* Bytes of formatted log kept for dmesg */
+#define KLOG_HISTORY_SIZE   (4 * KBYTE_4)
+
+/* Name open() takes for the log, it has no file system entry */
+#define KLOG_NAME           "dmesg"
+
+/* Messages at this level or more severe are also put on the console */
+extern volatile uint32_t klog_console_level;
+
+/* Logs a message, see printf for the formats */
+int32_t printk(uint32_t level, int8_t* format, ...);
+
+/* Writes every logged message out to the history and the console */
+void klog_drain(void);
+
+/* fops for fds opened on "dmesg" */
+int32_t klog_open(const uint8_t* filename);
+int32_t klog_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t klog_close(int32_t fd);
+
+#endif /* _KLOG_H */
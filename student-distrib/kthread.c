@@ -0,0 +1,44 @@
+/* kthread.c - kernel threads: tasks without a process
+ * vim:ts=4 noexpandtab
+ */
+
+#include "kthread.h"
+#include "scheduler.h"
+#include "lib.h"
+
+/* Tasks and stacks of the kernel threads; kernel threads never exit */
+static task_t kthread_task[KTHREAD_MAX];
+static uint8_t kthread_stack[KTHREAD_MAX][KTHREAD_STACK_SIZE] __attribute__((aligned(BYTE_4)));
+static uint32_t kthread_count = 0;
+static spinlock_t kthread_lock = SPINLOCK_INIT("kthread");
+
+/*
+ * kthread_create
+ *
+ * DESCRIPTION: sets up a kernel thread that runs entry on its own stack in
+ *              kernel mode, without a process or user address space. The
+ *              thread is not queued, the caller picks its CPU and calls
+ *              sched_enqueue. entry must call sched_thread_start first and
+ *              must never return.
+ *
+ * Inputs: entry - body of the thread
+ *         term - terminal the thread runs on behalf of
+ * Outputs: none
+ * Return values: the thread's task, NULL if all KTHREAD_MAX are in use
+ *
+ * SIDE EFFECTS: none
+ */
+task_t* kthread_create(void (*entry)(void), uint8_t term) {
+    uint32_t flags, idx;
+
+    spin_lock_irqsave(&kthread_lock, flags);
+    if (kthread_count == KTHREAD_MAX) {
+        spin_unlock_irqrestore(&kthread_lock, flags);
+        return NULL;
+    }
+    idx = kthread_count++;
+    spin_unlock_irqrestore(&kthread_lock, flags);
+
+    sched_task_init(&kthread_task[idx], entry, kthread_stack[idx], KTHREAD_STACK_SIZE, term);
+    return &kthread_task[idx];
+}
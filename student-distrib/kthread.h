@@ -0,0 +1,19 @@
+/* kthread.h - kernel threads: tasks without a process
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _KTHREAD_H
+#define _KTHREAD_H
+
+#include "types.h"
+
+/* Number of kernel threads that can exist at once */
+#define KTHREAD_MAX         8
+
+/* Size of each kernel thread's stack */
+#define KTHREAD_STACK_SIZE  (2 * KBYTE_4)
+
+/* Sets up a kernel thread running entry; queue it with sched_enqueue */
+task_t* kthread_create(void (*entry)(void), uint8_t term);
+
+#endif /* _KTHREAD_H */
@@ -0,0 +1,132 @@
+/* lapic.c - local APIC access for interprocessor interrupts
+ * vim:ts=4 noexpandtab
+ */
+
+#include "lapic.h"
+#include "paging.h"
+#include "lib.h"
+
+/* Base of the (identity mapped) local APIC registers, same on every CPU */
+static volatile uint8_t* lapic_base = NULL;
+
+/* Reads a local APIC register */
+static inline uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t*) (lapic_base + reg);
+}
+
+/* Writes a local APIC register */
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    *(volatile uint32_t*) (lapic_base + reg) = val;
+}
+
+/*
+ * lapic_detect
+ *
+ * DESCRIPTION: checks that the CPU has a local APIC and maps its
+ *              registers uncached into every CPU's page directory
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: 0 on success, -1 if there is no local APIC
+ *
+ * SIDE EFFECTS: modifies page directories
+ */
+int32_t lapic_detect(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t base;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_APIC))
+        return -1;
+
+    base = (uint32_t) rdmsr(MSR_APIC_BASE) & APIC_BASE_MASK;
+    paging_map_mmio(base);
+    lapic_base = (volatile uint8_t*) base;
+
+    return 0;
+}
+
+/*
+ * lapic_enable
+ *
+ * DESCRIPTION: software-enables the executing CPU's local APIC. The boot
+ *              CPU keeps receiving the 8259 interrupts through LINT0 in
+ *              virtual wire mode; the other CPUs only take IPIs.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: programs the local APIC
+ */
+void lapic_enable(void) {
+    uint32_t msr = (uint32_t) rdmsr(MSR_APIC_BASE);
+
+    lapic_write(LAPIC_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+
+    if (msr & APIC_BASE_BSP) {
+        lapic_write(LAPIC_LVT_LINT0, LVT_EXTINT);
+        lapic_write(LAPIC_LVT_LINT1, LVT_NMI);
+    } else {
+        lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+        lapic_write(LAPIC_LVT_LINT1, LVT_MASKED);
+    }
+
+    /* clear anything left pending from before */
+    lapic_eoi();
+}
+
+/*
+ * lapic_id
+ *
+ * DESCRIPTION: reads the executing CPU's local APIC ID
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: the APIC ID
+ *
+ * SIDE EFFECTS: none
+ */
+uint8_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+/*
+ * lapic_eoi
+ *
+ * DESCRIPTION: signals the end of an interrupt delivered by the local APIC
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: lets the local APIC deliver the next interrupt
+ */
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ * lapic_send_ipi
+ *
+ * DESCRIPTION: sends an interprocessor interrupt and waits until the
+ *              local APIC has accepted it for delivery
+ *
+ * Inputs: apic_id - destination APIC ID
+ *         icr - delivery mode, vector and shorthand bits
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: interrupts other CPUs
+ */
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr) {
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVS);
+
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t) apic_id << ICR_DEST_SHIFT);
+    lapic_write(LAPIC_ICR_LOW, icr);
+
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVS);
+}
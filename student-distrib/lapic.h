@@ -0,0 +1,65 @@
+/* lapic.h - local APIC access for interprocessor interrupts
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _LAPIC_H
+#define _LAPIC_H
+
+#include "types.h"
+#include "lapic_handler.h"
+#include "idt.h"
+
+/* IA32_APIC_BASE model-specific register */
+#define MSR_APIC_BASE       0x1B
+#define APIC_BASE_BSP       0x00000100      /* this CPU is the boot processor */
+#define APIC_BASE_ENABLE    0x00000800      /* global APIC enable */
+#define APIC_BASE_MASK      0xFFFFF000      /* physical address of the registers */
+
+/* CPUID leaf 1 EDX: on-chip local APIC */
+#define CPUID_APIC          0x00000200
+
+/* Register offsets from the local APIC base */
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+
+/* Register fields */
+#define LAPIC_ID_SHIFT      24              /* APIC ID lives in bits 31:24 */
+#define SVR_ENABLE          0x00000100      /* software enable */
+#define LVT_MASKED          0x00010000
+#define LVT_EXTINT          0x00000700      /* pass 8259 interrupts through (virtual wire) */
+#define LVT_NMI             0x00000400
+
+/* Interrupt command register fields */
+#define ICR_FIXED           0x00000000
+#define ICR_INIT            0x00000500
+#define ICR_STARTUP         0x00000600
+#define ICR_DELIVS          0x00001000      /* previous IPI still being delivered */
+#define ICR_ASSERT          0x00004000
+#define ICR_ALL_BUT_SELF    0x000C0000      /* destination shorthand */
+#define ICR_DEST_SHIFT      24
+
+/* Finds and maps the local APIC, returns -1 if the CPU has none */
+int32_t lapic_detect(void);
+
+/* Enables the executing CPU's local APIC */
+void lapic_enable(void);
+
+/* Returns the executing CPU's local APIC ID */
+uint8_t lapic_id(void);
+
+/* Acknowledges the interrupt being serviced */
+void lapic_eoi(void);
+
+/* Sends an IPI described by icr to the CPU with the given APIC ID
+ * (ignored when icr carries a destination shorthand) */
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr);
+
+#endif /* _LAPIC_H */
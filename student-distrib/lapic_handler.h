@@ -0,0 +1,14 @@
+#ifndef LAPIC_HANDLER
+#define LAPIC_HANDLER
+
+#ifndef ASM
+
+/* Scheduler tick IPI handler wrapper */
+extern void resched_handler();
+
+/* Spurious local APIC interrupt handler */
+extern void spurious_handler();
+
+#endif /* ASM */
+
+#endif /* LAPIC_HANDLER */
@@ -5,12 +5,145 @@
 #include "paging.h"
 #include "systemcalls.h"
 #include "types.h"
+#include "serial.h"
+#include "scheduler.h"
 
-static char* video_mem = (char *)VIDEO;
+/* Serializes screen, cursor and terminal position updates across CPUs */
+spinlock_t console_lock = SPINLOCK_INIT("console");
 
 #define VGA_CONTROL_REG 0x3D4
 #define VGA_DATA_REG 0x3D5
 
+/* CRTC register pairs, high byte register first */
+#define VGA_START_HIGH 0x0C
+#define VGA_CURSOR_HIGH 0x0E
+
+/* blank cell written when rows are cleared */
+#define BLANK_CELL ((ATTRIB << 8) | ' ')
+
+/* Escape sequence parser states */
+#define ANSI_NORMAL 0
+#define ANSI_ESC    1           /* seen ESC */
+#define ANSI_CSI    2           /* seen ESC [, reading numbers */
+#define ESC         0x1B
+
+/* ANSI colors in SGR order (black, red, green, yellow, blue, magenta,
+ * cyan, white) as VGA color numbers */
+static const uint8_t ansi_colors[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+/* Per terminal history, screen row y is line (sb_top + y) of the ring */
+static uint16_t scrollback[TERMINAL_MAX][SCROLLBACK_LINES][NUM_COLS];
+
+/* There are fewer VGA regions than terminals. A terminal without one keeps
+ * its screen in a backing page, which is also what vidmap maps for it. */
+static int32_t vga_owner[VGA_REGIONS];
+static uint16_t backing[TERMINAL_MAX][PAGE_SIZE / 2] __attribute__((aligned(PAGE_SIZE)));
+
+/* Counts terminal switches, the region of the terminal shown longest ago
+ * is the one taken */
+static uint32_t show_clock = 0;
+
+/* Set once the VGA shows a graphics mode. Text memory is not displayed
+ * any more, so every terminal keeps its screen in its backing page. */
+static uint8_t vga_text_off = 0;
+
+/* void vga_write_pair(uint8_t reg, uint16_t val);
+ * Inputs: uint8_t reg - high byte register of a CRTC register pair
+ *         uint16_t val - value to write, high byte to reg, low byte to reg + 1
+ * Return Value: none
+ * Function: writes a 16 bit CRTC value such as the start address or cursor */
+static void vga_write_pair(uint8_t reg, uint16_t val) {
+    outb(reg, VGA_CONTROL_REG);
+    outb((uint8_t) ((val >> 8) & 0xFF), VGA_DATA_REG);
+    outb(reg + 1, VGA_CONTROL_REG);
+    outb((uint8_t) (val & 0xFF), VGA_DATA_REG);
+}
+
+/* char* screen_base(uint8_t term);
+ * Inputs: uint8_t term - terminal owning the screen
+ * Return Value: start of the memory holding the terminal's screen
+ * Function: its VGA region, or its backing page while it has none. Not
+ *           taken from video_mem, the kernel prints before terminals exist. */
+static char* screen_base(uint8_t term) {
+    if (terminal[term].vga_region == NO_VGA_REGION)
+        return (char*) backing[term];
+    return (char*) VGA_REGION_BASE(terminal[term].vga_region);
+}
+
+/* uint16_t vga_cell(uint8_t term, int x, int y);
+ * Inputs: uint8_t term - terminal owning the screen, holding a VGA region
+ *         int x, y - position on that terminal's screen
+ * Return Value: cell index of the position from the start of VGA text memory
+ * Function: translates a screen position into the terminal's region */
+static uint16_t vga_cell(uint8_t term, int x, int y) {
+    uint32_t region = ((uint32_t) screen_base(term) - VIDEO) >> 1;
+
+    return region + (terminal[term].top_row + y) * NUM_COLS + x;
+}
+
+/* uint16_t* sb_line(uint8_t term, int y);
+ * Inputs: uint8_t term - terminal owning the history
+ *         int y - screen row, negative rows reach back into history
+ * Return Value: the history line shown on that row of the live screen
+ * Function: indexes the scrollback ring */
+static uint16_t* sb_line(uint8_t term, int y) {
+    return scrollback[term][(terminal[term].sb_top + y) & (SCROLLBACK_LINES - 1)];
+}
+
+/* int32_t screen_live(uint8_t term);
+ * Inputs: uint8_t term - terminal to check
+ * Return Value: 1 if the screen shows the terminal's live page, 0 otherwise
+ * Function: output only reaches video memory when the screen shows it */
+static int32_t screen_live(uint8_t term) {
+    return term == curr_term && terminal[term].sb_view == 0;
+}
+
+/* uint8_t term_attrib(uint8_t term);
+ * Inputs: uint8_t term - terminal being drawn on
+ * Return Value: attribute byte for cells the terminal writes
+ * Function: colors set by escape sequences, ATTRIB until one is seen. An
+ *           attribute of 0 (black on black) stands for ATTRIB so terminals
+ *           can print before they are initialized. */
+static uint8_t term_attrib(uint8_t term) {
+    return terminal[term].attrib ? terminal[term].attrib : ATTRIB;
+}
+
+/* char* screen_cell(uint8_t term, int x, int y);
+ * Inputs: uint8_t term - terminal owning the screen
+ *         int x, y - position on that terminal's screen
+ * Return Value: address of the character byte at that position
+ * Function: every terminal has its own region of VGA text memory or its own
+ *           backing page, so this is the only place a screen address is made */
+char* screen_cell(uint8_t term, int x, int y) {
+    return screen_base(term) + (((terminal[term].top_row + y) * NUM_COLS + x) << 1);
+}
+
+/* void set_cell(uint8_t term, int x, int y, uint8_t c);
+ * Inputs: uint8_t term - terminal to draw on
+ *         int x, y - position on that terminal's screen
+ *         uint8_t c - character to put there
+ * Return Value: none
+ * Function: stores a character in the terminal's history and draws it if
+ *           the live page is on screen. Caller holds console_lock. */
+void set_cell(uint8_t term, int x, int y, uint8_t c) {
+    uint16_t cell = (term_attrib(term) << 8) | c;
+
+    sb_line(term, y)[x] = cell;
+    if (screen_live(term))
+        *(uint16_t*) screen_cell(term, x, y) = cell;
+    else
+        terminal[term].stale = 1;
+}
+
+/* void set_screen_start(uint8_t term);
+ * Inputs: uint8_t term - terminal whose screen moved
+ * Return Value: none
+ * Function: points the CRTC start address at the terminal's top row if it
+ *           is the one being displayed */
+void set_screen_start(uint8_t term) {
+    if (term == curr_term && terminal[term].vga_region != NO_VGA_REGION)
+        vga_write_pair(VGA_START_HIGH, vga_cell(term, 0, 0));
+}
 
 /* void set_cursor(int x_pos, int y_pos, uint8_t term);
  * Inputs: int x_pos, y_pos - takes in x and y-coordinates of new cursor location on screen
@@ -22,92 +155,477 @@ void set_cursor(int x_pos, int y_pos, uint8_t term) {
     terminal[term].screen_x = x_pos;
     terminal[term].screen_y = y_pos;
 
-    /* sets a position variable in row-major order */
-    uint16_t pos = terminal[term].screen_y * NUM_COLS + terminal[term].screen_x;
- 
-    if(term == curr_term) {
-        /* sets starting cursor position and cursor shape information */
-        outb(0x0F, VGA_CONTROL_REG);
-        outb((uint8_t) (pos & 0xFF), VGA_DATA_REG);
-        /* sets ending cursor position and cursor shape information */
-        outb(0x0E, VGA_CONTROL_REG);
-        outb((uint8_t) ((pos >> 8) & 0xFF), VGA_DATA_REG);
+    /* the cursor location is an address in VGA memory, not on the screen */
+    if (screen_live(term) && terminal[term].vga_region != NO_VGA_REGION)
+        vga_write_pair(VGA_CURSOR_HIGH, vga_cell(term, x_pos, y_pos));
+}
+
+/* void sb_advance(uint8_t term);
+ * Inputs: uint8_t term - terminal to scroll
+ * Return Value: none
+ * Function: moves the live page one line down the scrollback ring. The line
+ *           coming into view is the oldest one in the ring, so it is blanked. */
+static void sb_advance(uint8_t term) {
+    terminal[term].sb_top = (terminal[term].sb_top + 1) & (SCROLLBACK_LINES - 1);
+    if (terminal[term].sb_count < SCROLLBACK_LINES - NUM_ROWS)
+        terminal[term].sb_count++;
+
+    /* someone browsing history keeps looking at the same lines */
+    if (terminal[term].sb_view != 0 && terminal[term].sb_view < terminal[term].sb_count)
+        terminal[term].sb_view++;
+
+    memset_word(sb_line(term, NUM_ROWS - 1), BLANK_CELL, NUM_COLS);
+}
+
+/* void scroll_region(uint8_t term);
+ * Inputs: uint8_t term - terminal to scroll
+ * Return Value: none
+ * Function: moves the screen one row further into the terminal's region.
+ *           Only when the region runs out is the screen copied back to the
+ *           start of it, which is every time for a backing page. Leaves the
+ *           CRTC registers to the caller. */
+static void scroll_region(uint8_t term) {
+    uint32_t rows = (terminal[term].vga_region == NO_VGA_REGION) ? NUM_ROWS : TERM_VGA_ROWS;
+
+    if (terminal[term].top_row + NUM_ROWS < rows) {
+        terminal[term].top_row++;
+    } else {
+        /* wrap: bring the rows that stay visible back to the region start */
+        memmove(screen_base(term), screen_cell(term, 0, 1),
+                (NUM_ROWS - 1) * NUM_COLS * 2);
+        terminal[term].top_row = 0;
+    }
+
+    /* the row coming into view holds whatever was last there */
+    memset_word(screen_cell(term, 0, NUM_ROWS - 1), BLANK_CELL, NUM_COLS);
+}
+
+/* void fill_cells(uint8_t term, int x, int y, int n);
+ * Inputs: uint8_t term - terminal to draw on
+ *         int x, y - first position to blank
+ *         int n - number of cells to blank, not past the end of the row
+ * Return Value: none
+ * Function: blanks part of a row in the current colors */
+static void fill_cells(uint8_t term, int x, int y, int n) {
+    uint16_t blank = (term_attrib(term) << 8) | ' ';
+
+    memset_word(sb_line(term, y) + x, blank, n);
+    if (screen_live(term))
+        memset_word(screen_cell(term, x, y), blank, n);
+    else
+        terminal[term].stale = 1;
+}
+
+/* void scroll_partial(uint8_t term, int top, int bottom);
+ * Inputs: uint8_t term - terminal to scroll
+ *         int top, bottom - first and last row of the scroll region
+ * Return Value: none
+ * Function: scrolls only the rows of a scroll region up by one. The line
+ *           leaving the region is dropped, not kept as history. */
+static void scroll_partial(uint8_t term, int top, int bottom) {
+    int y;
+
+    for (y = top; y < bottom; y++)
+        memcpy(sb_line(term, y), sb_line(term, y + 1), NUM_COLS * 2);
+    if (screen_live(term))
+        memmove(screen_cell(term, 0, top), screen_cell(term, 0, top + 1),
+                (bottom - top) * NUM_COLS * 2);
+    fill_cells(term, 0, bottom, NUM_COLS);
+}
+
+/* int32_t scroll_lines(uint8_t term);
+ * Inputs: uint8_t term - terminal to scroll
+ * Return Value: 1 if the CRTC start address has to be written, 0 otherwise
+ * Function: scrolls the terminal's scroll region, or the whole screen into
+ *           its history if no region is set */
+static int32_t scroll_lines(uint8_t term) {
+    if (terminal[term].region_bottom != 0) {
+        scroll_partial(term, terminal[term].region_top, terminal[term].region_bottom);
+        return 0;
+    }
+
+    sb_advance(term);
+    if (!screen_live(term)) {
+        terminal[term].stale = 1;
+        return 0;
     }
+    scroll_region(term);
+    return 1;
 }
 
 /* void scroll(uint8_t term);
  * Inputs: uint8_t term - terminal scroll function has been called on 
  * Return Value: none
- * Function: scrolls vertically down one line, clearing bottom-most video memory (top-most graphically) */
+ * Function: scrolls vertically down one line. Video memory is only
+ *           touched if the terminal's live page is on screen. */
 void scroll(uint8_t term) {
-    /* writes to video memory depending on current terminal / process */
-    video_mem = (term != curr_term) ? terminal[sched_term].video_mem : (char*) VIDEO;
-
-    /* iterates through every row, except for last row */
-    int i, j;
-    for (i = 0; i < NUM_ROWS - 1; i++) {
-        /* iterates through every column on a given line */
-        for (j = 0; j < NUM_COLS; j++) {
-            /* places information row "above" in video memory at current row */
-            *(uint8_t *)(video_mem + ((i * NUM_COLS + j) << 1)) = *(uint8_t *)(video_mem + (((i + 1) * NUM_COLS + j) << 1));
-            /* accounts for extra scan-line placeholder */
-            *(uint8_t *)(video_mem + ((i * NUM_COLS + j) << 1) + 1) = ATTRIB;
+    if (scroll_lines(term))
+        set_screen_start(term);
+
+    /* sets cursor to back to left-most point of line */
+    set_cursor(0, terminal[term].screen_y, term);
+}
+
+/* void screen_render(uint8_t term);
+ * Inputs: uint8_t term - terminal to draw
+ * Return Value: none
+ * Function: redraws the page being viewed, live or from history, from the
+ *           scrollback ring at the start of the terminal's region. Caller
+ *           holds console_lock. */
+static void screen_render(uint8_t term) {
+    int y;
+
+    terminal[term].top_row = 0;
+    for (y = 0; y < NUM_ROWS; y++)
+        memcpy(screen_cell(term, 0, y), sb_line(term, y - (int) terminal[term].sb_view),
+               NUM_COLS * 2);
+
+    /* while browsing, the live page is not what video memory holds */
+    terminal[term].stale = (terminal[term].sb_view != 0);
+    set_screen_start(term);
+    set_cursor(terminal[term].screen_x, terminal[term].screen_y, term);
+}
+
+/* void set_vga_region(uint8_t term, int32_t region);
+ * Inputs: uint8_t term - terminal whose screen moves
+ *         int32_t region - VGA region it gets, NO_VGA_REGION for its backing page
+ * Return Value: none
+ * Function: moves the terminal's screen, its processes map the new page
+ *           the next time they are scheduled */
+static void set_vga_region(uint8_t term, int32_t region) {
+    terminal[term].vga_region = region;
+    terminal[term].top_row = 0;
+    terminal[term].video_mem = screen_base(term);
+    if (region != NO_VGA_REGION)
+        vga_owner[region] = term;
+}
+
+/* void vga_region_take(uint8_t term);
+ * Inputs: uint8_t term - terminal without a VGA region about to be shown
+ * Return Value: none
+ * Function: gives the terminal a free region, or the region of the terminal
+ *           shown longest ago. Terminals with no process running on a CPU
+ *           go first: a program drawing through its vidmap page keeps
+ *           writing the region until its CPU maps the backing page, which
+ *           it is made to do at once. The screens move with their pages,
+ *           so neither terminal has to be redrawn unless it is stale.
+ *           Caller holds console_lock. */
+static void vga_region_take(uint8_t term) {
+    int r, victim = -1;
+    int32_t old, busy, victim_busy = 0;
+    char* shown;
+
+    for (r = 0; r < VGA_REGIONS; r++) {
+        if (vga_owner[r] == NO_VGA_REGION) {
+            victim = r;
+            break;
+        }
+        busy = (sched_term_cpus(vga_owner[r]) != 0);
+        if (victim == -1 || busy < victim_busy || (busy == victim_busy &&
+            terminal[vga_owner[r]].last_shown < terminal[vga_owner[victim]].last_shown)) {
+            victim = r;
+            victim_busy = busy;
         }
     }
-    
-    /* iterates through all columns in bottom-most row in video memory */
-    for (j = 0; j < NUM_COLS; j++) {
-        /* clearing last row */
-        *(uint8_t *)(video_mem + (((NUM_ROWS - 1) * NUM_COLS + j) << 1)) = ' ';
-        /* accounts for extra scan-line placeholder */
-        *(uint8_t *)(video_mem + (((NUM_ROWS - 1) * NUM_COLS + j) << 1) + 1) = ATTRIB;
+
+    old = vga_owner[victim];
+    if (old != NO_VGA_REGION) {
+        shown = screen_cell(old, 0, 0);
+        set_vga_region(old, NO_VGA_REGION);
+        sched_remap_video(old);
+        if (!terminal[old].stale)
+            memcpy(backing[old], shown, NUM_ROWS * NUM_COLS * 2);
     }
 
-    /* sets cursor to back to left-most point of line */
-    set_cursor(0, terminal[term].screen_y, term);
+    set_vga_region(term, victim);
+    if (!terminal[term].stale)
+        memcpy(screen_cell(term, 0, 0), backing[term], NUM_ROWS * NUM_COLS * 2);
+    sched_remap_video(term);
+}
+
+/* void screen_show(uint8_t term);
+ * Inputs: uint8_t term - terminal that was just made the displayed one
+ * Return Value: none
+ * Function: puts the terminal on screen, taking a VGA region for it if it
+ *           has none. Only a terminal that printed while hidden is redrawn,
+ *           otherwise its screen is already up to date. Caller holds
+ *           console_lock. */
+void screen_show(uint8_t term) {
+    terminal[term].last_shown = ++show_clock;
+    if (terminal[term].vga_region == NO_VGA_REGION && !vga_text_off)
+        vga_region_take(term);
+
+    if (terminal[term].stale) {
+        screen_render(term);
+    } else {
+        set_screen_start(term);
+        set_cursor(terminal[term].screen_x, terminal[term].screen_y, term);
+    }
+}
+
+/* void screen_browse(int32_t lines);
+ * Inputs: int32_t lines - lines to move back through history, negative
+ *                         moves forward towards the live page
+ * Return Value: none
+ * Function: scrolls the displayed terminal's view through its history */
+void screen_browse(int32_t lines) {
+    uint32_t flags;
+    int32_t view;
+
+    spin_lock_irqsave(&console_lock, flags);
+    view = (int32_t) terminal[curr_term].sb_view + lines;
+    if (view < 0)
+        view = 0;
+    if (view > (int32_t) terminal[curr_term].sb_count)
+        view = terminal[curr_term].sb_count;
+
+    if (view != (int32_t) terminal[curr_term].sb_view) {
+        terminal[curr_term].sb_view = view;
+        screen_render(curr_term);
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/* void screen_home(uint8_t term);
+ * Inputs: uint8_t term - terminal to rewind
+ * Return Value: none
+ * Function: redraws the terminal's live page at the start of its region so
+ *           the first video page holds it row by row, as vidmap expects */
+void screen_home(uint8_t term) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&console_lock, flags);
+    terminal[term].sb_view = 0;
+    screen_render(term);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/* int32_t row_changed(const uint16_t* a, const uint16_t* b);
+ * Inputs: const uint16_t* a, b - rows of NUM_COLS cells
+ * Return Value: 1 if any cell differs, 0 otherwise
+ * Function: compares two cells at a time */
+static int32_t row_changed(const uint16_t* a, const uint16_t* b) {
+    const uint32_t* x = (const uint32_t*) a;
+    const uint32_t* y = (const uint32_t*) b;
+    int i;
+
+    for (i = 0; i < NUM_COLS / 2; i++) {
+        if (x[i] != y[i])
+            return 1;
+    }
+    return 0;
+}
+
+/* void screen_read(uint8_t term, uint16_t* cells);
+ * Inputs: uint8_t term - terminal to read
+ *         uint16_t* cells - room for NUM_ROWS rows of NUM_COLS cells
+ * Return Value: none
+ * Function: copies the terminal's live page out of its history, which is
+ *           current even while its screen is stale */
+void screen_read(uint8_t term, uint16_t* cells) {
+    uint32_t flags;
+    int y;
+
+    spin_lock_irqsave(&console_lock, flags);
+    for (y = 0; y < NUM_ROWS; y++)
+        memcpy(cells + y * NUM_COLS, sb_line(term, y), NUM_COLS * 2);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/* int32_t screen_present(uint8_t term, const uint16_t* back, uint16_t* shown);
+ * Inputs: uint8_t term - terminal to draw on
+ *         const uint16_t* back - NUM_ROWS rows of cells drawn by a program
+ *         uint16_t* shown - the rows as last presented, updated
+ * Return Value: number of rows drawn
+ * Function: puts the rows of back that changed since the last present into
+ *           the terminal's history and onto its screen, all under one hold
+ *           of console_lock so the frame shows up whole. Rows are taken
+ *           into shown first, so a program still drawing cannot leave the
+ *           screen out of step with it. */
+int32_t screen_present(uint8_t term, const uint16_t* back, uint16_t* shown) {
+    uint32_t flags;
+    int32_t drawn = 0;
+    int y;
+
+    spin_lock_irqsave(&console_lock, flags);
+    for (y = 0; y < NUM_ROWS; y++) {
+        if (!row_changed(back + y * NUM_COLS, shown + y * NUM_COLS))
+            continue;
+        memcpy(shown + y * NUM_COLS, back + y * NUM_COLS, NUM_COLS * 2);
+        memcpy(sb_line(term, y), shown + y * NUM_COLS, NUM_COLS * 2);
+        if (screen_live(term))
+            memcpy(screen_cell(term, 0, y), shown + y * NUM_COLS, NUM_COLS * 2);
+        else
+            terminal[term].stale = 1;
+        drawn++;
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+    return drawn;
+}
+
+/* void screen_text_off(void);
+ * Inputs: none
+ * Return Value: none
+ * Function: moves every screen out of VGA text memory into its backing
+ *           page before the VGA leaves text mode, which reuses that memory.
+ *           No terminal takes a region after this. */
+void screen_text_off(void) {
+    uint32_t flags;
+    int32_t r, old;
+
+    spin_lock_irqsave(&console_lock, flags);
+    for (r = 0; r < VGA_REGIONS; r++) {
+        old = vga_owner[r];
+        if (old == NO_VGA_REGION)
+            continue;
+        if (!terminal[old].stale)
+            memcpy(backing[old], screen_cell(old, 0, 0), NUM_ROWS * NUM_COLS * 2);
+        set_vga_region(old, NO_VGA_REGION);
+        vga_owner[r] = NO_VGA_REGION;
+        sched_remap_video(old);
+    }
+    vga_text_off = 1;
+
+    if (terminal[curr_term].stale)
+        screen_render(curr_term);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/* int32_t screen_copy_shown(uint16_t* cells);
+ * Inputs: uint16_t* cells - room for NUM_ROWS rows of NUM_COLS cells
+ * Return Value: index of the cell under the cursor, -1 if it is hidden
+ * Function: copies what the displayed terminal shows, history while it is
+ *           browsed, for a console that draws the cells itself */
+int32_t screen_copy_shown(uint16_t* cells) {
+    uint32_t flags;
+    int32_t cursor = -1;
+
+    spin_lock_irqsave(&console_lock, flags);
+    memcpy(cells, screen_cell(curr_term, 0, 0), NUM_ROWS * NUM_COLS * 2);
+    if (terminal[curr_term].sb_view == 0)
+        cursor = terminal[curr_term].screen_y * NUM_COLS + terminal[curr_term].screen_x;
+    spin_unlock_irqrestore(&console_lock, flags);
+    return cursor;
+}
+
+/* void scrollback_init(uint8_t term);
+ * Inputs: uint8_t term - terminal to set up
+ * Return Value: none
+ * Function: empties the terminal's history and resets the colors, scroll
+ *           region and escape sequence state. It is drawn the first time
+ *           the terminal is shown. */
+void scrollback_init(uint8_t term) {
+    memset_word(scrollback[term], BLANK_CELL, SCROLLBACK_LINES * NUM_COLS);
+    terminal[term].sb_top = 0;
+    terminal[term].sb_count = 0;
+    terminal[term].sb_view = 0;
+    terminal[term].stale = (term != curr_term);
+
+    terminal[term].esc_state = ANSI_NORMAL;
+    terminal[term].attrib = ATTRIB;
+    terminal[term].region_top = 0;
+    terminal[term].region_bottom = 0;
+    terminal[term].saved_x = 0;
+    terminal[term].saved_y = 0;
+}
+
+/* void screen_init(uint8_t term);
+ * Inputs: uint8_t term - terminal to set up
+ * Return Value: none
+ * Function: the first terminals get a VGA region each, the rest start out
+ *           on their backing pages and take one when they are shown */
+void screen_init(uint8_t term) {
+    if (term < VGA_REGIONS)
+        vga_owner[term] = NO_VGA_REGION;
+
+    if (term < VGA_REGIONS && term < terminal_count)
+        set_vga_region(term, term);
+    else
+        set_vga_region(term, NO_VGA_REGION);
+    terminal[term].last_shown = 0;
+}
+
+/* void screen_clear(uint8_t term);
+ * Inputs: uint8_t term - terminal to clear
+ * Return Value: none
+ * Function: Clears a terminal's screen, history is kept. Caller holds
+ *           console_lock. */
+void screen_clear(uint8_t term) {
+    int y;
+
+    for (y = 0; y < NUM_ROWS; y++)
+        memset_word(sb_line(term, y), BLANK_CELL, NUM_COLS);
+    terminal[term].sb_view = 0;
+
+    if (term == curr_term) {
+        terminal[term].top_row = 0;
+        memset_word(screen_base(term), BLANK_CELL, NUM_ROWS * NUM_COLS);
+        terminal[term].stale = 0;
+        set_screen_start(term);
+    } else {
+        terminal[term].stale = 1;
+    }
+
+    /* reset cursor position */
+    set_cursor(0, 0, term);
 }
 
 /* void clear(void);
  * Inputs: void
  * Return Value: none
- * Function: Clears video memory */
+ * Function: Clears the displayed terminal's screen, history is kept */
 void clear(void) {
-    video_mem = (char*) VIDEO;    
-    int32_t i;
-    for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        *(uint8_t *)(video_mem + (i << 1)) = ' ';
-        *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
+    uint32_t flags;
+
+    spin_lock_irqsave(&console_lock, flags);
+    screen_clear(curr_term);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/* Where formatted characters go. A full buffer is handed to flush, or
+ * output is cut there if flush is NULL. */
+typedef struct fmt_out {
+    int8_t* buf;
+    int32_t size;
+    int32_t len;
+    void (*flush)(struct fmt_out* out);
+} fmt_out_t;
+
+/* void fmt_putc(fmt_out_t* out, int8_t c);
+ * Inputs: fmt_out_t* out - destination
+ *         int8_t c - character to add
+ * Return Value: none
+ * Function: adds one formatted character */
+static void fmt_putc(fmt_out_t* out, int8_t c) {
+    if (out->len == out->size) {
+        if (out->flush == NULL)
+            return;
+        out->flush(out);
     }
-    /* reset cursor position */
-    set_cursor(0, 0, curr_term);
+    out->buf[out->len++] = c;
 }
 
-/* Standard printf().
- * Only supports the following format strings:
- * %%  - print a literal '%' character
- * %x  - print a number in hexadecimal
- * %u  - print a number as an unsigned integer
- * %d  - print a number as a signed integer
- * %c  - print a character
- * %s  - print a string
- * %#x - print a number in 32-bit aligned hexadecimal, i.e.
- *       print 8 hexadecimal digits, zero-padded on the left.
- *       For example, the hex number "E" would be printed as
- *       "0000000E".
- *       Note: This is slightly different than the libc specification
- *       for the "#" modifier (this implementation doesn't add a "0x" at
- *       the beginning), but I think it's more flexible this way.
- *       Also note: %x is the only conversion specifier that can use
- *       the "#" modifier to alter output. */
-int32_t printf(int8_t *format, ...) {
+/* void fmt_puts(fmt_out_t* out, int8_t* s);
+ * Inputs: fmt_out_t* out - destination
+ *         int8_t* s - string to add
+ * Return Value: none
+ * Function: adds a formatted string */
+static void fmt_puts(fmt_out_t* out, int8_t* s) {
+    while (*s != '\0')
+        fmt_putc(out, *s++);
+}
+
+/* int32_t fmt_args(fmt_out_t* out, int8_t* format, int32_t* esp);
+ * Inputs: fmt_out_t* out - destination
+ *         int8_t* format - format string, see printf
+ *         int32_t* esp - first argument after the format string
+ * Return Value: length of the format string
+ * Function: formats into out, the engine behind printf and format_string */
+static int32_t fmt_args(fmt_out_t* out, int8_t* format, int32_t* esp) {
 
     /* Pointer to the format string */
     int8_t* buf = format;
 
-    /* Stack pointer for the other parameters */
-    int32_t* esp = (void *)&format;
-    esp++;
-
     while (*buf != '\0') {
         switch (*buf) {
             case '%':
@@ -120,7 +638,7 @@ format_char_switch:
                     switch (*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%');
+                            fmt_putc(out, '%');
                             break;
 
                         /* Use alternate formatting */
@@ -138,7 +656,7 @@ format_char_switch:
                                 int8_t conv_buf[64];
                                 if (alternate == 0) {
                                     itoa(*((uint32_t *)esp), conv_buf, 16);
-                                    puts(conv_buf);
+                                    fmt_puts(out, conv_buf);
                                 } else {
                                     int32_t starting_index;
                                     int32_t i;
@@ -148,7 +666,7 @@ format_char_switch:
                                         conv_buf[i] = '0';
                                         i++;
                                     }
-                                    puts(&conv_buf[starting_index]);
+                                    fmt_puts(out, &conv_buf[starting_index]);
                                 }
                                 esp++;
                             }
@@ -159,7 +677,7 @@ format_char_switch:
                             {
                                 int8_t conv_buf[36];
                                 itoa(*((uint32_t *)esp), conv_buf, 10);
-                                puts(conv_buf);
+                                fmt_puts(out, conv_buf);
                                 esp++;
                             }
                             break;
@@ -175,20 +693,20 @@ format_char_switch:
                                 } else {
                                     itoa(value, conv_buf, 10);
                                 }
-                                puts(conv_buf);
+                                fmt_puts(out, conv_buf);
                                 esp++;
                             }
                             break;
 
                         /* Print a single character */
                         case 'c':
-                            putc((uint8_t) *((int32_t *)esp));
+                            fmt_putc(out, (uint8_t) *((int32_t *)esp));
                             esp++;
                             break;
 
                         /* Print a NULL-terminated string */
                         case 's':
-                            puts(*((int8_t **)esp));
+                            fmt_puts(out, *((int8_t **)esp));
                             esp++;
                             break;
 
@@ -200,7 +718,7 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf);
+                fmt_putc(out, *buf);
                 break;
         }
         buf++;
@@ -208,69 +726,133 @@ format_char_switch:
     return (buf - format);
 }
 
+/* void printf_flush(fmt_out_t* out);
+ * Inputs: fmt_out_t* out - printf's buffer
+ * Return Value: none
+ * Function: puts what printf formatted so far on the scheduled terminal */
+static void printf_flush(fmt_out_t* out) {
+    (void) putbuf(sched_term, out->buf, out->len);
+    out->len = 0;
+}
+
+/* Standard printf().
+ * Only supports the following format strings:
+ * %%  - print a literal '%' character
+ * %x  - print a number in hexadecimal
+ * %u  - print a number as an unsigned integer
+ * %d  - print a number as a signed integer
+ * %c  - print a character
+ * %s  - print a string
+ * %#x - print a number in 32-bit aligned hexadecimal, i.e.
+ *       print 8 hexadecimal digits, zero-padded on the left.
+ *       For example, the hex number "E" would be printed as
+ *       "0000000E".
+ *       Note: This is slightly different than the libc specification
+ *       for the "#" modifier (this implementation doesn't add a "0x" at
+ *       the beginning), but I think it's more flexible this way.
+ *       Also note: %x is the only conversion specifier that can use
+ *       the "#" modifier to alter output.
+ * Output is formatted into a buffer on the stack and put on the screen a
+ * buffer at a time rather than a character at a time. */
+int32_t printf(int8_t *format, ...) {
+    int8_t buf[PRINTF_BUF_SIZE];
+    fmt_out_t out = {buf, PRINTF_BUF_SIZE, 0, printf_flush};
+    int32_t len;
+
+    /* Stack pointer for the other parameters */
+    int32_t* esp = (void *)&format;
+    esp++;
+
+    len = fmt_args(&out, format, esp);
+    printf_flush(&out);
+    return len;
+}
+
+/* int32_t format_string(int8_t* buf, int32_t size, int8_t* format, int32_t* args);
+ * Inputs: int8_t* buf - destination
+ *         int32_t size - size of buf, including the terminating NUL
+ *         int8_t* format - format string, see printf
+ *         int32_t* args - the arguments, one 32 bit word each
+ * Return Value: number of characters put in buf, not counting the NUL
+ * Function: formats into a buffer, cutting the output at size - 1 */
+int32_t format_string(int8_t* buf, int32_t size, int8_t* format, int32_t* args) {
+    fmt_out_t out = {buf, size - 1, 0, NULL};
+
+    if (size <= 0)
+        return 0;
+    (void) fmt_args(&out, format, args);
+    buf[out.len] = '\0';
+    return out.len;
+}
+
 /* int32_t puts(int8_t* s);
  *   Inputs: int_8* s = pointer to a string of characters
  *   Return Value: Number of bytes written
  *    Function: Output a string to the console */
 int32_t puts(int8_t* s) {
-    register int32_t index = 0;
-    while (s[index] != '\0') {
-        putc(s[index]);
-        index++;
-    }
-    return index;
+    return putbuf(sched_term, s, strlen(s));
 }
 
-/* void keyboard_putc(uint8_t c);
- * Inputs: uint_8* c - character to print
+/* void term_echo(uint8_t term, uint8_t c);
+ * Inputs: uint8_t term - terminal the key was typed on
+ *         uint8_t c - character to echo
  * Return Value: void
- *  Function: Output a character to the console */
-void keyboard_putc(uint8_t c) {
-    /* save flags + protect */
-    uint32_t flags;
-    cli_and_save(flags);
-
-    /* write onto video screen */
-    video_mem = (char*) VIDEO;
+ *  Function: Echoes a typed character. Caller holds console_lock. */
+void term_echo(uint8_t term, uint8_t c) {
+    /* typing brings a view of history back to the live page */
+    if (terminal[term].sb_view != 0) {
+        terminal[term].sb_view = 0;
+        screen_render(term);
+    }
 
     if(c == '\n' || c == '\r') {
         /* scroll screen if at bottom */
-        if (terminal[curr_term].screen_y == NUM_ROWS - 1)
-            scroll(curr_term);
+        if (terminal[term].screen_y == NUM_ROWS - 1)
+            scroll(term);
         /* otherwise, move to next line */
         else
-            set_cursor(0, terminal[curr_term].screen_y + 1, curr_term);
+            set_cursor(0, terminal[term].screen_y + 1, term);
     } else {
-        *(uint8_t *)(video_mem + ((NUM_COLS * terminal[curr_term].screen_y + terminal[curr_term].screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * terminal[curr_term].screen_y + terminal[curr_term].screen_x) << 1) + 1) = ATTRIB;
-        terminal[curr_term].screen_x++;
+        set_cell(term, terminal[term].screen_x, terminal[term].screen_y, c);
+        terminal[term].screen_x++;
 
         /* if characters on screen exceeds columns in line, move to next line */
         /* or scroll if at bottom of screen */
-        if(terminal[curr_term].screen_x >= NUM_COLS) {
+        if(terminal[term].screen_x >= NUM_COLS) {
             /* scroll screen if at bottom */
-            if (terminal[curr_term].screen_y == NUM_ROWS - 1)
-                scroll(curr_term);
+            if (terminal[term].screen_y == NUM_ROWS - 1)
+                scroll(term);
             /* otherwise, move to next line */
             else
-                set_cursor(0, terminal[curr_term].screen_y + 1, curr_term);
+                set_cursor(0, terminal[term].screen_y + 1, term);
         }
-        terminal[curr_term].screen_x %= NUM_COLS;
-        terminal[curr_term].screen_y = (terminal[curr_term].screen_y + (terminal[curr_term].screen_x / NUM_COLS)) % NUM_ROWS;
     }
     
-    /* sets a position variable in row-major order */
-    uint16_t pos = terminal[curr_term].screen_y * NUM_COLS + terminal[curr_term].screen_x;
- 
-    /* sets starting cursor position and cursor shape information */
-	outb(0x0F, VGA_CONTROL_REG);
-	outb((uint8_t) (pos & 0xFF), VGA_DATA_REG);
-    /* sets ending cursor position and cursor shape information */
-	outb(0x0E, VGA_CONTROL_REG);
-	outb((uint8_t) ((pos >> 8) & 0xFF), VGA_DATA_REG);
+    /* move the hardware cursor */
+    set_cursor(terminal[term].screen_x, terminal[term].screen_y, term);
+}
 
-    /* restore flags */
-    restore_flags(flags);
+/* void term_erase(uint8_t term);
+ * Inputs: uint8_t term - terminal the backspace was typed on
+ * Return Value: void
+ *  Function: Erases the character before the cursor, going back to the
+ *            end of the previous line at the start of one. Caller holds
+ *            console_lock. */
+void term_erase(uint8_t term) {
+    int x = terminal[term].screen_x;
+    int y = terminal[term].screen_y;
+
+    if (x == 0) {
+        /* the line wrapped, the character is at the end of the previous one */
+        if (y == 0)
+            return;
+        x = NUM_COLS;
+        y--;
+    }
+    set_cell(term, x - 1, y, ' ');
+
+    /* move cursor back one position */
+    set_cursor(x - 1, y, term);
 }
 
 /* void putc(uint8_t c);
@@ -280,10 +862,9 @@ void keyboard_putc(uint8_t c) {
 void putc(uint8_t c) {
     /* save flags + protect */
     uint32_t flags;
-    cli_and_save(flags);
 
-    /* sets video memory dependent on background or displayed screen */
-    video_mem = (sched_term != curr_term) ? terminal[sched_term].video_mem : (char*) VIDEO;
+    serial_mirror((int8_t*) &c, 1);
+    spin_lock_irqsave(&console_lock, flags);
 
     if(c == '\n' || c == '\r') {
         /* scroll screen if at bottom */
@@ -293,8 +874,7 @@ void putc(uint8_t c) {
         else
             set_cursor(0, terminal[sched_term].screen_y + 1, sched_term);
     } else {
-        *(uint8_t *)(video_mem + ((NUM_COLS * terminal[sched_term].screen_y + terminal[sched_term].screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * terminal[sched_term].screen_y + terminal[sched_term].screen_x) << 1) + 1) = ATTRIB;
+        set_cell(sched_term, terminal[sched_term].screen_x, terminal[sched_term].screen_y, c);
         terminal[sched_term].screen_x++;
 
         /* if characters on screen exceeds columns in line, move to next line */
@@ -311,20 +891,277 @@ void putc(uint8_t c) {
         terminal[sched_term].screen_y = (terminal[sched_term].screen_y + (terminal[sched_term].screen_x / NUM_COLS)) % NUM_ROWS;
     }
     
-    /* sets a position variable in row-major order */
-    uint16_t pos = terminal[sched_term].screen_y * NUM_COLS + terminal[sched_term].screen_x;
-    
-    if(curr_term == sched_term) {
-        /* sets starting cursor position and cursor shape information */
-        outb(0x0F, VGA_CONTROL_REG);
-        outb((uint8_t) (pos & 0xFF), VGA_DATA_REG);
-        /* sets ending cursor position and cursor shape information */
-        outb(0x0E, VGA_CONTROL_REG);
-        outb((uint8_t) ((pos >> 8) & 0xFF), VGA_DATA_REG);
-    }
+    /* move the hardware cursor if this terminal is displayed */
+    set_cursor(terminal[sched_term].screen_x, terminal[sched_term].screen_y, sched_term);
     
     /* restore flags */
-    restore_flags(flags);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/* int ansi_param(uint8_t term, int i, int def);
+ * Inputs: uint8_t term - terminal whose escape sequence is being run
+ *         int i - which number
+ *         int def - value when the number is missing or 0
+ * Return Value: the number
+ * Function: reads a number of the escape sequence that just ended */
+static int ansi_param(uint8_t term, int i, int def) {
+    if (i > terminal[term].esc_nparams || terminal[term].esc_params[i] == 0)
+        return def;
+    return terminal[term].esc_params[i];
+}
+
+/* int clamp(int v, int lo, int hi);
+ * Inputs: int v - value, int lo, hi - bounds
+ * Return Value: v limited to [lo, hi] */
+static int clamp(int v, int lo, int hi) {
+    return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+/* void ansi_sgr(uint8_t term);
+ * Inputs: uint8_t term - terminal whose colors change
+ * Return Value: none
+ * Function: runs ESC[...m. Supports 0 (reset), 1 (bright), 30-37 and 90-97
+ *           (foreground), 40-47 and 100-107 (background), 39 and 49
+ *           (default colors). */
+static void ansi_sgr(uint8_t term) {
+    uint8_t attrib = term_attrib(term);
+    int i, p;
+
+    for (i = 0; i <= terminal[term].esc_nparams; i++) {
+        p = terminal[term].esc_params[i];
+        if (p == 0)
+            attrib = ATTRIB;
+        else if (p == 1)
+            attrib |= 0x08;
+        else if (p >= 30 && p <= 37)
+            attrib = (attrib & 0xF8) | ansi_colors[p - 30];
+        else if (p >= 90 && p <= 97)
+            attrib = (attrib & 0xF0) | 0x08 | ansi_colors[p - 90];
+        else if (p == 39)
+            attrib = (attrib & 0xF0) | (ATTRIB & 0x0F);
+        else if (p >= 40 && p <= 47)
+            attrib = (attrib & 0x8F) | (ansi_colors[p - 40] << 4);
+        else if (p >= 100 && p <= 107)
+            attrib = (attrib & 0x0F) | 0x80 | (ansi_colors[p - 100] << 4);
+        else if (p == 49)
+            attrib = (attrib & 0x0F) | (ATTRIB & 0xF0);
+    }
+    terminal[term].attrib = attrib;
+}
+
+/* void ansi_csi(uint8_t term, uint8_t cmd, int* x, int* y);
+ * Inputs: uint8_t term - terminal the sequence was written to
+ *         uint8_t cmd - final byte of the sequence
+ *         int* x, y - cursor position, updated in place
+ * Return Value: none
+ * Function: runs a complete ESC[ sequence. Supported are cursor movement
+ *           (A B C D H f), erase in screen and line (J K), colors (m),
+ *           scroll region (r) and cursor save and restore (s u). Anything
+ *           else is ignored. */
+static void ansi_csi(uint8_t term, uint8_t cmd, int* x, int* y) {
+    int n = ansi_param(term, 0, 1);
+    int row, top, bottom;
+
+    switch (cmd) {
+        case 'A': *y = clamp(*y - n, 0, NUM_ROWS - 1); break;
+        case 'B': *y = clamp(*y + n, 0, NUM_ROWS - 1); break;
+        case 'C': *x = clamp(*x + n, 0, NUM_COLS - 1); break;
+        case 'D': *x = clamp(*x - n, 0, NUM_COLS - 1); break;
+
+        case 'H':
+        case 'f':
+            *y = clamp(ansi_param(term, 0, 1) - 1, 0, NUM_ROWS - 1);
+            *x = clamp(ansi_param(term, 1, 1) - 1, 0, NUM_COLS - 1);
+            break;
+
+        case 'J':
+            /* 0: cursor to end, 1: start to cursor, 2: whole screen */
+            n = terminal[term].esc_params[0];
+            if (n == 0) {
+                fill_cells(term, *x, *y, NUM_COLS - *x);
+                for (row = *y + 1; row < NUM_ROWS; row++)
+                    fill_cells(term, 0, row, NUM_COLS);
+            } else if (n == 1) {
+                for (row = 0; row < *y; row++)
+                    fill_cells(term, 0, row, NUM_COLS);
+                fill_cells(term, 0, *y, *x + 1);
+            } else if (n == 2) {
+                for (row = 0; row < NUM_ROWS; row++)
+                    fill_cells(term, 0, row, NUM_COLS);
+            }
+            break;
+
+        case 'K':
+            /* 0: cursor to end, 1: start to cursor, 2: whole line */
+            n = terminal[term].esc_params[0];
+            if (n == 0)
+                fill_cells(term, *x, *y, NUM_COLS - *x);
+            else if (n == 1)
+                fill_cells(term, 0, *y, *x + 1);
+            else if (n == 2)
+                fill_cells(term, 0, *y, NUM_COLS);
+            break;
+
+        case 'm':
+            ansi_sgr(term);
+            break;
+
+        case 'r':
+            top = ansi_param(term, 0, 1) - 1;
+            bottom = ansi_param(term, 1, NUM_ROWS) - 1;
+            if (top < 0 || top >= bottom || bottom >= NUM_ROWS)
+                break;
+            /* the whole screen is no region, it scrolls into history */
+            if (top == 0 && bottom == NUM_ROWS - 1)
+                top = bottom = 0;
+            terminal[term].region_top = top;
+            terminal[term].region_bottom = bottom;
+            *x = 0;
+            *y = 0;
+            break;
+
+        case 's':
+            terminal[term].saved_x = *x;
+            terminal[term].saved_y = *y;
+            break;
+        case 'u':
+            *x = terminal[term].saved_x;
+            *y = terminal[term].saved_y;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* void ansi_byte(uint8_t term, uint8_t c, int* x, int* y);
+ * Inputs: uint8_t term - terminal being written to
+ *         uint8_t c - ESC or a byte following one
+ *         int* x, y - cursor position, updated in place
+ * Return Value: none
+ * Function: feeds one byte to the terminal's escape sequence parser.
+ *           Sequences can be split across writes. */
+static void ansi_byte(uint8_t term, uint8_t c, int* x, int* y) {
+    term_t* t = &terminal[term];
+
+    switch (t->esc_state) {
+        case ANSI_NORMAL:
+            t->esc_state = ANSI_ESC;
+            break;
+
+        case ANSI_ESC:
+            if (c == '[') {
+                t->esc_state = ANSI_CSI;
+                t->esc_nparams = 0;
+                t->esc_params[0] = 0;
+            } else {
+                t->esc_state = ANSI_NORMAL;
+            }
+            break;
+
+        case ANSI_CSI:
+            if (c >= '0' && c <= '9') {
+                if (t->esc_params[t->esc_nparams] < 1000)
+                    t->esc_params[t->esc_nparams] = t->esc_params[t->esc_nparams] * 10 + (c - '0');
+            } else if (c == ';') {
+                if (t->esc_nparams < ANSI_MAX_PARAMS - 1)
+                    t->esc_params[++t->esc_nparams] = 0;
+            } else if (c >= 0x40 && c <= 0x7E) {
+                /* final byte */
+                t->esc_state = ANSI_NORMAL;
+                ansi_csi(term, c, x, y);
+            } else if (c != '?') {
+                /* not a sequence this terminal knows, drop it */
+                t->esc_state = ANSI_NORMAL;
+            }
+            break;
+
+        default:
+            t->esc_state = ANSI_NORMAL;
+            break;
+    }
+}
+
+/* int32_t putbuf(uint8_t term, const int8_t* buf, int32_t n);
+ * Inputs: uint8_t term - terminal to draw on
+ *         const int8_t* buf - characters to print, null characters are skipped
+ *         int32_t n - number of bytes in buf
+ * Return Value: number of characters printed
+ * Function: Output a buffer to a terminal. Runs of printable characters go
+ *           into the scrollback ring a row at a time, and into video memory
+ *           only if the terminal's live page is on screen. Escape sequences
+ *           are run as they end. The CRTC start address and cursor are
+ *           written once per PUTBUF_CHUNK bytes. */
+int32_t putbuf(uint8_t term, const int8_t* buf, int32_t n) {
+    int32_t i = 0, end, printed = 0, scrolled, live;
+    int x, y;
+    uint32_t flags;
+    uint16_t* line;
+    uint16_t* cell = NULL;
+    uint16_t attrib;
+
+    serial_mirror(buf, n);
+
+    while (i < n) {
+        /* bound how long other CPUs and interrupts wait on the console */
+        end = (n - i > PUTBUF_CHUNK) ? i + PUTBUF_CHUNK : n;
+        scrolled = 0;
+
+        spin_lock_irqsave(&console_lock, flags);
+        x = terminal[term].screen_x;
+        y = terminal[term].screen_y;
+        live = screen_live(term);
+        if (!live)
+            terminal[term].stale = 1;
+
+        while (i < end) {
+            if (buf[i] == '\0') {
+                i++;
+                continue;
+            }
+
+            if (buf[i] == ESC || terminal[term].esc_state != ANSI_NORMAL) {
+                ansi_byte(term, buf[i++], &x, &y);
+                printed++;
+                continue;
+            }
+
+            if (buf[i] != '\n' && buf[i] != '\r') {
+                /* copy the run up to the end of the row or of the text */
+                line = sb_line(term, y) + x;
+                if (live)
+                    cell = (uint16_t*) screen_cell(term, x, y);
+                attrib = term_attrib(term) << 8;
+                while (i < end && x < NUM_COLS && buf[i] != '\0' && buf[i] != ESC &&
+                       buf[i] != '\n' && buf[i] != '\r') {
+                    *line = attrib | (uint8_t) buf[i++];
+                    if (live)
+                        *cell++ = *line;
+                    line++;
+                    x++;
+                    printed++;
+                }
+                if (x < NUM_COLS)
+                    continue;
+            } else {
+                i++;
+                printed++;
+            }
+
+            /* newline, or the row filled up */
+            x = 0;
+            if (y == ((terminal[term].region_bottom != 0) ? terminal[term].region_bottom : NUM_ROWS - 1))
+                scrolled |= scroll_lines(term);
+            else if (y < NUM_ROWS - 1)
+                y++;
+        }
+
+        if (scrolled)
+            set_screen_start(term);
+        set_cursor(x, y, term);
+        spin_unlock_irqrestore(&console_lock, flags);
+    }
+    return printed;
 }
 
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -616,6 +1453,7 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
  * Return Value: void
  * Function: increments video memory. To be used to test rtc */
 void test_interrupts(void) {
+    char* video_mem = screen_cell(curr_term, 0, 0);
     int32_t i;
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
         video_mem[i << 1]++;
@@ -6,6 +6,7 @@
 #define _LIB_H
 
 #include "types.h"
+#include "spinlock.h"
 
 /* moved from lib.c to here */
 #define NUM_COLS    80
@@ -13,21 +14,72 @@
 #define VIDEO       0xB8000
 #define ATTRIB      0x7
 
+/* Text mode VGA memory, split into regions lent to terminals. The screen
+ * is a window into the region picked by the CRTC start address. */
+#define VGA_TEXT_SIZE   0x8000
+#define TERM_VGA_SIZE   0x2000
+#define TERM_VGA_ROWS   (TERM_VGA_SIZE / (NUM_COLS * 2))
+#define VGA_REGIONS     (VGA_TEXT_SIZE / TERM_VGA_SIZE)
+#define VGA_REGION_BASE(region) (VIDEO + (region) * TERM_VGA_SIZE)
+#define NO_VGA_REGION   (-1)
+
+/* Characters printf formats before putting them on screen */
+#define PRINTF_BUF_SIZE 128
+
+/* Lines of history kept per terminal, a power of two */
+#define SCROLLBACK_LINES 1024
+
 int32_t printf(int8_t *format, ...);
+/* formats into a buffer, args points at the arguments after format */
+int32_t format_string(int8_t* buf, int32_t size, int8_t* format, int32_t* args);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 int8_t *strrev(int8_t* s);
 uint32_t strlen(const int8_t* s);
 
 /* NEW AND MODIFIED FUNCTIONS */
-/* puts character onto current screen */
-void keyboard_putc(uint8_t c);
+/* echoes a typed character, caller holds console_lock */
+void term_echo(uint8_t term, uint8_t c);
+/* erases the character before the cursor, caller holds console_lock */
+void term_erase(uint8_t term);
 /* puts character onto scheduled screen */
 void putc(uint8_t c);
+/* puts a buffer onto a terminal's screen, updating the cursor once */
+#define PUTBUF_CHUNK 1024
+int32_t putbuf(uint8_t term, const int8_t* buf, int32_t n);
 /* clears screen */
 void clear(void);
+/* clears a terminal's screen, caller holds console_lock */
+void screen_clear(uint8_t term);
 /* sets cursor position */
 void set_cursor(int x_pos, int y_pos, uint8_t term);
+/* address of a position on a terminal's screen */
+char* screen_cell(uint8_t term, int x, int y);
+/* puts a character at a position on a terminal's screen */
+void set_cell(uint8_t term, int x, int y, uint8_t c);
+/* shows a terminal's screen if it is displayed */
+void set_screen_start(uint8_t term);
+/* puts a terminal that was just switched to on screen */
+void screen_show(uint8_t term);
+/* moves the displayed terminal's view through its history */
+void screen_browse(int32_t lines);
+/* redraws a terminal's live page at the start of its region */
+void screen_home(uint8_t term);
+/* copies a terminal's live page out */
+void screen_read(uint8_t term, uint16_t* cells);
+/* draws the rows of a program's back buffer that changed */
+int32_t screen_present(uint8_t term, const uint16_t* back, uint16_t* shown);
+/* moves every screen out of VGA text memory for a graphics mode */
+void screen_text_off(void);
+/* copies the cells on display, returns the cursor's cell or -1 */
+int32_t screen_copy_shown(uint16_t* cells);
+/* empties a terminal's history */
+void scrollback_init(uint8_t term);
+/* gives a terminal its first VGA region, if one is left */
+void screen_init(uint8_t term);
+
+/* Serializes screen, cursor and terminal position updates across CPUs */
+extern spinlock_t console_lock;
 /* scrolls vertically */
 void scroll(uint8_t term);
 
@@ -91,6 +143,44 @@ static inline uint32_t inl(int port) {
     return val;
 }
 
+/* Reads the 64-bit time-stamp counter (cycles since reset) */
+static inline uint64_t rdtsc(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+            :
+            : "memory"
+    );
+    return val;
+}
+
+/* Executes CPUID for the given leaf and returns the four result registers */
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid"
+            : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+            : "a"(leaf), "c"(0)
+    );
+}
+
+/* Reads a model-specific register */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint64_t val;
+    asm volatile ("rdmsr"
+            : "=A"(val)
+            : "c"(msr)
+    );
+    return val;
+}
+
+/* Writes a model-specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr"
+            :
+            : "c"(msr), "A"(val)
+            : "memory"
+    );
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -114,7 +204,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
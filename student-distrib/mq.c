@@ -0,0 +1,407 @@
+/* mq.c - named message queues with priorities, used through fds
+ * vim:ts=4 noexpandtab
+ */
+
+#include "mq.h"
+#include "scheduler.h"
+#include "systemcalls.h"
+#include "pit.h"
+#include "lib.h"
+#include "poll.h"
+
+/* A bounded queue. Messages sit in fixed slots; a binary heap of slot
+ * numbers orders them by priority, then by arrival. */
+typedef struct mq {
+    spinlock_t lock;
+    uint8_t name[MQ_NAME_LEN];
+    uint32_t opens;                     /* open fds, free when 0 */
+    uint32_t count;                     /* messages queued */
+    uint32_t next_seq;                  /* arrival number of the next message */
+    uint8_t heap[MQ_CAPACITY];          /* slots, highest priority at 0 */
+    uint8_t free_slots[MQ_CAPACITY];    /* slots not holding a message */
+    uint32_t seq[MQ_CAPACITY];          /* arrival number of each slot */
+    mq_msg_t slots[MQ_CAPACITY];
+    wait_queue_t receivers;             /* tasks waiting for messages */
+    wait_queue_t senders;               /* tasks waiting for room */
+} mq_t;
+
+static mq_t queues[MQ_COUNT] = {
+    [0 ... MQ_COUNT - 1] = { .lock = SPINLOCK_INIT("mq") }
+};
+
+/* Protects lookup and creation of queues by name */
+static spinlock_t mq_table_lock = SPINLOCK_INIT("mq table");
+
+/*
+ * mq_before
+ *
+ * DESCRIPTION: heap order: higher priority first, earlier arrival first
+ *              among equal priorities
+ *
+ * Inputs: q - queue
+ *         a, b - slots to compare
+ * Outputs: none
+ * Return values: nonzero if slot a is received before slot b
+ *
+ * SIDE EFFECTS: none
+ */
+static int32_t mq_before(mq_t* q, uint8_t a, uint8_t b) {
+    if (q->slots[a].priority != q->slots[b].priority)
+        return q->slots[a].priority > q->slots[b].priority;
+    return (int32_t) (q->seq[a] - q->seq[b]) < 0;
+}
+
+/*
+ * mq_push
+ *
+ * DESCRIPTION: copies a message into a free slot and sifts it up the heap.
+ *              The length is checked on the copy, a sender can still change
+ *              the message it passed.
+ *
+ * Inputs: q - queue with room, lock held
+ *         msg - message to copy
+ * Outputs: none
+ * Return values: 0 on success, -1 if the message is longer than MQ_MSG_DATA
+ *
+ * SIDE EFFECTS: none
+ */
+static int32_t mq_push(mq_t* q, const mq_msg_t* msg) {
+    uint32_t i, parent;
+    uint8_t slot = q->free_slots[MQ_CAPACITY - q->count - 1];
+
+    memcpy(&q->slots[slot], msg, sizeof(mq_msg_t));
+    if (q->slots[slot].len > MQ_MSG_DATA)
+        return -1;
+    q->seq[slot] = q->next_seq++;
+
+    for (i = q->count++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!mq_before(q, slot, q->heap[parent]))
+            break;
+        q->heap[i] = q->heap[parent];
+    }
+    q->heap[i] = slot;
+    return 0;
+}
+
+/*
+ * mq_pop
+ *
+ * DESCRIPTION: copies out the first message and sifts the last one down
+ *              into its place
+ *
+ * Inputs: q - nonempty queue, lock held
+ *         msg - destination
+ * Outputs: msg - the message received
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+static void mq_pop(mq_t* q, mq_msg_t* msg) {
+    uint32_t i, child;
+    uint8_t slot = q->heap[0];
+    uint8_t last;
+
+    memcpy(msg, &q->slots[slot], sizeof(mq_msg_t));
+    last = q->heap[--q->count];
+    q->free_slots[MQ_CAPACITY - q->count - 1] = slot;
+
+    for (i = 0; (child = 2 * i + 1) < q->count; i = child) {
+        if (child + 1 < q->count && mq_before(q, q->heap[child + 1], q->heap[child]))
+            child++;
+        if (!mq_before(q, q->heap[child], last))
+            break;
+        q->heap[i] = q->heap[child];
+    }
+    q->heap[i] = last;
+}
+
+/*
+ * mq_open_queue
+ *
+ * DESCRIPTION: finds the queue named name, or sets up an empty one
+ *
+ * Inputs: name - NUL terminated name, shorter than MQ_NAME_LEN
+ * Outputs: none
+ * Return values: index of the queue, -1 on a bad name or if every queue
+ *                is in use
+ *
+ * SIDE EFFECTS: the caller holds a reference to the queue
+ */
+int32_t mq_open_queue(const uint8_t* name) {
+    uint32_t flags, len;
+    int32_t i, free_id = -1;
+
+    len = strlen((const int8_t*) name);
+    if (len == 0 || len >= MQ_NAME_LEN)
+        return -1;
+
+    spin_lock_irqsave(&mq_table_lock, flags);
+    for (i = 0; i < MQ_COUNT; i++) {
+        spin_lock(&queues[i].lock);
+        if (queues[i].opens == 0) {
+            if (free_id == -1)
+                free_id = i;
+        } else if (strncmp((const int8_t*) queues[i].name, (const int8_t*) name, MQ_NAME_LEN) == 0) {
+            queues[i].opens++;
+            spin_unlock(&queues[i].lock);
+            spin_unlock_irqrestore(&mq_table_lock, flags);
+            return i;
+        }
+        spin_unlock(&queues[i].lock);
+    }
+
+    if (free_id != -1) {
+        mq_t* q = &queues[free_id];
+
+        spin_lock(&q->lock);
+        strcpy((int8_t*) q->name, (const int8_t*) name);
+        q->opens = 1;
+        q->count = 0;
+        q->next_seq = 0;
+        for (i = 0; i < MQ_CAPACITY; i++)
+            q->free_slots[i] = i;
+        spin_unlock(&q->lock);
+    }
+    spin_unlock_irqrestore(&mq_table_lock, flags);
+    return free_id;
+}
+
+/*
+ * mq_get
+ *
+ * DESCRIPTION: takes another reference to an open queue
+ *
+ * Inputs: mq - index of the queue
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void mq_get(uint32_t mq) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&queues[mq].lock, flags);
+    queues[mq].opens++;
+    spin_unlock_irqrestore(&queues[mq].lock, flags);
+}
+
+/*
+ * mq_put
+ *
+ * DESCRIPTION: drops a reference to a queue; after the last one the name
+ *              is free again and queued messages are discarded
+ *
+ * Inputs: mq - index of the queue
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void mq_put(uint32_t mq) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&queues[mq].lock, flags);
+    queues[mq].opens--;
+    spin_unlock_irqrestore(&queues[mq].lock, flags);
+}
+
+/*
+ * mq_receive
+ *
+ * DESCRIPTION: moves up to n messages out of the queue in one pass,
+ *              highest priority first
+ *
+ * Inputs: mq - index of the queue
+ *         msgs - destination
+ *         n - most messages to receive
+ *         timeout - MQ_NOWAIT, MQ_FOREVER or PIT ticks to wait while empty
+ * Outputs: msgs - messages received
+ * Return values: number of messages received, 0 if none came in time
+ *
+ * SIDE EFFECTS: may block, wakes blocked senders
+ */
+int32_t mq_receive(uint32_t mq, mq_msg_t* msgs, uint32_t n, uint32_t timeout) {
+    uint32_t flags, got;
+    uint32_t deadline = pit_ticks + timeout;
+    mq_t* q = &queues[mq];
+
+    spin_lock_irqsave(&q->lock, flags);
+    while (q->count == 0) {
+        if (timeout == MQ_NOWAIT)
+            break;
+        if (timeout == MQ_FOREVER) {
+            sched_wait(&q->receivers, &q->lock);
+        } else if ((int32_t) (deadline - pit_ticks) <= 0 ||
+                !sched_wait_timeout(&q->receivers, &q->lock, deadline - pit_ticks)) {
+            break;
+        }
+    }
+
+    for (got = 0; got < n && q->count != 0; got++)
+        mq_pop(q, &msgs[got]);
+
+    if (got != 0) {
+        sched_wake_all(&q->senders);
+        poll_notify();
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+    return got;
+}
+
+/*
+ * mq_send
+ *
+ * DESCRIPTION: moves up to n messages into the queue in one pass, as many
+ *              as there is room for once there is room for any
+ *
+ * Inputs: mq - index of the queue
+ *         msgs - messages to send
+ *         n - number of messages
+ *         timeout - MQ_NOWAIT, MQ_FOREVER or PIT ticks to wait while full
+ * Outputs: none
+ * Return values: number of messages sent, 0 if there was no room in time,
+ *                -1 if the first message is longer than MQ_MSG_DATA; a
+ *                longer message later on ends the pass
+ *
+ * SIDE EFFECTS: may block, wakes blocked receivers
+ */
+int32_t mq_send(uint32_t mq, const mq_msg_t* msgs, uint32_t n, uint32_t timeout) {
+    uint32_t flags, sent;
+    uint32_t deadline = pit_ticks + timeout;
+    mq_t* q = &queues[mq];
+    int32_t bad = 0;
+
+    spin_lock_irqsave(&q->lock, flags);
+    while (q->count == MQ_CAPACITY) {
+        if (timeout == MQ_NOWAIT)
+            break;
+        if (timeout == MQ_FOREVER) {
+            sched_wait(&q->senders, &q->lock);
+        } else if ((int32_t) (deadline - pit_ticks) <= 0 ||
+                !sched_wait_timeout(&q->senders, &q->lock, deadline - pit_ticks)) {
+            break;
+        }
+    }
+
+    for (sent = 0; sent < n && q->count != MQ_CAPACITY; sent++) {
+        if (mq_push(q, &msgs[sent]) == -1) {
+            bad = 1;
+            break;
+        }
+    }
+
+    if (sent != 0) {
+        sched_wake_all(&q->receivers);
+        poll_notify();
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+    return (bad && sent == 0) ? -1 : (int32_t) sent;
+}
+
+/*
+ * mq_read
+ *
+ * DESCRIPTION: read for a queue fd, receives as many whole messages as
+ *              fit in nbytes using the timeout the fd was opened with
+ *
+ * Inputs: fd - queue fd
+ *         buf - user array of mq_msg_t
+ *         nbytes - size of buf
+ * Outputs: buf - messages received
+ * Return values: bytes received, -1 if buf holds no whole message or is
+ *                not in the program's page
+ *
+ * SIDE EFFECTS: may block
+ */
+int32_t mq_read(int32_t fd, void* buf, int32_t nbytes) {
+    fd_array_t* file = &sched_process() -> fd_array[fd];
+
+    if (buf == NULL || nbytes < (int32_t) sizeof(mq_msg_t) || !user_range(buf, nbytes))
+        return -1;
+    return sizeof(mq_msg_t) * mq_receive(file -> inode, (mq_msg_t*) buf,
+            nbytes / sizeof(mq_msg_t), file -> file_position);
+}
+
+/*
+ * mq_write
+ *
+ * DESCRIPTION: write for a queue fd, sends the whole messages in buf
+ *              using the timeout the fd was opened with
+ *
+ * Inputs: fd - queue fd
+ *         buf - user array of mq_msg_t
+ *         nbytes - size of buf
+ * Outputs: none
+ * Return values: bytes sent, -1 on a bad buffer or message
+ *
+ * SIDE EFFECTS: may block
+ */
+int32_t mq_write(int32_t fd, const void* buf, int32_t nbytes) {
+    fd_array_t* file = &sched_process() -> fd_array[fd];
+    int32_t sent;
+
+    if (buf == NULL || nbytes < (int32_t) sizeof(mq_msg_t) || !user_range(buf, nbytes))
+        return -1;
+    sent = mq_send(file -> inode, (const mq_msg_t*) buf,
+            nbytes / sizeof(mq_msg_t), file -> file_position);
+    return (sent == -1) ? -1 : sent * sizeof(mq_msg_t);
+}
+
+/*
+ * mq_close
+ *
+ * DESCRIPTION: close for a queue fd
+ *
+ * Inputs: fd - queue fd
+ * Outputs: none
+ * Return values: 0
+ *
+ * SIDE EFFECTS: drops the fd's reference to the queue
+ */
+int32_t mq_close(int32_t fd) {
+    mq_put(sched_process() -> fd_array[fd].inode);
+    return 0;
+}
+
+/*
+ * mq_poll
+ *
+ * DESCRIPTION: poll for a queue fd
+ *
+ * Inputs: fd - queue fd
+ * Outputs: none
+ * Return values: POLLIN if a message is queued, POLLOUT if there is room
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t mq_poll(int32_t fd) {
+    uint32_t flags;
+    int32_t ready = 0;
+    mq_t* q = &queues[sched_process() -> fd_array[fd].inode];
+
+    spin_lock_irqsave(&q->lock, flags);
+    if (q->count != 0)
+        ready |= POLLIN;
+    if (q->count != MQ_CAPACITY)
+        ready |= POLLOUT;
+    spin_unlock_irqrestore(&q->lock, flags);
+    return ready;
+}
+
+/*
+ * mq_fd_get
+ *
+ * DESCRIPTION: called on each descriptor copied into a new process; a
+ *              queue gets another reference
+ *
+ * Inputs: fd - the copied descriptor
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void mq_fd_get(fd_array_t* fd) {
+    if (fd -> file_operations_table_ptr.close == mq_close)
+        mq_get(fd -> inode);
+}
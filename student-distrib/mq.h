@@ -0,0 +1,56 @@
+/* mq.h - named message queues with priorities, used through fds
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _MQ_H
+#define _MQ_H
+
+#include "types.h"
+
+/* Number of queues, and messages each holds before senders block */
+#define MQ_COUNT            8
+#define MQ_CAPACITY         32
+
+/* Longest queue name, including the terminating NUL */
+#define MQ_NAME_LEN         32
+
+/* Payload bytes in one message */
+#define MQ_MSG_DATA         56
+
+/* mq_open timeouts, anything else is a number of PIT ticks */
+#define MQ_NOWAIT           0
+#define MQ_FOREVER          0xFFFFFFFF
+
+/* A message as read and written by user programs; a read or write moves
+ * as many whole messages as fit in its byte count */
+typedef struct mq_msg {
+    uint32_t priority;          /* higher priorities are received first */
+    uint32_t len;               /* payload bytes used, at most MQ_MSG_DATA */
+    uint8_t data[MQ_MSG_DATA];
+} mq_msg_t;
+
+/* Opens the queue named name, creating it if needed */
+int32_t mq_open_queue(const uint8_t* name);
+
+/* Takes another reference to an open queue */
+void mq_get(uint32_t mq);
+
+/* Drops a reference to a queue, freeing it and its messages after the last one */
+void mq_put(uint32_t mq);
+
+/* Receives up to n messages, highest priority first */
+int32_t mq_receive(uint32_t mq, mq_msg_t* msgs, uint32_t n, uint32_t timeout);
+
+/* Sends up to n messages */
+int32_t mq_send(uint32_t mq, const mq_msg_t* msgs, uint32_t n, uint32_t timeout);
+
+/* fops for message queue fds */
+int32_t mq_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t mq_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t mq_close(int32_t fd);
+int32_t mq_poll(int32_t fd);
+
+/* Takes another reference if an fd being copied to a new process is a queue */
+void mq_fd_get(fd_array_t* fd);
+
+#endif /* _MQ_H */
@@ -9,41 +9,173 @@
  *   SIDE EFFECTS: Initializes paging
  */
 void paging_init() {
-    int i;
-    
-    /* Initialize Page Directory and Page Table */
+    int i, cpu;
+
+    /* Initialize Page Table */
     for (i = 0; i < MAX_ENTRIES; i++) {
-        /* Set default attributes */
-        page_directory[i] = RW & ~PRESENT;
         /* Set default attributes */
         page_table[i] = (i * PAGE_SIZE) | (RW & ~PRESENT);
-        /* Set default attributes */
-        user_video_page_table[i] = (i * PAGE_SIZE) | (RW & ~PRESENT);
     }
 
-    /* The first entry of the page directory should hold the page table */
-    page_directory[0] = (uint32_t) page_table;
-    page_directory[0] |= (RW | PRESENT);
-
-    /* allocates physical memory video and backups */
-    for (i = 0; i <= TERMINAL_COUNT; i++) {
+    /* maps all of text mode video memory, each terminal owns a region of it */
+    for (i = 0; i < VGA_TEXT_SIZE / PAGE_SIZE; i++) {
         page_table[VIDEO_MEM_PAGE + i] |= (RW | PRESENT);
     }
 
-    /* Set second entry in page directory to be start of kernel memory */
-    page_directory[1] = KERNEL_MEM_START;
-    page_directory[1] |= (FOUR_MB_PAGE | RW | PRESENT);
-    
-    /* The page after the user page should hold the user video page table */
-    page_directory[USER_VID_MEM_PAGE] = (uint32_t) user_video_page_table;
-    page_directory[USER_VID_MEM_PAGE] |= (USER | RW | PRESENT);
-
-    /* maps user space virtual memory to physical memory video backups */
-    for (i = 0; i <= TERMINAL_COUNT; i++) {
-        user_video_page_table[i] = VIDEO + (i * PAGE_SIZE);
-        user_video_page_table[i] |= (USER | RW | PRESENT);
+    /* Every CPU gets the same kernel mappings in its own page directory */
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (i = 0; i < MAX_ENTRIES; i++) {
+            /* Set default attributes */
+            page_directory[cpu][i] = RW & ~PRESENT;
+            /* Set default attributes */
+            user_video_page_table[cpu][i] = (i * PAGE_SIZE) | (RW & ~PRESENT);
+        }
+
+        /* The first entry of the page directory should hold the page table */
+        page_directory[cpu][0] = (uint32_t) page_table;
+        page_directory[cpu][0] |= (RW | PRESENT);
+
+        /* Set second entry in page directory to be start of kernel memory */
+        page_directory[cpu][1] = KERNEL_MEM_START;
+        page_directory[cpu][1] |= (FOUR_MB_PAGE | RW | PRESENT);
+
+        /* The page after the user page should hold the user video page table */
+        page_directory[cpu][USER_VID_MEM_PAGE] = (uint32_t) user_video_page_table[cpu];
+        page_directory[cpu][USER_VID_MEM_PAGE] |= (USER | RW | PRESENT);
+
+        /* the vidmap page, pointed at the running process's terminal
+         * screen by the scheduler */
+        user_video_page_table[cpu][0] = VIDEO;
+        user_video_page_table[cpu][0] |= (USER | RW | PRESENT);
+    }
+
+    /* Enable paging on the boot CPU using assembly code */
+    enable_paging(page_directory[0]);
+    paging_init_cpu();
+}
+
+/*
+ * paging_init_cpu
+ *   DESCRIPTION: Makes PAT entry 1 write-combining on the executing CPU, so
+ *                pages mapped with WRITE_COMBINE gather their stores into
+ *                bursts. Every CPU has to agree, so each calls this once
+ *                paging is on. Without a PAT the entry stays write-through.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes the PAT MSR
+ */
+void paging_init_cpu() {
+    uint32_t eax, ebx, ecx, edx;
+    uint64_t pat;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_PAT))
+        return;
+
+    pat = rdmsr(MSR_PAT);
+    pat &= ~((uint64_t) 0xFF << (PAT_WC_ENTRY * 8));
+    pat |= (uint64_t) PAT_TYPE_WC << (PAT_WC_ENTRY * 8);
+    wrmsr(MSR_PAT, pat);
+}
+
+/*
+ * paging_map_mmio
+ *   DESCRIPTION: Identity maps the 4MB region containing phys_addr into
+ *                every CPU's page directory as an uncached kernel page,
+ *                for memory-mapped device registers such as the local APIC
+ *   INPUTS: phys_addr - physical address of the device registers
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Modifies all page directories and flushes the TLB
+ */
+void paging_map_mmio(uint32_t phys_addr) {
+    int cpu;
+    uint32_t pde = phys_addr >> PAGE_BASE_ADDR_OFFSET;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        page_directory[cpu][pde] = phys_addr & FOUR_MB_MASK;
+        page_directory[cpu][pde] |= (FOUR_MB_PAGE | PCD | PWT | RW | PRESENT);
+    }
+
+    /* Flush the TLB */
+    flush_tlb();
+}
+
+/*
+ * paging_map_wc
+ *   DESCRIPTION: Identity maps the 4MB region containing phys_addr into
+ *                every CPU's page directory as a write-combining kernel
+ *                page, for framebuffers that are written far more than read
+ *   INPUTS: phys_addr - physical address inside the framebuffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Modifies all page directories and flushes the TLB
+ */
+void paging_map_wc(uint32_t phys_addr) {
+    int cpu;
+    uint32_t pde = phys_addr >> PAGE_BASE_ADDR_OFFSET;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        page_directory[cpu][pde] = phys_addr & FOUR_MB_MASK;
+        page_directory[cpu][pde] |= (FOUR_MB_PAGE | WRITE_COMBINE | RW | PRESENT);
     }
 
-    /* Enable paging using assembly code */
-    enable_paging();
+    /* Flush the TLB */
+    flush_tlb();
+}
+
+/*
+ * paging_walk
+ *   DESCRIPTION: Translates a virtual address through this CPU's page
+ *                directory, following 4MB pages and 4KB page tables, if
+ *                every level has all of the given bits set
+ *   INPUTS: virt_addr - virtual address to translate
+ *           need - bits required in the PDE and the PTE, PRESENT at least
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address, or 0 if the address is not mapped so
+ *   SIDE EFFECTS: none
+ */
+static uint32_t paging_walk(uint32_t virt_addr, uint32_t need) {
+    uint32_t pde = page_directory[cpu_id()][virt_addr >> PAGE_BASE_ADDR_OFFSET];
+    uint32_t pte;
+
+    if ((pde & need) != need)
+        return 0;
+
+    if (pde & FOUR_MB_PAGE)
+        return (pde & FOUR_MB_MASK) | (virt_addr & ~FOUR_MB_MASK);
+
+    /* page tables live in the identity mapped kernel image */
+    pte = ((uint32_t*) (pde & ~(PAGE_SIZE - 1)))[(virt_addr >> PAGE_TABLE_OFFSET) & (MAX_ENTRIES - 1)];
+    if ((pte & need) != need)
+        return 0;
+
+    return (pte & ~(PAGE_SIZE - 1)) | (virt_addr & (PAGE_SIZE - 1));
+}
+
+/*
+ * paging_virt_to_phys
+ *   DESCRIPTION: Translates a virtual address through this CPU's page
+ *                directory, following 4MB pages and 4KB page tables
+ *   INPUTS: virt_addr - virtual address to translate
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address, or 0 if the address is not mapped
+ *   SIDE EFFECTS: none
+ */
+uint32_t paging_virt_to_phys(uint32_t virt_addr) {
+    return paging_walk(virt_addr, PRESENT);
+}
+
+/*
+ * paging_user_to_phys
+ *   DESCRIPTION: Like paging_virt_to_phys, but only for addresses user
+ *                code may touch, both the PDE and the PTE being USER
+ *   INPUTS: virt_addr - virtual address to translate
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address, or 0 if user code cannot reach it
+ *   SIDE EFFECTS: none
+ */
+uint32_t paging_user_to_phys(uint32_t virt_addr) {
+    return paging_walk(virt_addr, USER | PRESENT);
 }
@@ -9,7 +9,16 @@
 #define PRESENT                 0x00000001      /* If bit 0 is set, the page is located in physical memory */
 #define RW                      0x00000002      /* If bit 1 is set, the page is writeable */
 #define USER                    0x00000004      /* If bit 2 is set, the page is accessible to User and Supervisor */
+#define PWT                     0x00000008      /* If bit 3 is set, the page is write-through */
+#define PCD                     0x00000010      /* If bit 4 is set, the page is not cached */
 #define FOUR_MB_PAGE            0x00000080      /* If bit 7 is set, the page size becomes 4MB */
+#define WRITE_COMBINE           PWT             /* PAT entry 1, made write-combining by paging_init_cpu */
+
+/* Page attribute table */
+#define MSR_PAT                 0x277
+#define PAT_WC_ENTRY            1               /* entry selected by PWT alone, write-through by default */
+#define PAT_TYPE_WC             0x01
+#define CPUID_PAT               0x00010000      /* CPUID leaf 1 EDX feature bit */
 
 #define PROGRAM_IMAGE_ADDR      0x8048000       /* Address of program image */
 #define USER_STACK              0x83FFFFC       /* Address of user stack for program */
@@ -21,18 +30,35 @@
 #define KERNEL_MEM_END          0x00800000      /* Kernel memory ending address */
 
 #define PAGE_BASE_ADDR_OFFSET   22      /* Only the first 10 bits [31:22] are the page base address */
+#define PAGE_TABLE_OFFSET       12      /* Bits [21:12] index the page table */
+#define FOUR_MB_MASK            0xFFC00000      /* Base address bits of a 4MB page */
 
 #define USER_PAGE           (PROGRAM_IMAGE_ADDR >> PAGE_BASE_ADDR_OFFSET) /* Page where the program image is stored */
 #define USER_VID_MEM_PAGE   (USER_PAGE + 1)   /* The page after the program image page is where the user video memory pages should be */
 
-/* Page Directory */
-uint32_t page_directory[MAX_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
-/* Page Table */
+/* Page Directory, one per CPU so each can map a different process at USER_PAGE */
+uint32_t page_directory[MAX_CPUS][MAX_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+/* Page Table, shared by all CPUs */
 uint32_t page_table[MAX_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
-/* User Video Page Table */
-uint32_t user_video_page_table[MAX_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+/* User Video Page Table, one per CPU */
+uint32_t user_video_page_table[MAX_CPUS][MAX_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
 
 /* Initializes paging */
 void paging_init();
 
+/* Sets up the executing CPU's page attribute table */
+void paging_init_cpu();
+
+/* Identity maps the uncached 4MB region holding a device's registers */
+void paging_map_mmio(uint32_t phys_addr);
+
+/* Identity maps the write-combining 4MB region holding part of a framebuffer */
+void paging_map_wc(uint32_t phys_addr);
+
+/* Translates a virtual address with this CPU's page directory, 0 if unmapped */
+uint32_t paging_virt_to_phys(uint32_t virt_addr);
+
+/* Same, 0 unless the address is mapped for user code */
+uint32_t paging_user_to_phys(uint32_t virt_addr);
+
 #endif /* PAGING_H */
@@ -3,8 +3,8 @@
 
 #ifndef ASM
 
-/* Helper function for paging_init(), Enables paging */
-extern void enable_paging();
+/* Helper function for paging_init(), Enables paging with the given page directory */
+extern void enable_paging(uint32_t* page_directory);
 
 /* Flushes all TLB entries of the non-global pages owned by the current process */
 extern void flush_tlb();
@@ -0,0 +1,348 @@
+/* pipe.c - anonymous pipes backed by kernel ring buffers
+ * vim:ts=4 noexpandtab
+ */
+
+#include "pipe.h"
+#include "scheduler.h"
+#include "systemcalls.h"
+#include "lib.h"
+#include "poll.h"
+
+/* A ring buffer with its open ends and the tasks waiting on it */
+typedef struct pipe {
+    spinlock_t lock;
+    uint8_t buf[PIPE_SIZE];
+    uint32_t head;              /* index of the oldest unread byte */
+    uint32_t count;             /* bytes waiting to be read */
+    uint32_t ends[2];           /* references to the read and write ends */
+    wait_queue_t readers;       /* tasks waiting for data */
+    wait_queue_t writers;       /* tasks waiting for room */
+} pipe_t;
+
+static pipe_t pipes[PIPE_COUNT] = {
+    [0 ... PIPE_COUNT - 1] = { .lock = SPINLOCK_INIT("pipe") }
+};
+
+/* Protects allocation of pipes; a pipe is free when neither end is open */
+static spinlock_t pipe_table_lock = SPINLOCK_INIT("pipe table");
+
+/*
+ * pipe_create
+ *
+ * DESCRIPTION: allocates an empty pipe, the caller owns one reference to
+ *              each of its ends
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: index of the pipe, -1 if all pipes are in use
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t pipe_create(void) {
+    uint32_t flags;
+    int32_t i;
+
+    spin_lock_irqsave(&pipe_table_lock, flags);
+    for (i = 0; i < PIPE_COUNT; i++) {
+        spin_lock(&pipes[i].lock);
+        if (pipes[i].ends[PIPE_READ_END] == 0 && pipes[i].ends[PIPE_WRITE_END] == 0) {
+            pipes[i].head = 0;
+            pipes[i].count = 0;
+            pipes[i].ends[PIPE_READ_END] = 1;
+            pipes[i].ends[PIPE_WRITE_END] = 1;
+            spin_unlock(&pipes[i].lock);
+            spin_unlock_irqrestore(&pipe_table_lock, flags);
+            return i;
+        }
+        spin_unlock(&pipes[i].lock);
+    }
+    spin_unlock_irqrestore(&pipe_table_lock, flags);
+    return -1;
+}
+
+/*
+ * pipe_get
+ *
+ * DESCRIPTION: takes another reference to an end that is already open
+ *
+ * Inputs: pipe - index of the pipe
+ *         end - PIPE_READ_END or PIPE_WRITE_END
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void pipe_get(uint32_t pipe, uint32_t end) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&pipes[pipe].lock, flags);
+    pipes[pipe].ends[end]++;
+    spin_unlock_irqrestore(&pipes[pipe].lock, flags);
+}
+
+/*
+ * pipe_put
+ *
+ * DESCRIPTION: drops a reference to an end. Closing the last write end
+ *              lets readers see end of file, closing the last read end
+ *              makes writers fail; both wake whoever is blocked.
+ *
+ * Inputs: pipe - index of the pipe
+ *         end - PIPE_READ_END or PIPE_WRITE_END
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: the pipe is free again once both ends are closed
+ */
+void pipe_put(uint32_t pipe, uint32_t end) {
+    uint32_t flags;
+    pipe_t* p = &pipes[pipe];
+
+    spin_lock_irqsave(&p->lock, flags);
+    if (--p->ends[end] == 0) {
+        sched_wake_all(&p->readers);
+        sched_wake_all(&p->writers);
+        poll_notify();
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+}
+
+/*
+ * pipe_read_bytes
+ *
+ * DESCRIPTION: copies out whatever is buffered, up to nbytes, in at most
+ *              two block copies around the end of the ring
+ *
+ * Inputs: pipe - index of the pipe
+ *         buf - destination
+ *         nbytes - most bytes to read
+ * Outputs: buf - bytes read
+ * Return values: bytes read, 0 at end of file once all writers are closed
+ *
+ * SIDE EFFECTS: blocks while the pipe is empty, wakes blocked writers
+ */
+int32_t pipe_read_bytes(uint32_t pipe, uint8_t* buf, int32_t nbytes) {
+    uint32_t flags, n, chunk;
+    pipe_t* p = &pipes[pipe];
+
+    if (nbytes <= 0)
+        return 0;
+
+    spin_lock_irqsave(&p->lock, flags);
+    while (p->count == 0 && p->ends[PIPE_WRITE_END] != 0)
+        sched_wait(&p->readers, &p->lock);
+
+    n = ((uint32_t) nbytes < p->count) ? (uint32_t) nbytes : p->count;
+
+    chunk = PIPE_SIZE - p->head;
+    if (chunk > n)
+        chunk = n;
+    memcpy(buf, p->buf + p->head, chunk);
+    memcpy(buf + chunk, p->buf, n - chunk);
+
+    p->head = (p->head + n) % PIPE_SIZE;
+    p->count -= n;
+
+    if (n != 0) {
+        sched_wake_all(&p->writers);
+        poll_notify();
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+    return n;
+}
+
+/*
+ * pipe_write_bytes
+ *
+ * DESCRIPTION: copies all of buf into the pipe, as much as fits at a time
+ *              in at most two block copies, blocking for room in between
+ *
+ * Inputs: pipe - index of the pipe
+ *         buf - source
+ *         nbytes - bytes to write
+ * Outputs: none
+ * Return values: nbytes, fewer if all readers closed part way through,
+ *                -1 if there were no readers to begin with
+ *
+ * SIDE EFFECTS: blocks while the pipe is full, wakes blocked readers
+ */
+int32_t pipe_write_bytes(uint32_t pipe, const uint8_t* buf, int32_t nbytes) {
+    uint32_t flags, n, tail, chunk;
+    int32_t written = 0;
+    pipe_t* p = &pipes[pipe];
+
+    if (nbytes <= 0)
+        return 0;
+
+    spin_lock_irqsave(&p->lock, flags);
+    while (written < nbytes) {
+        while (p->count == PIPE_SIZE && p->ends[PIPE_READ_END] != 0)
+            sched_wait(&p->writers, &p->lock);
+
+        if (p->ends[PIPE_READ_END] == 0)
+            break;
+
+        n = PIPE_SIZE - p->count;
+        if (n > (uint32_t) (nbytes - written))
+            n = nbytes - written;
+
+        tail = (p->head + p->count) % PIPE_SIZE;
+        chunk = PIPE_SIZE - tail;
+        if (chunk > n)
+            chunk = n;
+        memcpy(p->buf + tail, buf + written, chunk);
+        memcpy(p->buf, buf + written + chunk, n - chunk);
+
+        p->count += n;
+        written += n;
+        sched_wake_all(&p->readers);
+        poll_notify();
+    }
+    spin_unlock_irqrestore(&p->lock, flags);
+
+    return (written == 0) ? -1 : written;
+}
+
+/*
+ * pipe_read
+ *
+ * DESCRIPTION: read for the read end of a pipe
+ *
+ * Inputs: fd - file descriptor of the read end
+ *         buf - user buffer
+ *         nbytes - most bytes to read
+ * Outputs: buf - bytes read
+ * Return values: bytes read, 0 at end of file, -1 if buf is not in the
+ *                program's page
+ *
+ * SIDE EFFECTS: may block
+ */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes) {
+    if (buf == NULL || (nbytes > 0 && !user_range(buf, nbytes)))
+        return -1;
+    return pipe_read_bytes(sched_process() -> fd_array[fd].inode, (uint8_t*) buf, nbytes);
+}
+
+/*
+ * pipe_write
+ *
+ * DESCRIPTION: write for the write end of a pipe
+ *
+ * Inputs: fd - file descriptor of the write end
+ *         buf - user buffer
+ *         nbytes - bytes to write
+ * Outputs: none
+ * Return values: bytes written, -1 if the pipe has no readers or buf is
+ *                not in the program's page
+ *
+ * SIDE EFFECTS: may block
+ */
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes) {
+    if (buf == NULL || (nbytes > 0 && !user_range(buf, nbytes)))
+        return -1;
+    return pipe_write_bytes(sched_process() -> fd_array[fd].inode, (const uint8_t*) buf, nbytes);
+}
+
+/*
+ * pipe_read_close
+ *
+ * DESCRIPTION: close for the read end of a pipe
+ *
+ * Inputs: fd - file descriptor of the read end
+ * Outputs: none
+ * Return values: 0
+ *
+ * SIDE EFFECTS: drops a reference to the read end
+ */
+int32_t pipe_read_close(int32_t fd) {
+    pipe_put(sched_process() -> fd_array[fd].inode, PIPE_READ_END);
+    return 0;
+}
+
+/*
+ * pipe_write_close
+ *
+ * DESCRIPTION: close for the write end of a pipe
+ *
+ * Inputs: fd - file descriptor of the write end
+ * Outputs: none
+ * Return values: 0
+ *
+ * SIDE EFFECTS: drops a reference to the write end
+ */
+int32_t pipe_write_close(int32_t fd) {
+    pipe_put(sched_process() -> fd_array[fd].inode, PIPE_WRITE_END);
+    return 0;
+}
+
+/*
+ * pipe_read_poll
+ *
+ * DESCRIPTION: poll for the read end of a pipe
+ *
+ * Inputs: fd - file descriptor of the read end
+ * Outputs: none
+ * Return values: POLLIN if there is data or end of file, plus POLLHUP
+ *                once all writers are closed
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t pipe_read_poll(int32_t fd) {
+    uint32_t flags;
+    int32_t ready = 0;
+    pipe_t* p = &pipes[sched_process() -> fd_array[fd].inode];
+
+    spin_lock_irqsave(&p->lock, flags);
+    if (p->ends[PIPE_WRITE_END] == 0)
+        ready = POLLIN | POLLHUP;
+    else if (p->count != 0)
+        ready = POLLIN;
+    spin_unlock_irqrestore(&p->lock, flags);
+    return ready;
+}
+
+/*
+ * pipe_write_poll
+ *
+ * DESCRIPTION: poll for the write end of a pipe
+ *
+ * Inputs: fd - file descriptor of the write end
+ * Outputs: none
+ * Return values: POLLOUT if there is room, POLLERR once all readers are
+ *                closed
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t pipe_write_poll(int32_t fd) {
+    uint32_t flags;
+    int32_t ready = 0;
+    pipe_t* p = &pipes[sched_process() -> fd_array[fd].inode];
+
+    spin_lock_irqsave(&p->lock, flags);
+    if (p->ends[PIPE_READ_END] == 0)
+        ready = POLLERR;
+    else if (p->count != PIPE_SIZE)
+        ready = POLLOUT;
+    spin_unlock_irqrestore(&p->lock, flags);
+    return ready;
+}
+
+/*
+ * pipe_fd_get
+ *
+ * DESCRIPTION: called on each descriptor copied into a new process; a
+ *              pipe end gets another reference so it stays open until
+ *              both processes have closed it
+ *
+ * Inputs: fd - the copied descriptor
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void pipe_fd_get(fd_array_t* fd) {
+    if (fd -> file_operations_table_ptr.close == pipe_read_close)
+        pipe_get(fd -> inode, PIPE_READ_END);
+    else if (fd -> file_operations_table_ptr.close == pipe_write_close)
+        pipe_get(fd -> inode, PIPE_WRITE_END);
+}
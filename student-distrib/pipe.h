@@ -0,0 +1,46 @@
+/* pipe.h - anonymous pipes backed by kernel ring buffers
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+
+/* Number of pipes that can be open at once */
+#define PIPE_COUNT          8
+
+/* Bytes buffered by a pipe before writers block */
+#define PIPE_SIZE           KBYTE_4
+
+/* Ends of a pipe */
+#define PIPE_READ_END       0
+#define PIPE_WRITE_END      1
+
+/* Allocates a pipe with one reference to each end, -1 if none is free */
+int32_t pipe_create(void);
+
+/* Takes another reference to one end of a pipe */
+void pipe_get(uint32_t pipe, uint32_t end);
+
+/* Drops a reference to one end of a pipe, freeing it after the last one */
+void pipe_put(uint32_t pipe, uint32_t end);
+
+/* Reads up to nbytes, blocking while the pipe is empty and has writers */
+int32_t pipe_read_bytes(uint32_t pipe, uint8_t* buf, int32_t nbytes);
+
+/* Writes nbytes, blocking while the pipe is full and has readers */
+int32_t pipe_write_bytes(uint32_t pipe, const uint8_t* buf, int32_t nbytes);
+
+/* fops for the two ends of a pipe */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t pipe_read_close(int32_t fd);
+int32_t pipe_write_close(int32_t fd);
+int32_t pipe_read_poll(int32_t fd);
+int32_t pipe_write_poll(int32_t fd);
+
+/* Takes another reference if an fd being copied to a new process is a pipe end */
+void pipe_fd_get(fd_array_t* fd);
+
+#endif /* _PIPE_H */
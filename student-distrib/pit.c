@@ -6,6 +6,11 @@
 #include "scheduler.h"
 #include "systemcalls.h"
 #include "types.h"
+#include "smp.h"
+#include "fbcon.h"
+
+/* Number of PIT interrupts since init_pit */
+volatile uint32_t pit_ticks = 0;
 
 /* init_PIT
  * 
@@ -43,15 +48,35 @@ void init_pit() {
  * SIDE EFFECTS: switches tasks in and out of memory
  */
 void pit_intr_handler() {
-    /* check if any terminals are running */
-    if (terminal[sched_term].curr_pcb == NULL) {
-        send_eoi(PIT_IRQ);
-        return;
-    }
+    /* send EOI to PIC before the scheduler switches away from this stack */
+    send_eoi(PIT_IRQ);
 
-    /* schedules next process using round robin scheduling */
-    scheduler(sched_term, (sched_term + 1) % TERMINAL_COUNT);
+    pit_ticks++;
 
-    /* send EOI to PIC */
-    send_eoi(PIT_IRQ);
+    /* wake tasks whose timeouts ran out */
+    sched_timer_tick();
+
+    /* redraw the framebuffer console now and then */
+    fbcon_tick();
+
+    /* only CPU 0 gets the PIT, the other CPUs schedule on its IPI */
+    smp_resched_others();
+
+    /* round robin through this CPU's run queue */
+    schedule();
+}
+
+/* pit_sleep
+ * 
+ * DESCRIPTION: busy-waits for a number of PIT ticks, interrupts must be on
+ * 
+ * Inputs: ticks - number of 10ms ticks to wait
+ * Outputs: none
+ * Return values: none
+ * 
+ * SIDE EFFECTS: none
+ */
+void pit_sleep(uint32_t ticks) {
+    uint32_t start = pit_ticks;
+    while (pit_ticks - start < ticks);
 }
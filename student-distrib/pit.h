@@ -38,4 +38,10 @@ void init_pit();
 /* Interrupt handler for PIT */
 void pit_intr_handler();
 
+/* Number of PIT interrupts since init_pit */
+extern volatile uint32_t pit_ticks;
+
+/* Waits for the given number of PIT ticks */
+void pit_sleep(uint32_t ticks);
+
 #endif /* ensure .h file only read once */
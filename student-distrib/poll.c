@@ -0,0 +1,132 @@
+/* poll.c - waits for any of several fds to become ready
+ * vim:ts=4 noexpandtab
+ */
+
+#include "poll.h"
+#include "scheduler.h"
+#include "pit.h"
+#include "systemcalls.h"
+#include "lib.h"
+
+/* Every poller sleeps on one queue. Sources of readiness bump poll_seq
+ * and wake them all; a poller that saw poll_seq change while it checked
+ * its fds checks again instead of sleeping. */
+static wait_queue_t pollers = WAIT_QUEUE_INIT;
+static volatile uint32_t poll_seq = 0;
+static spinlock_t poll_lock = SPINLOCK_INIT("poll");
+
+/*
+ * poll_scan
+ *
+ * DESCRIPTION: asks each fd's poll callback which of the wanted events
+ *              are ready; errors and hangups are always reported
+ *
+ * Inputs: process - process owning the fds
+ *         fds - entries to check
+ *         nfds - number of entries
+ * Outputs: fds - revents of every entry
+ * Return values: number of entries with any revents
+ *
+ * SIDE EFFECTS: none
+ */
+static int32_t poll_scan(pcb_t* process, pollfd_t* fds, uint32_t nfds) {
+    uint32_t i;
+    int32_t fd, ready = 0;
+
+    for (i = 0; i < nfds; i++) {
+        fd = fds[i].fd;
+        if (fd < 0 || fd >= FD_ARRAY_SIZE || process -> fd_array[fd].flags == 0)
+            fds[i].revents = POLLNVAL;
+        else
+            fds[i].revents = process -> fd_array[fd].file_operations_table_ptr.poll(fd) &
+                    (fds[i].events | POLLERR | POLLHUP);
+
+        if (fds[i].revents != 0)
+            ready++;
+    }
+    return ready;
+}
+
+/*
+ * poll
+ *
+ * DESCRIPTION: checks every fd in fds and, if none is ready, sleeps until
+ *              one may be or until the timeout passes, then checks again.
+ *              One task can then wait on the keyboard, the RTC, pipes and
+ *              queues at once without spinning.
+ *
+ * Inputs: fds - user array of entries, each with an fd and the events wanted
+ *         nfds - number of entries, at most POLL_MAX_FDS
+ *         timeout - POLL_NOWAIT, POLL_FOREVER or PIT ticks to wait
+ * Outputs: fds - revents of every entry
+ * Return values: number of entries with any revents, 0 if the timeout
+ *                passed first, -1 on a bad array
+ *
+ * SIDE EFFECTS: may block the calling task
+ */
+int32_t poll(pollfd_t* fds, uint32_t nfds, uint32_t timeout) {
+    uint32_t flags, seq, deadline = pit_ticks + timeout;
+    int32_t ready;
+    pcb_t* process = sched_process();
+
+    if (fds == NULL || nfds == 0 || nfds > POLL_MAX_FDS)
+        return -1;
+    /* array should fall in the user-level page */
+    if (!user_range(fds, nfds * sizeof(pollfd_t)))
+        return -1;
+
+    while (1) {
+        seq = poll_seq;
+        if ((ready = poll_scan(process, fds, nfds)) != 0 || timeout == POLL_NOWAIT)
+            return ready;
+
+        spin_lock_irqsave(&poll_lock, flags);
+        if (poll_seq == seq) {
+            if (timeout == POLL_FOREVER) {
+                sched_wait(&pollers, &poll_lock);
+            } else if ((int32_t) (deadline - pit_ticks) <= 0 ||
+                    !sched_wait_timeout(&pollers, &poll_lock, deadline - pit_ticks)) {
+                spin_unlock_irqrestore(&poll_lock, flags);
+                return 0;
+            }
+        }
+        spin_unlock_irqrestore(&poll_lock, flags);
+    }
+}
+
+/*
+ * poll_notify
+ *
+ * DESCRIPTION: called wherever an fd may have become ready, wakes every
+ *              sleeping poller to check its fds again. Safe in interrupt
+ *              handlers and with the caller's own locks held.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void poll_notify(void) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&poll_lock, flags);
+    poll_seq++;
+    sched_wake_all(&pollers);
+    spin_unlock_irqrestore(&poll_lock, flags);
+}
+
+/*
+ * poll_always
+ *
+ * DESCRIPTION: poll callback of files and directories, which never block
+ *
+ * Inputs: fd - ignored
+ * Outputs: none
+ * Return values: POLLIN | POLLOUT
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t poll_always(int32_t fd) {
+    return POLLIN | POLLOUT;
+}
@@ -0,0 +1,40 @@
+/* poll.h - waits for any of several fds to become ready
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _POLL_H
+#define _POLL_H
+
+#include "types.h"
+
+/* Readiness bits, in events and revents */
+#define POLLIN              0x01    /* read would not block */
+#define POLLOUT             0x04    /* write would not block */
+#define POLLERR             0x08    /* write end with no readers left */
+#define POLLHUP             0x10    /* read end with no writers left */
+#define POLLNVAL            0x20    /* fd is not open */
+
+/* poll timeouts, anything else is a number of PIT ticks */
+#define POLL_NOWAIT         0
+#define POLL_FOREVER        0xFFFFFFFF
+
+/* Most entries one poll call takes */
+#define POLL_MAX_FDS        16
+
+/* One entry of the array passed to poll */
+typedef struct pollfd {
+    int32_t fd;
+    uint16_t events;            /* bits the caller waits for */
+    uint16_t revents;           /* bits that are ready, set by poll */
+} pollfd_t;
+
+/* Waits until one of the fds is ready or the timeout passes */
+int32_t poll(pollfd_t* fds, uint32_t nfds, uint32_t timeout);
+
+/* Tells sleeping pollers that some fd may have become ready */
+void poll_notify(void);
+
+/* poll for fds that never block */
+int32_t poll_always(int32_t fd);
+
+#endif /* _POLL_H */
@@ -5,12 +5,16 @@
 // include .h files 
 #include "rtc.h"
 #include "lib.h"
+#include "poll.h"
 
 /* mask for lower bits */
 #define LOW_HEX_MASK 0xF0
 /* masks lower 7-bits for non-maskable interrupts */
 #define NMI_MASK 0x80
 
+/* Protects the CMOS index port and the terminals' RTC countdowns */
+static spinlock_t rtc_lock = SPINLOCK_INIT("rtc");
+
 /*
  * init_rtc
  * 
@@ -66,16 +70,23 @@ void rtc_intr_handler(void) {
     /* send EOI signal to PIC */
     send_eoi(RTC_IRQ);
 
-    cli(); // LOCK
+    spin_lock(&rtc_lock); // LOCK, interrupts are already off in the handler
     /* read data from Register C to allow for next interrupt */
     outb(RTC_REG_C, INDEX_PORT);
     inb(CMOS_PORT);
 
-    /* decrement iterations */
-    int i;
-    if (terminal[sched_term].active && terminal[sched_term].rtc_iterations != 0)
-        terminal[sched_term].rtc_iterations--;
-    sti(); // UNLOCK
+    /* decrement iterations of every terminal, the RTC only interrupts CPU 0
+     * while the readers may be waiting on any CPU */
+    int i, expired = 0;
+    for (i = 0; i < terminal_count; i++) {
+        if (terminal[i].active && terminal[i].rtc_iterations != 0 && --terminal[i].rtc_iterations == 0)
+            expired = 1;
+    }
+    spin_unlock(&rtc_lock); // UNLOCK
+
+    /* a period ran out, so an RTC fd some poller waits on may be ready */
+    if (expired)
+        poll_notify();
 }
 
 /*
@@ -115,13 +126,47 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     // the open system call. 
 
     /* wait for rtc_intr_handler to clear flag, then return 0 */
-    sti();
-    terminal[sched_term].rtc_iterations = terminal[sched_term].rtc_constant;
+    uint32_t flags;
+    spin_lock_irqsave(&rtc_lock, flags);
+    /* finish a period rtc_poll already started, otherwise start a new one */
+    if (!terminal[sched_term].rtc_armed)
+        terminal[sched_term].rtc_iterations = terminal[sched_term].rtc_constant;
+    terminal[sched_term].rtc_armed = 0;
+    spin_unlock_irqrestore(&rtc_lock, flags);
+
+    /* system calls run with interrupts on, so ticks keep arriving */
     while (terminal[sched_term].rtc_iterations != 0);
-    cli();
     return 0;
 }
 
+/*
+ * rtc_poll
+ * 
+ * DESCRIPTION: poll callback of the RTC. Starts a period if none is being
+ *              counted; the fd is readable once it has run out, and the
+ *              next rtc_read then returns at once.
+ * 
+ * INPUTS: int32_t fd - file descriptor for device type
+ * OUTPUTS: none
+ * RETURN VALUE: POLLIN once the period is over, 0 before
+ * 
+ * SIDE EFFECTS: may start counting a period
+ */
+int32_t rtc_poll(int32_t fd) {
+    uint32_t flags;
+    int32_t ready;
+
+    spin_lock_irqsave(&rtc_lock, flags);
+    if (!terminal[sched_term].rtc_armed) {
+        terminal[sched_term].rtc_iterations = terminal[sched_term].rtc_constant;
+        terminal[sched_term].rtc_armed = 1;
+    }
+    ready = (terminal[sched_term].rtc_iterations == 0) ? POLLIN : 0;
+    spin_unlock_irqrestore(&rtc_lock, flags);
+
+    return ready;
+}
+
 /*
  * rtc_write
  * 
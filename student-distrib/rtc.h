@@ -46,5 +46,7 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes);
 /* closes the rtc */
 int32_t rtc_close(int32_t fd);
+/* reports whether an rtc read would return at once */
+int32_t rtc_poll(int32_t fd);
 
 #endif // _RTC_H is now defined
@@ -6,113 +6,790 @@
 #include "paging.h"
 #include "systemcalls.h"
 #include "pit.h"
+#include "context_switch.h"
+#include "fpu.h"
+#include "x86_desc.h"
+#include "kthread.h"
+#include "shm.h"
+#include "klog.h"
+#include "vbe.h"
+#include "smp.h"
 
-/* 
+/* Per-CPU run queues, idle tasks and the task each CPU last switched away from */
+static runqueue_t runqueues[MAX_CPUS];
+static task_t idle_task[MAX_CPUS];
+static task_t* prev_task[MAX_CPUS];
+
+/* Orders blocking against wakeups: protects task_t.state and task_t.on_cpu */
+static spinlock_t wake_lock = SPINLOCK_INIT("wake");
+
+/* Tasks in sched_wait_timeout, checked by the PIT handler */
+static sched_timer_t* timers = NULL;
+static spinlock_t timer_lock = SPINLOCK_INIT("timer");
+
+/* TSC value taken right before each CPU's last call to switch_to */
+static uint64_t switch_start[MAX_CPUS];
+
+/* Context switch cost counters */
+sched_stats_t sched_stats[MAX_CPUS];
+
+/*
+ * rq_push
+ *
+ * DESCRIPTION: appends a task to the tail of a run queue
+ *
+ * Input: rq - run queue
+ *        task - task that is not running and not queued anywhere
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: takes the run queue lock
+ */
+static void rq_push(runqueue_t* rq, task_t* task) {
+    uint32_t flags;
+    spin_lock_irqsave(&rq->lock, flags);
+
+    task->next = NULL;
+    if (rq->tail == NULL)
+        rq->head = task;
+    else
+        rq->tail->next = task;
+    rq->tail = task;
+    rq->len++;
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/*
+ * rq_pop
+ *
+ * DESCRIPTION: removes the task at the head of a run queue
+ *
+ * Input: rq - run queue
+ * Output: none
+ * Return Values: the task, or NULL if the queue is empty
+ *
+ * SIDE EFFECTS: takes the run queue lock
+ */
+static task_t* rq_pop(runqueue_t* rq) {
+    uint32_t flags;
+    task_t* task;
+
+    /* racy peek, saves the lock round trip on an empty queue */
+    if (rq->head == NULL)
+        return NULL;
+
+    spin_lock_irqsave(&rq->lock, flags);
+
+    task = rq->head;
+    if (task != NULL) {
+        rq->head = task->next;
+        if (rq->head == NULL)
+            rq->tail = NULL;
+        rq->len--;
+        task->next = NULL;
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return task;
+}
+
+/*
+ * sched_steal
+ *
+ * DESCRIPTION: work stealing for an idle CPU, takes the oldest waiting task
+ *              from the longest run queue of another CPU. Only waiting tasks
+ *              are queued, so the stolen task is never running elsewhere.
+ *
+ * Input: cpu - index of the idle CPU
+ * Output: none
+ * Return Values: the stolen task, or NULL if every other queue is empty
+ *
+ * SIDE EFFECTS: takes one other CPU's run queue lock
+ */
+static task_t* sched_steal(uint32_t cpu) {
+    uint32_t i, victim = cpu, longest = 0;
+
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (i != cpu && runqueues[i].len > longest) {
+            longest = runqueues[i].len;
+            victim = i;
+        }
+    }
+
+    if (victim == cpu)
+        return NULL;
+    return rq_pop(&runqueues[victim]);
+}
+
+/*
+ * sched_account_switch
+ *
+ * DESCRIPTION: records how many cycles the switch that just completed took;
+ *              must be called by the context that was switched to
+ *
+ * Input: cpu - CPU the switch happened on
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: updates sched_stats
+ */
+static void sched_account_switch(uint32_t cpu) {
+    uint32_t cycles = (uint32_t) (rdtsc() - switch_start[cpu]);
+    sched_stats_t* stats = &sched_stats[cpu];
+
+    stats->switches++;
+    stats->last_cycles = cycles;
+    stats->total_cycles += cycles;
+    if (cycles < stats->min_cycles)
+        stats->min_cycles = cycles;
+    if (cycles > stats->max_cycles)
+        stats->max_cycles = cycles;
+}
+
+/*
+ * sched_finish
+ *
+ * DESCRIPTION: first thing a task does after being switched to. The task
+ *              switched away from is only queued now that switch_to has
+ *              saved its context, so no other CPU can pick it up while
+ *              its stack is still in use. A blocked task is left off the
+ *              queues; its wakeup queues it from now on.
+ *
+ * Input: none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: requeues the previous task on this CPU
+ */
+static void sched_finish(void) {
+    uint32_t cpu = cpu_id();
+    task_t* prev = prev_task[cpu];
+    uint32_t requeue;
+
+    sched_account_switch(cpu);
+
+    prev_task[cpu] = NULL;
+    if (prev == NULL || prev == &idle_task[cpu])
+        return;
+
+    spin_lock(&wake_lock);
+    prev->on_cpu = 0;
+    requeue = (prev->state == TASK_RUNNABLE);
+    spin_unlock(&wake_lock);
+
+    if (requeue)
+        rq_push(&runqueues[cpu], prev);
+}
+
+/*
+ * sched_map_video
+ *
+ * DESCRIPTION: points this CPU's vidmap page at the screen of the
+ *              process's terminal, its region of video memory or its
+ *              backing page while it has no region, or at the process's
+ *              back page if it double-buffers
+ *
+ * Input: cpu - executing CPU
+ *        pcb - process running on it
+ * Output: none
+ * Return Values: 1 if the mapping changed, 0 otherwise
+ *
+ * SIDE EFFECTS: modifies user_video_page_table[cpu]
+ */
+int32_t sched_map_video(uint32_t cpu, pcb_t* pcb) {
+    uint32_t entry;
+
+    entry = vidmap_page(pcb);
+    entry |= (USER | RW | PRESENT);
+
+    if (user_video_page_table[cpu][0] == entry)
+        return 0;
+    user_video_page_table[cpu][0] = entry;
+    return 1;
+}
+
+/*
+ * sched_term_cpus
+ *
+ * DESCRIPTION: finds the CPUs running a process of the terminal whose
+ *              vidmap page is the terminal's screen. Unlocked, so a CPU
+ *              may switch tasks right after it is looked at.
+ *
+ * Input: term - terminal to look for
+ * Output: none
+ * Return Values: bit cpu set for every such CPU
+ *
+ * SIDE EFFECTS: none
+ */
+uint32_t sched_term_cpus(uint8_t term) {
+    uint32_t cpu, mask = 0;
+    task_t* task;
+    pcb_t* pcb;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpus[cpu].online || (task = cpus[cpu].curr_task) == NULL)
+            continue;
+        pcb = task->pcb;
+        if (pcb != NULL && pcb->terminal_id == term && !pcb->leader->vid_buffered)
+            mask |= 1 << cpu;
+    }
+    return mask;
+}
+
+/*
+ * sched_remap_video
+ *
+ * DESCRIPTION: called when a terminal's screen moved between VGA memory and
+ *              its backing page. This CPU maps the new page at once, the
+ *              others on a scheduler tick sent to them now, instead of
+ *              drawing where the screen was until their next tick.
+ *
+ * Input: term - terminal whose screen moved
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: may interrupt other CPUs
+ */
+void sched_remap_video(uint8_t term) {
+    uint32_t cpu, self = cpu_id(), mask = sched_term_cpus(term);
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!(mask & (1 << cpu)))
+            continue;
+        if (cpu != self)
+            smp_resched_cpu(cpu);
+        else if (sched_map_video(cpu, cpus[cpu].curr_task->pcb))
+            flush_tlb();
+    }
+}
+
+/*
+ * terminal_launch
+ *
+ * DESCRIPTION: entry point of a launch thread, runs the first shell of the
+ *              terminal currently being scheduled
+ *
+ * Input: none
+ * Output: none
+ * Return Values: never returns
+ *
+ * SIDE EFFECTS: executes a new shell
+ */
+static void terminal_launch(void) {
+    sched_thread_start();
+
+    execute((uint8_t *) "shell");
+
+    /* only reached if the shell could not be started */
+    printk(KLOG_ERR, "Failed to launch shell on terminal %d\n", sched_term);
+    while (1);
+}
+
+/*
  * terminal_switch
- * 
+ *
  * DESCRIPTION: switches between current terminal to argument terminal
- * 
- * Input: uint8_t new_terminal_id - terminal id (0, 1, 2) to be switched into
+ *
+ * Input: uint8_t new_terminal_id - terminal id, below terminal_count, to be switched into
  * Output: N/A
  * Return Values: N/A
- * 
+ *
  * SIDE EFFECTS: none
  */
 void terminal_switch (uint8_t new_terminal) {
-    /* lock copying memory */
+    /* keep other CPUs from printing while the screen changes hands */
     uint32_t flags;
-    cli_and_save(flags);
+    spin_lock_irqsave(&console_lock, flags);
 
-    /* Do nothing if argument terminal is current terminal */
-    if (curr_term == new_terminal)
+    /* Do nothing if argument terminal is current terminal or not open */
+    if (curr_term == new_terminal || new_terminal >= terminal_count) {
+        spin_unlock_irqrestore(&console_lock, flags);
         return;
-
-    /* save current video memory from screen into backup */
-    memcpy((int8_t *) terminal[curr_term].video_mem, (int8_t *) (VIDEO), PAGE_SIZE);
-
-    /* restore new video memory from backup onto screen */
-    memcpy((int8_t *) (VIDEO), (int8_t *) terminal[new_terminal].video_mem, PAGE_SIZE);
+    }
 
     /* set current terminal as argument */
     curr_term = new_terminal;
 
-    /* update cursor position based on current terminal */
-    set_cursor(terminal[curr_term].screen_x, terminal[curr_term].screen_y, curr_term);
+    /* a terminal holding a VGA region is shown by pointing the CRTC start
+     * address at it, one without takes the region of the terminal shown
+     * longest ago; either is drawn from its scrollback if it printed while
+     * hidden */
+    screen_show(curr_term);
 
-    /* restore flags from cli */
-    restore_flags(flags);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/*
+ * sched_init
+ *
+ * DESCRIPTION: empties the run queues and makes the code each CPU boots on
+ *              its idle task, which runs whenever its queue has nothing
+ *
+ * Input: none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: initializes per-CPU scheduler state
+ */
+void sched_init(void) {
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        spin_lock_init(&runqueues[cpu].lock, "runqueue");
+        runqueues[cpu].head = NULL;
+        runqueues[cpu].tail = NULL;
+        runqueues[cpu].len = 0;
+
+        idle_task[cpu].pcb = NULL;
+        idle_task[cpu].terminal_id = 0;
+        idle_task[cpu].state = TASK_RUNNABLE;
+        idle_task[cpu].on_cpu = 1;
+        idle_task[cpu].cpu = cpu;
+        idle_task[cpu].next = NULL;
+        prev_task[cpu] = NULL;
+
+        sched_stats[cpu].switches = 0;
+        sched_stats[cpu].last_cycles = 0;
+        sched_stats[cpu].min_cycles = 0xFFFFFFFF;
+        sched_stats[cpu].max_cycles = 0;
+        sched_stats[cpu].total_cycles = 0;
+
+        cpus[cpu].curr_task = &idle_task[cpu];
+    }
+}
+
+/*
+ * sched_launch_terminals
+ *
+ * DESCRIPTION: queues a kernel thread that launches the first shell of
+ *              every terminal, handing them out
+ *              round robin over the online CPUs so the terminals start out
+ *              running in parallel
+ *
+ * Input: none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: shells start on the next scheduler ticks
+ */
+void sched_launch_terminals(void) {
+    uint32_t term, cpu = 0;
+    task_t* task;
+
+    for (term = 0; term < terminal_count; term++) {
+        /* execute new shell on a fresh stack */
+        task = kthread_create(terminal_launch, term);
+        if (task == NULL)
+            return;
+        task->cpu = cpu;
+
+        sched_enqueue(task);
+
+        /* next online CPU */
+        do {
+            cpu = (cpu + 1) % MAX_CPUS;
+        } while (!cpus[cpu].online);
+    }
 }
 
-/* scheduler
- * 
+/* schedule
+ *
  * DESCRIPTION: "schedules" process by switching from current process to next using round-robin method
- *              - saves ebp/esp of current process
+ *              over this CPU's run queue, called on every tick and by sleeping tasks with interrupts off
+ *              - takes the next queued task, or steals one if this CPU is idle or
+ *                the current task blocked; falls back to the idle task
  *              - switches process paging
  *              - sets task state segment
  *              - updates running video coordinates
- *              - restores ebp/esp of next process
- * 
- * Inputs: prev_term - terminal scheduler is switching from
- *         next_term - terminal scheduler is switching to
+ *              - saves the kernel context of the current task and resumes
+ *                the next one through switch_to
+ *
+ * Inputs: none
  * Outputs: none
  * Return values: none
- * 
+ *
  * SIDE EFFECTS: contexts switches into new process
  */
-void scheduler(uint8_t prev_term, uint8_t next_term) {
-    /* return if previous terminal is same as next terminal */
-    if (prev_term == next_term) {
-        send_eoi(PIT_IRQ);
+void schedule(void) {
+    uint32_t cpu = cpu_id();
+    task_t* prev = cpus[cpu].curr_task;
+    task_t* next;
+    pcb_t* pcb;
+
+    next = rq_pop(&runqueues[cpu]);
+    if (next == NULL && (prev == &idle_task[cpu] || prev->state != TASK_RUNNABLE))
+        next = sched_steal(cpu);
+
+    /* a task that slept or exited with nothing else to run hands over to idle */
+    if (next == NULL && prev->state != TASK_RUNNABLE)
+        next = &idle_task[cpu];
+
+    /* nothing else to run here, keep the current task */
+    if (next == NULL) {
+        if (prev->pcb != NULL && sched_map_video(cpu, prev->pcb))
+            flush_tlb();
         return;
     }
 
-    /* 1. saves ebp/esp of current process
-     *  - process that's on the screen
-     *  - process running in the background */
-    if (terminal[prev_term].active) {
-        asm volatile ("      \n\
-            movl %%esp, %0   \n\
-            movl %%ebp, %1"
-            : "=r" (terminal[prev_term].curr_pcb->esp), "=r" (terminal[prev_term].curr_pcb->ebp)
-        );
+    /* the previous task is requeued by sched_finish once it is saved */
+    prev_task[cpu] = prev;
+    next->on_cpu = 1;
+    next->cpu = cpu;
+    cpus[cpu].curr_task = next;
+    cpus[cpu].term = next->terminal_id;
+
+    pcb = next->pcb;
+    if (pcb != NULL) {
+        /* 1. switches process paging */
+        page_directory[cpu][USER_PAGE] = KERNEL_MEM_END + ((pcb -> page_pid) * _4MB_);
+        page_directory[cpu][USER_PAGE] |= FOUR_MB_PAGE | USER | RW | PRESENT;
+
+        /* 2. sets task state segment */
+        tss[cpu].ss0 = KERNEL_DS;
+        tss[cpu].esp0 = (uint32_t)(KERNEL_MEM_END - (pcb -> pid) * _8KB_ - BYTE_4);
+
+        /* 3. updates running video coordinates, shared memory and framebuffer */
+        sched_map_video(cpu, pcb);
+        shm_map_process(cpu, pcb -> leader);
+        vbe_map_process(cpu, pcb -> leader);
+        flush_tlb();
     }
 
-    /* set the scheduled terminal to next terminal */
-    sched_term = next_term;
+    /* 4. saves the FPU state of a process that may move to another CPU */
+    fpu_switch(prev->pcb, pcb);
 
-    /* execute new shell on terminal switch */
-    if (terminal[next_term].active == 0) {
-        send_eoi(PIT_IRQ);
-        execute((uint8_t *) "shell");
-        return;
+    /* 5. save this kernel context and resume the next one */
+    switch_start[cpu] = rdtsc();
+    switch_to(&prev->context, &next->context);
+
+    /* running again: some later schedule call switched back to us */
+    sched_finish();
+}
+
+/*
+ * sched_task_init
+ *
+ * DESCRIPTION: sets up a task without a process that starts running entry
+ *              on its own kernel stack the first time it is switched to;
+ *              entry must call sched_thread_start first
+ *
+ * Input: task - task to set up
+ *        entry - function the task runs, must never return
+ *        stack - bottom of the task's kernel stack
+ *        size - size of the stack in bytes
+ *        term - terminal the task runs on behalf of
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: none, the task is not queued yet
+ */
+void sched_task_init(task_t* task, void (*entry)(void), uint8_t* stack, uint32_t size, uint8_t term) {
+    task->context.ebp = 0;
+    task->context.esp = (uint32_t) &stack[size - BYTE_4];
+    task->context.eip = (uint32_t) entry;
+    task->context.eflags = CTX_INIT_EFLAGS;
+    task->pcb = NULL;
+    task->terminal_id = term;
+    task->state = TASK_RUNNABLE;
+    task->on_cpu = 0;
+    task->cpu = cpu_id();
+    task->kernel_io = 0;
+    task->next = NULL;
+}
+
+/*
+ * sched_thread_start
+ *
+ * DESCRIPTION: first call of every task set up by sched_task_init. Finishes
+ *              the switch that started the task and turns interrupts on,
+ *              since a fresh stack is not inside the tick that switched here.
+ *
+ * Input: none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: enables interrupts
+ */
+void sched_thread_start(void) {
+    sched_finish();
+    sti();
+}
+
+/*
+ * sched_enqueue
+ *
+ * DESCRIPTION: makes a runnable task that is not running or queued eligible
+ *              to run, on the run queue of the CPU it last ran on
+ *
+ * Input: task - task to queue
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: takes the run queue lock
+ */
+void sched_enqueue(task_t* task) {
+    rq_push(&runqueues[task->cpu], task);
+}
+
+/*
+ * sched_current
+ *
+ * DESCRIPTION: task running on this CPU; only stable with interrupts off,
+ *              since a task may move to another CPU on any tick
+ *
+ * Input: none
+ * Output: none
+ * Return Values: the running task
+ *
+ * SIDE EFFECTS: none
+ */
+task_t* sched_current(void) {
+    return this_cpu()->curr_task;
+}
+
+/*
+ * sched_process
+ *
+ * DESCRIPTION: process of the running task. A thread shares the address
+ *              space and files of its leader, so that is what it gets.
+ *
+ * Input: none
+ * Output: none
+ * Return Values: the leader of the running task's process, NULL for a
+ *                task without a process
+ *
+ * SIDE EFFECTS: none
+ */
+pcb_t* sched_process(void) {
+    uint32_t flags;
+    pcb_t* pcb;
+
+    /* our task keeps its PCB wherever it runs, only the lookup needs the CPU */
+    cli_and_save(flags);
+    pcb = this_cpu()->curr_task->pcb;
+    restore_flags(flags);
+
+    return (pcb == NULL) ? NULL : pcb->leader;
+}
+
+/*
+ * sched_sleep
+ *
+ * DESCRIPTION: blocks the running task until sched_wakeup is called on it.
+ *              The task is marked blocked before lock is dropped, so a
+ *              waker that takes lock to change the awaited condition
+ *              cannot slip its wakeup in unnoticed.
+ *
+ * Input: lock - lock protecting the awaited condition, held by the caller
+ *               with interrupts off; NULL if there is none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: switches to another task, lock is held again on return
+ */
+void sched_sleep(spinlock_t* lock) {
+    task_t* task = sched_current();
+
+    spin_lock(&wake_lock);
+    task->state = TASK_BLOCKED;
+    spin_unlock(&wake_lock);
+
+    if (lock != NULL)
+        spin_unlock(lock);
+
+    /* returns once woken, straight away if the wakeup already came */
+    schedule();
+
+    if (lock != NULL)
+        spin_lock(lock);
+}
+
+/*
+ * sched_wait
+ *
+ * DESCRIPTION: sleeps on a wait queue until a sched_wake_all on it. The
+ *              caller rechecks its condition in a loop, a wakeup only means
+ *              it may have changed.
+ *
+ * Input: queue - queue to wait on, guarded by lock
+ *        lock - lock protecting the awaited condition, held by the caller
+ *               with interrupts off
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: switches to another task, lock is held again on return
+ */
+void sched_wait(wait_queue_t* queue, spinlock_t* lock) {
+    wait_entry_t entry;
+    wait_entry_t** link;
+
+    entry.task = sched_current();
+    entry.next = queue->head;
+    queue->head = &entry;
+
+    sched_sleep(lock);
+
+    /* the sleeper unlinks itself, so wakers never touch a stale entry */
+    for (link = &queue->head; *link != NULL; link = &(*link)->next) {
+        if (*link == &entry) {
+            *link = entry.next;
+            break;
+        }
+    }
+}
+
+/*
+ * sched_wait_timeout
+ *
+ * DESCRIPTION: sleeps on a wait queue until a sched_wake_all on it or
+ *              until ticks PIT ticks have passed, whichever comes first
+ *
+ * Input: queue - queue to wait on, guarded by lock
+ *        lock - lock protecting the awaited condition, held by the caller
+ *               with interrupts off
+ *        ticks - most PIT ticks to sleep
+ * Output: none
+ * Return Values: 0 if the timeout has passed, 1 otherwise
+ *
+ * SIDE EFFECTS: switches to another task, lock is held again on return
+ */
+int32_t sched_wait_timeout(wait_queue_t* queue, spinlock_t* lock, uint32_t ticks) {
+    sched_timer_t timer;
+    sched_timer_t** link;
+
+    timer.deadline = pit_ticks + ticks;
+    timer.task = sched_current();
+
+    spin_lock(&timer_lock);
+    timer.next = timers;
+    timers = &timer;
+    spin_unlock(&timer_lock);
+
+    sched_wait(queue, lock);
+
+    spin_lock(&timer_lock);
+    for (link = &timers; *link != NULL; link = &(*link)->next) {
+        if (*link == &timer) {
+            *link = timer.next;
+            break;
+        }
+    }
+    spin_unlock(&timer_lock);
+
+    return ((int32_t) (pit_ticks - timer.deadline) < 0);
+}
+
+/*
+ * sched_timer_tick
+ *
+ * DESCRIPTION: wakes the tasks whose timeout has passed; each stays on the
+ *              list until it runs and takes itself off
+ *
+ * Input: none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: may queue tasks
+ */
+void sched_timer_tick(void) {
+    sched_timer_t* timer;
+
+    spin_lock(&timer_lock);
+    for (timer = timers; timer != NULL; timer = timer->next) {
+        if ((int32_t) (pit_ticks - timer->deadline) >= 0)
+            sched_wakeup(timer->task);
     }
+    spin_unlock(&timer_lock);
+}
+
+/*
+ * sched_wake_all
+ *
+ * DESCRIPTION: wakes every task sleeping on a wait queue
+ *
+ * Input: queue - queue to wake, its lock held by the caller
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: may queue the woken tasks
+ */
+void sched_wake_all(wait_queue_t* queue) {
+    wait_entry_t* entry;
+
+    for (entry = queue->head; entry != NULL; entry = entry->next)
+        sched_wakeup(entry->task);
+}
+
+/*
+ * sched_wakeup
+ *
+ * DESCRIPTION: makes a blocked task runnable again. A task that is still
+ *              switching away is queued by sched_finish instead, so it is
+ *              never queued while its stack is in use. Safe in interrupt
+ *              handlers.
+ *
+ * Input: task - task to wake, may already be runnable
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: may queue the task on the CPU it last ran on
+ */
+void sched_wakeup(task_t* task) {
+    uint32_t flags, requeue = 0;
 
-    /* 2. switches process paging */
-    page_directory[USER_PAGE] = KERNEL_MEM_END + ((terminal[next_term].curr_pcb -> pid) * _4MB_);
-    page_directory[USER_PAGE] |= FOUR_MB_PAGE | USER | RW | PRESENT;
-    flush_tlb();
-
-    /* 3. sets task state segment */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = (uint32_t)(KERNEL_MEM_END - (terminal[next_term].curr_pcb -> pid) * _8KB_ - BYTE_4);
-
-    /* 4. updates running video coordinates */
-    if (terminal[next_term].curr_pcb -> terminal_id == curr_term) {
-        /* write to screen */
-        user_video_page_table[0] = VIDEO;
-        user_video_page_table[0] |= (USER | RW | PRESENT);
-    } else {
-        /* write to backup */
-        user_video_page_table[0] = VIDEO + ((terminal[next_term].curr_pcb -> terminal_id + 1) * PAGE_SIZE);
-        user_video_page_table[0] |= (USER | RW | PRESENT);
+    spin_lock_irqsave(&wake_lock, flags);
+    if (task->state == TASK_BLOCKED) {
+        task->state = TASK_RUNNABLE;
+        requeue = !task->on_cpu;
     }
-    flush_tlb();
-
-    /* 5. restore EBP and ESP of next process */
-    asm volatile ("         \n\
-        movl %0, %%esp      \n\
-        movl %1, %%ebp"
-        : 
-        : "r" (terminal[next_term].curr_pcb->esp), "r" (terminal[next_term].curr_pcb->ebp)
-    );
+    spin_unlock_irqrestore(&wake_lock, flags);
+
+    if (requeue)
+        sched_enqueue(task);
+}
+
+/*
+ * sched_kick
+ *
+ * DESCRIPTION: called at the end of an interrupt handler that woke a task,
+ *              so an idle CPU runs it now instead of on the next tick
+ *
+ * Input: none
+ * Output: none
+ * Return Values: none
+ *
+ * SIDE EFFECTS: may switch to another task
+ */
+void sched_kick(void) {
+    uint32_t cpu = cpu_id();
+
+    if (cpus[cpu].curr_task == &idle_task[cpu])
+        schedule();
+}
+
+/*
+ * sched_exit
+ *
+ * DESCRIPTION: ends the running task. It is never queued again, whoever
+ *              reuses its stack must wait until task_t.on_cpu drops to 0.
+ *              Must be called with interrupts off.
+ *
+ * Input: none
+ * Output: none
+ * Return Values: never returns
+ *
+ * SIDE EFFECTS: switches to another task
+ */
+void sched_exit(void) {
+    task_t* task = sched_current();
+
+    spin_lock(&wake_lock);
+    task->state = TASK_DEAD;
+    spin_unlock(&wake_lock);
+
+    schedule();
+
+    /* not reached, a dead task is never switched back to */
+    while (1);
 }
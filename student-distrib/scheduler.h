@@ -6,11 +6,107 @@
 #define _SCHEDULER_H
 
 #include "types.h"
+#include "spinlock.h"
+
+/* Cost of switch_to in TSC cycles, measured from the switching context
+ * until the resumed context starts running again */
+typedef struct sched_stats {
+    uint32_t switches;          /* number of measured context switches */
+    uint32_t last_cycles;       /* cycles taken by the most recent switch */
+    uint32_t min_cycles;        /* fastest switch seen */
+    uint32_t max_cycles;        /* slowest switch seen */
+    uint64_t total_cycles;      /* sum over all measured switches */
+} sched_stats_t;
+
+/* Per-CPU switch costs, indexed by CPU */
+extern sched_stats_t sched_stats[MAX_CPUS];
+
+/* FIFO of tasks waiting for one CPU; the running task is not on it */
+typedef struct runqueue {
+    spinlock_t lock;
+    task_t* head;
+    task_t* tail;
+    uint32_t len;
+} runqueue_t;
+
+/* A task sleeping in sched_wait, lives on the sleeper's stack */
+typedef struct wait_entry {
+    task_t* task;
+    struct wait_entry* next;
+} wait_entry_t;
+
+/* Tasks waiting for a condition guarded by the owner's lock */
+typedef struct wait_queue {
+    wait_entry_t* head;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT     { NULL }
+
+/* A task sleeping until a PIT tick, lives on the sleeper's stack */
+typedef struct sched_timer {
+    uint32_t deadline;          /* pit_ticks value to wake at */
+    task_t* task;
+    struct sched_timer* next;
+} sched_timer_t;
 
 /* Switches between current terminal and terminal given */
 void terminal_switch (uint8_t new_terminal_id);
 
-/* schedules between one process to the next */
-void scheduler(uint8_t prev_term, uint8_t new_terminal);
+/* Sets up the run queues and makes every CPU's boot flow its idle task */
+void sched_init(void);
+
+/* Queues a task that starts the first shell of every terminal */
+void sched_launch_terminals(void);
+
+/* Scheduler tick: switches this CPU to the next task in its run queue */
+void schedule(void);
+
+/* Sets up a task without a process that runs entry on the given stack */
+void sched_task_init(task_t* task, void (*entry)(void), uint8_t* stack, uint32_t size, uint8_t term);
+
+/* First call of a task set up by sched_task_init */
+void sched_thread_start(void);
+
+/* Queues a runnable task on the CPU it last ran on */
+void sched_enqueue(task_t* task);
+
+/* Task running on this CPU */
+task_t* sched_current(void);
+
+/* Process whose address space and files the running task uses */
+pcb_t* sched_process(void);
+
+/* Blocks the running task until woken, dropping lock while asleep */
+void sched_sleep(spinlock_t* lock);
+
+/* Sleeps on a wait queue until sched_wake_all, dropping lock while asleep */
+void sched_wait(wait_queue_t* queue, spinlock_t* lock);
+
+/* Like sched_wait, but gives up after ticks PIT ticks; 0 if it timed out */
+int32_t sched_wait_timeout(wait_queue_t* queue, spinlock_t* lock, uint32_t ticks);
+
+/* Wakes every task on a wait queue, caller holds the queue's lock */
+void sched_wake_all(wait_queue_t* queue);
+
+/* Wakes tasks whose timeout has passed, called on every PIT tick */
+void sched_timer_tick(void);
+
+/* Makes a blocked task runnable again */
+void sched_wakeup(task_t* task);
+
+/* Ends the running task for good */
+void sched_exit(void);
+
+/* Reschedules right away if this CPU is idle */
+void sched_kick(void);
+
+/* Points this CPU's vidmap page at what the process draws on; 1 if it changed */
+int32_t sched_map_video(uint32_t cpu, pcb_t* pcb);
+
+/* CPUs running a process that draws on a terminal's screen, a bit each */
+uint32_t sched_term_cpus(uint8_t term);
+
+/* Makes the CPUs running a terminal's processes map its screen again */
+void sched_remap_video(uint8_t term);
 
 #endif /* ensure .h file only read once */
@@ -0,0 +1,393 @@
+/* serial.c - interrupt driven 16550 UART driver for COM1
+ * vim:ts=4 noexpandtab
+ */
+
+#include "serial.h"
+#include "scheduler.h"
+#include "systemcalls.h"
+#include "lib.h"
+#include "poll.h"
+
+/* Interrupt enable register bits */
+#define IER_RX_DATA         0x01    /* received data available */
+#define IER_TX_EMPTY        0x02    /* transmit holding register empty */
+
+/* Interrupt identification register, bit 0 clear while one is pending */
+#define IIR_NONE            0x01
+#define IIR_ID_MASK         0x0E
+#define IIR_TX_EMPTY        0x02
+#define IIR_RX_DATA         0x04
+#define IIR_LINE_STATUS     0x06
+#define IIR_RX_TIMEOUT      0x0C
+
+/* Line and modem control values */
+#define LCR_DLAB            0x80    /* divisor latch access */
+#define LCR_8N1             0x03    /* 8 data bits, no parity, 1 stop bit */
+#define FCR_ENABLE_CLEAR    0xC7    /* enable and clear both FIFOs, receive interrupt at 14 bytes */
+#define MCR_LOOPBACK        0x1E    /* loopback with RTS, OUT1 and OUT2 */
+#define MCR_ONLINE          0x0B    /* DTR, RTS and OUT2, which gates the IRQ line */
+#define LSR_DATA_READY      0x01
+
+/* 115200 baud */
+#define BAUD_DIVISOR        1
+
+/* Byte sent to itself in loopback to see if the port is there */
+#define LOOPBACK_BYTE       0xAE
+
+/* Both rings are protected by serial_lock, also taken by the interrupt */
+static spinlock_t serial_lock = SPINLOCK_INIT("serial");
+
+static uint8_t tx_buf[SERIAL_TX_SIZE];
+static uint32_t tx_head = 0;            /* index of the oldest unsent byte */
+static uint32_t tx_count = 0;           /* bytes waiting to be sent */
+static uint32_t tx_busy = 0;            /* the FIFO is being drained, a transmit interrupt will follow */
+static wait_queue_t tx_waiters;         /* writers waiting for room */
+
+static uint8_t rx_buf[SERIAL_RX_SIZE];
+static uint32_t rx_head = 0;
+static uint32_t rx_count = 0;
+static wait_queue_t rx_waiters;         /* readers waiting for data */
+
+/* The port answered the loopback check */
+static uint32_t serial_present = 0;
+
+volatile uint32_t serial_console = 0;
+volatile uint32_t serial_dropped = 0;
+
+/*
+ * tx_fill
+ *
+ * DESCRIPTION: loads the empty transmit FIFO from the ring. The FIFO is
+ *              only loaded when it is known to be empty, at start or on a
+ *              transmit interrupt, so the line status is never polled.
+ *              Caller holds serial_lock.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: turns the transmit interrupt on while there is data and
+ *               off once the ring is empty, wakes writers
+ */
+static void tx_fill(void) {
+    uint32_t i;
+
+    if (tx_count == 0) {
+        outb(IER_RX_DATA, COM1_PORT + UART_IER);
+        tx_busy = 0;
+        return;
+    }
+
+    for (i = 0; i < UART_FIFO_SIZE && tx_count != 0; i++) {
+        outb(tx_buf[tx_head], COM1_PORT + UART_DATA);
+        tx_head = (tx_head + 1) % SERIAL_TX_SIZE;
+        tx_count--;
+    }
+
+    if (!tx_busy) {
+        outb(IER_RX_DATA | IER_TX_EMPTY, COM1_PORT + UART_IER);
+        tx_busy = 1;
+    }
+
+    sched_wake_all(&tx_waiters);
+    poll_notify();
+}
+
+/*
+ * tx_queue
+ *
+ * DESCRIPTION: copies as much of buf as fits into the transmit ring, in at
+ *              most two block copies, and starts the FIFO if it is idle.
+ *              Caller holds serial_lock.
+ *
+ * Inputs: buf - bytes to send
+ *         nbytes - number of bytes
+ * Outputs: none
+ * Return values: bytes queued
+ *
+ * SIDE EFFECTS: may start transmitting
+ */
+static uint32_t tx_queue(const uint8_t* buf, uint32_t nbytes) {
+    uint32_t n, tail, chunk;
+
+    n = SERIAL_TX_SIZE - tx_count;
+    if (n > nbytes)
+        n = nbytes;
+
+    tail = (tx_head + tx_count) % SERIAL_TX_SIZE;
+    chunk = SERIAL_TX_SIZE - tail;
+    if (chunk > n)
+        chunk = n;
+    memcpy(tx_buf + tail, buf, chunk);
+    memcpy(tx_buf, buf + chunk, n - chunk);
+    tx_count += n;
+
+    if (!tx_busy)
+        tx_fill();
+    return n;
+}
+
+/*
+ * rx_drain
+ *
+ * DESCRIPTION: moves everything in the receive FIFO into the ring, bytes
+ *              that do not fit are lost. Caller holds serial_lock.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: wakes readers
+ */
+static void rx_drain(void) {
+    uint8_t c;
+
+    while (inb(COM1_PORT + UART_LSR) & LSR_DATA_READY) {
+        c = inb(COM1_PORT + UART_DATA);
+        if (rx_count < SERIAL_RX_SIZE) {
+            rx_buf[(rx_head + rx_count) % SERIAL_RX_SIZE] = c;
+            rx_count++;
+        }
+    }
+
+    sched_wake_all(&rx_waiters);
+    poll_notify();
+}
+
+/*
+ * serial_init
+ *
+ * DESCRIPTION: programs COM1 for 115200 8N1 with its FIFOs on and checks
+ *              it is there by sending a byte to itself in loopback
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: enables IRQ 4 if the port is present
+ */
+void serial_init(void) {
+    outb(0, COM1_PORT + UART_IER);
+
+    outb(LCR_DLAB, COM1_PORT + UART_LCR);
+    outb(BAUD_DIVISOR & 0xFF, COM1_PORT + UART_DATA);
+    outb((BAUD_DIVISOR >> 8) & 0xFF, COM1_PORT + UART_IER);
+    outb(LCR_8N1, COM1_PORT + UART_LCR);
+
+    /* a missing port reads back 0xFF */
+    outb(FCR_ENABLE_CLEAR, COM1_PORT + UART_FCR);
+    outb(MCR_LOOPBACK, COM1_PORT + UART_MCR);
+    outb(LOOPBACK_BYTE, COM1_PORT + UART_DATA);
+    if (inb(COM1_PORT + UART_DATA) != LOOPBACK_BYTE) {
+        outb(0, COM1_PORT + UART_MCR);
+        return;
+    }
+
+    outb(FCR_ENABLE_CLEAR, COM1_PORT + UART_FCR);
+    outb(MCR_ONLINE, COM1_PORT + UART_MCR);
+    outb(IER_RX_DATA, COM1_PORT + UART_IER);
+    serial_present = 1;
+
+    enable_irq(SERIAL_IRQ);
+}
+
+/*
+ * serial_intr_handler
+ *
+ * DESCRIPTION: handles every interrupt the UART has pending: refills the
+ *              transmit FIFO, drains the receive FIFO, and clears line and
+ *              modem status changes
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: wakes readers and writers
+ */
+void serial_intr_handler(void) {
+    uint8_t iir;
+
+    /* send EOI signal to PIC */
+    send_eoi(SERIAL_IRQ);
+
+    spin_lock(&serial_lock); // interrupts are already off in the handler
+    while (!((iir = inb(COM1_PORT + UART_IIR)) & IIR_NONE)) {
+        switch (iir & IIR_ID_MASK) {
+            case IIR_TX_EMPTY:
+                tx_fill();
+                break;
+            case IIR_RX_DATA:
+            case IIR_RX_TIMEOUT:
+                rx_drain();
+                break;
+            case IIR_LINE_STATUS:
+                (void) inb(COM1_PORT + UART_LSR);
+                break;
+            default:
+                (void) inb(COM1_PORT + UART_MSR);
+                break;
+        }
+    }
+    spin_unlock(&serial_lock);
+}
+
+/*
+ * serial_mirror
+ *
+ * DESCRIPTION: copies console output to the port if serial_console is
+ *              set. Newlines become CR LF for the terminal on the other
+ *              end. Never blocks, the kernel prints from anywhere.
+ *
+ * Inputs: buf - characters printed
+ *         n - number of characters
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: counts what did not fit in serial_dropped
+ */
+void serial_mirror(const int8_t* buf, int32_t n) {
+    static const uint8_t crlf[2] = {'\r', '\n'};
+    uint32_t flags, line;
+    int32_t i, start = 0;
+
+    if (!serial_console || !serial_present)
+        return;
+
+    spin_lock_irqsave(&serial_lock, flags);
+    for (i = 0; i <= n; i++) {
+        if (i < n && buf[i] != '\n' && buf[i] != '\0')
+            continue;
+
+        /* the run before the newline, then the newline itself; NULs are
+         * skipped like the screen does */
+        line = i - start;
+        serial_dropped += line - tx_queue((const uint8_t*) buf + start, line);
+        if (i < n && buf[i] == '\n' && tx_queue(crlf, 2) != 2)
+            serial_dropped++;
+        start = i + 1;
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+ * serial_open
+ *
+ * DESCRIPTION: open for "serial"
+ *
+ * Inputs: filename - name opened
+ * Outputs: none
+ * Return values: 0, -1 if there is no serial port
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t serial_open(const uint8_t* filename) {
+    return serial_present ? 0 : -1;
+}
+
+/*
+ * serial_read
+ *
+ * DESCRIPTION: reads what has been received, up to nbytes
+ *
+ * Inputs: fd - file descriptor of the port
+ *         buf - destination
+ *         nbytes - most bytes to read
+ * Outputs: buf - bytes read
+ * Return values: bytes read, -1 on a bad buffer
+ *
+ * SIDE EFFECTS: blocks until at least one byte has arrived
+ */
+int32_t serial_read(int32_t fd, void* buf, int32_t nbytes) {
+    uint32_t flags, n, chunk;
+
+    if (buf == NULL || nbytes < 0 || !user_range(buf, nbytes))
+        return -1;
+    if (nbytes == 0)
+        return 0;
+
+    spin_lock_irqsave(&serial_lock, flags);
+    while (rx_count == 0)
+        sched_wait(&rx_waiters, &serial_lock);
+
+    n = ((uint32_t) nbytes < rx_count) ? (uint32_t) nbytes : rx_count;
+    chunk = SERIAL_RX_SIZE - rx_head;
+    if (chunk > n)
+        chunk = n;
+    memcpy(buf, rx_buf + rx_head, chunk);
+    memcpy((uint8_t*) buf + chunk, rx_buf, n - chunk);
+
+    rx_head = (rx_head + n) % SERIAL_RX_SIZE;
+    rx_count -= n;
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return n;
+}
+
+/*
+ * serial_write
+ *
+ * DESCRIPTION: queues all of buf for the port, blocking for room when the
+ *              transmit ring is full
+ *
+ * Inputs: fd - file descriptor of the port
+ *         buf - bytes to send, as they are
+ *         nbytes - number of bytes
+ * Outputs: none
+ * Return values: nbytes, -1 on a bad buffer
+ *
+ * SIDE EFFECTS: may block while earlier output drains
+ */
+int32_t serial_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+    int32_t written = 0;
+
+    if (buf == NULL || nbytes < 0 || !user_range(buf, nbytes))
+        return -1;
+
+    spin_lock_irqsave(&serial_lock, flags);
+    while (written < nbytes) {
+        while (tx_count == SERIAL_TX_SIZE)
+            sched_wait(&tx_waiters, &serial_lock);
+        written += tx_queue((const uint8_t*) buf + written, nbytes - written);
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return written;
+}
+
+/*
+ * serial_close
+ *
+ * DESCRIPTION: close for "serial", output still queued is sent anyway
+ *
+ * Inputs: fd - file descriptor of the port
+ * Outputs: none
+ * Return values: 0
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t serial_close(int32_t fd) {
+    return 0;
+}
+
+/*
+ * serial_poll
+ *
+ * DESCRIPTION: poll for "serial"
+ *
+ * Inputs: fd - file descriptor of the port
+ * Outputs: none
+ * Return values: POLLIN if bytes have arrived, POLLOUT if there is room
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t serial_poll(int32_t fd) {
+    uint32_t flags;
+    int32_t ready = 0;
+
+    spin_lock_irqsave(&serial_lock, flags);
+    if (rx_count != 0)
+        ready |= POLLIN;
+    if (tx_count != SERIAL_TX_SIZE)
+        ready |= POLLOUT;
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return ready;
+}
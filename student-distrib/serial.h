@@ -0,0 +1,58 @@
+/* serial.h - interrupt driven 16550 UART driver for COM1
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "types.h"
+#include "i8259.h"
+#include "serial_handler.h"
+
+/* COM1 I/O ports and IRQ line on the PIC */
+#define COM1_PORT           0x3F8
+#define SERIAL_IRQ          4
+
+/* 16550 registers, offsets from the base port */
+#define UART_DATA           0       /* receive buffer / transmit holding, divisor low with DLAB */
+#define UART_IER            1       /* interrupt enable, divisor high with DLAB */
+#define UART_IIR            2       /* interrupt identification on read */
+#define UART_FCR            2       /* FIFO control on write */
+#define UART_LCR            3       /* line control */
+#define UART_MCR            4       /* modem control */
+#define UART_LSR            5       /* line status */
+#define UART_MSR            6       /* modem status */
+
+/* Bytes the transmit FIFO takes once the holding register is empty */
+#define UART_FIFO_SIZE      16
+
+/* Bytes buffered on the way out and on the way in */
+#define SERIAL_TX_SIZE      KBYTE_4
+#define SERIAL_RX_SIZE      256
+
+/* Name open() takes for the serial port, it has no file system entry */
+#define SERIAL_NAME         "serial"
+
+/* Kernel console output is copied to the port while this is set */
+extern volatile uint32_t serial_console;
+
+/* Bytes of console output dropped because the transmit buffer was full */
+extern volatile uint32_t serial_dropped;
+
+/* Sets up COM1 at 115200 8N1 with FIFOs and enables its IRQ */
+void serial_init(void);
+
+/* COM1 interrupt handler */
+void serial_intr_handler(void);
+
+/* Queues console output for the port without blocking, dropping what does not fit */
+void serial_mirror(const int8_t* buf, int32_t n);
+
+/* fops for fds opened on "serial" */
+int32_t serial_open(const uint8_t* filename);
+int32_t serial_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t serial_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t serial_close(int32_t fd);
+int32_t serial_poll(int32_t fd);
+
+#endif /* _SERIAL_H */
@@ -0,0 +1,11 @@
+#ifndef SERIAL_HANDLER
+#define SERIAL_HANDLER
+
+#ifndef ASM
+
+/* COM1 interrupt handler wrapper */
+extern void serial_handler();
+
+#endif /* ASM */
+
+#endif /* SERIAL_HANDLER */
@@ -0,0 +1,168 @@
+/* shm.c - shared memory segments mapped into several processes
+ * vim:ts=4 noexpandtab
+ */
+
+#include "shm.h"
+#include "systemcalls.h"
+#include "scheduler.h"
+#include "lib.h"
+
+/* A segment is in use while some process holds it */
+typedef struct shm_seg {
+    uint32_t key;               /* name processes find the segment by */
+    uint32_t refs;              /* processes holding the segment */
+} shm_seg_t;
+
+static shm_seg_t shm_segs[SHM_COUNT];
+static spinlock_t shm_lock = SPINLOCK_INIT("shm");
+
+/* Frames of the segments, in the identity mapped kernel page */
+static uint8_t shm_frames[SHM_COUNT][SHM_SEG_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+/*
+ * shm_hold
+ *
+ * DESCRIPTION: records that the calling process holds a segment and maps
+ *              it on this CPU. Other CPUs running the process's threads
+ *              pick the mapping up on their next switch to it.
+ *
+ * Inputs: process - calling process
+ *         id - segment to hold, shm_lock held
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: modifies this CPU's vidmap page table
+ */
+static void shm_hold(pcb_t* process, int32_t id) {
+    if (!(process -> shm_mask & (1 << id))) {
+        process -> shm_mask |= (1 << id);
+        shm_segs[id].refs++;
+    }
+    shm_map_process(cpu_id(), process);
+    flush_tlb();
+}
+
+/*
+ * shm_create
+ *
+ * DESCRIPTION: finds the segment named key, or creates a zeroed one, and
+ *              maps it into the calling process at SHM_ADDR(id)
+ *
+ * Inputs: key - name of the segment, shared by the processes using it
+ * Outputs: none
+ * Return values: segment id, -1 if every segment is in use
+ *
+ * SIDE EFFECTS: the process holds the segment until it halts
+ */
+int32_t shm_create(uint32_t key) {
+    uint32_t flags;
+    int32_t id, free_id = -1;
+    pcb_t* process = sched_process();
+
+    spin_lock_irqsave(&shm_lock, flags);
+    for (id = 0; id < SHM_COUNT; id++) {
+        if (shm_segs[id].refs == 0) {
+            if (free_id == -1)
+                free_id = id;
+        } else if (shm_segs[id].key == key) {
+            shm_hold(process, id);
+            spin_unlock_irqrestore(&shm_lock, flags);
+            return id;
+        }
+    }
+
+    if (free_id != -1) {
+        shm_segs[free_id].key = key;
+        memset(shm_frames[free_id], 0, SHM_SEG_SIZE);
+        shm_hold(process, free_id);
+    }
+    spin_unlock_irqrestore(&shm_lock, flags);
+    return free_id;
+}
+
+/*
+ * shm_map
+ *
+ * DESCRIPTION: maps an existing segment into the calling process
+ *
+ * Inputs: id - segment returned by shm_create
+ *         addr - user pointer that receives the segment's address
+ * Outputs: *addr - where the segment is mapped
+ * Return values: 0 on success, -1 on a bad id or pointer
+ *
+ * SIDE EFFECTS: the process holds the segment until it halts
+ */
+int32_t shm_map(int32_t id, uint8_t** addr) {
+    uint32_t flags;
+
+    if (id < 0 || id >= SHM_COUNT)
+        return -1;
+    /* the whole pointer should fall in the user-level page */
+    if (!user_range(addr, sizeof(*addr)))
+        return -1;
+
+    spin_lock_irqsave(&shm_lock, flags);
+    if (shm_segs[id].refs == 0) {
+        spin_unlock_irqrestore(&shm_lock, flags);
+        return -1;
+    }
+    shm_hold(sched_process(), id);
+    spin_unlock_irqrestore(&shm_lock, flags);
+
+    *addr = (uint8_t*) SHM_ADDR(id);
+    return 0;
+}
+
+/*
+ * shm_release
+ *
+ * DESCRIPTION: drops the segments a halting process holds, a segment is
+ *              free once no process holds it
+ *
+ * Inputs: process - halting process
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: the caller remaps the CPU for the process that runs next
+ */
+void shm_release(pcb_t* process) {
+    uint32_t flags;
+    int32_t id;
+
+    spin_lock_irqsave(&shm_lock, flags);
+    for (id = 0; id < SHM_COUNT; id++) {
+        if (process -> shm_mask & (1 << id))
+            shm_segs[id].refs--;
+    }
+    process -> shm_mask = 0;
+    spin_unlock_irqrestore(&shm_lock, flags);
+}
+
+/*
+ * shm_map_process
+ *
+ * DESCRIPTION: maps the segments a process holds and unmaps the rest in
+ *              a CPU's vidmap page table, the same table vidmap points at
+ *              the screen. Called on every switch to a process.
+ *
+ * Inputs: cpu - CPU whose tables to change
+ *         process - process about to run there
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: caller flushes the TLB
+ */
+void shm_map_process(uint32_t cpu, pcb_t* process) {
+    int32_t id, page;
+    uint32_t* entry;
+
+    for (id = 0; id < SHM_COUNT; id++) {
+        entry = &user_video_page_table[cpu][SHM_FIRST_ENTRY + id * SHM_SEG_PAGES];
+        for (page = 0; page < SHM_SEG_PAGES; page++) {
+            if (process -> shm_mask & (1 << id))
+                entry[page] = (uint32_t) &shm_frames[id][page * PAGE_SIZE] | USER | RW | PRESENT;
+            else
+                entry[page] = RW & ~PRESENT;
+        }
+    }
+}
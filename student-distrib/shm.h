@@ -0,0 +1,35 @@
+/* shm.h - shared memory segments mapped into several processes
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "paging.h"
+
+/* Number of segments and the size of each */
+#define SHM_COUNT           8
+#define SHM_SEG_PAGES       4
+#define SHM_SEG_SIZE        (SHM_SEG_PAGES * PAGE_SIZE)
+
+/* Segments live in the vidmap page table, after the video pages */
+#define SHM_FIRST_ENTRY     16
+
+/* User address segment id is mapped at in every process holding it */
+#define SHM_ADDR(id)        ((USER_VID_MEM_PAGE << PAGE_BASE_ADDR_OFFSET) + \
+                             (SHM_FIRST_ENTRY + (id) * SHM_SEG_PAGES) * PAGE_SIZE)
+
+/* Finds or creates the segment named key and maps it into the caller */
+int32_t shm_create(uint32_t key);
+
+/* Maps an existing segment into the caller and returns its address */
+int32_t shm_map(int32_t id, uint8_t** addr);
+
+/* Drops every segment a halting process holds */
+void shm_release(pcb_t* process);
+
+/* Points a CPU's segment pages at the segments a process holds */
+void shm_map_process(uint32_t cpu, pcb_t* process);
+
+#endif /* _SHM_H */
@@ -0,0 +1,163 @@
+/* smp.c - starts the application processors
+ * vim:ts=4 noexpandtab
+ */
+
+#include "smp.h"
+#include "lapic.h"
+#include "x86_desc.h"
+#include "paging.h"
+#include "pit.h"
+#include "fpu.h"
+#include "sysenter.h"
+#include "scheduler.h"
+#include "lib.h"
+
+/* Boot and idle stacks of the APs, indexed by CPU (CPU 0 uses the boot stack) */
+uint8_t ap_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+/* Next CPU index handed out by ap_boot.S, CPU 0 is the boot CPU */
+volatile uint32_t ap_next_id = 1;
+
+/* Number of CPUs online, including the boot CPU */
+volatile uint32_t smp_cpu_count = 1;
+
+/*
+ * smp_init
+ *
+ * DESCRIPTION: brings up the application processors with the INIT-SIPI-SIPI
+ *              sequence. The startup IPIs are broadcast, each AP claims its
+ *              own CPU index in ap_boot.S, so no MP/ACPI table is needed.
+ *              Must run with interrupts on, the delays count PIT ticks.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: other CPUs start running the scheduler's idle loop
+ */
+void smp_init(void) {
+    uint32_t i, count;
+    uint32_t trampoline_page = AP_TRAMPOLINE_ADDR >> PAGE_TABLE_OFFSET;
+
+    cpus[0].id = 0;
+    cpus[0].online = 1;
+
+    /* stay uniprocessor if there is no local APIC to send IPIs with */
+    if (lapic_detect() == -1)
+        return;
+    lapic_enable();
+    cpus[0].apic_id = lapic_id();
+
+    /* temporarily map the trampoline page and copy the real-mode code in */
+    page_table[trampoline_page] |= PRESENT;
+    flush_tlb();
+    memcpy((void*) AP_TRAMPOLINE_ADDR, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    memcpy((void*) (AP_TRAMPOLINE_ADDR + (ap_gdt_desc - ap_trampoline)), gdt_desc_ptr, GDT_DESC_SIZE);
+
+    /* INIT, then two startup IPIs as the MP specification asks */
+    lapic_send_ipi(0, ICR_ALL_BUT_SELF | ICR_INIT | ICR_ASSERT);
+    pit_sleep(SMP_INIT_TICKS);
+    for (i = 0; i < 2; i++) {
+        lapic_send_ipi(0, ICR_ALL_BUT_SELF | ICR_STARTUP | AP_STARTUP_VECTOR);
+        pit_sleep(SMP_SIPI_TICKS);
+    }
+
+    /* give the APs time to reach ap_main */
+    pit_sleep(SMP_BOOT_TICKS);
+
+    page_table[trampoline_page] &= ~PRESENT;
+    flush_tlb();
+
+    count = 0;
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (cpus[i].online)
+            count++;
+    }
+    smp_cpu_count = count;
+
+    printf("SMP: %d CPUs online\n", count);
+}
+
+/*
+ * ap_main
+ *
+ * DESCRIPTION: finishes bringing up an AP: turns on paging with its own page
+ *              directory, loads its TSS, enables its local APIC and FPU and
+ *              drops into its idle task
+ *
+ * Inputs: id - CPU index claimed in ap_boot.S
+ * Outputs: none
+ * Return values: never returns
+ *
+ * SIDE EFFECTS: CPU id starts taking scheduler ticks
+ */
+void ap_main(uint32_t id) {
+    enable_paging(page_directory[id]);
+    paging_init_cpu();
+
+    ltr(CPU_TSS_SEL(id));
+    lldt(KERNEL_LDT);
+
+    lapic_enable();
+    fpu_init_cpu();
+    sysenter_init_cpu(id);
+
+    cpus[id].id = id;
+    cpus[id].apic_id = lapic_id();
+    cpus[id].online = 1;
+
+    /* this stack is now CPU id's idle task */
+    sti();
+    while (1)
+        asm volatile ("hlt");
+}
+
+/*
+ * smp_resched_others
+ *
+ * DESCRIPTION: the PIT only interrupts CPU 0, which passes every tick on to
+ *              the other CPUs so each runs its own scheduler
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: sends an IPI to all other CPUs
+ */
+void smp_resched_others(void) {
+    if (smp_cpu_count > 1)
+        lapic_send_ipi(0, ICR_ALL_BUT_SELF | ICR_FIXED | RESCHED_VECTOR);
+}
+
+/*
+ * smp_resched_cpu
+ *
+ * DESCRIPTION: makes another CPU run its scheduler now, which maps the
+ *              pages of the task it picks again
+ *
+ * Inputs: cpu - index of an online CPU other than this one
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: sends an IPI to the CPU
+ */
+void smp_resched_cpu(uint32_t cpu) {
+    lapic_send_ipi(cpus[cpu].apic_id, ICR_FIXED | RESCHED_VECTOR);
+}
+
+/*
+ * resched_intr_handler
+ *
+ * DESCRIPTION: scheduler tick forwarded by CPU 0
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: may switch to another task
+ */
+void resched_intr_handler(void) {
+    /* acknowledge before the scheduler switches away from this stack */
+    lapic_eoi();
+    schedule();
+}
@@ -0,0 +1,34 @@
+/* smp.h - starts the application processors
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "types.h"
+#include "ap_boot.h"
+
+/* PIT ticks (10ms each) to wait between the INIT and startup IPIs and after */
+#define SMP_INIT_TICKS      2
+#define SMP_SIPI_TICKS      2
+#define SMP_BOOT_TICKS      10
+
+/* Number of CPUs online, including the boot CPU */
+extern volatile uint32_t smp_cpu_count;
+
+/* Boots every AP the machine has, up to MAX_CPUS */
+void smp_init(void);
+
+/* C entry point of an AP, called by ap_boot.S */
+void ap_main(uint32_t id);
+
+/* Forwards the scheduler tick to every other CPU */
+void smp_resched_others(void);
+
+/* Sends the scheduler tick to one other CPU */
+void smp_resched_cpu(uint32_t cpu);
+
+/* Scheduler tick on the APs */
+void resched_intr_handler(void);
+
+#endif /* _SMP_H */
@@ -0,0 +1,168 @@
+/* spinlock.c - ticket spinlocks with contention statistics
+ * vim:ts=4 noexpandtab
+ */
+
+#include "spinlock.h"
+#include "lib.h"
+
+/*
+ * spin_lock_init
+ *
+ * DESCRIPTION: sets up an unlocked lock with cleared counters
+ *
+ * Inputs: lock - lock to set up
+ *         name - name shown by spin_lock_report
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void spin_lock_init(spinlock_t* lock, const char* name) {
+    lock->tickets = 0;
+    lock->name = name;
+    lock->acquired = 0;
+    lock->contended = 0;
+    lock->wait_cycles = 0;
+    lock->hold_cycles = 0;
+    lock->max_hold_cycles = 0;
+    lock->hold_start = 0;
+}
+
+/*
+ * spin_lock
+ *
+ * DESCRIPTION: takes a ticket and spins until it is served, so CPUs get the
+ *              lock in the order they asked for it
+ *
+ * Inputs: lock - lock to acquire
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: updates the lock's counters
+ */
+void spin_lock(spinlock_t* lock) {
+    uint32_t old = TICKET_INC;
+    uint16_t ticket;
+    uint64_t start;
+
+    asm volatile ("lock xaddl %0, %1"
+            : "+r"(old), "+m"(lock->tickets)
+            :
+            : "memory", "cc"
+    );
+    ticket = old >> TICKET_SHIFT;
+
+    if ((old & TICKET_MASK) != ticket) {
+        /* wait on a plain read so the cache line is not bounced by writes */
+        start = rdtsc();
+        while ((lock->tickets & TICKET_MASK) != ticket)
+            asm volatile ("pause");
+
+        lock->contended++;
+        lock->wait_cycles += rdtsc() - start;
+    }
+
+    lock->acquired++;
+    lock->hold_start = rdtsc();
+}
+
+/*
+ * spin_trylock
+ *
+ * DESCRIPTION: acquires the lock only if nobody holds or waits for it
+ *
+ * Inputs: lock - lock to acquire
+ * Outputs: none
+ * Return values: 1 if the lock was acquired, 0 otherwise
+ *
+ * SIDE EFFECTS: updates the lock's counters on success
+ */
+int32_t spin_trylock(spinlock_t* lock) {
+    uint32_t old = lock->tickets;
+    uint32_t prev;
+
+    /* free means the ticket being served is the next one handed out */
+    if ((old & TICKET_MASK) != (old >> TICKET_SHIFT))
+        return 0;
+
+    asm volatile ("lock cmpxchgl %2, %1"
+            : "=a"(prev), "+m"(lock->tickets)
+            : "r"(old + TICKET_INC), "0"(old)
+            : "memory", "cc"
+    );
+    if (prev != old)
+        return 0;
+
+    lock->acquired++;
+    lock->hold_start = rdtsc();
+    return 1;
+}
+
+/*
+ * spin_unlock
+ *
+ * DESCRIPTION: records how long the lock was held and serves the next ticket
+ *
+ * Inputs: lock - lock held by this CPU
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: updates the lock's counters
+ */
+void spin_unlock(spinlock_t* lock) {
+    uint32_t held = (uint32_t) (rdtsc() - lock->hold_start);
+
+    lock->hold_cycles += held;
+    if (held > lock->max_hold_cycles)
+        lock->max_hold_cycles = held;
+
+    /* only the holder writes the low half, waiters only add to the high half */
+    asm volatile ("incw %0"
+            : "+m"(*(volatile uint16_t*) &lock->tickets)
+            :
+            : "memory", "cc"
+    );
+}
+
+/*
+ * spin_avg_cycles
+ *
+ * DESCRIPTION: average of a 64-bit cycle total without 64-bit division,
+ *              which the kernel has no runtime support for
+ *
+ * Inputs: total - sum of cycles
+ *         count - number of samples
+ * Outputs: none
+ * Return values: total / count, 0 without samples
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t spin_avg_cycles(uint64_t total, uint32_t count) {
+    /* scale both down until the total fits in 32 bits */
+    while ((total >> 32) != 0) {
+        total >>= 1;
+        count >>= 1;
+    }
+    return (count == 0) ? 0 : (uint32_t) total / count;
+}
+
+/*
+ * spin_lock_report
+ *
+ * DESCRIPTION: prints how often a lock was taken, how often it was contended
+ *              and its average and longest hold time
+ *
+ * Inputs: lock - lock to report on
+ * Outputs: prints to the screen
+ * Return values: none
+ *
+ * SIDE EFFECTS: none
+ */
+void spin_lock_report(spinlock_t* lock) {
+    uint32_t avg_hold = spin_avg_cycles(lock->hold_cycles, lock->acquired);
+    uint32_t avg_wait = spin_avg_cycles(lock->wait_cycles, lock->contended);
+
+    printf("%s: %u taken, %u contended (avg wait %u), hold avg %u max %u cycles\n",
+            (int8_t*) lock->name, lock->acquired, lock->contended,
+            avg_wait, avg_hold, lock->max_hold_cycles);
+}
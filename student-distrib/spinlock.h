@@ -0,0 +1,61 @@
+/* spinlock.h - busy-waiting locks for data shared between CPUs
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+
+/* Split of the ticket word: low half is the ticket being served,
+ * high half is the next ticket to hand out */
+#define TICKET_SHIFT        16
+#define TICKET_MASK         0xFFFF
+#define TICKET_INC          (1 << TICKET_SHIFT)
+
+/* A FIFO ticket lock with contention and hold-time counters in TSC cycles.
+ * The counters are only written by the holder, so they need no extra lock */
+typedef struct spinlock {
+    volatile uint32_t tickets;  /* next ticket << 16 | ticket being served */
+    const char* name;           /* shown by spin_lock_report */
+    uint32_t acquired;          /* number of acquisitions */
+    uint32_t contended;         /* acquisitions that had to wait */
+    uint64_t wait_cycles;       /* total cycles spent waiting for the lock */
+    uint64_t hold_cycles;       /* total cycles the lock was held */
+    uint32_t max_hold_cycles;   /* longest single hold */
+    uint64_t hold_start;        /* TSC when the current holder got the lock */
+} spinlock_t;
+
+/* Initializer for statically allocated locks */
+#define SPINLOCK_INIT(lock_name)    { 0, lock_name, 0, 0, 0, 0, 0, 0 }
+
+/* Locks that an interrupt handler also takes must be held with interrupts
+ * off on this CPU, otherwise the handler can spin on its own CPU's lock */
+#define spin_lock_irqsave(lock, flags)          \
+do {                                            \
+    cli_and_save(flags);                        \
+    spin_lock(lock);                            \
+} while (0)
+
+#define spin_unlock_irqrestore(lock, flags)     \
+do {                                            \
+    spin_unlock(lock);                          \
+    restore_flags(flags);                       \
+} while (0)
+
+/* Sets up a lock at run time */
+void spin_lock_init(spinlock_t* lock, const char* name);
+
+/* Spins until the lock is acquired, in arrival order */
+void spin_lock(spinlock_t* lock);
+
+/* Acquires the lock only if it is free; returns 1 on success, 0 otherwise */
+int32_t spin_trylock(spinlock_t* lock);
+
+/* Releases a lock held by this CPU */
+void spin_unlock(spinlock_t* lock);
+
+/* Prints the contention and hold-time counters of a lock */
+void spin_lock_report(spinlock_t* lock);
+
+#endif /* _SPINLOCK_H */
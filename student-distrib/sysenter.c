@@ -0,0 +1,59 @@
+/* sysenter.c - SYSENTER/SYSEXIT fast system call entry
+ * vim:ts=4 noexpandtab
+ */
+
+#include "sysenter.h"
+#include "systemcall_handler.h"
+#include "x86_desc.h"
+#include "lib.h"
+
+uint8_t sysenter_enabled = 0;
+
+/*
+ * sysenter_init
+ *
+ * DESCRIPTION: detects SYSENTER/SYSEXIT and enables them on the boot CPU.
+ *              Without them the MSRs are left alone and programs keep
+ *              using int $0x80, which their stubs detect on their own.
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: writes the SYSENTER MSRs
+ */
+void sysenter_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    /* the user stubs make the same check, so both sides agree */
+    if (!(edx & CPUID_SEP))
+        return;
+
+    sysenter_enabled = 1;
+    sysenter_init_cpu(0);
+}
+
+/*
+ * sysenter_init_cpu
+ *
+ * DESCRIPTION: points the executing CPU's SYSENTER MSRs at
+ *              sysenter_handler. The stack MSR holds the address of this
+ *              CPU's tss.esp0, which the handler loads first, so it lands
+ *              on the same kernel stack as an int $0x80 would.
+ *
+ * Inputs: cpu - index of the executing CPU
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: writes the SYSENTER MSRs
+ */
+void sysenter_init_cpu(uint32_t cpu) {
+    if (!sysenter_enabled)
+        return;
+
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t) &tss[cpu].esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_handler);
+}
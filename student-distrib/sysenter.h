@@ -0,0 +1,27 @@
+/* sysenter.h - SYSENTER/SYSEXIT fast system call entry
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SYSENTER_H
+#define _SYSENTER_H
+
+#include "types.h"
+
+/* SYSENTER MSRs */
+#define MSR_SYSENTER_CS     0x174   /* kernel CS; SS, user CS and user SS follow it in the GDT */
+#define MSR_SYSENTER_ESP    0x175   /* stack SYSENTER switches to */
+#define MSR_SYSENTER_EIP    0x176   /* where SYSENTER enters the kernel */
+
+/* CPUID leaf 1 EDX feature bit */
+#define CPUID_SEP           0x00000800
+
+/* Set when the CPUs support SYSENTER and the MSRs are programmed */
+extern uint8_t sysenter_enabled;
+
+/* Detects SYSENTER and sets it up on the boot CPU */
+void sysenter_init(void);
+
+/* Points the executing CPU's SYSENTER MSRs at sysenter_handler */
+void sysenter_init_cpu(uint32_t cpu);
+
+#endif /* _SYSENTER_H */
@@ -1,11 +1,17 @@
 #ifndef SYSTEMCALL_HANDLER_H
 #define SYSTEMCALL_HANDLER_H
 
+/* Number of entries in system_call_jumptable, system calls are numbered from 1 */
+#define NUM_SYSTEM_CALLS    26
+
 #ifndef ASM
 
 /* System Call Interrupt Handler Wrapper */
 extern void systemcall_handler();
 
+/* SYSENTER entry into the same system calls */
+extern void sysenter_handler();
+
 #endif /* ASM */
 
 #endif /* SYSTEMCALL_HANDLER_H */
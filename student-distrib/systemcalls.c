@@ -1,15 +1,41 @@
 #include "systemcalls.h"
 #include "terminal.h"
 #include "lib.h"
+#include "fpu.h"
+#include "scheduler.h"
+#include "pipe.h"
+#include "shm.h"
+#include "mq.h"
+#include "poll.h"
+#include "serial.h"
+#include "klog.h"
+#include "vbe.h"
 
 /* Keeps track of the current number of processes active */
-static uint32_t pid_array[MAX_PROC] = {0, 0, 0, 0, 0, 0};
+static uint32_t pid_array[MAX_PROC] = {PID_FREE};
+static spinlock_t pid_lock = SPINLOCK_INIT("pid");
+
+/* Protects the thread counts and exit waiters of processes */
+static spinlock_t thread_lock = SPINLOCK_INIT("thread");
+
+/* PID + 1 that halt hands to the shell it relaunches on each CPU, 0 if none */
+static uint8_t relaunch_pid[MAX_CPUS];
+
+/* Back pages of double-buffered vidmap, one per address space, and what
+ * each held at its last present */
+static uint16_t vid_back[MAX_PROC][PAGE_SIZE / 2] __attribute__((aligned(PAGE_SIZE)));
+static uint16_t vid_shown[MAX_PROC][NUM_ROWS * NUM_COLS];
 
 /* OPERATION TABLES */
-static fops_t terminal_ops_table = {bad_call_open, terminal_read, terminal_write, bad_call_close};
-static fops_t rtc_ops_table = {rtc_open, rtc_read, rtc_write, rtc_close};
-static fops_t directory_ops_table = {fs_open, fs_read, fs_write, fs_close};
-static fops_t file_ops_table = {fs_open, fs_read, fs_write, fs_close};
+static fops_t terminal_ops_table = {bad_call_open, terminal_read, terminal_write, bad_call_close, terminal_poll, terminal_ioctl};
+static fops_t rtc_ops_table = {rtc_open, rtc_read, rtc_write, rtc_close, rtc_poll, bad_call_ioctl};
+static fops_t directory_ops_table = {fs_open, fs_read, fs_write, fs_close, poll_always, bad_call_ioctl};
+static fops_t file_ops_table = {fs_open, fs_read, fs_write, fs_close, poll_always, bad_call_ioctl};
+static fops_t pipe_read_ops_table = {bad_call_open, pipe_read, bad_call_write, pipe_read_close, pipe_read_poll, bad_call_ioctl};
+static fops_t pipe_write_ops_table = {bad_call_open, bad_call_read, pipe_write, pipe_write_close, pipe_write_poll, bad_call_ioctl};
+static fops_t mq_ops_table = {bad_call_open, mq_read, mq_write, mq_close, mq_poll, bad_call_ioctl};
+static fops_t serial_ops_table = {serial_open, serial_read, serial_write, serial_close, serial_poll, bad_call_ioctl};
+static fops_t klog_ops_table = {klog_open, klog_read, bad_call_write, klog_close, poll_always, bad_call_ioctl};
 
 /* 
  * bad_call_open
@@ -26,6 +52,36 @@ int32_t bad_call_open(const uint8_t* filename) {
     return -1;
 }
 
+/* 
+ * bad_call_read
+ * 
+ * DESCRIPTION: dummy functions, returns -1
+ * 
+ * Input: match read parameters
+ * Output: none
+ * Return Values: -1 always
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t bad_call_read(int32_t fd, void* buf, int32_t nbytes) {
+    return -1;
+}
+
+/* 
+ * bad_call_write
+ * 
+ * DESCRIPTION: dummy functions, returns -1
+ * 
+ * Input: match write parameters
+ * Output: none
+ * Return Values: -1 always
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t bad_call_write(int32_t fd, const void* buf, int32_t nbytes) {
+    return -1;
+}
+
 /* 
  * bad_call_close
  * 
@@ -41,6 +97,52 @@ int32_t bad_call_close(int32_t fd) {
     return -1;
 }
 
+/*
+ * bad_call_ioctl
+ * 
+ * DESCRIPTION: dummy functions, returns -1
+ * 
+ * Input: int32_t fd, uint32_t request, uint32_t arg - match ioctl parameters
+ * Output: none
+ * Return Values: -1 always
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t bad_call_ioctl(int32_t fd, uint32_t request, uint32_t arg) {
+    return -1;
+}
+
+/*
+ * halt_thread
+ *
+ * DESCRIPTION: ends the calling thread. Its PID is marked exited rather
+ * than free, execute_find_pid only hands it out again once the scheduler
+ * has switched off the thread's kernel stack.
+ *
+ * Input: self - PCB of the calling thread, interrupts off
+ * Output: none
+ * Return Values: never returns
+ *
+ * SIDE EFFECTS: may wake the process waiting in halt for its threads
+ */
+static void halt_thread(pcb_t* self) {
+    pcb_t* leader = self -> leader;
+
+    fpu_release(self);
+
+    spin_lock(&thread_lock);
+    leader -> threads--;
+    if (leader -> threads == 0 && leader -> exit_waiter != NULL)
+        sched_wakeup(leader -> exit_waiter);
+    spin_unlock(&thread_lock);
+
+    spin_lock(&pid_lock);
+    pid_array[self -> pid] = PID_EXITED;
+    spin_unlock(&pid_lock);
+
+    sched_exit();
+}
+
 /* 
  * halt
  * 
@@ -55,34 +157,78 @@ int32_t bad_call_close(int32_t fd) {
  * SIDE EFFECTS: N/A
  */
 int32_t halt (uint8_t status) {
-    // clear FD array of process
+    uint32_t cpu, pid, flags;
+    pcb_t* self;
+    pcb_t* parent;
+
+    cli_and_save(flags);
+    self = sched_current() -> pcb;
+
+    /* a thread only ends itself, its process keeps the files */
+    if (self -> leader != self)
+        halt_thread(self);
+
+    /* a process exits once all of its threads have */
+    spin_lock(&thread_lock);
+    while (self -> threads != 0) {
+        self -> exit_waiter = sched_current();
+        sched_sleep(&thread_lock);
+    }
+    self -> exit_waiter = NULL;
+    spin_unlock(&thread_lock);
+    restore_flags(flags);
+
+    /* close every open file, stdin and stdout too since they may be pipe ends */
     int i; 
     for (i = 0; i < FD_ARRAY_SIZE; i++) {
-        close(i);
+        if (self -> fd_array[i].flags != 0) {
+            self -> fd_array[i].file_operations_table_ptr.close(i);
+            self -> fd_array[i].flags = 0;
+        }
     }
-    
-    /* Restore PID array */
-    pid_array[ terminal[sched_term].curr_pcb -> pid ] = 0;
 
-    /* execute shell if no processes are running */
-    if (terminal[sched_term].curr_pcb->parent_pcb == NULL) {
-        terminal[sched_term].curr_pcb = NULL;
+    /* let go of shared memory and the framebuffer, the mappings change below */
+    shm_release(self);
+    vbe_release(self);
+
+    /* stay on this CPU until we are back on the parent's stack */
+    cli();
+    cpu = cpu_id();
+    pid = self -> pid;
+    parent = self -> parent_pcb;
+
+    /* Drop any FPU state the process left behind */
+    fpu_release(self);
+
+    /* execute shell if no processes are running, it keeps our PID since we are still on its stack */
+    if (parent == NULL) {
+        /* the new shell is a root process too, not our child */
+        self -> task.pcb = NULL;
+        relaunch_pid[cpu] = pid + 1;
         execute((uint8_t*)"shell");
     }
 
-    /* restore parent PCB and set it in terminal_proc */
-    terminal[sched_term].curr_pcb = terminal[sched_term].curr_pcb -> parent_pcb;
+    /* the parent, which may be a thread, is this CPU's task again */
+    cpus[cpu].curr_task = &parent -> task;
 
     /* Set page base address */
-    page_directory[USER_PAGE] = KERNEL_MEM_END + ((terminal[sched_term].curr_pcb -> pid) * _4MB_);
+    page_directory[cpu][USER_PAGE] = KERNEL_MEM_END + ((parent -> page_pid) * _4MB_);
     /* Set attributes of new page */
-    page_directory[USER_PAGE] |= FOUR_MB_PAGE | USER | RW | PRESENT;
+    page_directory[cpu][USER_PAGE] |= FOUR_MB_PAGE | USER | RW | PRESENT;
+    /* Map the parent's shared memory and framebuffer */
+    shm_map_process(cpu, parent -> leader);
+    vbe_map_process(cpu, parent -> leader);
+    /* Map the parent's screen or back page */
+    sched_map_video(cpu, parent);
     /* Flush the TLB */
     flush_tlb();
     
     /* Load TSS segment with kernel stack for parent process */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = (uint32_t)(KERNEL_MEM_END - (terminal[sched_term].curr_pcb ->pid) * _8KB_) - BYTE_4;
+    tss[cpu].ss0 = KERNEL_DS;
+    tss[cpu].esp0 = (uint32_t)(KERNEL_MEM_END - (parent -> pid) * _8KB_) - BYTE_4;
+
+    /* Parent reclaims the FPU lazily on its next FPU instruction */
+    fpu_switch(NULL, parent);
 
     /* store 256 into status if exception has been raised */
     uint32_t status_exp = (uint32_t) status;
@@ -96,6 +242,11 @@ int32_t halt (uint8_t status) {
     memset(terminal[sched_term].internal_buffer, '\0', MAX_BUFFER_SIZE);
     terminal[sched_term].buffer_index = 0;
 
+    /* Restore PID array, as late as possible since this is still the PID's kernel stack */
+    spin_lock(&pid_lock);
+    pid_array[pid] = PID_FREE;
+    spin_unlock(&pid_lock);
+
     /* restore ESP and EBP of parent process (now current process) then jump to end of execute */
     asm volatile ("     \n\
         movl %0, %%esp  \n\
@@ -103,16 +254,123 @@ int32_t halt (uint8_t status) {
         movl %2, %%eax  \n\
         jmp EXEC_FIN"
         :
-        : "r" (terminal[sched_term].curr_pcb -> esp), "r" (terminal[sched_term].curr_pcb -> ebp), "r" (status_exp)
+        : "r" (parent -> esp), "r" (parent -> ebp), "r" (status_exp)
     );
 
     return 0;
 }
 
+/*
+ * clone_start
+ *
+ * DESCRIPTION: first code a new thread runs, in kernel mode on its own
+ * kernel stack. The scheduler has already mapped the process's page and
+ * loaded the TSS, so all that is left is the IRET into user space.
+ *
+ * Input: none
+ * Output: none
+ * Return Values: never returns
+ *
+ * SIDE EFFECTS: enters user mode
+ */
+static void clone_start(void) {
+    pcb_t* self;
+
+    sched_thread_start();
+
+    cli();
+    self = sched_current() -> pcb;
+
+    // push user DS, ESP, EFLAG, user CS and EIP for IRET
+    asm volatile (" \n\
+        pushl %0    \n\
+        pushl %1    \n\
+        sti         \n\
+        pushfl      \n\
+        pushl %2    \n\
+        pushl %3    \n\
+        iret"
+        :
+        : "r" (USER_DS), "r" (self -> user_stack), "r" (USER_CS), "r" (self -> user_entry)
+    );
+}
+
+/* 
+ * clone
+ * 
+ * DESCRIPTION: system call that starts a thread of the calling process.
+ * The thread gets its own PID slot and with it its own kernel stack and
+ * scheduler task, but maps the process's 4MB page and uses its file
+ * descriptors. It begins running at entry with ESP = stack; halt from a
+ * thread ends only that thread.
+ * 
+ * Input: entry - user address the thread starts at
+ *        stack - top of the thread's user stack, inside the process's page
+ * Output: none
+ * Return Values: thread's PID, -1 on bad arguments or if no PID is free
+ * 
+ * SIDE EFFECTS: the new thread is queued on this CPU
+ */
+int32_t clone (uint32_t entry, uint32_t stack) {
+    uint32_t flags;
+    int8_t pid;
+    pcb_t* leader;
+    pcb_t* thread;
+
+    /* both addresses must fall in the user-level page */
+    if ((entry & PAGE_DIR_MASK) != USER_PAGE_ADDR)
+        return -1;
+    if (((stack - 1) & PAGE_DIR_MASK) != USER_PAGE_ADDR)
+        return -1;
+
+    cli_and_save(flags);
+    if (sched_current() -> pcb == NULL) {
+        restore_flags(flags);
+        return -1;
+    }
+    leader = sched_current() -> pcb -> leader;
+
+    if ((pid = execute_find_pid()) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    thread = PCB_ADDR(pid);
+    thread -> pid = pid;
+    thread -> parent_pcb = NULL;
+    thread -> terminal_id = leader -> terminal_id;
+    thread -> args[0] = '\0';
+    thread -> fpu_used = 0;
+    thread -> fpu_cpu = FPU_NO_CPU;
+    thread -> leader = leader;
+    thread -> page_pid = leader -> page_pid;
+    thread -> threads = 0;
+    thread -> exit_waiter = NULL;
+    thread -> user_entry = entry;
+    thread -> user_stack = stack;
+    thread -> shm_mask = 0;
+    thread -> vid_buffered = 0;
+    thread -> fb_mapped = 0;
+
+    /* the task starts in clone_start at the top of the thread's kernel stack */
+    sched_task_init(&thread -> task, clone_start, (uint8_t*) thread, _8KB_, leader -> terminal_id);
+    thread -> task.pcb = thread;
+
+    spin_lock(&thread_lock);
+    leader -> threads++;
+    spin_unlock(&thread_lock);
+
+    sched_enqueue(&thread -> task);
+    restore_flags(flags);
+
+    return pid;
+}
+
 /* 
  * execute
  * 
- * DESCRIPTION: creates a new child process and executes it 
+ * DESCRIPTION: creates a new child process and executes it, with the
+ * terminal as its stdin and stdout
  * 
  * Input: a command used for execution
  * Output: none
@@ -122,22 +380,64 @@ int32_t halt (uint8_t status) {
  * SIDE EFFECTS: creates a new process (PCB) and executes it
  */
 int32_t execute(const uint8_t* command) {
-    /* lock so execute cant be interrupted */
-    cli();
+    return execute_redirect(command, -1, -1);
+}
+
+/* 
+ * execute_redirect
+ * 
+ * DESCRIPTION: creates a new child process and executes it, with its
+ * stdin and stdout copied from the caller's file descriptors. Threads may
+ * execute too; the caller blocks until the child halts either way, so a
+ * program runs alongside its children only through its threads.
+ * 
+ * Input: command - command used for execution
+ *        in_fd - caller's fd that becomes the child's stdin, -1 for the terminal
+ *        out_fd - caller's fd that becomes the child's stdout, -1 for the terminal
+ * Output: none
+ * Return Values: returns status of child process when it ends 
+ * (stored in EAX from halt inline assembly), -1 on failure
+ * 
+ * SIDE EFFECTS: creates a new process (PCB) and executes it
+ */
+int32_t execute_redirect(const uint8_t* command, int32_t in_fd, int32_t out_fd) {
+    uint32_t flags;
+    pcb_t* self;
+    fd_array_t* stdio[2] = {NULL, NULL};
 
     /* validate command is valid */
     if (command == NULL)
         return -1;
+
+    cli_and_save(flags);
+    self = sched_current() -> pcb;
+    restore_flags(flags);
+
+    /* redirected descriptors must be open in the calling process */
+    if (in_fd != -1 || out_fd != -1) {
+        if (self == NULL)
+            return -1;
+        if (in_fd != -1) {
+            if (in_fd < 0 || in_fd >= FD_ARRAY_SIZE || self -> leader -> fd_array[in_fd].flags == 0)
+                return -1;
+            stdio[0] = &self -> leader -> fd_array[in_fd];
+        }
+        if (out_fd != -1) {
+            if (out_fd < 0 || out_fd >= FD_ARRAY_SIZE || self -> leader -> fd_array[out_fd].flags == 0)
+                return -1;
+            stdio[1] = &self -> leader -> fd_array[out_fd];
+        }
+    }
     
     /* Reset exception flag */
     exception_flag = 0;
 
-    /* store the esp and ebp of the current process */
-    if (terminal[sched_term].active && terminal[sched_term].curr_pcb != NULL) {
+    /* store the esp and ebp of the caller, halt of the child returns here */
+    if (self != NULL) {
         asm volatile ("      \n\
             movl %%esp, %0   \n\
             movl %%ebp, %1"
-            : "=r" (terminal[sched_term].curr_pcb -> esp), "=r" (terminal[sched_term].curr_pcb -> ebp) 
+            : "=r" (self -> esp), "=r" (self -> ebp) 
         );
     }
 
@@ -163,20 +463,27 @@ int32_t execute(const uint8_t* command) {
     /* find next available PID for process */
     int8_t new_pid;
     if ((new_pid = execute_find_pid()) == -1) {
-        printf("PID Array is Full\n");
+        printk(KLOG_WARNING, "PID Array is Full\n");
         return -1;
     }
 
+    /* the child becomes this CPU's task and gets its paging in one step, so
+     * the scheduler maps the right program page wherever the load resumes */
+    cli_and_save(flags);
+
+    /* create a new PCB for process */
+    execute_create_pcb(&dentry, filename, args, new_pid, stdio);
+
     /* sets up correct paging for shell / user function */
     execute_program_paging(new_pid);
 
-    /* copying program image from filename to PROGRAM_IMAGE_ADDR */
+    restore_flags(flags);
+
+    /* copying program image from filename to PROGRAM_IMAGE_ADDR, preemptible */
     execute_user_level_program_loader(filename);
-    
-    /* create a new PCB for process */
-    execute_create_pcb(&dentry, filename, args, new_pid);
 
     /* context switch (trick IRET) to run other process */
+    cli();
     execute_context_switch(filename);
 
     /* child process has called "halt" with status code, return control to parent */
@@ -284,15 +591,32 @@ int32_t execute_executable_check(uint8_t* filename) {
  * SIDE EFFECTS: none
  */
 int8_t execute_find_pid() {
+    uint32_t flags, cpu;
+    int8_t pid;
+
+    // interrupts off so the CPU index stays ours
+    spin_lock_irqsave(&pid_lock, flags);
+    cpu = cpu_id();
+
+    // shell relaunched by halt reuses the PID it is running on
+    if (relaunch_pid[cpu] != 0) {
+        pid = relaunch_pid[cpu] - 1;
+        relaunch_pid[cpu] = 0;
+        spin_unlock_irqrestore(&pid_lock, flags);
+        return pid;
+    }
+
     // parse PID array, find first PID with flag 0 (not in use)
     int i; 
     for (i = 0; i < MAX_PROC; i++) {
-        if (pid_array[i] == 0) {
+        if (pid_array[i] == PID_FREE || (pid_array[i] == PID_EXITED && !PCB_ADDR(i) -> task.on_cpu)) {
             // available PID found, set flag to 1 (in use)
-            pid_array[i] = 1;
+            pid_array[i] = PID_USED;
+            spin_unlock_irqrestore(&pid_lock, flags);
             return i;
         }
     }
+    spin_unlock_irqrestore(&pid_lock, flags);
 
     // no slots for PID array available
     return -1;
@@ -313,10 +637,14 @@ int8_t execute_find_pid() {
  * address space of new process
  */
 int32_t execute_program_paging(int8_t new_pid) {   
+    uint32_t cpu = cpu_id();
+
     /* Set page base address */
-    page_directory[USER_PAGE] = KERNEL_MEM_END + (new_pid * _4MB_);
+    page_directory[cpu][USER_PAGE] = KERNEL_MEM_END + (new_pid * _4MB_);
     /* Set attributes of new page */
-    page_directory[USER_PAGE] |= FOUR_MB_PAGE | USER | RW | PRESENT;
+    page_directory[cpu][USER_PAGE] |= FOUR_MB_PAGE | USER | RW | PRESENT;
+    /* A new process holds no shared memory */
+    shm_map_process(cpu, PCB_ADDR(new_pid));
     /* Flush the TLB */
     flush_tlb();
 
@@ -346,25 +674,33 @@ void execute_user_level_program_loader(uint8_t* filename) {
  * DESCRIPTION: creates a new Process Control Block (PCB)
  * given a dentry. 
  * 
- * Input: dentry block of executable, filename buffer, args buffer, PID for new process
+ * Input: dentry block of executable, filename buffer, args buffer, PID for new process,
+ * stdin and stdout to copy into the new process (NULL entries for the terminal)
  * Output: none
  * Return Values: returns 0 if successful
  * 
  * SIDE EFFECTS: creates new pcb 
  */
-int32_t execute_create_pcb(dentry_t* dentry, uint8_t* filename, uint8_t* args, int8_t new_pid) {
+int32_t execute_create_pcb(dentry_t* dentry, uint8_t* filename, uint8_t* args, int8_t new_pid, fd_array_t** stdio) {
     int i;
 
     /* initialize starting location of PCB */
-    pcb_t* new_pcb = (pcb_t*)(KERNEL_MEM_END - (new_pid + 1) * _8KB_);
+    pcb_t* new_pcb = PCB_ADDR(new_pid);
     
     for (i = 0; i < FD_ARRAY_SIZE; i++) {
+        /* copy a redirected stdin or stdout, a pipe end or queue gets another reference */
+        if ((i == 0 || i == 1) && stdio[i] != NULL) {
+            new_pcb -> fd_array[i] = *stdio[i];
+            pipe_fd_get(&new_pcb -> fd_array[i]);
+            mq_fd_get(&new_pcb -> fd_array[i]);
+            continue;
+        }
         /* set terminal table and flags if stdin or stdout */
         if (i == 0 || i == 1) {
             new_pcb -> fd_array[i].file_operations_table_ptr = terminal_ops_table;
             new_pcb -> fd_array[i].flags = 1;
         } else {
-            new_pcb -> fd_array[i].file_operations_table_ptr = (fops_t) {NULL, NULL, NULL, NULL};
+            new_pcb -> fd_array[i].file_operations_table_ptr = (fops_t) {NULL, NULL, NULL, NULL, NULL, NULL};
             new_pcb -> fd_array[i].flags = 0;
         }
         /* initialize inode and file position */
@@ -372,20 +708,43 @@ int32_t execute_create_pcb(dentry_t* dentry, uint8_t* filename, uint8_t* args, i
         new_pcb -> fd_array[i].file_position = 0;
     }
     
-    /* updates parent_pcb based on current process running per terminal */
-    new_pcb -> parent_pcb = terminal[sched_term].curr_pcb == NULL ? NULL : terminal[sched_term].curr_pcb;
+    /* the caller, process or thread, is the parent halt returns to */
+    new_pcb -> parent_pcb = sched_current() -> pcb;
     new_pcb -> pid = new_pid; 
     new_pcb -> terminal_id = sched_term;
+    new_pcb -> fpu_used = 0;
+    new_pcb -> fpu_cpu = FPU_NO_CPU;
+
+    /* a process is its own thread group leader */
+    new_pcb -> leader = new_pcb;
+    new_pcb -> page_pid = new_pid;
+    new_pcb -> threads = 0;
+    new_pcb -> exit_waiter = NULL;
+    new_pcb -> shm_mask = 0;
+    new_pcb -> vid_buffered = 0;
+    new_pcb -> fb_mapped = 0;
+
+    /* the process runs as the scheduler task embedded in its PCB */
+    new_pcb -> task.pcb = new_pcb;
+    new_pcb -> task.terminal_id = sched_term;
+    new_pcb -> task.state = TASK_RUNNABLE;
+    new_pcb -> task.on_cpu = 1;
+    new_pcb -> task.cpu = cpu_id();
+    new_pcb -> task.kernel_io = 0;
+    new_pcb -> task.next = NULL;
 
     /* set starting address for kernel stack and kernel base pointers */
     /* esp and ebp held 4 behind the program image */
-    new_pcb -> esp = (PROGRAM_IMAGE_ADDR & PAGE_DIR_MASK) + _4MB_ - BYTE_4;
-    new_pcb -> ebp = (PROGRAM_IMAGE_ADDR & PAGE_DIR_MASK) + _4MB_ - BYTE_4;
+    new_pcb -> esp = USER_PAGE_ADDR + _4MB_ - BYTE_4;
+    new_pcb -> ebp = USER_PAGE_ADDR + _4MB_ - BYTE_4;
     
     strcpy((int8_t*)(new_pcb->args), (const int8_t*)args);
 
-    /* assigns newly created pcb as the current pcb */
-    terminal[sched_term].curr_pcb = new_pcb;
+    /* the new process is this CPU's task from here on */
+    this_cpu()->curr_task = &new_pcb -> task;
+
+    /* Parent's FPU state is saved before the child can be preempted */
+    fpu_switch(new_pcb -> parent_pcb, new_pcb);
 
     return 0;
 }
@@ -410,9 +769,14 @@ int32_t execute_context_switch(uint8_t* filename) {
     read_file(filename, ENTRY_POINT, entry_point_string, BYTE_4);
     entry_point = *((uint32_t *) entry_point_string);
 
+    pcb_t* child = sched_current() -> pcb;
+
     // Load TSS segment with kernel stack for the process about to run
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = (uint32_t)(KERNEL_MEM_END - (terminal[sched_term].curr_pcb -> pid) * _8KB_ - BYTE_4);
+    tss[cpu_id()].ss0 = KERNEL_DS;
+    tss[cpu_id()].esp0 = (uint32_t)(KERNEL_MEM_END - (child -> pid) * _8KB_ - BYTE_4);
+
+    // New process traps on its first FPU instruction
+    fpu_switch(NULL, child);
 
     // push kernel DS, ESP, EFLAG, kernel CS
     asm volatile (" \n\
@@ -446,15 +810,25 @@ int32_t execute_context_switch(uint8_t* filename) {
 int32_t open (const uint8_t* filename) {
     dentry_t dentry;
     int32_t fd;
+    fops_t* device = NULL;
+
+    /* the serial port and the kernel log have no directory entry, they
+     * are found by name */
+    if (filename != NULL && strncmp((int8_t*) filename, (int8_t*) SERIAL_NAME, FILE_NAME_CHAR) == 0)
+        device = &serial_ops_table;
+    else if (filename != NULL && strncmp((int8_t*) filename, (int8_t*) KLOG_NAME, FILE_NAME_CHAR) == 0)
+        device = &klog_ops_table;
 
     /* fill in dentry by searching dentries via filename */
-    if (read_dentry_by_name(filename, &dentry) == -1)
+    if (device != NULL)
+        dentry.inode_num = 0;
+    else if (read_dentry_by_name(filename, &dentry) == -1)
         return -1;
 
 
     /* find an fd that is not in use */
     for (fd = 0; fd < FD_ARRAY_SIZE; fd++) {
-        if (terminal[sched_term].curr_pcb -> fd_array[fd].flags == 0) {
+        if (sched_process() -> fd_array[fd].flags == 0) {
             break;
         }
     }
@@ -464,27 +838,29 @@ int32_t open (const uint8_t* filename) {
         return -1;
 
     /* set relevant jump table based on file type */
-    switch(dentry.file_type) {
+    if (device != NULL)
+        sched_process() -> fd_array[fd].file_operations_table_ptr = *device;
+    else switch(dentry.file_type) {
         case RTC_TYPE:
-            terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr = rtc_ops_table;
+            sched_process() -> fd_array[fd].file_operations_table_ptr = rtc_ops_table;
             break;
         case DIR_TYPE:
-            terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr = directory_ops_table;
+            sched_process() -> fd_array[fd].file_operations_table_ptr = directory_ops_table;
             break;
         case FILE_TYPE:
-            terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr = file_ops_table;
+            sched_process() -> fd_array[fd].file_operations_table_ptr = file_ops_table;
             break;
         default:
             break;
     }
 
     /* initialize inode and flags */
-    terminal[sched_term].curr_pcb -> fd_array[fd].inode = dentry.inode_num;
-    terminal[sched_term].curr_pcb -> fd_array[fd].file_position = 0;
-    terminal[sched_term].curr_pcb -> fd_array[fd].flags = 1;
+    sched_process() -> fd_array[fd].inode = dentry.inode_num;
+    sched_process() -> fd_array[fd].file_position = 0;
+    sched_process() -> fd_array[fd].flags = 1;
 
     /* Call function specific open, return -1 if it fails */
-    if (terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr.open(filename) == -1)
+    if (sched_process() -> fd_array[fd].file_operations_table_ptr.open(filename) == -1)
         return -1;
 
     return fd;
@@ -512,11 +888,11 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes) {
         return -1;
     
     /* checks if not in use */
-    if (terminal[sched_term].curr_pcb -> fd_array[fd].flags == 0)
+    if (sched_process() -> fd_array[fd].flags == 0)
         return -1;
 
     /* returns function call for given file descriptor with function parameters */
-    return terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr.read(fd, buf, nbytes);
+    return sched_process() -> fd_array[fd].file_operations_table_ptr.read(fd, buf, nbytes);
 }
 
 /* 
@@ -540,10 +916,10 @@ int32_t write (int32_t fd, const void* buf, int32_t nbytes) {
     if (fd == 0)
         return -1;
     /* checks if not in use */
-    if (terminal[sched_term].curr_pcb -> fd_array[fd].flags == 0)
+    if (sched_process() -> fd_array[fd].flags == 0)
         return -1;
     /* returns function call for given file descriptor with function parameters */
-    return terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr.write(fd, buf, nbytes);
+    return sched_process() -> fd_array[fd].file_operations_table_ptr.write(fd, buf, nbytes);
 }
 
 /* 
@@ -565,18 +941,343 @@ int32_t close (int32_t fd) {
     if (fd == 0 || fd == 1)
         return -1;
     /* checks if not in use */
-    if (terminal[sched_term].curr_pcb -> fd_array[fd].flags == 0)
+    if (sched_process() -> fd_array[fd].flags == 0)
         return -1;
     /* function call for given file descriptor with function parameters */
-    if(terminal[sched_term].curr_pcb -> fd_array[fd].file_operations_table_ptr.close(fd))
+    if(sched_process() -> fd_array[fd].file_operations_table_ptr.close(fd))
         return -1;
 
     /* Set as not in use */
-    terminal[sched_term].curr_pcb -> fd_array[fd].flags = 0;
+    sched_process() -> fd_array[fd].flags = 0;
+
+    return 0;
+}
+
+/* 
+ * user_range
+ * 
+ * DESCRIPTION: checks that a buffer handed to a system call lies inside
+ * the user-level page. Kernel threads, and tasks in sendfile, pass their
+ * own buffers to file operations, which are let through.
+ * 
+ * Input: addr - start of the buffer
+ *        size - bytes in the buffer
+ * Output: none
+ * Return Values: 1 if the buffer may be used, 0 otherwise
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t user_range (const void* addr, uint32_t size) {
+    task_t* task = sched_current();
+    uint32_t start = (uint32_t)addr;
+
+    if (task -> pcb == NULL || task -> kernel_io)
+        return 1;
+    if ((start & PAGE_DIR_MASK) != USER_PAGE_ADDR)
+        return 0;
+    return size == 0 || ((start + size - 1) & PAGE_DIR_MASK) == USER_PAGE_ADDR;
+}
+
+/* 
+ * iov_copy
+ * 
+ * DESCRIPTION: copies an iovec array into the kernel and checks the copy
+ * and every buffer it names lie in the user-level page. Only the copy is
+ * used afterwards, another thread may change the array meanwhile.
+ * 
+ * Input: iov - user array of buffers
+ *        iovcnt - number of entries, at most IOV_MAX
+ * Output: kiov - the entries, IOV_MAX long
+ * Return Values: 0 if they lie in the page, -1 otherwise
+ * 
+ * SIDE EFFECTS: N/A
+ */
+static int32_t iov_copy (iovec_t* kiov, const iovec_t* iov, int32_t iovcnt) {
+    int32_t i;
+
+    if (iov == NULL || iovcnt <= 0 || iovcnt > IOV_MAX)
+        return -1;
+    if (!user_range(iov, iovcnt * sizeof(iovec_t)))
+        return -1;
+    memcpy(kiov, iov, iovcnt * sizeof(iovec_t));
+
+    for (i = 0; i < iovcnt; i++) {
+        if (kiov[i].len < 0)
+            return -1;
+        if (kiov[i].len != 0 && !user_range(kiov[i].base, kiov[i].len))
+            return -1;
+    }
+    return 0;
+}
+
+/* 
+ * readv
+ * 
+ * DESCRIPTION: readv system call, checks the fd once and then reads into
+ * each buffer in turn through the file's read, stopping at the first
+ * short read so no data is skipped
+ * 
+ * Input: fd - file descriptor to read
+ *        iov - user array of buffers to fill
+ *        iovcnt - number of buffers, at most IOV_MAX
+ * Output: the buffers are filled in order
+ * Return Values: total bytes read, -1 on fail
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t readv (int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+    iovec_t kiov[IOV_MAX];
+    int32_t i, cnt, total = 0;
+    int32_t (*file_read)(int32_t, void*, int32_t);
+
+    /* same checks as read */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd == 1)
+        return -1;
+    if (sched_process() -> fd_array[fd].flags == 0)
+        return -1;
+    if (iov_copy(kiov, iov, iovcnt) == -1)
+        return -1;
+
+    file_read = sched_process() -> fd_array[fd].file_operations_table_ptr.read;
+    for (i = 0; i < iovcnt; i++) {
+        if (kiov[i].len == 0)
+            continue;
+        if ((cnt = file_read(fd, kiov[i].base, kiov[i].len)) == -1)
+            return (total == 0) ? -1 : total;
+        total += cnt;
+        if (cnt < kiov[i].len)
+            break;
+    }
+    return total;
+}
+
+/* 
+ * writev
+ * 
+ * DESCRIPTION: writev system call, checks the fd once and then writes each
+ * buffer in turn through the file's write, stopping at the first short
+ * write
+ * 
+ * Input: fd - file descriptor to write
+ *        iov - user array of buffers to write
+ *        iovcnt - number of buffers, at most IOV_MAX
+ * Output: none
+ * Return Values: total bytes written, -1 on fail
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t writev (int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+    iovec_t kiov[IOV_MAX];
+    int32_t i, cnt, total = 0;
+    int32_t (*file_write)(int32_t, const void*, int32_t);
+
+    /* same checks as write */
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || fd == 0)
+        return -1;
+    if (sched_process() -> fd_array[fd].flags == 0)
+        return -1;
+    if (iov_copy(kiov, iov, iovcnt) == -1)
+        return -1;
+
+    file_write = sched_process() -> fd_array[fd].file_operations_table_ptr.write;
+    for (i = 0; i < iovcnt; i++) {
+        if (kiov[i].len == 0)
+            continue;
+        if ((cnt = file_write(fd, kiov[i].base, kiov[i].len)) == -1)
+            return (total == 0) ? -1 : total;
+        total += cnt;
+        if (cnt < kiov[i].len)
+            break;
+    }
+    return total;
+}
+
+/* 
+ * sendfile
+ * 
+ * DESCRIPTION: sendfile system call, writes count bytes of a regular file
+ * to out_fd straight from the filesystem image, one data block per call
+ * of the output file's write, with no copy through a user buffer
+ * 
+ * Input: out_fd - descriptor to write to, such as stdout or a pipe
+ *        in_fd - regular file to read from
+ *        offset - byte offset to start at, -1 to start at in_fd's
+ *                 position and advance it
+ *        count - most bytes to send
+ * Output: none
+ * Return Values: bytes sent, 0 at end of file, -1 on fail
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t sendfile (int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count) {
+    pcb_t* process = sched_process();
+    fd_array_t* in;
+    const uint8_t* data;
+    int32_t n, written, sent = 0;
+    uint32_t position;
+
+    /* out_fd is checked as in write, in_fd must be an open regular file */
+    if (out_fd < 0 || out_fd >= FD_ARRAY_SIZE || out_fd == 0 || process -> fd_array[out_fd].flags == 0)
+        return -1;
+    if (in_fd < 0 || in_fd >= FD_ARRAY_SIZE || process -> fd_array[in_fd].flags == 0)
+        return -1;
+    in = &process -> fd_array[in_fd];
+    if (in -> file_operations_table_ptr.read != fs_read || !fs_is_file(in -> inode))
+        return -1;
+    if (count < 0 || offset < -1)
+        return -1;
+
+    position = (offset == -1) ? in -> file_position : (uint32_t) offset;
+    while (sent < count) {
+        if ((n = read_data_block(in -> inode, position, &data)) <= 0)
+            break;
+        if (n > count - sent)
+            n = count - sent;
+
+        /* data is in the kernel, the write has to take it anyway */
+        sched_current() -> kernel_io = 1;
+        written = process -> fd_array[out_fd].file_operations_table_ptr.write(out_fd, data, n);
+        sched_current() -> kernel_io = 0;
+        if (written <= 0) {
+            if (sent == 0)
+                return -1;
+            break;
+        }
+        sent += written;
+        position += written;
+        if (written < n)
+            break;
+    }
+
+    if (offset == -1)
+        in -> file_position = position;
+    return sent;
+}
+
+/* 
+ * ioctl
+ * 
+ * DESCRIPTION: ioctl system call, passes a device specific request to the
+ * fd's driver, such as TTY_SETMODE on a terminal
+ * 
+ * Input: fd - file descriptor
+ *        request - what to do, defined by the driver
+ *        arg - argument of the request
+ * Output: none
+ * Return Values: the driver's result, -1 on fail or if the fd has no
+ * requests
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t ioctl (int32_t fd, uint32_t request, uint32_t arg) {
+    pcb_t* process = sched_process();
+
+    if (fd < 0 || fd >= FD_ARRAY_SIZE || process -> fd_array[fd].flags == 0)
+        return -1;
+    return process -> fd_array[fd].file_operations_table_ptr.ioctl(fd, request, arg);
+}
+
+/* 
+ * pipe
+ * 
+ * DESCRIPTION: creates a pipe and opens both of its ends in the calling
+ * process. Bytes written to fds[1] are read from fds[0]; readers block
+ * while it is empty and writers while it is full.
+ * 
+ * Input: fds - user array that receives the read and write descriptors
+ * Output: fds[0] - read end, fds[1] - write end
+ * Return Values: 0 on success, -1 if fds is bad or no pipe or fds are free
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t pipe (int32_t* fds) {
+    int32_t fd, ends[2], pipe_id;
+    uint32_t found = 0;
+    pcb_t* process = sched_process();
+
+    /* both entries should fall in the user-level page */
+    if (!user_range(fds, 2 * sizeof(int32_t)))
+        return -1;
+
+    /* find two fds that are not in use */
+    for (fd = 0; fd < FD_ARRAY_SIZE && found < 2; fd++) {
+        if (process -> fd_array[fd].flags == 0)
+            ends[found++] = fd;
+    }
+    if (found < 2)
+        return -1;
+
+    if ((pipe_id = pipe_create()) == -1)
+        return -1;
+
+    process -> fd_array[ends[0]].file_operations_table_ptr = pipe_read_ops_table;
+    process -> fd_array[ends[1]].file_operations_table_ptr = pipe_write_ops_table;
+    for (fd = 0; fd < 2; fd++) {
+        process -> fd_array[ends[fd]].inode = pipe_id;
+        process -> fd_array[ends[fd]].file_position = 0;
+        process -> fd_array[ends[fd]].flags = 1;
+        fds[fd] = ends[fd];
+    }
 
     return 0;
 }
 
+/* 
+ * mq_open
+ * 
+ * DESCRIPTION: opens the message queue named name, creating an empty one
+ * if there is none. Reads and writes on the fd move whole mq_msg_t
+ * messages, highest priority first, waiting up to timeout for the queue
+ * to become nonempty or nonfull.
+ * 
+ * Input: name - queue name, shorter than MQ_NAME_LEN
+ *        timeout - MQ_NOWAIT, MQ_FOREVER or a number of PIT ticks
+ * Output: none
+ * Return Values: the new fd, -1 if name is bad or no queue or fd is free
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t mq_open (const uint8_t* name, uint32_t timeout) {
+    int32_t fd, mq;
+    uint32_t i, len = MQ_NAME_LEN;
+    uint8_t kname[MQ_NAME_LEN];
+    pcb_t* process = sched_process();
+
+    /* a name near the end of the user-level page may not have
+     * MQ_NAME_LEN bytes after it, only look as far as the page goes */
+    if (((uint32_t)name & PAGE_DIR_MASK) == USER_PAGE_ADDR &&
+        USER_PAGE_ADDR + _4MB_ - (uint32_t)name < len)
+        len = USER_PAGE_ADDR + _4MB_ - (uint32_t)name;
+    if (name == NULL || !user_range(name, len))
+        return -1;
+
+    /* copy the name so the queue code never reads user memory */
+    for (i = 0; i < len && name[i] != '\0'; i++)
+        kname[i] = name[i];
+    if (i == len)
+        return -1;
+    kname[i] = '\0';
+
+    /* find an fd that is not in use */
+    for (fd = 0; fd < FD_ARRAY_SIZE; fd++) {
+        if (process -> fd_array[fd].flags == 0)
+            break;
+    }
+    if (fd == FD_ARRAY_SIZE)
+        return -1;
+
+    if ((mq = mq_open_queue(kname)) == -1)
+        return -1;
+
+    /* the timeout rides in the file position, which queues do not use */
+    process -> fd_array[fd].file_operations_table_ptr = mq_ops_table;
+    process -> fd_array[fd].inode = mq;
+    process -> fd_array[fd].file_position = timeout;
+    process -> fd_array[fd].flags = 1;
+
+    return fd;
+}
+
 /* 
  * getargs
  * 
@@ -596,46 +1297,137 @@ int32_t getargs (uint8_t* buf, int32_t nbytes) {
         return -1;
 
     /* check if args buffer length is no 0 */
-    if (strlen((const int8_t*) terminal[sched_term].curr_pcb -> args) == 0) 
+    if (strlen((const int8_t*) sched_process() -> args) == 0) 
         return -1; 
 
     /* check if whole args can fit into buffer */
-    if (strlen((const int8_t*)(terminal[sched_term].curr_pcb -> args)) > nbytes)
+    if (strlen((const int8_t*)(sched_process() -> args)) > nbytes)
         return -1;
 
     /* copy arguments into user level buffer */
-    strcpy((int8_t*)buf, (const int8_t*)(terminal[sched_term].curr_pcb -> args));
+    strcpy((int8_t*)buf, (const int8_t*)(sched_process() -> args));
     return 0;
 }
 
-/* 
- * vidmap
- * 
- * DESCRIPTION: maps the text-mode video memory into 
- *              user space at a pre-set virtual address
- * 
+/*
+ * vidmap_map
+ *
+ * DESCRIPTION: checks where the vidmap address goes, picks the page the
+ *              vidmap entry maps for the process and maps it on this CPU
+ *
  * Input: screen_start - pre-set virtual address in user space
+ *        buffered - 1 to map the process's back page, 0 for the screen
  * Output: none
  * Return Values: 0 for success, -1 for failure
- * 
- * SIDE EFFECTS: N/A
+ *
+ * SIDE EFFECTS: changes this CPU's vidmap page
  */
-int32_t vidmap (uint8_t** screen_start) {
+static int32_t vidmap_map (uint8_t** screen_start, uint8_t buffered) {
+    pcb_t* pcb = sched_process();
+    uint32_t flags;
+
     /* check if argument is not null */
     if(screen_start == NULL)
         return -1;
     /* address should not fall in the user-level page */
-    if(((uint32_t)screen_start & PAGE_DIR_MASK) != (PROGRAM_IMAGE_ADDR & PAGE_DIR_MASK))
+    if(((uint32_t)screen_start & PAGE_DIR_MASK) != USER_PAGE_ADDR)
         return -1;
 
+    /* the page maps the start of the terminal's region, so the screen
+     * has to be there rather than scrolled further into it */
+    screen_home(sched_term);
+
+    /* a back page starts out as the screen, with nothing to present */
+    if (buffered && !pcb -> vid_buffered) {
+        screen_read(sched_term, vid_back[pcb -> page_pid]);
+        memcpy(vid_shown[pcb -> page_pid], vid_back[pcb -> page_pid], sizeof(vid_shown[0]));
+    }
+    pcb -> vid_buffered = buffered;
+
     /* map 4kB video memory page */
     *screen_start = (uint8_t *)(USER_VID_MEM_PAGE << PAGE_BASE_ADDR_OFFSET);
 
-    /* Flush the TLB */
+    /* Remap it here and flush the TLB, other CPUs pick it up when they next schedule */
+    cli_and_save(flags);
+    sched_map_video(cpu_id(), sched_current() -> pcb);
     flush_tlb();
+    restore_flags(flags);
     return 0;
 }
 
+/* 
+ * vidmap
+ * 
+ * DESCRIPTION: maps the text-mode video memory into 
+ *              user space at a pre-set virtual address
+ * 
+ * Input: screen_start - pre-set virtual address in user space
+ * Output: none
+ * Return Values: 0 for success, -1 for failure
+ * 
+ * SIDE EFFECTS: ends double buffering if the process had asked for it
+ */
+int32_t vidmap (uint8_t** screen_start) {
+    return vidmap_map(screen_start, 0);
+}
+
+/*
+ * vidmap_buffered
+ *
+ * DESCRIPTION: like vidmap, but maps a back page private to the process
+ *              holding a copy of the screen. Nothing drawn there is seen
+ *              until vidmap_present.
+ *
+ * Input: screen_start - pre-set virtual address in user space
+ * Output: none
+ * Return Values: 0 for success, -1 for failure
+ *
+ * SIDE EFFECTS: the process's threads all draw into the back page
+ */
+int32_t vidmap_buffered (uint8_t** screen_start) {
+    return vidmap_map(screen_start, 1);
+}
+
+/*
+ * vidmap_present
+ *
+ * DESCRIPTION: puts the rows of the back page that changed since the last
+ *              present on the terminal's screen. Unchanged rows are found
+ *              by comparing against a copy, not through the page's dirty
+ *              bit: the vidmap entry is per CPU and rewritten whenever the
+ *              scheduler switches, which loses the bit.
+ *
+ * Input: none
+ * Output: none
+ * Return Values: rows drawn, -1 if the process did not call vidmap_buffered
+ *
+ * SIDE EFFECTS: draws on the screen
+ */
+int32_t vidmap_present (void) {
+    pcb_t* pcb = sched_process();
+
+    if (!pcb -> vid_buffered)
+        return -1;
+    return screen_present(sched_term, vid_back[pcb -> page_pid], vid_shown[pcb -> page_pid]);
+}
+
+/*
+ * vidmap_page
+ *
+ * DESCRIPTION: page the vidmap entry maps for a process or thread
+ *
+ * Input: pcb - process or thread
+ * Output: none
+ * Return Values: physical address of the page
+ *
+ * SIDE EFFECTS: none
+ */
+uint32_t vidmap_page (pcb_t* pcb) {
+    if (pcb -> leader -> vid_buffered)
+        return (uint32_t) vid_back[pcb -> page_pid];
+    return (uint32_t) terminal[pcb -> terminal_id].video_mem;
+}
+
 /* 
  * set_handler
  * 
@@ -649,7 +1441,7 @@ int32_t vidmap (uint8_t** screen_start) {
  */
 int32_t set_handler (int32_t signum, void* handler_address) {
     /* Extra Credit */
-    printf("Set_handler\n");
+    printk(KLOG_DEBUG, "set_handler %d\n", signum);
     return 0;
 }
 
@@ -666,6 +1458,6 @@ int32_t set_handler (int32_t signum, void* handler_address) {
  */
 int32_t sigreturn (void) {
     /* Extra Credit */
-    printf("Sigreturn\n");
+    printk(KLOG_DEBUG, "sigreturn\n");
     return 0;
 }
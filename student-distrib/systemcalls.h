@@ -14,9 +14,25 @@
 #define ELF_OFFSET          1               /* first character is always 'del' before "ELF" */
 #define PAGE_DIR_MASK       0xFFC00000      /* Mask to get just the highest 10 bits (page dir offset) of the address*/
 #define _8KB_               0x00002000      /* 8KB = 8192 bytes */
-#define PID_SIZE            8               /* Number of possible PIDs in our OS */
 #define EXCEPTION_OCCURRED  256             /* Signifies exception occurred */
-#define MAX_PROC            6               /* Maximum number of processes that can run at once */
+#define MAX_PROC            24              /* Maximum number of processes that can run at once */
+
+/* pid_array states */
+#define PID_FREE            0
+#define PID_USED            1
+#define PID_EXITED          2               /* thread exited, free once its task is off the CPU */
+
+/* PCB of a PID, at the bottom of the PID's 8KB kernel stack */
+#define PCB_ADDR(pid)       ((pcb_t*)(KERNEL_MEM_END - ((pid) + 1) * _8KB_))
+
+/* Most buffers one readv or writev takes */
+#define IOV_MAX             16
+
+/* One buffer of a readv or writev */
+typedef struct iovec {
+    void* base;
+    int32_t len;
+} iovec_t;
 
 /* dummy function returns -1 for terminal_open */
 int32_t bad_call_open(const uint8_t* filename);
@@ -24,12 +40,27 @@ int32_t bad_call_open(const uint8_t* filename);
 /* dummy function returns -1 for terminal_close */
 int32_t bad_call_close(int32_t fd);
 
-/* exits the current process running */
+/* dummy function returns -1 for reads of a pipe's write end */
+int32_t bad_call_read(int32_t fd, void* buf, int32_t nbytes);
+
+/* dummy function returns -1 for writes to a pipe's read end */
+int32_t bad_call_write(int32_t fd, const void* buf, int32_t nbytes);
+
+/* dummy function returns -1 for ioctl on anything but a terminal */
+int32_t bad_call_ioctl(int32_t fd, uint32_t request, uint32_t arg);
+
+/* exits the current process running, or only the current thread */
 int32_t halt (uint8_t status);
 
+/* starts a thread sharing the current process's memory and files */
+int32_t clone (uint32_t entry, uint32_t stack);
+
 /* executes programs */
 int32_t execute(const uint8_t* command);
 
+/* executes programs with stdin and stdout taken from the caller's fds */
+int32_t execute_redirect(const uint8_t* command, int32_t in_fd, int32_t out_fd);
+
 /* [helper function] parses command into three seperate buffers*/
 void execute_parse_args(uint8_t* filename_buf, uint8_t* args_buf, const uint8_t* command);
 
@@ -46,7 +77,7 @@ int32_t execute_program_paging(int8_t new_pid);
 void execute_user_level_program_loader();
 
 /* [helper function] creates a new pcb for a new process */
-int32_t execute_create_pcb(dentry_t* dentry, uint8_t* filename, uint8_t* args, int8_t new_pid);
+int32_t execute_create_pcb(dentry_t* dentry, uint8_t* filename, uint8_t* args, int8_t new_pid, fd_array_t** stdio);
 
 /* [helper function] context switch (fool IRET) to run other process*/
 int32_t execute_context_switch(uint8_t* filename);
@@ -63,12 +94,42 @@ int32_t write (int32_t fd, const void* buf, int32_t nbytes);
 /* Close the file descriptor passed in and set it to be available */
 int32_t close (int32_t fd);
 
+/* checks a system call's buffer lies in the user-level page */
+int32_t user_range (const void* addr, uint32_t size);
+
+/* read system call into several buffers in turn */
+int32_t readv (int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
+/* write system call from several buffers in turn */
+int32_t writev (int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
+/* writes part of a file to another fd without a user buffer */
+int32_t sendfile (int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count);
+
+/* device specific request on an fd */
+int32_t ioctl (int32_t fd, uint32_t request, uint32_t arg);
+
+/* creates a pipe, returning its read and write fds */
+int32_t pipe (int32_t* fds);
+
+/* opens a named message queue, returning its fd */
+int32_t mq_open (const uint8_t* name, uint32_t timeout);
+
 /* returns arguments passed to executable */
 int32_t getargs (uint8_t* buf, int32_t nbytes);
 
 /* sets a pointer to video memory */ 
 int32_t vidmap (uint8_t** screen_start);
 
+/* sets a pointer to a back page that vidmap_present puts on screen */
+int32_t vidmap_buffered (uint8_t** screen_start);
+
+/* draws the rows of the back page that changed */
+int32_t vidmap_present (void);
+
+/* page the vidmap entry maps for a process or thread */
+uint32_t vidmap_page (pcb_t* pcb);
+
 /* EXTRA CREDIT */
 int32_t set_handler (int32_t signum, void* handler_address);
 
@@ -1,5 +1,7 @@
 #include "terminal.h"
 #include "lib.h"
+#include "scheduler.h"
+#include "poll.h"
 
 /* 
  * terminal_init
@@ -14,17 +16,22 @@
  */
 void terminal_init () {
     int i;
-    for (i = 0; i < TERMINAL_COUNT; i++) {
+    for (i = 0; i < TERMINAL_MAX; i++) {
         terminal[i].screen_x = 0;
         terminal[i].screen_y = 0;
         terminal[i].active = 0;
         terminal[i].buffer_index = 0;
-        terminal[i].curr_pcb = NULL;
         terminal[i].rtc_constant = 0;
         terminal[i].rtc_iterations = 0;
-        terminal[i].video_mem = (int8_t*) (VIDEO + ((i + 1) * PAGE_SIZE));
+        terminal[i].rtc_armed = 0;
+        screen_init(i);
+        scrollback_init(i);
         memset(terminal[i].internal_buffer, '\0', MAX_BUFFER_SIZE);
         terminal[i].buffer_index = 0;
+        terminal[i].kbd_head = 0;
+        terminal[i].kbd_tail = 0;
+        terminal[i].redraw = 0;
+        terminal[i].reader = NULL;
     }
     curr_term = 0;
     sched_term = 0;
@@ -46,64 +53,228 @@ int32_t terminal_open (const uint8_t* filename) {
 }
 
 /* 
- * terminal_read
+ * terminal_key
  * 
- * DESCRIPTION: function to read data from the keyboard, file, device (RTC), or directory
+ * DESCRIPTION: queues a key event for a terminal. Called only from the
+ * keyboard interrupt, the one producer of each ring, so the event is
+ * published without a lock; the lock is only taken to wake a reader.
  * 
- * Input: int32_t fd - file descriptor of device being used
- *        void* buf - buffer being written to (user level)
- *        int32_t nbytes - number of bytes being read off of keyboard, file, device, or directory
- * Output: Writes values from device internal buffer onto argument buffer (user level)
- * Return Values: Number of bytes read
+ * Input: uint8_t term - terminal the key was typed on
+ *        uint16_t event - character, control character or KEY_* code
+ * Output: N/A
+ * Return Values: none
  * 
- * SIDE EFFECTS: N/A
+ * SIDE EFFECTS: drops the key if the ring is full, wakes the reader
  */
-int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes) {
-    /* check for valid argument */
-    if (buf == NULL || nbytes < 0)
+void terminal_key (uint8_t term, uint16_t event) {
+    term_t* t = &terminal[term];
+    uint32_t flags;
+
+    if (t->kbd_head - t->kbd_tail == KBD_RING_SIZE)
+        return;
+
+    t->kbd_ring[t->kbd_head & (KBD_RING_SIZE - 1)] = event;
+    /* the event is stored before readers can see it */
+    asm volatile ("" : : : "memory");
+    t->kbd_head++;
+
+    spin_lock_irqsave(&console_lock, flags);
+    if (t->reader != NULL)
+        sched_wakeup(t->reader);
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    poll_notify();
+}
+
+/* 
+ * kbd_pop
+ * 
+ * DESCRIPTION: takes the oldest key event of a terminal
+ * 
+ * Input: term_t* t - terminal, console_lock held by the caller
+ * Output: N/A
+ * Return Values: the event, -1 if there is none
+ * 
+ * SIDE EFFECTS: none
+ */
+static int32_t kbd_pop (term_t* t) {
+    int32_t event;
+
+    if (t->kbd_tail == t->kbd_head)
         return -1;
-    
-    /* cast void* argument to int8_t* for modification */
-    int8_t* buffer = (int8_t*) buf; 
-    int32_t num_bytes_read = 0;
+    event = t->kbd_ring[t->kbd_tail & (KBD_RING_SIZE - 1)];
+    t->kbd_tail++;
+    return event;
+}
 
-    int i;
-    /* special case for clearing the screen */
-    if (ctrl_L_flag) {
-        /* restore values of internal buffer and buffer index before ctrl+L */
-        memcpy(terminal[sched_term].internal_buffer, placeholder_buf, MAX_BUFFER_SIZE);
-        terminal[sched_term].buffer_index = placeholder_buf_index;
-
-        /* Redisplay all characters previously in the buffer */
-        for (i = 0; i < terminal[sched_term].buffer_index; i++)
-            putc(terminal[sched_term].internal_buffer[i]);
-
-        /* reset clear flag */
-        ctrl_L_flag = 0;
+/* 
+ * terminal_line_append
+ * 
+ * DESCRIPTION: adds a typed character to the line being edited and echoes it
+ * 
+ * Input: uint8_t term - terminal, console_lock held by the caller
+ *        uint8_t c - character typed
+ * Output: N/A
+ * Return Values: none
+ * 
+ * SIDE EFFECTS: none
+ */
+static void terminal_line_append (uint8_t term, uint8_t c) {
+    /* leave room for the newline */
+    if (terminal[term].buffer_index >= MAX_BUFFER_SIZE - 1)
+        return;
+    terminal[term].internal_buffer[terminal[term].buffer_index++] = c;
+    term_echo(term, c);
+}
+
+/* 
+ * terminal_read_line
+ * 
+ * DESCRIPTION: canonical read. Takes key events, editing and echoing the
+ * line, until Enter, then returns the line with a newline at the end.
+ * Ctrl+L clears the screen and returns an empty line so the program can
+ * draw its prompt again; the next read puts the unfinished line back.
+ * 
+ * Input: uint8_t term - terminal of the reading process
+ *        int8_t* buffer - user buffer
+ *        int32_t nbytes - size of buffer
+ * Output: buffer - the line
+ * Return Values: number of bytes read
+ * 
+ * SIDE EFFECTS: sleeps until a key arrives
+ */
+static int32_t terminal_read_line (uint8_t term, int8_t* buffer, int32_t nbytes) {
+    term_t* t = &terminal[term];
+    int32_t event, num_bytes_read = 0, i;
+    uint32_t flags;
+
+    spin_lock_irqsave(&console_lock, flags);
+
+    /* the screen was cleared under the unfinished line, show it again */
+    if (t->redraw) {
+        for (i = 0; i < t->buffer_index; i++)
+            term_echo(term, t->internal_buffer[i]);
+        t->redraw = 0;
     }
 
-    sti();
-    /* wait for enter press */
-    while(!terminal[sched_term].enter_flag);
-    terminal[sched_term].enter_flag = 0;
-    cli();
+    while (1) {
+        while ((event = kbd_pop(t)) == -1) {
+            t->reader = sched_current();
+            sched_sleep(&console_lock);
+        }
+        t->reader = NULL;
+
+        if (event == NEWLINE) {
+            term_echo(term, NEWLINE);
+            break;
+        }
+
+        if (event == KEY_CLEAR) {
+            /* keep the line for the next read, hand back an empty one */
+            screen_clear(term);
+            t->redraw = 1;
+            buffer[0] = NEWLINE;
+            spin_unlock_irqrestore(&console_lock, flags);
+            return 1;
+        }
+
+        if (event == KEY_BACKSPACE) {
+            if (t->buffer_index != 0) {
+                t->buffer_index--;
+                term_erase(term);
+            }
+        } else if (event == '\t') {
+            /* A tab input consists of 4 spaces - so 4 iterations */
+            for (i = 0; i < 4; i++)
+                terminal_line_append(term, ' ');
+        } else if (event >= ' ' && event < 0x7F) {
+            terminal_line_append(term, event);
+        }
+    }
 
     /* count number of bytes typed */
-    for (i = 0; i < terminal[sched_term].buffer_index && i < (nbytes - 1); i++)
+    for (i = 0; i < t->buffer_index && i < (nbytes - 1); i++)
         num_bytes_read++;
 
     /* copies current internal buffer into argument; inserts NEWLINE at end */
-    memcpy(buffer, terminal[sched_term].internal_buffer, num_bytes_read);
+    memcpy(buffer, t->internal_buffer, num_bytes_read);
     buffer[num_bytes_read++] = NEWLINE;
 
     /* clears internal buffer and resets buffer index */
-    memset(terminal[sched_term].internal_buffer, '\0', MAX_BUFFER_SIZE);
-    terminal[sched_term].buffer_index = 0;
+    memset(t->internal_buffer, '\0', MAX_BUFFER_SIZE);
+    t->buffer_index = 0;
+    spin_unlock_irqrestore(&console_lock, flags);
 
     /* return number of bytes read */
     return num_bytes_read;
 }
 
+/* 
+ * terminal_read_raw
+ * 
+ * DESCRIPTION: raw read. Returns the keys typed so far, one byte each and
+ * ESC [ A to D for the arrow keys, without echo or waiting.
+ * 
+ * Input: uint8_t term - terminal of the reading process
+ *        uint8_t* buffer - user buffer
+ *        int32_t nbytes - size of buffer
+ * Output: buffer - the keys
+ * Return Values: number of bytes read, 0 if no key is waiting
+ * 
+ * SIDE EFFECTS: none
+ */
+static int32_t terminal_read_raw (uint8_t term, uint8_t* buffer, int32_t nbytes) {
+    term_t* t = &terminal[term];
+    int32_t event, num_bytes_read = 0;
+    uint32_t flags;
+
+    spin_lock_irqsave(&console_lock, flags);
+    while (t->kbd_tail != t->kbd_head) {
+        event = t->kbd_ring[t->kbd_tail & (KBD_RING_SIZE - 1)];
+
+        if (event >= KEY_UP) {
+            /* an arrow key is read whole or not at all */
+            if (num_bytes_read + 3 > nbytes)
+                break;
+            buffer[num_bytes_read++] = KEY_ESC;
+            buffer[num_bytes_read++] = '[';
+            buffer[num_bytes_read++] = 'A' + (event - KEY_UP);
+        } else {
+            if (num_bytes_read == nbytes)
+                break;
+            buffer[num_bytes_read++] = event;
+        }
+        t->kbd_tail++;
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    return num_bytes_read;
+}
+
+/* 
+ * terminal_read
+ * 
+ * DESCRIPTION: function to read data from the keyboard, file, device (RTC), or directory
+ * 
+ * Input: int32_t fd - file descriptor of device being used
+ *        void* buf - buffer being written to (user level)
+ *        int32_t nbytes - number of bytes being read off of keyboard, file, device, or directory
+ * Output: Writes values from device internal buffer onto argument buffer (user level)
+ * Return Values: Number of bytes read
+ * 
+ * SIDE EFFECTS: N/A
+ */
+int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes) {
+    /* check for valid argument */
+    if (buf == NULL || nbytes < 0)
+        return -1;
+    if (nbytes == 0)
+        return 0;
+
+    if (sched_process() -> fd_array[fd].file_position == TTY_RAW)
+        return terminal_read_raw(sched_term, (uint8_t*) buf, nbytes);
+    return terminal_read_line(sched_term, (int8_t*) buf, nbytes);
+}
 
 /* 
  * terminal_write
@@ -113,36 +284,18 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes) {
  * Input: int32_t fd - file descriptor of device being used
  *        const void* buf - buffer being written from
  *        int32_t nbytes - number of bytes being written from argument buffer to device/terminal
- * Output: Writes onto device/terminal using putc
+ * Output: Writes onto device/terminal using putbuf
  * Return Values: Number of bytes typed
  * 
  * SIDE EFFECTS: Updates value of internal buffer
  */
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes) {
-    int32_t num_bytes_typed = 0;
-    
     /* check for valid argument */
     if (buf == NULL || nbytes < 0)
         return -1;
-    
-
-    /* cast void* argument to int8_t* for modification */
-    int8_t* buffer = (int8_t*) buf; 
-    
-    /* iterate through all characters to be written */
-    int i;
-    for (i = 0; i < nbytes; i++) {
-        /* do not print null characters */
-        if (buffer[i] == '\0')
-            continue;
-        
-        /* write characters to screen */
-        putc(buffer[i]);
-        num_bytes_typed++;
-    }
 
-    /* return number of bytes typed */
-    return num_bytes_typed;
+    /* write the whole buffer to screen, null characters are not printed */
+    return putbuf(sched_term, (const int8_t*) buf, nbytes);
 }
 
 
@@ -160,3 +313,72 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes) {
 int32_t terminal_close (int32_t fd) {
     return 0;
 }
+
+/* 
+ * terminal_poll
+ * 
+ * DESCRIPTION: poll callback of the terminal. Writes never block. A raw
+ * read is ready once any key is waiting, a canonical one once Enter or
+ * Ctrl+L is.
+ * 
+ * Input: int32_t fd - file descriptor of device being used
+ * Output: N/A
+ * Return Values: POLLOUT, plus POLLIN if a read would not block
+ * 
+ * SIDE EFFECTS: none
+ */
+int32_t terminal_poll (int32_t fd) {
+    term_t* t = &terminal[sched_term];
+    int32_t ready = POLLOUT;
+    uint32_t flags, i;
+    uint16_t event;
+
+    spin_lock_irqsave(&console_lock, flags);
+    if (sched_process() -> fd_array[fd].file_position == TTY_RAW) {
+        if (t->kbd_tail != t->kbd_head)
+            ready |= POLLIN;
+    } else {
+        for (i = t->kbd_tail; i != t->kbd_head; i++) {
+            event = t->kbd_ring[i & (KBD_RING_SIZE - 1)];
+            if (event == NEWLINE || event == KEY_CLEAR) {
+                ready |= POLLIN;
+                break;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    return ready;
+}
+
+/* 
+ * terminal_ioctl
+ * 
+ * DESCRIPTION: TTY_SETMODE switches a terminal fd between TTY_CANON and
+ * TTY_RAW reads, TTY_GETMODE returns its mode. The mode belongs to the fd,
+ * so stdin can be raw while another fd on the terminal stays canonical.
+ * 
+ * Input: int32_t fd - terminal file descriptor
+ *        uint32_t request - TTY_SETMODE or TTY_GETMODE
+ *        uint32_t arg - new mode for TTY_SETMODE
+ * Output: N/A
+ * Return Values: the mode for TTY_GETMODE, 0 for TTY_SETMODE, -1 on a bad
+ * request or mode
+ * 
+ * SIDE EFFECTS: changes how reads on fd behave
+ */
+int32_t terminal_ioctl (int32_t fd, uint32_t request, uint32_t arg) {
+    fd_array_t* file = &sched_process() -> fd_array[fd];
+
+    switch (request) {
+        case TTY_SETMODE:
+            if (arg != TTY_CANON && arg != TTY_RAW)
+                return -1;
+            file -> file_position = arg;
+            return 0;
+        case TTY_GETMODE:
+            return file -> file_position;
+        default:
+            return -1;
+    }
+}
@@ -6,16 +6,24 @@
 #define MAX_BUFFER_SIZE 128
 #define NEWLINE 0xA
 
-/* Internal buffer */
-uint8_t internal_buffer[TERMINAL_COUNT][MAX_BUFFER_SIZE];
-/* Placeholder buffer for ctrl+L special case */
-uint8_t placeholder_buf[TERMINAL_COUNT][MAX_BUFFER_SIZE];
-/* Number of elements in the internal buffer */
-volatile uint32_t buffer_index;
-/* Placeholder buffer index for ctrl+L special case */
-volatile uint32_t placeholder_buf_index;
-/* Identifies if ctrl+L has been pressed */
-volatile uint32_t ctrl_L_flag;
+/* Key events above the byte range, raw reads see them as ESC [ A..D */
+#define KEY_UP      0x100
+#define KEY_DOWN    0x101
+#define KEY_RIGHT   0x102
+#define KEY_LEFT    0x103
+
+/* Control characters the line discipline acts on */
+#define KEY_BACKSPACE   0x08
+#define KEY_CLEAR       0x0C        /* Ctrl+L */
+#define KEY_ESC         0x1B
+
+/* Read modes of a terminal fd, kept in its file position */
+#define TTY_CANON   0           /* line edited and echoed, read blocks for Enter */
+#define TTY_RAW     1           /* one byte per key, no echo, read never blocks */
+
+/* ioctl requests on a terminal fd */
+#define TTY_SETMODE 1
+#define TTY_GETMODE 2
 
 /* initialize terminal */
 void terminal_init();
@@ -32,4 +40,16 @@ int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes);
 /* Closes the specified file descriptor for access by another open */
 int32_t terminal_close (int32_t fd);
 
+/* Reports whether a terminal read or write would block */
+int32_t terminal_poll (int32_t fd);
+
+/* Sets or reads the mode of a terminal fd */
+int32_t terminal_ioctl (int32_t fd, uint32_t request, uint32_t arg);
+
+/* Queues a key event for a terminal, called from the keyboard interrupt */
+void terminal_key (uint8_t term, uint16_t event);
+
+/* Number of terminals the boot command line asks for, in kernel.c */
+uint32_t boot_terminal_count(const int8_t* cmdline);
+
 #endif  /* end if for _TERMINAL_H */
@@ -7,6 +7,19 @@
 #include "terminal.h"
 #include "filesystem.h"
 #include "systemcalls.h"
+#include "context_switch.h"
+#include "fpu.h"
+#include "workqueue.h"
+#include "pit.h"
+#include "futex.h"
+#include "pipe.h"
+#include "shm.h"
+#include "mq.h"
+#include "serial.h"
+#include "klog.h"
+#include "poll.h"
+#include "vbe.h"
+#include "scheduler.h"
 
 #define PASS 1
 #define FAIL 0
@@ -218,7 +231,7 @@ int paging_pd_entries() {
 	TEST_HEADER;
 
 	/* Get last bit of each page directory page */
-	if(((page_directory[0] & 0x01) & (page_directory[1] & 0x01)) != 1) {
+	if(((page_directory[0][0] & 0x01) & (page_directory[0][1] & 0x01)) != 1) {
 		return FAIL;
 	}
 	return PASS;
@@ -609,6 +622,969 @@ int open_read_test() {
 
 /* Checkpoint 5 tests */
 
+/* Number of round trips made by switch_to_test */
+#define SWITCH_TEST_ROUNDS	1000
+
+/* Contexts and stack bounced between by switch_to_test */
+static context_t switch_test_main;
+static context_t switch_test_peer;
+static uint8_t switch_test_stack[KBYTE_4] __attribute__((aligned(BYTE_4)));
+static volatile uint32_t switch_test_count;
+
+/* Body of the peer context: counts each visit and switches straight back */
+static void switch_test_body() {
+	while (1) {
+		switch_test_count++;
+		switch_to(&switch_test_peer, &switch_test_main);
+	}
+}
+
+/* Context Switch Test
+ * 
+ * Asserts that switch_to resumes both contexts with their state intact
+ * and reports the average cost of one switch in cycles
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: switch_to
+ * Files: context_switch.h/S
+ */
+int switch_to_test() {
+	TEST_HEADER;
+
+	int i;
+	uint32_t flags;
+	uint32_t cycles;
+	uint64_t start;
+
+	/* fresh context that starts in switch_test_body */
+	switch_test_peer.ebp = 0;
+	switch_test_peer.esp = (uint32_t) &switch_test_stack[KBYTE_4 - BYTE_4];
+	switch_test_peer.eip = (uint32_t) switch_test_body;
+	switch_test_peer.eflags = CTX_INIT_EFLAGS;
+	switch_test_count = 0;
+
+	cli_and_save(flags);
+	start = rdtsc();
+	for (i = 0; i < SWITCH_TEST_ROUNDS; i++)
+		switch_to(&switch_test_main, &switch_test_peer);
+	cycles = (uint32_t) (rdtsc() - start);
+	restore_flags(flags);
+
+	/* every switch into the peer must have come back exactly once */
+	if (switch_test_count != SWITCH_TEST_ROUNDS)
+		return FAIL;
+
+	/* each round trip is two switches */
+	printf("switch_to: %u cycles per switch\n", cycles / (2 * SWITCH_TEST_ROUNDS));
+	return PASS;
+}
+
+/* fpu_trap_test
+ *
+ * Arms the lazy FPU switch and runs an x87 instruction, which must trap
+ * into the #NM handler and come back to finish the computation
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: clears CR0.TS
+ * Coverage: fpu_switch, fpu_handler
+ */
+int fpu_trap_test() {
+	TEST_HEADER;
+
+	uint32_t cr0;
+	uint32_t result;
+
+	/* nothing owns the FPU for a NULL process, so TS gets set */
+	fpu_switch(NULL, NULL);
+	asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+	if (!(cr0 & CR0_TS))
+		return FAIL;
+
+	/* 1 + 1 on the x87 stack, the first instruction raises #NM */
+	asm volatile ("    \n\
+		fld1           \n\
+		fld1           \n\
+		faddp          \n\
+		fistpl %0"
+		: "=m"(result)
+	);
+
+	asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+	if (result != 2 || (cr0 & CR0_TS))
+		return FAIL;
+
+	return PASS;
+}
+
+/* Number of acquisitions made by spinlock_test */
+#define SPINLOCK_TEST_ROUNDS	100
+
+/* Spinlock Test
+ *
+ * Asserts that a ticket lock is exclusive, that trylock respects it and
+ * that the counters track every acquisition, then prints the counters
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: spin_lock, spin_trylock, spin_unlock, spin_lock_irqsave
+ * Files: spinlock.h/c
+ */
+int spinlock_test() {
+	TEST_HEADER;
+
+	int i;
+	uint32_t flags;
+	spinlock_t lock;
+
+	spin_lock_init(&lock, "spinlock_test");
+
+	for (i = 0; i < SPINLOCK_TEST_ROUNDS; i++) {
+		spin_lock_irqsave(&lock, flags);
+		spin_unlock_irqrestore(&lock, flags);
+	}
+
+	/* a held lock cannot be taken again, a free one can */
+	spin_lock(&lock);
+	if (spin_trylock(&lock))
+		return FAIL;
+	spin_unlock(&lock);
+	if (!spin_trylock(&lock))
+		return FAIL;
+	spin_unlock(&lock);
+
+	/* nobody else touched the lock, so it never had to wait */
+	if (lock.acquired != SPINLOCK_TEST_ROUNDS + 2 || lock.contended != 0)
+		return FAIL;
+
+	spin_lock_report(&lock);
+	spin_lock_report(&console_lock);
+	return PASS;
+}
+
+/* Work items queued by workqueue_test and PIT ticks it waits for them */
+#define WORKQUEUE_TEST_ITEMS	8
+#define WORKQUEUE_TEST_TICKS	50
+
+/* Sum of the arguments the worker has run workqueue_test_fn with */
+static volatile uint32_t workqueue_test_sum;
+
+/* Work function for workqueue_test */
+static void workqueue_test_fn(uint32_t arg) {
+	workqueue_test_sum += arg;
+}
+
+/* Workqueue Test
+ *
+ * Queues work the way an interrupt handler would and checks that the
+ * kernel worker runs every item within a few scheduler ticks
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: work_queue, worker task, sched_sleep, sched_wakeup
+ * Files: workqueue.h/c, scheduler.c
+ */
+int workqueue_test() {
+	TEST_HEADER;
+
+	uint32_t i, start, expected = 0;
+
+	workqueue_test_sum = 0;
+	for (i = 1; i <= WORKQUEUE_TEST_ITEMS; i++) {
+		if (work_queue(workqueue_test_fn, i) != 0)
+			return FAIL;
+		expected += i;
+	}
+
+	/* the worker preempts us on a tick, runs the items and sleeps again */
+	start = pit_ticks;
+	while (workqueue_test_sum != expected && pit_ticks - start < WORKQUEUE_TEST_TICKS);
+
+	return (workqueue_test_sum == expected) ? PASS : FAIL;
+}
+
+/* Futex Test
+ *
+ * Checks the page walk used to key futex words and that futex refuses
+ * kernel and misaligned addresses before touching them
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: paging_virt_to_phys, paging_user_to_phys, futex argument checks
+ * Files: paging.c, futex.h/c
+ */
+int futex_test() {
+	TEST_HEADER;
+
+	static uint32_t word = 0;
+
+	/* the kernel image and video memory are identity mapped */
+	if (paging_virt_to_phys((uint32_t) &word) != (uint32_t) &word)
+		return FAIL;
+	if (paging_virt_to_phys(VIDEO + 1) != VIDEO + 1)
+		return FAIL;
+	/* nothing is mapped just past the kernel page without a process */
+	if (paging_virt_to_phys(KERNEL_MEM_END + 4 * _4MB_) != 0)
+		return FAIL;
+	/* kernel-only maps are not user memory, so no futex lands on them */
+	if (paging_user_to_phys((uint32_t) &word) != 0)
+		return FAIL;
+	if (paging_user_to_phys(VIDEO + 1) != 0)
+		return FAIL;
+
+	if (futex(&word, FUTEX_WAKE, 1) != -1)
+		return FAIL;
+	if (futex((uint32_t*) (PROGRAM_IMAGE_ADDR + 1), FUTEX_WAIT, 0) != -1)
+		return FAIL;
+
+	return PASS;
+}
+
+/* Pipe Test
+ *
+ * Pushes data through a pipe around the end of its ring buffer and checks
+ * it comes out intact, then that closing the ends gives end of file and
+ * failed writes instead of blocking
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: pipe_create, pipe_read_bytes, pipe_write_bytes, pipe_put
+ * Files: pipe.h/c
+ */
+int pipe_test() {
+	TEST_HEADER;
+
+	static uint8_t out[PIPE_SIZE / 2 + 1];
+	static uint8_t in[PIPE_SIZE / 2 + 1];
+	int32_t p, round, i;
+
+	if ((p = pipe_create()) == -1)
+		return FAIL;
+
+	/* three half-buffer rounds wrap the ring once */
+	for (round = 0; round < 3; round++) {
+		for (i = 0; i < sizeof(out); i++)
+			out[i] = (uint8_t) (round * 7 + i);
+		if (pipe_write_bytes(p, out, sizeof(out)) != sizeof(out))
+			return FAIL;
+		if (pipe_read_bytes(p, in, sizeof(in)) != sizeof(in))
+			return FAIL;
+		for (i = 0; i < sizeof(in); i++) {
+			if (in[i] != out[i])
+				return FAIL;
+		}
+	}
+
+	/* buffered bytes are still read after the writer is gone, then EOF */
+	if (pipe_write_bytes(p, out, 10) != 10)
+		return FAIL;
+	pipe_put(p, PIPE_WRITE_END);
+	if (pipe_read_bytes(p, in, sizeof(in)) != 10)
+		return FAIL;
+	if (pipe_read_bytes(p, in, sizeof(in)) != 0)
+		return FAIL;
+
+	pipe_put(p, PIPE_READ_END);
+	return PASS;
+}
+
+/* Readv Writev Test
+ *
+ * Runs the boot task as a stand-in process whose fds 2 and 3 are the
+ * ends of a pipe, writes two buffers with writev and reads them back
+ * split differently with readv, then checks bad arrays are refused
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: readv, writev, iov_copy
+ * Files: systemcalls.h/c
+ */
+int readv_writev_test() {
+	TEST_HEADER;
+
+	static pcb_t process;
+	static uint8_t out[10] = "abcdefghij";
+	static uint8_t in[10];
+	iovec_t iov[IOV_MAX + 1];
+	task_t* task = sched_current();
+	uint32_t flags;
+	int32_t p, i;
+	int32_t result = PASS;
+
+	if ((p = pipe_create()) == -1)
+		return FAIL;
+
+	/* no switch while the task has the stand-in; the buffers are in the
+	 * kernel, as for sendfile */
+	cli_and_save(flags);
+	process.leader = &process;
+	process.fd_array[2].flags = 1;
+	process.fd_array[2].inode = p;
+	process.fd_array[2].file_operations_table_ptr.write = pipe_write;
+	process.fd_array[3].flags = 1;
+	process.fd_array[3].inode = p;
+	process.fd_array[3].file_operations_table_ptr.read = pipe_read;
+	task->pcb = &process;
+	task->kernel_io = 1;
+
+	iov[0].base = out;
+	iov[0].len = 4;
+	iov[1].base = out + 4;
+	iov[1].len = 6;
+	if (writev(2, iov, 2) != 10)
+		result = FAIL;
+
+	iov[0].base = in;
+	iov[0].len = 7;
+	iov[1].base = NULL;
+	iov[1].len = 0;
+	iov[2].base = in + 7;
+	iov[2].len = 3;
+	if (readv(3, iov, 3) != 10)
+		result = FAIL;
+	for (i = 0; i < 10; i++) {
+		if (in[i] != out[i])
+			result = FAIL;
+	}
+
+	/* too many buffers, a negative length, no array */
+	for (i = 0; i <= IOV_MAX; i++) {
+		iov[i].base = out;
+		iov[i].len = 1;
+	}
+	if (writev(2, iov, IOV_MAX + 1) != -1)
+		result = FAIL;
+	iov[0].len = -1;
+	if (writev(2, iov, 1) != -1)
+		result = FAIL;
+	if (readv(3, NULL, 1) != -1)
+		result = FAIL;
+
+	task->pcb = NULL;
+	task->kernel_io = 0;
+	restore_flags(flags);
+
+	pipe_put(p, PIPE_WRITE_END);
+	pipe_put(p, PIPE_READ_END);
+	return result;
+}
+
+/* bytes the pipe behind sendfile_test_write still has room for */
+static int32_t sendfile_room;
+
+/* sendfile_test_write
+ *
+ * Write of sendfile_test's pipe, which acts as though the pipe fills up
+ * after sendfile_room bytes, taking what fits instead of blocking
+ * Inputs: fd - write end
+ *         buf, nbytes - bytes to write
+ * Outputs: None
+ * Return Values: bytes written, -1 once the pipe is full
+ */
+static int32_t sendfile_test_write(int32_t fd, const void* buf, int32_t nbytes) {
+	if (nbytes > sendfile_room)
+		nbytes = sendfile_room;
+	if (nbytes == 0)
+		return -1;
+	sendfile_room -= nbytes;
+	return pipe_write(fd, buf, nbytes);
+}
+
+/* Sendfile Test
+ *
+ * Runs the boot task as a stand-in process with a pipe on fds 2 and 3
+ * and a file spanning two data blocks on fd 4, sends parts of the file
+ * into the pipe and checks what comes out and where the file position
+ * ends up, for explicit and current offsets, a count that ends in the
+ * middle of a block, and a pipe that fills up
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: sendfile, read_data_block
+ * Files: systemcalls.h/c, filesystem.h/c
+ */
+int sendfile_test() {
+	TEST_HEADER;
+
+	static pcb_t process;
+	static uint8_t in[200];
+	static uint8_t expect[200];
+	static const struct {
+		int32_t offset, count, room, sent;
+		uint32_t start, position;
+	} steps[] = {
+		/* explicit offset: file_position stays put */
+		{100, 50, PIPE_SIZE, 50, 100, 0},
+		/* current offset: file_position moves on */
+		{-1, 10, PIPE_SIZE, 10, 0, 10},
+		/* 96 bytes from the first block, then stops 104 into the second */
+		{KBYTE_4 - 96, 200, PIPE_SIZE, 200, KBYTE_4 - 96, 10},
+		/* the pipe fills after 30 bytes */
+		{-1, 100, 30, 30, 10, 40},
+		/* and then takes nothing */
+		{-1, 100, 0, -1, 0, 40}
+	};
+	dentry_t dentry;
+	task_t* task = sched_current();
+	uint32_t flags;
+	int32_t p, i, j;
+	int32_t result = PASS;
+
+	if (read_dentry_by_name((uint8_t*) "verylargetextwithverylongname.tx", &dentry) == -1)
+		return FAIL;
+	if ((p = pipe_create()) == -1)
+		return FAIL;
+
+	/* no switch while the task has the stand-in */
+	cli_and_save(flags);
+	process.leader = &process;
+	process.fd_array[2].flags = 1;
+	process.fd_array[2].inode = p;
+	process.fd_array[2].file_operations_table_ptr.write = sendfile_test_write;
+	process.fd_array[3].flags = 1;
+	process.fd_array[3].inode = p;
+	process.fd_array[3].file_operations_table_ptr.read = pipe_read;
+	process.fd_array[4].flags = 1;
+	process.fd_array[4].inode = dentry.inode_num;
+	process.fd_array[4].file_position = 0;
+	process.fd_array[4].file_operations_table_ptr.read = fs_read;
+	task->pcb = &process;
+
+	for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+		sendfile_room = steps[i].room;
+		if (sendfile(2, 4, steps[i].offset, steps[i].count) != steps[i].sent)
+			result = FAIL;
+		if (process.fd_array[4].file_position != steps[i].position)
+			result = FAIL;
+		if (steps[i].sent <= 0)
+			continue;
+
+		if (read_data(dentry.inode_num, steps[i].start, expect, steps[i].sent) != steps[i].sent)
+			result = FAIL;
+		if (pipe_read_bytes(p, in, steps[i].sent) != steps[i].sent)
+			result = FAIL;
+		for (j = 0; j < steps[i].sent; j++) {
+			if (in[j] != expect[j])
+				result = FAIL;
+		}
+	}
+
+	task->pcb = NULL;
+	task->kernel_io = 0;
+	restore_flags(flags);
+
+	pipe_put(p, PIPE_WRITE_END);
+	pipe_put(p, PIPE_READ_END);
+	return result;
+}
+
+/* Poll Test
+ *
+ * Runs the boot task as a stand-in process whose fds 2 and 3 are the
+ * ends of a pipe and polls them without waiting: the read end is not
+ * ready until bytes are written, the write end always is, and a closed
+ * fd or too many entries are reported
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: poll, pipe_read_poll, pipe_write_poll
+ * Files: poll.h/c, pipe.h/c
+ */
+int poll_test() {
+	TEST_HEADER;
+
+	static pcb_t process;
+	static uint8_t out[4] = "abcd";
+	pollfd_t fds[2];
+	task_t* task = sched_current();
+	uint32_t flags;
+	int32_t p;
+	int32_t result = PASS;
+
+	if ((p = pipe_create()) == -1)
+		return FAIL;
+
+	/* no switch while the task has the stand-in */
+	cli_and_save(flags);
+	process.leader = &process;
+	process.fd_array[2].flags = 1;
+	process.fd_array[2].inode = p;
+	process.fd_array[2].file_operations_table_ptr.poll = pipe_write_poll;
+	process.fd_array[3].flags = 1;
+	process.fd_array[3].inode = p;
+	process.fd_array[3].file_operations_table_ptr.poll = pipe_read_poll;
+	task->pcb = &process;
+	task->kernel_io = 1;
+
+	/* empty pipe: nothing to read, the timeout passes at once */
+	fds[0].fd = 3;
+	fds[0].events = POLLIN;
+	if (poll(fds, 1, POLL_NOWAIT) != 0 || fds[0].revents != 0)
+		result = FAIL;
+
+	/* the write end has room either way */
+	fds[1].fd = 2;
+	fds[1].events = POLLOUT;
+	if (poll(fds, 2, POLL_NOWAIT) != 1 || fds[1].revents != POLLOUT)
+		result = FAIL;
+
+	if (pipe_write_bytes(p, out, sizeof(out)) != sizeof(out))
+		result = FAIL;
+	if (poll(fds, 2, POLL_NOWAIT) != 2 || fds[0].revents != POLLIN)
+		result = FAIL;
+
+	/* fd 4 is not open */
+	fds[1].fd = 4;
+	if (poll(fds, 2, POLL_NOWAIT) != 2 || fds[1].revents != POLLNVAL)
+		result = FAIL;
+	if (poll(fds, POLL_MAX_FDS + 1, POLL_NOWAIT) != -1)
+		result = FAIL;
+
+	task->pcb = NULL;
+	task->kernel_io = 0;
+	restore_flags(flags);
+
+	pipe_put(p, PIPE_WRITE_END);
+	pipe_put(p, PIPE_READ_END);
+	return result;
+}
+
+/* Shared Memory Test
+ *
+ * Maps a segment for a process and checks the vidmap page table points
+ * its pages at user accessible frames, and that they go away without it
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves this CPU's segment pages unmapped
+ * Coverage: shm_map_process, SHM_ADDR
+ * Files: shm.h/c
+ */
+int shm_test() {
+	TEST_HEADER;
+
+	static pcb_t process;
+	uint32_t entry, virt = SHM_ADDR(1);
+
+	process.shm_mask = (1 << 1);
+	shm_map_process(cpu_id(), &process);
+	flush_tlb();
+
+	entry = user_video_page_table[cpu_id()][(virt >> PAGE_TABLE_OFFSET) & (MAX_ENTRIES - 1)];
+	if ((entry & (USER | RW | PRESENT)) != (USER | RW | PRESENT))
+		return FAIL;
+	if (paging_virt_to_phys(virt) != (entry & ~(PAGE_SIZE - 1)))
+		return FAIL;
+	/* segment 0 is not held */
+	if (paging_virt_to_phys(SHM_ADDR(0)) != 0)
+		return FAIL;
+
+	process.shm_mask = 0;
+	shm_map_process(cpu_id(), &process);
+	flush_tlb();
+	if (paging_virt_to_phys(virt) != 0)
+		return FAIL;
+
+	return PASS;
+}
+
+/* Message Queue Test
+ *
+ * Sends messages of mixed priority in one batch and receives them
+ * highest priority first, arrival order within a priority. Also checks
+ * that a full queue takes no more and an empty one gives nothing.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: message queues
+ * Files: mq.c/h, scheduler.c/h
+ */
+int mq_test() {
+	TEST_HEADER;
+
+	static mq_msg_t msgs[MQ_CAPACITY + 1];
+	static const uint32_t prio[5] = {1, 5, 1, 9, 5};
+	static const uint32_t expect[5] = {3, 1, 4, 0, 2};
+	int32_t mq, i;
+	int32_t result = PASS;
+
+	if ((mq = mq_open_queue((uint8_t*)"mq_test")) == -1)
+		return FAIL;
+
+	for (i = 0; i < 5; i++) {
+		msgs[i].priority = prio[i];
+		msgs[i].len = 1;
+		msgs[i].data[0] = i;
+	}
+	if (mq_send(mq, msgs, 5, MQ_NOWAIT) != 5)
+		result = FAIL;
+	if (mq_receive(mq, msgs, MQ_CAPACITY, MQ_NOWAIT) != 5)
+		result = FAIL;
+	for (i = 0; i < 5; i++) {
+		if (msgs[i].data[0] != expect[i])
+			result = FAIL;
+	}
+
+	/* one more than fits */
+	for (i = 0; i <= MQ_CAPACITY; i++)
+		msgs[i].len = 0;
+	if (mq_send(mq, msgs, MQ_CAPACITY + 1, MQ_NOWAIT) != MQ_CAPACITY)
+		result = FAIL;
+	if (mq_send(mq, msgs, 1, MQ_NOWAIT) != 0)
+		result = FAIL;
+	if (mq_receive(mq, msgs, MQ_CAPACITY + 1, MQ_NOWAIT) != MQ_CAPACITY)
+		result = FAIL;
+	if (mq_receive(mq, msgs, 1, MQ_NOWAIT) != 0)
+		result = FAIL;
+
+	msgs[0].len = MQ_MSG_DATA + 1;
+	if (mq_send(mq, msgs, 1, MQ_NOWAIT) != -1)
+		result = FAIL;
+
+	/* a longer message stops the pass after the ones before it */
+	msgs[0].len = 1;
+	msgs[1].len = MQ_MSG_DATA + 1;
+	if (mq_send(mq, msgs, 2, MQ_NOWAIT) != 1)
+		result = FAIL;
+	if (mq_receive(mq, msgs, MQ_CAPACITY, MQ_NOWAIT) != 1)
+		result = FAIL;
+
+	mq_put(mq);
+	return result;
+}
+
+/* putbuf_test
+ *
+ * Prints a buffer with a null character and a newline in it on a cleared
+ * screen, checks the cells and cursor it leaves, then prints enough
+ * newlines to scroll and checks the cursor stays on the last row.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Clears the screen
+ * Coverage: batched terminal output
+ * Files: lib.c/h, terminal.c/h
+ */
+int putbuf_test() {
+	TEST_HEADER;
+
+	static const int8_t text[6] = {'a', 'b', '\0', 'c', '\n', 'd'};
+	static int8_t newlines[NUM_ROWS];
+	int32_t result = PASS;
+
+	clear();
+	if (putbuf(curr_term, text, 6) != 5)
+		result = FAIL;
+	if (*screen_cell(curr_term, 0, 0) != 'a' || *screen_cell(curr_term, 2, 0) != 'c' ||
+	    *screen_cell(curr_term, 0, 1) != 'd')
+		result = FAIL;
+	if (terminal[curr_term].screen_x != 1 || terminal[curr_term].screen_y != 1)
+		result = FAIL;
+
+	memset(newlines, '\n', NUM_ROWS);
+	if (putbuf(curr_term, newlines, NUM_ROWS) != NUM_ROWS)
+		result = FAIL;
+	if (terminal[curr_term].screen_x != 0 || terminal[curr_term].screen_y != NUM_ROWS - 1)
+		result = FAIL;
+
+	return result;
+}
+
+/* scrollback_test
+ *
+ * Scrolls a line off the top of a cleared screen, browses back to it and
+ * checks it is drawn on the first row, then returns to the live page.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Clears the screen
+ * Coverage: scrollback
+ * Files: lib.c/h
+ */
+int scrollback_test() {
+	TEST_HEADER;
+
+	static int8_t newlines[NUM_ROWS];
+	int32_t result = PASS;
+
+	clear();
+	memset(newlines, '\n', NUM_ROWS);
+	(void)putbuf(curr_term, (int8_t*)"x\n", 2);
+	(void)putbuf(curr_term, newlines, NUM_ROWS);
+	if (*screen_cell(curr_term, 0, 0) == 'x')
+		result = FAIL;
+
+	/* the line is two lines above the live page */
+	screen_browse(2);
+	if (terminal[curr_term].sb_view != 2 || *screen_cell(curr_term, 0, 0) != 'x')
+		result = FAIL;
+
+	screen_browse(-NUM_ROWS);
+	if (terminal[curr_term].sb_view != 0 || *screen_cell(curr_term, 0, 0) == 'x')
+		result = FAIL;
+
+	return result;
+}
+
+/* ansi_test
+ *
+ * Writes escape sequences for cursor positioning, colors and erase in
+ * line, one of them split across two writes, and checks the cells.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Clears the screen
+ * Coverage: ANSI escape sequences
+ * Files: lib.c/h
+ */
+int ansi_test() {
+	TEST_HEADER;
+
+	int32_t result = PASS;
+
+	clear();
+	(void)putbuf(curr_term, (int8_t*)"\033[3;5Hx\033[31my\033[0m", 17);
+	if (*screen_cell(curr_term, 4, 2) != 'x' || *screen_cell(curr_term, 5, 2) != 'y')
+		result = FAIL;
+	if (*(screen_cell(curr_term, 4, 2) + 1) != ATTRIB || *(screen_cell(curr_term, 5, 2) + 1) != 0x04)
+		result = FAIL;
+
+	(void)putbuf(curr_term, (int8_t*)"\033[2K", 4);
+	if (*screen_cell(curr_term, 4, 2) != ' ' || *screen_cell(curr_term, 5, 2) != ' ')
+		result = FAIL;
+
+	/* a sequence split across writes */
+	(void)putbuf(curr_term, (int8_t*)"\033[1", 3);
+	(void)putbuf(curr_term, (int8_t*)";1Hz", 4);
+	if (*screen_cell(curr_term, 0, 0) != 'z')
+		result = FAIL;
+
+	return result;
+}
+
+/* kbd_ring_test
+ *
+ * Queues more key events than a terminal's ring holds and checks the
+ * extra one is dropped and the oldest is still first, then empties it.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Discards keys waiting on the displayed terminal
+ * Coverage: keyboard event ring
+ * Files: terminal.c/h
+ */
+int kbd_ring_test() {
+	TEST_HEADER;
+
+	term_t* t = &terminal[curr_term];
+	int32_t i;
+	int32_t result = PASS;
+
+	t->kbd_tail = t->kbd_head;
+	for (i = 0; i <= KBD_RING_SIZE; i++)
+		terminal_key(curr_term, 'a' + (i % 26));
+	if (t->kbd_head - t->kbd_tail != KBD_RING_SIZE)
+		result = FAIL;
+	if (t->kbd_ring[t->kbd_tail & (KBD_RING_SIZE - 1)] != 'a')
+		result = FAIL;
+
+	t->kbd_tail = t->kbd_head;
+	return result;
+}
+
+/* serial_test
+ *
+ * Opens COM1 and writes a line to it through the transmit ring, which
+ * should take the whole line at once and still have room after it.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Sends a line out of COM1
+ * Coverage: serial driver
+ * Files: serial.c/h
+ */
+int serial_test() {
+	TEST_HEADER;
+
+	int8_t msg[] = "serial_test\r\n";
+	int32_t len = strlen(msg);
+
+	if (serial_open((uint8_t*)SERIAL_NAME) != 0)
+		return FAIL;
+	if (serial_write(0, msg, len) != len)
+		return FAIL;
+	if (!(serial_poll(0) & POLLOUT))
+		return FAIL;
+	return PASS;
+}
+
+/* klog_test
+ *
+ * Formats into a buffer too small for the result and checks it is cut
+ * and terminated, then logs a debug message and drains it.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Adds a line to the kernel log
+ * Coverage: format_string, printk
+ * Files: lib.c/h, klog.c/h
+ */
+int klog_test() {
+	TEST_HEADER;
+
+	int8_t buf[8];
+	int32_t args[2] = {12, (int32_t)"abcdef"};
+
+	if (format_string(buf, 8, "%u-%s", args) != 7)
+		return FAIL;
+	if (strncmp(buf, "12-abcd", 8) != 0)
+		return FAIL;
+	if (printk(KLOG_DEBUG, "klog_test %d\n", -1) != 0)
+		return FAIL;
+	klog_drain();
+	return PASS;
+}
+
+/* screen_present_test
+ *
+ * Presents a copy of terminal 0's screen, which draws nothing, then a
+ * copy with one cell recolored, which draws only that row, then puts
+ * the cell back.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Redraws a row of terminal 0
+ * Coverage: screen_read, screen_present
+ * Files: lib.c/h
+ */
+int screen_present_test() {
+	TEST_HEADER;
+
+	static uint16_t back[NUM_ROWS * NUM_COLS];
+	static uint16_t shown[NUM_ROWS * NUM_COLS];
+	uint16_t cell;
+
+	screen_read(0, back);
+	memcpy(shown, back, sizeof(back));
+	if (screen_present(0, back, shown) != 0)
+		return FAIL;
+
+	cell = back[3 * NUM_COLS + 5];
+	back[3 * NUM_COLS + 5] = cell ^ 0x0F00;
+	if (screen_present(0, back, shown) != 1)
+		return FAIL;
+	if (shown[3 * NUM_COLS + 5] != back[3 * NUM_COLS + 5])
+		return FAIL;
+
+	back[3 * NUM_COLS + 5] = cell;
+	if (screen_present(0, back, shown) != 1)
+		return FAIL;
+	if (screen_present(0, back, shown) != 0)
+		return FAIL;
+	return PASS;
+}
+
+/* vbe_test
+ *
+ * Checks that modes the framebuffer mapping cannot hold are refused
+ * before the display is touched, and that PAT entry 1 is write-combining
+ * on this CPU if it has a PAT.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: vbe_mode_valid, paging_init_cpu
+ * Files: vbe.c/h, paging.c/h
+ */
+int vbe_test() {
+	TEST_HEADER;
+
+	uint32_t eax, ebx, ecx, edx;
+
+	if (vbe_mode_valid(1024, 768, 12) != -1)
+		return FAIL;
+	if (vbe_mode_valid(0, 768, 32) != -1)
+		return FAIL;
+	if (vbe_mode_valid(4096, 4096, 32) != -1)
+		return FAIL;
+
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	if ((edx & CPUID_PAT) &&
+		((rdmsr(MSR_PAT) >> (PAT_WC_ENTRY * 8)) & 0xFF) != PAT_TYPE_WC)
+		return FAIL;
+	return PASS;
+}
+
+/* boot_terminal_count_test
+ *
+ * Reads terminals=N out of boot command lines, with the option missing,
+ * not first, out of range and not a number
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: boot_terminal_count
+ * Files: kernel.c, terminal.h
+ */
+int boot_terminal_count_test() {
+	TEST_HEADER;
+
+	if (boot_terminal_count("") != TERMINAL_DEFAULT)
+		return FAIL;
+	if (boot_terminal_count("terminals=5") != 5)
+		return FAIL;
+	if (boot_terminal_count("console=ttyS0 terminals=12 video=1024x768x32") != TERMINAL_MAX)
+		return FAIL;
+	if (boot_terminal_count("terminals=13") != TERMINAL_DEFAULT)
+		return FAIL;
+	if (boot_terminal_count("terminals=0") != TERMINAL_DEFAULT)
+		return FAIL;
+	if (boot_terminal_count("terminals=x") != TERMINAL_DEFAULT)
+		return FAIL;
+	if (boot_terminal_count("terminals=4294967301") != TERMINAL_DEFAULT)
+		return FAIL;
+	return PASS;
+}
+
+/* vga_region_test
+ *
+ * Shows a terminal without a VGA region and checks it took one from the
+ * terminal shown longest ago, which went back to its backing page, then
+ * shows the first terminal again. Passes trivially unless the kernel was
+ * booted with more terminals than regions, terminals=5 or more.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Switches the displayed terminal and back
+ * Coverage: terminal_switch, screen_show, vga_region_take
+ * Files: lib.c/h, scheduler.c/h
+ */
+int vga_region_test() {
+	TEST_HEADER;
+
+	uint8_t first = curr_term;
+	int32_t t, u, oldest = -1, region;
+	int32_t result = PASS;
+
+	for (t = 0; t < terminal_count && terminal[t].vga_region != NO_VGA_REGION; t++);
+	if (t == terminal_count)
+		return PASS;
+
+	/* holders with a process on a CPU are passed over while others are not */
+	for (u = 0; u < terminal_count; u++) {
+		if (terminal[u].vga_region == NO_VGA_REGION || sched_term_cpus(u) != 0)
+			continue;
+		if (oldest == -1 || terminal[u].last_shown < terminal[oldest].last_shown)
+			oldest = u;
+	}
+
+	terminal_switch(t);
+	region = terminal[t].vga_region;
+	if (region == NO_VGA_REGION || terminal[t].video_mem != (char*) VGA_REGION_BASE(region))
+		result = FAIL;
+	for (u = 0; u < terminal_count; u++) {
+		if (u != t && terminal[u].vga_region == region)
+			result = FAIL;
+	}
+	if (oldest != -1 && (terminal[oldest].vga_region != NO_VGA_REGION ||
+		(uint32_t) terminal[oldest].video_mem - VIDEO < VGA_TEXT_SIZE))
+		result = FAIL;
+
+	terminal_switch(first);
+	if (terminal[first].vga_region == NO_VGA_REGION)
+		result = FAIL;
+	return result;
+}
+
 /* Test suite entry point */
 void launch_tests() {
 	/* Checkpoint 1 tests */
@@ -642,4 +1618,25 @@ void launch_tests() {
 	// open_read_test();
 
 	/* Checkpoint 5 tests */
+	// TEST_OUTPUT("switch_to_test", switch_to_test());
+	// TEST_OUTPUT("fpu_trap_test", fpu_trap_test());
+	// TEST_OUTPUT("spinlock_test", spinlock_test());
+	// TEST_OUTPUT("workqueue_test", workqueue_test());
+	// TEST_OUTPUT("futex_test", futex_test());
+	// TEST_OUTPUT("pipe_test", pipe_test());
+	// TEST_OUTPUT("shm_test", shm_test());
+	// TEST_OUTPUT("mq_test", mq_test());
+	// TEST_OUTPUT("putbuf_test", putbuf_test());
+	// TEST_OUTPUT("scrollback_test", scrollback_test());
+	// TEST_OUTPUT("ansi_test", ansi_test());
+	// TEST_OUTPUT("kbd_ring_test", kbd_ring_test());
+	// TEST_OUTPUT("serial_test", serial_test());
+	// TEST_OUTPUT("klog_test", klog_test());
+	// TEST_OUTPUT("screen_present_test", screen_present_test());
+	// TEST_OUTPUT("vbe_test", vbe_test());
+	// TEST_OUTPUT("readv_writev_test", readv_writev_test());
+	// TEST_OUTPUT("sendfile_test", sendfile_test());
+	// TEST_OUTPUT("boot_terminal_count_test", boot_terminal_count_test());
+	// TEST_OUTPUT("vga_region_test", vga_region_test());
+	// TEST_OUTPUT("poll_test", poll_test());
 }
@@ -9,6 +9,16 @@
 
 #define NULL 0
 
+/* smp.h */
+#define MAX_CPUS            4           /* most CPUs brought up by smp_init */
+
+/* byte size definitions the assembly uses too */
+#define _4MB_               0x00400000  /* 4MB = 4194304 bytes */
+
+/* paging.h: the program's 4MB page, which holds its image at
+ * PROGRAM_IMAGE_ADDR. It is the only user memory system calls take. */
+#define USER_PAGE_ADDR      0x08000000
+
 #ifndef ASM
 
 /* Types defined here just like in <stdint.h> */
@@ -21,10 +31,14 @@ typedef unsigned short uint16_t;
 typedef char int8_t;
 typedef unsigned char uint8_t;
 
+typedef long long int64_t;
+typedef unsigned long long uint64_t;
+
 
 /** MACROS **/
 /* multiterminal.h */
-#define TERMINAL_COUNT      3           /* maximum number of terminals open */
+#define TERMINAL_MAX        12          /* most terminals that can be configured */
+#define TERMINAL_DEFAULT    3           /* terminals opened unless the boot command line says otherwise */
 
 /* systemcalls.h */
 #define FD_ARRAY_SIZE       8           /* Upto 8 open files at any given point */
@@ -37,7 +51,6 @@ typedef unsigned char uint8_t;
 #define FILE_NAME_CHAR      32          /* file name is 32 characters */
 
 /* byte size definitions */
-#define _4MB_               0x00400000  /* 4MB = 4194304 bytes */
 #define KBYTE_4             4096        /* 4kB block in bytes */
 #define BYTE_64             64          /* size of 64 bytes in bytes */
 #define BYTE_33             33          /* size of 33 bytes in bytes */
@@ -52,14 +65,23 @@ typedef unsigned char uint8_t;
 
 /* terminal.h */
 #define MAX_BUFFER_SIZE     128         /* maximum size for internal buffer */
+#define ANSI_MAX_PARAMS     8           /* numbers kept from one escape sequence */
+#define KBD_RING_SIZE       256         /* key events queued per terminal, a power of two */
+
+/* fpu.h */
+#define FPU_STATE_SIZE      512         /* size of an FXSAVE image */
+#define FPU_STATE_ALIGN     16          /* FXSAVE images must be 16-byte aligned */
 
 /** Structs **/
-/* file operations table for system calls read, write, open, and close */
+/* file operations table for system calls read, write, open, and close,
+ * plus the readiness check used by poll and device control for ioctl */
 typedef struct file_operations_table {
 	int32_t (*open)(const uint8_t* filename);
     int32_t (*read)(int32_t fd, void* buf, int32_t nbytes);
 	int32_t (*write)(int32_t fd, const void* buf, int32_t nbytes);
 	int32_t (*close)(int32_t fd);
+	int32_t (*poll)(int32_t fd);
+	int32_t (*ioctl)(int32_t fd, uint32_t request, uint32_t arg);
 } fops_t;
 
 /* file descriptor struct */
@@ -70,15 +92,57 @@ typedef struct fd_struct {
     uint32_t flags;
 } fd_array_t;
 
+/* callee-saved register state of a kernel context, saved/restored by switch_to */
+typedef struct context {
+    uint32_t ebx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t esp;
+    uint32_t eip;
+    uint32_t eflags;
+} context_t;
+
+/* task_t.state */
+#define TASK_RUNNABLE   0       /* running or waiting on a run queue */
+#define TASK_BLOCKED    1       /* sleeping until sched_wakeup */
+#define TASK_DEAD       2       /* exited, never runs again */
+
+/* a kernel context the scheduler can run: one per process, plus the
+ * launch, worker and idle contexts that have no process */
+typedef struct task {
+    context_t context;                      /* kernel context saved by switch_to */
+    struct process_control_block* pcb;      /* process run by this task, NULL if none */
+    uint8_t terminal_id;                    /* terminal the task runs on behalf of */
+    volatile uint8_t state;                 /* TASK_RUNNABLE or TASK_BLOCKED */
+    volatile uint8_t on_cpu;                /* running, or switched away but not saved yet */
+    uint8_t cpu;                            /* CPU the task last ran on */
+    uint8_t kernel_io;                      /* file operations are given kernel buffers, see user_range */
+    struct task* next;                      /* next task in the same run queue */
+} task_t;
+
 /* process control block (PCB) struct */
 typedef struct process_control_block {
     fd_array_t fd_array[FD_ARRAY_SIZE];
     uint8_t args[MAX_BUFFER_SIZE];
     uint32_t pid;
     struct process_control_block* parent_pcb;
-    uint32_t esp;
+    uint32_t esp;               /* kernel stack of the parent's execute, restored by halt */
     uint32_t ebp;
+    task_t task;                /* scheduling state, saved when the scheduler switches away */
+    struct process_control_block* leader;   /* process owning the address space and fds, self if not a thread */
+    uint32_t page_pid;          /* PID whose 4MB user page is mapped, the leader's */
+    volatile uint32_t threads;  /* live threads created by this process */
+    task_t* exit_waiter;        /* leader task waiting in halt for its threads */
+    uint32_t user_entry;        /* where a new thread starts in user space */
+    uint32_t user_stack;        /* user stack pointer a new thread starts with */
+    uint32_t shm_mask;          /* shared memory segments held, one bit per segment */
+    uint8_t vid_buffered;       /* vidmap maps the back page, see vidmap_buffered */
+    uint8_t fb_mapped;          /* holds the framebuffer, see fbmap */
     uint8_t terminal_id;
+    uint8_t fpu_used;           /* process has touched the FPU, fpu_state is valid */
+    uint8_t fpu_cpu;            /* CPU whose FPU registers last held fpu_state */
+    uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(FPU_STATE_ALIGN)));
 } pcb_t;
 
 /* struct to define the directory entries */
@@ -96,31 +160,79 @@ typedef struct {
 } inode_t;
 
 
+/* MULTI CPU */
+#define CPU_TSS_SEL(cpu)    (0x38 + ((cpu) << 3))   /* GDT selector of a CPU's TSS (x86_desc.h) */
+
+typedef struct cpu {
+    uint8_t id;                     /* index into cpus[] */
+    uint8_t apic_id;                /* local APIC ID */
+    volatile uint8_t online;        /* CPU has finished booting */
+    volatile uint8_t term;          /* terminal of the task running on this CPU */
+    task_t* curr_task;              /* task running on this CPU */
+    pcb_t* fpu_owner;               /* process whose state is loaded in this CPU's FPU */
+} cpu_t;
+
+cpu_t cpus[MAX_CPUS];
+
+/* Index of the executing CPU, derived from the TSS it has loaded */
+static inline uint32_t cpu_id(void) {
+    uint16_t sel;
+    asm volatile ("str %0" : "=r"(sel));
+    return (sel < CPU_TSS_SEL(0)) ? 0 : (uint32_t) (sel - CPU_TSS_SEL(0)) >> 3;
+}
+
+#define this_cpu()          (&cpus[cpu_id()])
+
 /* MULTI TERMINAL */
 volatile uint8_t curr_term;  // terminal currently being displayed
-volatile uint8_t sched_term;  // terminal currently running
+#define sched_term          (this_cpu()->term)  // terminal running on this CPU
 
 typedef struct terminal {
     /* library */
     int screen_x;
     int screen_y;
-    char* video_mem;
+    char* video_mem;                    /* page vidmap maps, its VGA region or its backing page */
+    int8_t vga_region;                  /* region of VGA text memory it holds, NO_VGA_REGION if none */
+    uint32_t last_shown;                /* when it was last displayed, the oldest gives up its region */
+    uint32_t top_row;                   /* row of the region shown at the top of the screen */
+    uint32_t sb_top;                    /* scrollback line shown on the first row of the live page */
+    uint32_t sb_count;                  /* lines of history above the live page */
+    uint32_t sb_view;                   /* lines the view is scrolled back, 0 for the live page */
+    uint8_t stale;                      /* video memory is behind the scrollback */
+
+    /* escape sequences */
+    uint8_t esc_state;                  /* where terminal_write is in an escape sequence */
+    uint8_t esc_nparams;                /* index of the number being parsed */
+    uint16_t esc_params[ANSI_MAX_PARAMS];
+    uint8_t attrib;                     /* attribute for new cells, 0 for ATTRIB */
+    uint8_t region_top;                 /* scroll region rows, both 0 for the whole screen */
+    uint8_t region_bottom;
+    int saved_x;                        /* position saved by ESC[s */
+    int saved_y;
     
     /* keyboard */
-    uint8_t internal_buffer[MAX_BUFFER_SIZE];
+    uint16_t kbd_ring[KBD_RING_SIZE];   /* key events, filled by the keyboard interrupt */
+    volatile uint32_t kbd_head;         /* events pushed, only the interrupt moves it */
+    volatile uint32_t kbd_tail;         /* events taken, only readers move it */
+    uint8_t internal_buffer[MAX_BUFFER_SIZE];   /* line being edited in canonical mode */
     uint32_t buffer_index;
-    uint8_t enter_flag;
+    uint8_t redraw;                     /* the screen was cleared under the line being edited */
+    struct task* reader;                /* task sleeping in terminal_read, NULL if none */
 
     /* rtc */
     uint32_t rtc_constant;
     uint32_t rtc_iterations;
+    uint8_t rtc_armed;                  /* rtc_iterations is counting down a period */
 
     /* processes */
-    pcb_t* curr_pcb;
     uint8_t active;
+    volatile uint8_t exception_flag;    /* process on this terminal died from an exception */
 } term_t;
 
-term_t terminal[TERMINAL_COUNT];
+term_t terminal[TERMINAL_MAX];
+
+/* terminals in use, chosen at boot, at most TERMINAL_MAX */
+uint32_t terminal_count;
 
 #endif /* ASM */
 
@@ -0,0 +1,254 @@
+/* vbe.c - Bochs/QEMU VBE linear framebuffer, mapped into processes
+ * vim:ts=4 noexpandtab
+ */
+
+#include "vbe.h"
+#include "systemcalls.h"
+#include "scheduler.h"
+#include "lib.h"
+
+/* PCI configuration space through I/O ports */
+#define PCI_CONFIG_ADDRESS      0x0CF8
+#define PCI_CONFIG_DATA         0x0CFC
+#define PCI_CONFIG_ENABLE       0x80000000
+#define PCI_DEVICES             32
+#define PCI_ID                  0x00        /* vendor in the low half, device in the high half */
+#define PCI_BAR0                0x10
+#define PCI_BAR_MEM_MASK        0xFFFFFFF0  /* address bits of a memory BAR */
+
+fb_info_t vbe_mode = {NULL, 0, 0, 0, 0};
+volatile uint32_t vbe_users = 0;
+
+/* 4MB pages the framebuffer of vbe_mode spans */
+static uint32_t vbe_pages = 0;
+
+/* Protects vbe_users and the fb_mapped flags of processes */
+static spinlock_t vbe_lock = SPINLOCK_INIT("vbe");
+
+/*
+ * vbe_read
+ *
+ * DESCRIPTION: reads a VBE dispatch interface register
+ *
+ * Inputs: index - VBE_DISPI_INDEX_*
+ * Outputs: none
+ * Return values: the register's value
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t vbe_read(uint16_t index) {
+    outw(index, VBE_DISPI_INDEX);
+    return inw(VBE_DISPI_DATA) & 0xFFFF;
+}
+
+/*
+ * vbe_write
+ *
+ * DESCRIPTION: writes a VBE dispatch interface register
+ *
+ * Inputs: index - VBE_DISPI_INDEX_*
+ *         val - value to write
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: may change the display mode
+ */
+static void vbe_write(uint16_t index, uint16_t val) {
+    outw(index, VBE_DISPI_INDEX);
+    outw(val, VBE_DISPI_DATA);
+}
+
+/*
+ * vbe_find_lfb
+ *
+ * DESCRIPTION: looks on PCI bus 0 for the stdvga device and reads where its
+ *              framebuffer BAR was put
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: physical address of the framebuffer, VBE_DEFAULT_LFB if
+ *                the device is not on bus 0
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t vbe_find_lfb(void) {
+    uint32_t dev;
+
+    for (dev = 0; dev < PCI_DEVICES; dev++) {
+        outl(PCI_CONFIG_ENABLE | (dev << 11) | PCI_ID, PCI_CONFIG_ADDRESS);
+        if (inl(PCI_CONFIG_DATA) != ((VBE_PCI_DEVICE << 16) | VBE_PCI_VENDOR))
+            continue;
+
+        outl(PCI_CONFIG_ENABLE | (dev << 11) | PCI_BAR0, PCI_CONFIG_ADDRESS);
+        return inl(PCI_CONFIG_DATA) & PCI_BAR_MEM_MASK;
+    }
+    return VBE_DEFAULT_LFB;
+}
+
+/*
+ * vbe_mode_valid
+ *
+ * DESCRIPTION: checks that the VGA has the Bochs VBE interface and that a
+ *              mode's framebuffer fits the pages it is mapped with, without
+ *              touching the display
+ *
+ * Inputs: width, height - resolution in pixels
+ *         bpp - 8, 15, 16, 24 or 32 bits per pixel
+ * Outputs: none
+ * Return values: 0 if vbe_set_mode can set the mode, -1 otherwise
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t vbe_mode_valid(uint32_t width, uint32_t height, uint32_t bpp) {
+    uint32_t id = vbe_read(VBE_DISPI_INDEX_ID);
+    uint32_t lfb = vbe_find_lfb();
+
+    if (id < VBE_DISPI_ID2 || id > VBE_DISPI_ID_MAX)
+        return -1;
+    if (bpp != 8 && bpp != 15 && bpp != 16 && bpp != 24 && bpp != 32)
+        return -1;
+    if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF)
+        return -1;
+    if ((lfb & ~FOUR_MB_MASK) + width * ((bpp + 7) / 8) * height > VBE_MAP_PAGES * _4MB_)
+        return -1;
+    return 0;
+}
+
+/*
+ * vbe_set_mode
+ *
+ * DESCRIPTION: switches the VGA to a linear framebuffer mode and maps the
+ *              framebuffer write-combining at its physical address, so the
+ *              stores of a blit reach the card in bursts. Text memory is
+ *              reused by the mode, see screen_text_off.
+ *
+ * Inputs: width, height - resolution in pixels
+ *         bpp - 8, 15, 16, 24 or 32 bits per pixel
+ * Outputs: none
+ * Return values: 0 on success, -1 if the mode is not valid or not taken
+ *
+ * SIDE EFFECTS: sets vbe_mode, clears the screen
+ */
+int32_t vbe_set_mode(uint32_t width, uint32_t height, uint32_t bpp) {
+    uint32_t lfb, size, page;
+
+    if (vbe_mode_valid(width, height, bpp) == -1)
+        return -1;
+
+    vbe_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+    vbe_write(VBE_DISPI_INDEX_XRES, width);
+    vbe_write(VBE_DISPI_INDEX_YRES, height);
+    vbe_write(VBE_DISPI_INDEX_BPP, bpp);
+    vbe_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED);
+
+    /* the card clamps what it cannot do */
+    if (vbe_read(VBE_DISPI_INDEX_XRES) != width || vbe_read(VBE_DISPI_INDEX_YRES) != height ||
+        vbe_read(VBE_DISPI_INDEX_BPP) != bpp) {
+        vbe_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+        return -1;
+    }
+
+    lfb = vbe_find_lfb();
+    size = width * ((bpp + 7) / 8) * height;
+    vbe_pages = ((lfb & ~FOUR_MB_MASK) + size + _4MB_ - 1) / _4MB_;
+    for (page = 0; page < vbe_pages; page++)
+        paging_map_wc((lfb & FOUR_MB_MASK) + page * _4MB_);
+
+    vbe_mode.width = width;
+    vbe_mode.height = height;
+    vbe_mode.pitch = width * ((bpp + 7) / 8);
+    vbe_mode.bpp = bpp;
+    vbe_mode.base = (uint8_t*) lfb;
+    return 0;
+}
+
+/*
+ * fbmap
+ *
+ * DESCRIPTION: maps the framebuffer write-combining into the calling
+ *              process at USER_FB_PAGE, like vidmap does the text screen.
+ *              The console stops drawing until every process holding the
+ *              framebuffer has halted.
+ *
+ * Inputs: info - where to describe the mode, in the program's page
+ * Outputs: info - the mode, base being the user address of the first pixel
+ * Return values: 0 on success, -1 in text mode or for a bad info
+ *
+ * SIDE EFFECTS: the process's threads all see the framebuffer
+ */
+int32_t fbmap(fb_info_t* info) {
+    pcb_t* process = sched_process();
+    uint32_t flags;
+
+    if (vbe_mode.base == NULL || info == NULL)
+        return -1;
+    /* the whole description has to go into the user-level page */
+    if (!user_range(info, sizeof(fb_info_t)))
+        return -1;
+
+    spin_lock_irqsave(&vbe_lock, flags);
+    if (!process -> fb_mapped) {
+        process -> fb_mapped = 1;
+        vbe_users++;
+    }
+    vbe_map_process(cpu_id(), process);
+    flush_tlb();
+    spin_unlock_irqrestore(&vbe_lock, flags);
+
+    info -> base = (uint8_t*) ((USER_FB_PAGE << PAGE_BASE_ADDR_OFFSET) +
+                               ((uint32_t) vbe_mode.base & ~FOUR_MB_MASK));
+    info -> width = vbe_mode.width;
+    info -> height = vbe_mode.height;
+    info -> pitch = vbe_mode.pitch;
+    info -> bpp = vbe_mode.bpp;
+    return 0;
+}
+
+/*
+ * vbe_release
+ *
+ * DESCRIPTION: drops the framebuffer from a halting process, the console
+ *              draws again once nobody holds it
+ *
+ * Inputs: process - halting process
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: the caller remaps the CPU for the process that runs next
+ */
+void vbe_release(pcb_t* process) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&vbe_lock, flags);
+    if (process -> fb_mapped) {
+        process -> fb_mapped = 0;
+        vbe_users--;
+    }
+    spin_unlock_irqrestore(&vbe_lock, flags);
+}
+
+/*
+ * vbe_map_process
+ *
+ * DESCRIPTION: maps the framebuffer in a CPU's page directory if the process
+ *              holds it and unmaps it otherwise. Called on every switch to
+ *              a process.
+ *
+ * Inputs: cpu - CPU whose page directory to change
+ *         process - process about to run there
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: caller flushes the TLB
+ */
+void vbe_map_process(uint32_t cpu, pcb_t* process) {
+    uint32_t page, lfb = (uint32_t) vbe_mode.base & FOUR_MB_MASK;
+
+    for (page = 0; page < vbe_pages; page++) {
+        if (process -> fb_mapped)
+            page_directory[cpu][USER_FB_PAGE + page] = (lfb + page * _4MB_) |
+                FOUR_MB_PAGE | WRITE_COMBINE | USER | RW | PRESENT;
+        else
+            page_directory[cpu][USER_FB_PAGE + page] = RW & ~PRESENT;
+    }
+}
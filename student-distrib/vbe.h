@@ -0,0 +1,73 @@
+/* vbe.h - Bochs/QEMU VBE linear framebuffer, mapped into processes
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _VBE_H
+#define _VBE_H
+
+#include "types.h"
+#include "paging.h"
+
+/* Bochs VBE dispatch interface, an index register and a 16 bit data register */
+#define VBE_DISPI_INDEX         0x01CE
+#define VBE_DISPI_DATA          0x01CF
+
+#define VBE_DISPI_INDEX_ID      0
+#define VBE_DISPI_INDEX_XRES    1
+#define VBE_DISPI_INDEX_YRES    2
+#define VBE_DISPI_INDEX_BPP     3
+#define VBE_DISPI_INDEX_ENABLE  4
+
+/* Interface versions, 0xB0C2 is the first with 32 bpp and a linear framebuffer */
+#define VBE_DISPI_ID2           0xB0C2
+#define VBE_DISPI_ID_MAX        0xB0CF
+
+/* VBE_DISPI_INDEX_ENABLE bits */
+#define VBE_DISPI_DISABLED      0x00
+#define VBE_DISPI_ENABLED       0x01
+#define VBE_DISPI_LFB_ENABLED   0x40
+
+/* The stdvga PCI device, its BAR 0 is the framebuffer */
+#define VBE_PCI_VENDOR          0x1234
+#define VBE_PCI_DEVICE          0x1111
+
+/* Where Bochs puts the framebuffer if the PCI device is not found */
+#define VBE_DEFAULT_LFB         0xE0000000
+
+/* 4MB pages the framebuffer may span, which bounds the mode */
+#define VBE_MAP_PAGES           2
+
+/* The framebuffer is mapped into processes from the page after the vidmap page table */
+#define USER_FB_PAGE            (USER_VID_MEM_PAGE + 1)
+
+/* A graphics mode and where its pixels are */
+typedef struct fb_info {
+    uint8_t* base;              /* first pixel */
+    uint32_t width;             /* pixels per line */
+    uint32_t height;            /* lines */
+    uint32_t pitch;             /* bytes from one line to the next */
+    uint32_t bpp;               /* bits per pixel */
+} fb_info_t;
+
+/* Mode set by vbe_set_mode, base is NULL while the VGA is in text mode */
+extern fb_info_t vbe_mode;
+
+/* Processes holding the framebuffer, the console leaves it to them */
+extern volatile uint32_t vbe_users;
+
+/* Checks a mode can be set, without touching the display */
+int32_t vbe_mode_valid(uint32_t width, uint32_t height, uint32_t bpp);
+
+/* Switches the VGA to a linear framebuffer mode */
+int32_t vbe_set_mode(uint32_t width, uint32_t height, uint32_t bpp);
+
+/* Maps the framebuffer into the caller and describes the mode */
+int32_t fbmap(fb_info_t* info);
+
+/* Drops the framebuffer from a halting process */
+void vbe_release(pcb_t* process);
+
+/* Maps or unmaps the framebuffer on a CPU for the process about to run */
+void vbe_map_process(uint32_t cpu, pcb_t* process);
+
+#endif /* _VBE_H */
@@ -0,0 +1,103 @@
+/* workqueue.c - deferred work run by a kernel worker task
+ * vim:ts=4 noexpandtab
+ */
+
+#include "workqueue.h"
+#include "scheduler.h"
+#include "kthread.h"
+#include "lib.h"
+
+/* FIFO of pending work; a single worker keeps items in queueing order */
+static work_t work_ring[WORKQUEUE_SIZE];
+static uint32_t work_head = 0;
+static uint32_t work_count = 0;
+static spinlock_t work_lock = SPINLOCK_INIT("workqueue");
+
+/* The worker kernel thread */
+static task_t* worker_task = NULL;
+
+/* Work items lost because the queue was full */
+volatile uint32_t work_dropped = 0;
+
+/*
+ * worker_main
+ *
+ * DESCRIPTION: body of the worker task, runs queued work with interrupts on
+ *              and sleeps while the queue is empty
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: never returns
+ *
+ * SIDE EFFECTS: runs queued work
+ */
+static void worker_main(void) {
+    uint32_t flags;
+    work_t work;
+
+    sched_thread_start();
+
+    while (1) {
+        spin_lock_irqsave(&work_lock, flags);
+        while (work_count == 0)
+            sched_sleep(&work_lock);
+
+        work = work_ring[work_head];
+        work_head = (work_head + 1) % WORKQUEUE_SIZE;
+        work_count--;
+        spin_unlock_irqrestore(&work_lock, flags);
+
+        work.fn(work.arg);
+    }
+}
+
+/*
+ * workqueue_init
+ *
+ * DESCRIPTION: creates the worker task and queues it on this CPU
+ *
+ * Inputs: none
+ * Outputs: none
+ * Return values: none
+ *
+ * SIDE EFFECTS: the worker starts on a later scheduler tick
+ */
+void workqueue_init(void) {
+    worker_task = kthread_create(worker_main, 0);
+    if (worker_task != NULL)
+        sched_enqueue(worker_task);
+}
+
+/*
+ * work_queue
+ *
+ * DESCRIPTION: queues fn(arg) to run in the worker. Interrupt handlers use
+ *              this to return right after capturing their event.
+ *
+ * Inputs: fn - function to run
+ *         arg - argument passed to fn
+ * Outputs: none
+ * Return values: 0 on success, -1 if the queue is full
+ *
+ * SIDE EFFECTS: wakes the worker
+ */
+int32_t work_queue(work_fn_t fn, uint32_t arg) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&work_lock, flags);
+    if (work_count == WORKQUEUE_SIZE) {
+        work_dropped++;
+        spin_unlock_irqrestore(&work_lock, flags);
+        return -1;
+    }
+
+    work_ring[(work_head + work_count) % WORKQUEUE_SIZE].fn = fn;
+    work_ring[(work_head + work_count) % WORKQUEUE_SIZE].arg = arg;
+    work_count++;
+    spin_unlock_irqrestore(&work_lock, flags);
+
+    /* items queued before the worker exists run once it starts */
+    if (worker_task != NULL)
+        sched_wakeup(worker_task);
+    return 0;
+}
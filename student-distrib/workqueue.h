@@ -0,0 +1,31 @@
+/* workqueue.h - deferred work run by a kernel worker task
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "types.h"
+
+/* Number of work items that can wait for the worker */
+#define WORKQUEUE_SIZE      128
+
+/* Function run by the worker, with the argument it was queued with */
+typedef void (*work_fn_t)(uint32_t arg);
+
+/* A queued call */
+typedef struct work {
+    work_fn_t fn;
+    uint32_t arg;
+} work_t;
+
+/* Work items lost because the queue was full */
+extern volatile uint32_t work_dropped;
+
+/* Creates the worker task */
+void workqueue_init(void);
+
+/* Queues fn(arg) for the worker, callable from interrupt handlers */
+int32_t work_queue(work_fn_t fn, uint32_t arg);
+
+#endif /* _WORKQUEUE_H */
@@ -13,8 +13,8 @@
 #define KERNEL_DS   0x0018
 #define USER_CS     0x0023
 #define USER_DS     0x002B
-#define KERNEL_TSS  0x0030
-#define KERNEL_LDT  0x0038
+#define KERNEL_LDT  0x0030
+#define KERNEL_TSS  0x0038      /* CPU 0's TSS, CPU i uses CPU_TSS_SEL(i) */
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
@@ -121,8 +121,12 @@ extern seg_desc_t gdt_ptr;
 extern uint32_t ldt;
 
 extern uint32_t tss_size;
-extern seg_desc_t tss_desc_ptr;
-extern tss_t tss;
+extern seg_desc_t tss_desc_ptr[MAX_CPUS];
+extern tss_t tss[MAX_CPUS];
+
+/* Image of the GDTR loaded by boot.S, also copied into the AP trampoline */
+#define GDT_DESC_SIZE   6
+extern uint8_t gdt_desc_ptr[GDT_DESC_SIZE];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -0,0 +1,80 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Event loop over stdin and the RTC: keeps the seconds since start on a
+ * status line and echoes every line typed, sleeping in poll in between.
+ * The status line sits above a scroll region and is redrawn with escape
+ * sequences, so only its cells are written each second. Type "quit" to
+ * exit.
+ */
+
+#define BUFSIZE 128
+#define RTC_HZ 2
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+int main ()
+{
+    int32_t rtc_fd, cnt, hz = RTC_HZ, garbage, rval = 0;
+    uint32_t periods = 0;
+    uint8_t buf[BUFSIZE];
+    ece391_pollfd_t fds[2];
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &hz, 4)) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = rtc_fd;
+    fds[1].events = POLLIN;
+
+    /* clear, keep row 1 for the status line and scroll the rest */
+    ece391_fdputs (1, (uint8_t*)"\033[2J\033[2;25r\033[2;1H");
+    ece391_fdputs (1, (uint8_t*)"type a line to echo it, quit to exit\n");
+    while (1) {
+        if (-1 == ece391_poll (fds, 2, POLL_FOREVER)) {
+            ece391_fdputs (1, (uint8_t*)"poll failed\n");
+            rval = 3;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            (void)ece391_read (rtc_fd, &garbage, 4);
+            if (0 == ++periods % RTC_HZ) {
+                ece391_fdputs (1, (uint8_t*)"\033[s\033[1;1H\033[30;47m up ");
+                put_num (periods / RTC_HZ);
+                ece391_fdputs (1, (uint8_t*)" s\033[K\033[0m\033[u");
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            if (-1 == (cnt = ece391_read (0, buf, BUFSIZE - 1))) {
+                rval = 3;
+                break;
+            }
+            if (cnt > 0 && '\n' == buf[cnt - 1])
+                cnt--;
+            buf[cnt] = '\0';
+            if (0 == ece391_strcmp (buf, (uint8_t*)"quit"))
+                break;
+            ece391_fdputs (1, (uint8_t*)"echo: ");
+            ece391_fdputs (1, buf);
+            ece391_fdputs (1, (uint8_t*)"\n");
+        }
+    }
+
+    /* give the whole screen back to the shell */
+    ece391_fdputs (1, (uint8_t*)"\033[r\033[25;1H");
+    (void)ece391_close (rtc_fd);
+    return rval;
+}
@@ -0,0 +1,94 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Animated bar chart on the framebuffer, q quits. Needs the kernel booted
+ * with video=WxHx32. The framebuffer is mapped write-combining, so every
+ * bar is drawn a pixel row at a time, left to right, and the stores leave
+ * the CPU in bursts.
+ */
+
+#define BARS 8
+#define FRAME_TICKS 4
+#define BACKGROUND 0x101820
+#define BUFSIZE 32
+
+static const uint32_t colors[BARS] = {
+    0xE05050, 0xE0A040, 0xD0D050, 0x60C060,
+    0x50B0D0, 0x5070E0, 0x9060D0, 0xD060B0
+};
+
+static ece391_fb_info_t fb;
+
+/* Fills a rectangle with one color */
+static void fill (uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+    uint32_t* px;
+    uint32_t i, j;
+
+    for (j = 0; j < h; j++) {
+        px = (uint32_t*)(fb.base + (y + j) * fb.pitch) + x;
+        for (i = 0; i < w; i++)
+            px[i] = color;
+    }
+}
+
+/* Height of bar b in frame t, a triangle wave of its own period */
+static uint32_t bar_height (uint32_t b, uint32_t t, uint32_t max)
+{
+    uint32_t period = 40 + 13 * b;
+    uint32_t phase = (t + 7 * b) % period;
+
+    if (phase > period / 2)
+        phase = period - phase;
+    return max / 8 + phase * (max - max / 8) / (period / 2);
+}
+
+int main ()
+{
+    uint32_t t, b, slot, width, base, max, h;
+    uint8_t buf[BUFSIZE];
+    ece391_pollfd_t fds[1];
+    int32_t cnt, i;
+
+    if (-1 == ece391_fbmap (&fb) || 32 != fb.bpp) {
+        ece391_fdputs (1, (uint8_t*)"no 32 bpp framebuffer, boot with video=1024x768x32\n");
+        return 2;
+    }
+    if (-1 == ece391_ioctl (0, TTY_SETMODE, TTY_RAW)) {
+        ece391_fdputs (1, (uint8_t*)"stdin is not a terminal\n");
+        return 2;
+    }
+
+    fill (0, 0, fb.width, fb.height, BACKGROUND);
+
+    slot = fb.width / BARS;
+    width = slot * 3 / 4;
+    base = fb.height * 7 / 8;
+    max = fb.height * 3 / 4;
+
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    for (t = 0; ; t++) {
+        for (b = 0; b < BARS; b++) {
+            h = bar_height (b, t, max);
+            fill (b * slot + (slot - width) / 2, base - max, width, max - h, BACKGROUND);
+            fill (b * slot + (slot - width) / 2, base - h, width, h, colors[b]);
+        }
+
+        /* sleep until the next frame, or a key */
+        if (0 < ece391_poll (fds, 1, FRAME_TICKS)) {
+            cnt = ece391_read (0, buf, BUFSIZE);
+            for (i = 0; i < cnt; i++) {
+                if ('q' == buf[i])
+                    goto done;
+            }
+        }
+    }
+
+done:
+    (void)ece391_ioctl (0, TTY_SETMODE, TTY_CANON);
+    return 0;
+}
@@ -6,17 +6,16 @@
 #define BUFSIZE 1024
 #define SBUFSIZE 33
 
+/* Prints the lines read from fd that contain s, prefixed by fname if
+   one is given */
 int32_t
-do_one_file (const char* s, const char* fname) 
+do_one_fd (const char* s, const char* fname, int32_t fd) 
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
+    int32_t cnt, last, line_start, line_end, check, s_len;
     uint8_t data[BUFSIZE+1];
+    uint8_t* out[4];
 
     s_len = ece391_strlen ((uint8_t*)s);
-    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
-        ece391_fdputs (1, (uint8_t*)"file open failed\n");
-        return -1;
-    }
     last = 0;
     while (1) {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
@@ -30,7 +29,10 @@ do_one_file (const char* s, const char* fname)
 	    line_end = line_start;
 	    while (line_end < last && '\n' != data[line_end])
 		line_end++;
-	    if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
+	    /* pipes return partial lines, keep one for the next read
+	       unless it fills the whole buffer */
+	    if ('\n' != data[line_end] && 0 != cnt &&
+		(line_start != 0 || last < BUFSIZE)) {
 		/* copy from line_start to last down to 0 and fix last */
 		data[line_end] = '\0';
 		ece391_strcpy (data, data + line_start);
@@ -42,10 +44,15 @@ do_one_file (const char* s, const char* fname)
 	    for (check = line_start; check < line_end; check++) {
 		if (s[0] == data[check] && 
 		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
-		    ece391_fdputs (1, data + line_start);
-		    ece391_fdputs (1, (uint8_t*)"\n");
+		    /* the whole line in one system call */
+		    out[0] = (uint8_t*)fname;
+		    out[1] = (uint8_t*)":";
+		    out[2] = data + line_start;
+		    out[3] = (uint8_t*)"\n";
+		    if (0 != fname)
+			ece391_fdputsv (1, (const uint8_t* const*)out, 4);
+		    else
+			ece391_fdputsv (1, (const uint8_t* const*)(out + 2), 2);
 		    break;
 		}
 	    }
@@ -58,6 +65,20 @@ do_one_file (const char* s, const char* fname)
 	if (0 == cnt)
 	    break;
     }
+    return 0;
+}
+
+int32_t
+do_one_file (const char* s, const char* fname) 
+{
+    int32_t fd;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
+        ece391_fdputs (1, (uint8_t*)"file open failed\n");
+        return -1;
+    }
+    if (0 != do_one_fd (s, fname, fd))
+        return -1;
     if (-1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
         return -1;
@@ -67,7 +88,7 @@ do_one_file (const char* s, const char* fname)
 
 int main ()
 {
-    int32_t fd, cnt;
+    int32_t fd, cnt, len;
     uint8_t buf[SBUFSIZE];
     uint8_t search[BUFSIZE];
 
@@ -76,6 +97,13 @@ int main ()
         return 3;
     }
 
+    /* "grep word -" searches stdin, e.g. the output of a pipe */
+    len = ece391_strlen (search);
+    if (len > 2 && 0 == ece391_strcmp (search + len - 2, (uint8_t*)" -")) {
+        search[len - 2] = '\0';
+        return (0 == do_one_fd ((char*)search, 0, 0)) ? 0 : 3;
+    }
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
@@ -0,0 +1,134 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Per-operation cost of small pipe writes and reads, first one system
+ * call each and then batched through the submission ring, BATCH pairs
+ * per ece391_io_enter.
+ */
+
+#define PAIRS 16000         /* OPS is 32000 = 125 * 256, see ns_per_op */
+#define OPS (2 * PAIRS)
+#define BATCH 16
+#define MSG 16
+#define RTC_HZ 512
+#define STACKSIZE 2048
+
+static ece391_io_ring_t ring;
+static uint8_t wbuf[MSG];
+static uint8_t rbuf[MSG];
+static uint8_t timer_stack[STACKSIZE];
+static int32_t fds[2];
+
+static volatile uint32_t ticks;
+static volatile uint32_t done;
+
+/* Counts RTC interrupts until the benchmark is over */
+static int32_t timer (void* arg)
+{
+    int32_t rtc_fd = (int32_t)arg;
+    int32_t garbage;
+
+    while (!done) {
+        (void)ece391_read (rtc_fd, &garbage, 4);
+        ticks++;
+    }
+    return 0;
+}
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+/* Lines up with a tick so a partial tick is not counted */
+static uint32_t start_timing (void)
+{
+    uint32_t start = ticks;
+
+    while (ticks == start);
+    return ticks;
+}
+
+/* 10^9 / RTC_HZ / OPS, kept in 32 bits: 1953125 / 32000 = 15625 / 256 */
+static void report (const char* what, uint32_t elapsed, uint32_t bad)
+{
+    ece391_fdputs (1, (uint8_t*)what);
+    put_num (OPS);
+    ece391_fdputs (1, (uint8_t*)" ops in ");
+    put_num (elapsed * 1000 / RTC_HZ);
+    ece391_fdputs (1, (uint8_t*)" ms, ");
+    put_num (elapsed * 15625 / 256);
+    ece391_fdputs (1, (uint8_t*)" ns/op, ");
+    put_num (bad);
+    ece391_fdputs (1, (uint8_t*)" failed\n");
+}
+
+static void plain (void)
+{
+    uint32_t i, start, bad = 0;
+
+    start = start_timing ();
+    for (i = 0; i < PAIRS; i++) {
+        if (MSG != ece391_write (fds[1], wbuf, MSG))
+            bad++;
+        if (MSG != ece391_read (fds[0], rbuf, MSG))
+            bad++;
+    }
+    report ("plain: ", ticks - start, bad);
+}
+
+static void batched (void)
+{
+    uint32_t i, j, start, bad = 0;
+    ece391_io_cqe_t cqe;
+
+    ece391_ring_init (&ring);
+    start = start_timing ();
+    for (i = 0; i < PAIRS; i += BATCH) {
+        /* in order, so each read finds the write before it */
+        for (j = 0; j < BATCH; j++) {
+            (void)ece391_ring_prep (&ring, IO_OP_WRITE, fds[1], wbuf, MSG, 0);
+            (void)ece391_ring_prep (&ring, IO_OP_READ, fds[0], rbuf, MSG, 1);
+        }
+        if (2 * BATCH != ece391_ring_submit (&ring))
+            bad++;
+        while (0 == ece391_ring_reap (&ring, &cqe)) {
+            if (MSG != cqe.res)
+                bad++;
+        }
+    }
+    report ("ring:  ", ticks - start, bad);
+}
+
+int main ()
+{
+    int32_t rtc_fd, hz = RTC_HZ;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &hz, 4)) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+    if (-1 == ece391_pipe (fds)) {
+        ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+        return 2;
+    }
+    if (-1 == ece391_clone (timer, timer_stack + STACKSIZE, (void*)rtc_fd)) {
+        ece391_fdputs (1, (uint8_t*)"could not start timer thread\n");
+        return 2;
+    }
+
+    plain ();
+    batched ();
+
+    done = 1;
+    (void)ece391_close (fds[0]);
+    (void)ece391_close (fds[1]);
+    (void)ece391_close (rtc_fd);
+    return 0;
+}
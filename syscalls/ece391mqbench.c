@@ -0,0 +1,149 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Pushes messages through a queue from a sender thread, first one message
+ * per system call and then BATCH per call, and checks that the receiver
+ * gets each batch in priority order. Ends with a timed read on an empty
+ * queue.
+ */
+
+#define MESSAGES 16384
+#define BATCH 16
+#define RTC_HZ 512
+#define STACKSIZE 2048
+#define TIMEOUT_TICKS 50
+
+static ece391_msg_t sbuf[BATCH];
+static ece391_msg_t rbuf[BATCH];
+/* one sender stack per run, the first sender may still be halting */
+static uint8_t sender_stack[2][STACKSIZE];
+static uint8_t timer_stack[STACKSIZE];
+
+static int32_t mq_fd;
+static uint32_t batch;
+static volatile uint32_t ticks;
+static volatile uint32_t done;
+
+/* Counts RTC interrupts until the benchmark is over */
+static int32_t timer (void* arg)
+{
+    int32_t rtc_fd = (int32_t)arg;
+    int32_t garbage;
+
+    while (!done) {
+        (void)ece391_read (rtc_fd, &garbage, 4);
+        ticks++;
+    }
+    return 0;
+}
+
+/* Sends MESSAGES messages, batch at a time, with priorities 0..batch-1 */
+static int32_t sender (void* arg)
+{
+    uint32_t sent, i;
+    int32_t cnt;
+
+    for (sent = 0; sent < MESSAGES; sent += cnt / sizeof (ece391_msg_t)) {
+        for (i = 0; i < batch; i++) {
+            sbuf[i].priority = i;
+            sbuf[i].len = 4;
+            *(uint32_t*)sbuf[i].data = sent + i;
+        }
+        if (0 >= (cnt = ece391_write (mq_fd, sbuf, batch * sizeof (ece391_msg_t)))) {
+            ece391_fdputs (1, (uint8_t*)"queue write failed\n");
+            break;
+        }
+    }
+    return 0;
+}
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+/* Runs the sender with the given batch size and receives everything */
+static int32_t run (uint32_t n, uint8_t* stack)
+{
+    uint32_t received = 0, start, elapsed, i, bad = 0;
+    int32_t cnt;
+
+    batch = n;
+    start = ticks;
+    while (ticks == start);
+    start = ticks;
+
+    if (-1 == ece391_clone (sender, stack + STACKSIZE, 0)) {
+        ece391_fdputs (1, (uint8_t*)"could not start sender thread\n");
+        return -1;
+    }
+
+    while (received < MESSAGES) {
+        if (0 >= (cnt = ece391_read (mq_fd, rbuf, n * sizeof (ece391_msg_t)))) {
+            ece391_fdputs (1, (uint8_t*)"queue read failed\n");
+            return -1;
+        }
+        cnt /= sizeof (ece391_msg_t);
+        for (i = 1; i < cnt; i++) {
+            if (rbuf[i].priority > rbuf[i - 1].priority)
+                bad++;
+        }
+        received += cnt;
+    }
+    elapsed = ticks - start;
+
+    put_num (MESSAGES);
+    ece391_fdputs (1, (uint8_t*)" messages, ");
+    put_num (n);
+    ece391_fdputs (1, (uint8_t*)" per call: ");
+    put_num (elapsed * 1000 / RTC_HZ);
+    ece391_fdputs (1, (uint8_t*)" ms, ");
+    put_num (bad);
+    ece391_fdputs (1, (uint8_t*)" out of order\n");
+    return bad;
+}
+
+int main ()
+{
+    int32_t rtc_fd, empty_fd, hz = RTC_HZ, rval;
+    uint32_t start;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &hz, 4)) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+    if (-1 == (mq_fd = ece391_mq_open ((uint8_t*)"mqbench", MQ_FOREVER))) {
+        ece391_fdputs (1, (uint8_t*)"mq_open failed\n");
+        return 2;
+    }
+    if (-1 == ece391_clone (timer, timer_stack + STACKSIZE, (void*)rtc_fd)) {
+        ece391_fdputs (1, (uint8_t*)"could not start timer thread\n");
+        return 2;
+    }
+
+    rval = run (1, sender_stack[0]);
+    if (0 <= rval)
+        rval |= run (BATCH, sender_stack[1]);
+
+    /* nothing is ever sent here, so the read gives up after its timeout */
+    if (-1 != (empty_fd = ece391_mq_open ((uint8_t*)"mqbench empty", TIMEOUT_TICKS))) {
+        start = ticks;
+        if (0 != ece391_read (empty_fd, rbuf, sizeof (ece391_msg_t)))
+            rval = 1;
+        ece391_fdputs (1, (uint8_t*)"empty read timed out after ");
+        put_num ((ticks - start) * 1000 / RTC_HZ);
+        ece391_fdputs (1, (uint8_t*)" ms\n");
+        (void)ece391_close (empty_fd);
+    }
+
+    done = 1;
+    (void)ece391_close (mq_fd);
+    (void)ece391_close (rtc_fd);
+    return (0 == rval) ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define CHUNK 4096
+#define TOTAL_KB 4096
+#define RTC_HZ 512
+#define STACKSIZE 2048
+
+static int32_t fds[2];
+static uint8_t wbuf[CHUNK];
+static uint8_t rbuf[CHUNK];
+static uint8_t writer_stack[STACKSIZE];
+static uint8_t timer_stack[STACKSIZE];
+
+static volatile uint32_t ticks;
+static volatile uint32_t done;
+
+/* Counts RTC interrupts until the benchmark is over */
+static int32_t timer (void* arg)
+{
+    int32_t rtc_fd = (int32_t)arg;
+    int32_t garbage;
+
+    while (!done) {
+        (void)ece391_read (rtc_fd, &garbage, 4);
+        ticks++;
+    }
+    return 0;
+}
+
+/* Pushes TOTAL_KB kilobytes through the pipe, then closes its write end */
+static int32_t writer (void* arg)
+{
+    uint32_t sent;
+
+    for (sent = 0; sent < TOTAL_KB * 1024; sent += CHUNK) {
+        if (CHUNK != ece391_write (fds[1], wbuf, CHUNK)) {
+            ece391_fdputs (1, (uint8_t*)"pipe write failed\n");
+            break;
+        }
+    }
+    (void)ece391_close (fds[1]);
+    return 0;
+}
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+int main ()
+{
+    int32_t rtc_fd, cnt, hz = RTC_HZ;
+    uint32_t received = 0, start, elapsed, kbps;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &hz, 4)) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+    if (-1 == ece391_pipe (fds)) {
+        ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+        return 2;
+    }
+    if (-1 == ece391_clone (timer, timer_stack + STACKSIZE, (void*)rtc_fd)) {
+        ece391_fdputs (1, (uint8_t*)"could not start timer thread\n");
+        return 2;
+    }
+
+    /* line up with a tick so a partial tick is not counted */
+    start = ticks;
+    while (ticks == start);
+    start = ticks;
+
+    if (-1 == ece391_clone (writer, writer_stack + STACKSIZE, 0)) {
+        ece391_fdputs (1, (uint8_t*)"could not start writer thread\n");
+        done = 1;
+        return 2;
+    }
+
+    while (0 < (cnt = ece391_read (fds[0], rbuf, CHUNK)))
+        received += cnt;
+
+    elapsed = ticks - start;
+    done = 1;
+    (void)ece391_close (fds[0]);
+    (void)ece391_close (rtc_fd);
+
+    if (0 == elapsed)
+        elapsed = 1;
+    kbps = (received / 1024) * RTC_HZ / elapsed;
+
+    put_num (received / 1024);
+    ece391_fdputs (1, (uint8_t*)" KB in ");
+    put_num (elapsed * 1000 / RTC_HZ);
+    ece391_fdputs (1, (uint8_t*)" ms: ");
+    put_num (kbps / 1024);
+    ece391_fdputs (1, (uint8_t*)".");
+    put_num ((kbps % 1024) * 10 / 1024);
+    ece391_fdputs (1, (uint8_t*)" MB/s\n");
+    return 0;
+}
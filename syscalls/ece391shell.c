@@ -4,6 +4,135 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 4
+#define STAGE_STACK 2048
+
+/* One command of a pipeline and the descriptors it runs with */
+typedef struct stage {
+    uint8_t* cmd;
+    int32_t in;         /* read end of the pipe before it, -1 for the terminal */
+    int32_t out;        /* write end of the pipe after it, -1 for the terminal */
+} stage_t;
+
+static stage_t stages[MAX_STAGES];
+static uint8_t stage_stack[MAX_STAGES - 1][STAGE_STACK];
+
+/* Stages still running in threads, the shell waits for them to finish */
+static ece391_mutex_t stage_lock;
+static ece391_cond_t stage_done;
+static int32_t stages_running;
+
+/* Runs one stage and closes the pipe ends it was handed */
+static int32_t run_stage (stage_t* st)
+{
+    int32_t rval;
+
+    rval = ece391_execute_redirect (st->cmd, st->in, st->out);
+
+    /* the next stage sees end of file once its writer is gone */
+    if (-1 != st->in)
+        (void)ece391_close (st->in);
+    if (-1 != st->out)
+        (void)ece391_close (st->out);
+    return rval;
+}
+
+/* Body of a thread running every stage but the last */
+static int32_t stage_thread (void* arg)
+{
+    (void)run_stage ((stage_t*)arg);
+
+    ece391_mutex_lock (&stage_lock);
+    stages_running--;
+    ece391_cond_signal (&stage_done);
+    ece391_mutex_unlock (&stage_lock);
+    return 0;
+}
+
+/* Strips leading and trailing spaces in place */
+static uint8_t* trim (uint8_t* s)
+{
+    uint8_t* end;
+
+    while (' ' == *s)
+        s++;
+    end = s + ece391_strlen (s);
+    while (end > s && ' ' == end[-1])
+        *--end = '\0';
+    return s;
+}
+
+/*
+ * Runs "a | b | c": every stage but the last gets a thread that executes
+ * it, the last runs in the shell itself. Returns the last stage's status.
+ */
+static int32_t run_pipeline (uint8_t* buf)
+{
+    int32_t n, i, fds[2], rval;
+    uint8_t* p;
+
+    /* split at each '|' */
+    n = 0;
+    stages[n++].cmd = buf;
+    for (p = buf; '\0' != *p; p++) {
+        if ('|' != *p)
+            continue;
+        if (MAX_STAGES == n) {
+            ece391_fdputs (1, (uint8_t*)"pipeline too long\n");
+            return 0;
+        }
+        *p = '\0';
+        stages[n++].cmd = p + 1;
+    }
+    for (i = 0; i < n; i++) {
+        stages[i].cmd = trim (stages[i].cmd);
+        stages[i].in = -1;
+        stages[i].out = -1;
+        if ('\0' == stages[i].cmd[0]) {
+            ece391_fdputs (1, (uint8_t*)"empty command in pipeline\n");
+            return 0;
+        }
+    }
+
+    for (i = 0; i < n - 1; i++) {
+        if (-1 == ece391_pipe (fds)) {
+            ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+            while (i-- > 0) {
+                (void)ece391_close (stages[i].out);
+                (void)ece391_close (stages[i + 1].in);
+            }
+            return 0;
+        }
+        stages[i].out = fds[1];
+        stages[i + 1].in = fds[0];
+    }
+
+    for (i = 0; i < n - 1; i++) {
+        ece391_mutex_lock (&stage_lock);
+        stages_running++;
+        ece391_mutex_unlock (&stage_lock);
+
+        if (-1 == ece391_clone (stage_thread, stage_stack[i + 1], &stages[i])) {
+            /* closing its ends lets the stages around it finish */
+            ece391_fdputs (1, (uint8_t*)"could not start pipeline stage\n");
+            if (-1 != stages[i].in)
+                (void)ece391_close (stages[i].in);
+            (void)ece391_close (stages[i].out);
+            ece391_mutex_lock (&stage_lock);
+            stages_running--;
+            ece391_mutex_unlock (&stage_lock);
+        }
+    }
+
+    rval = run_stage (&stages[n - 1]);
+
+    ece391_mutex_lock (&stage_lock);
+    while (0 != stages_running)
+        ece391_cond_wait (&stage_done, &stage_lock);
+    ece391_mutex_unlock (&stage_lock);
+
+    return rval;
+}
 
 int main ()
 {
@@ -24,7 +153,7 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
-	rval = ece391_execute (buf);
+	rval = run_pipeline (buf);
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
 	else if (256 == rval)
@@ -33,4 +162,3 @@ int main ()
 	    ece391_fdputs (1, (uint8_t*)"program terminated abnormally\n");
     }
 }
-
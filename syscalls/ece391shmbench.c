@@ -0,0 +1,176 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Producer/consumer through shared memory. Start "shmbench c" on one
+ * terminal, then "shmbench p" on another. The producer writes straight
+ * into a ring in the segment and the consumer reads it in place, so the
+ * data never passes through the kernel; the futex is only used to sleep
+ * when the ring is full or empty.
+ */
+
+#define SHM_KEY 391
+#define RING 8192
+#define CHUNK 1024
+#define TOTAL_KB 16384
+#define RTC_HZ 512
+#define STACKSIZE 2048
+
+typedef struct ring {
+    volatile uint32_t ready;        /* consumer is attached */
+    volatile uint32_t head;         /* bytes produced */
+    volatile uint32_t tail;         /* bytes consumed */
+    volatile uint32_t consumer_sleeping;    /* consumer waits for head to move */
+    volatile uint32_t producer_sleeping;    /* producer waits for ready or tail */
+    uint8_t data[RING];
+} ring_t;
+
+static ring_t* ring;
+
+static uint8_t timer_stack[STACKSIZE];
+static volatile uint32_t ticks;
+static volatile uint32_t done;
+
+/* Orders a flag store before the load that follows it */
+static void barrier (void)
+{
+    asm volatile ("lock; addl $0, (%%esp)" : : : "memory", "cc");
+}
+
+/* Sleeps until *word changes from val, after telling the other side */
+static void wait_change (volatile uint32_t* word, uint32_t val, volatile uint32_t* sleeping)
+{
+    *sleeping = 1;
+    barrier ();
+    if (*word == val)
+        (void)ece391_futex ((uint32_t*)word, FUTEX_WAIT, val);
+    *sleeping = 0;
+}
+
+/* Wakes the other side if it said it was sleeping on word */
+static void wake_change (volatile uint32_t* word, volatile uint32_t* sleeping)
+{
+    barrier ();
+    if (*sleeping)
+        (void)ece391_futex ((uint32_t*)word, FUTEX_WAKE, 1);
+}
+
+/* Counts RTC interrupts until the benchmark is over */
+static int32_t timer (void* arg)
+{
+    int32_t rtc_fd = (int32_t)arg;
+    int32_t garbage;
+
+    while (!done) {
+        (void)ece391_read (rtc_fd, &garbage, 4);
+        ticks++;
+    }
+    return 0;
+}
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+static int32_t produce (void)
+{
+    uint32_t head, i;
+    uint8_t* dst;
+
+    ece391_fdputs (1, (uint8_t*)"waiting for consumer\n");
+    while (!ring->ready)
+        wait_change (&ring->ready, 0, &ring->producer_sleeping);
+
+    for (head = 0; head < TOTAL_KB * 1024; head += CHUNK) {
+        while (head - ring->tail == RING)
+            wait_change (&ring->tail, ring->tail, &ring->producer_sleeping);
+
+        dst = ring->data + (head & (RING - 1));
+        for (i = 0; i < CHUNK; i++)
+            dst[i] = (uint8_t)(head + i);
+
+        ring->head = head + CHUNK;
+        wake_change (&ring->head, &ring->consumer_sleeping);
+    }
+    ece391_fdputs (1, (uint8_t*)"producer done\n");
+    return 0;
+}
+
+static int32_t consume (void)
+{
+    int32_t rtc_fd, hz = RTC_HZ;
+    uint32_t tail, i, start, elapsed, kbps, bad = 0;
+    uint8_t* src;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc_fd, &hz, 4)) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+    if (-1 == ece391_clone (timer, timer_stack + STACKSIZE, (void*)rtc_fd)) {
+        ece391_fdputs (1, (uint8_t*)"could not start timer thread\n");
+        return 2;
+    }
+
+    ece391_fdputs (1, (uint8_t*)"waiting for producer\n");
+    ring->ready = 1;
+    wake_change (&ring->ready, &ring->producer_sleeping);
+    while (0 == ring->head)
+        wait_change (&ring->head, 0, &ring->consumer_sleeping);
+    start = ticks;
+
+    for (tail = 0; tail < TOTAL_KB * 1024; tail += CHUNK) {
+        while (ring->head == tail)
+            wait_change (&ring->head, tail, &ring->consumer_sleeping);
+
+        src = ring->data + (tail & (RING - 1));
+        for (i = 0; i < CHUNK; i++) {
+            if (src[i] != (uint8_t)(tail + i))
+                bad++;
+        }
+
+        ring->tail = tail + CHUNK;
+        wake_change (&ring->tail, &ring->producer_sleeping);
+    }
+
+    elapsed = ticks - start;
+    done = 1;
+    if (0 == elapsed)
+        elapsed = 1;
+    kbps = TOTAL_KB * RTC_HZ / elapsed;
+
+    put_num (TOTAL_KB);
+    ece391_fdputs (1, (uint8_t*)" KB in ");
+    put_num (elapsed * 1000 / RTC_HZ);
+    ece391_fdputs (1, (uint8_t*)" ms: ");
+    put_num (kbps / 1024);
+    ece391_fdputs (1, (uint8_t*)".");
+    put_num ((kbps % 1024) * 10 / 1024);
+    ece391_fdputs (1, (uint8_t*)" MB/s, ");
+    put_num (bad);
+    ece391_fdputs (1, (uint8_t*)" bad bytes\n");
+    return (0 == bad) ? 0 : 1;
+}
+
+int main ()
+{
+    int32_t id;
+    uint8_t buf[8];
+
+    if (0 != ece391_getargs (buf, 8) || ('p' != buf[0] && 'c' != buf[0])) {
+        ece391_fdputs (1, (uint8_t*)"usage: shmbench c | shmbench p\n");
+        return 3;
+    }
+    if (-1 == (id = ece391_shm_create (SHM_KEY)) ||
+        -1 == ece391_shm_map (id, (uint8_t**)&ring)) {
+        ece391_fdputs (1, (uint8_t*)"shared memory unavailable\n");
+        return 2;
+    }
+
+    return ('p' == buf[0]) ? produce () : consume ();
+}
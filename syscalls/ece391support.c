@@ -21,6 +21,20 @@ void ece391_fdputs(int32_t fd, const uint8_t* s)
     (void)ece391_write (fd, s, ece391_strlen(s));
 }
 
+void ece391_fdputsv(int32_t fd, const uint8_t* const* strs, uint32_t n)
+{
+    ece391_iovec_t iov[IOV_MAX];
+    uint32_t i;
+
+    if (n > IOV_MAX)
+        n = IOV_MAX;
+    for (i = 0; i < n; i++) {
+        iov[i].base = (void*)strs[i];
+        iov[i].len = ece391_strlen(strs[i]);
+    }
+    (void)ece391_writev (fd, iov, n);
+}
+
 int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2)
 {
     while (*s1 == *s2) {
@@ -102,3 +116,151 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/* Atomically replace *p with val if it holds old, return what it held */
+static uint32_t ece391_cmpxchg(volatile uint32_t* p, uint32_t old, uint32_t val)
+{
+    uint32_t prev;
+
+    asm volatile ("lock cmpxchgl %2, %1"
+                  : "=a"(prev), "+m"(*p)
+                  : "r"(val), "0"(old)
+                  : "memory", "cc");
+    return prev;
+}
+
+/* Atomically replace *p with val, return what it held */
+static uint32_t ece391_xchg(volatile uint32_t* p, uint32_t val)
+{
+    asm volatile ("xchgl %0, %1"
+                  : "+r"(val), "+m"(*p)
+                  :
+                  : "memory");
+    return val;
+}
+
+/* Atomically add val to *p */
+static void ece391_atomic_add(volatile uint32_t* p, uint32_t val)
+{
+    asm volatile ("lock addl %1, %0"
+                  : "+m"(*p)
+                  : "r"(val)
+                  : "memory", "cc");
+}
+
+void ece391_mutex_init(ece391_mutex_t* m)
+{
+    m->state = 0;
+}
+
+void ece391_mutex_lock(ece391_mutex_t* m)
+{
+    uint32_t c;
+
+    /* fast path, free to locked without entering the kernel */
+    if ((c = ece391_cmpxchg(&m->state, 0, 1)) == 0)
+        return;
+
+    /* mark the lock contended so the holder wakes us, then sleep until
+     * we are the one who swaps it from free */
+    if (c != 2)
+        c = ece391_xchg(&m->state, 2);
+    while (c != 0) {
+        (void)ece391_futex((uint32_t*)&m->state, FUTEX_WAIT, 2);
+        c = ece391_xchg(&m->state, 2);
+    }
+}
+
+int32_t ece391_mutex_trylock(ece391_mutex_t* m)
+{
+    return ece391_cmpxchg(&m->state, 0, 1) == 0 ? 0 : -1;
+}
+
+void ece391_mutex_unlock(ece391_mutex_t* m)
+{
+    /* only a lock that had sleepers needs a system call */
+    if (ece391_xchg(&m->state, 0) == 2)
+        (void)ece391_futex((uint32_t*)&m->state, FUTEX_WAKE, 1);
+}
+
+void ece391_cond_init(ece391_cond_t* c)
+{
+    c->seq = 0;
+    c->waiters = 0;
+}
+
+void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m)
+{
+    uint32_t seq = c->seq;
+
+    ece391_atomic_add(&c->waiters, 1);
+    ece391_mutex_unlock(m);
+
+    /* a signal between the unlock and the sleep changes seq, so the
+     * kernel returns at once instead of missing it */
+    (void)ece391_futex((uint32_t*)&c->seq, FUTEX_WAIT, seq);
+
+    ece391_atomic_add(&c->waiters, -1);
+
+    /* others may have been woken with us, take the lock as contended */
+    if (ece391_xchg(&m->state, 2) != 0)
+        ece391_mutex_lock(m);
+}
+
+void ece391_cond_signal(ece391_cond_t* c)
+{
+    if (c->waiters == 0)
+        return;
+    ece391_atomic_add(&c->seq, 1);
+    (void)ece391_futex((uint32_t*)&c->seq, FUTEX_WAKE, 1);
+}
+
+void ece391_cond_broadcast(ece391_cond_t* c)
+{
+    if (c->waiters == 0)
+        return;
+    ece391_atomic_add(&c->seq, 1);
+    (void)ece391_futex((uint32_t*)&c->seq, FUTEX_WAKE, c->waiters);
+}
+
+void ece391_ring_init(ece391_io_ring_t* ring)
+{
+    ring->sq_head = 0;
+    ring->sq_tail = 0;
+    ring->cq_head = 0;
+    ring->cq_tail = 0;
+}
+
+int32_t ece391_ring_prep(ece391_io_ring_t* ring, uint32_t op, int32_t fd, void* buf, int32_t nbytes, uint32_t user_data)
+{
+    ece391_io_sqe_t* sqe;
+
+    if (ring->sq_tail - ring->sq_head == IO_RING_ENTRIES)
+        return -1;
+
+    sqe = &ring->sqes[ring->sq_tail & (IO_RING_ENTRIES - 1)];
+    sqe->op = op;
+    sqe->fd = fd;
+    sqe->buf = buf;
+    sqe->nbytes = nbytes;
+    sqe->user_data = user_data;
+
+    /* the entry is filled in before the kernel can see it */
+    ring->sq_tail++;
+    return 0;
+}
+
+int32_t ece391_ring_submit(ece391_io_ring_t* ring)
+{
+    return ece391_io_enter(ring, ring->sq_tail - ring->sq_head);
+}
+
+int32_t ece391_ring_reap(ece391_io_ring_t* ring, ece391_io_cqe_t* cqe)
+{
+    if (ring->cq_head == ring->cq_tail)
+        return -1;
+
+    *cqe = ring->cqes[ring->cq_head & (IO_RING_ENTRIES - 1)];
+    ring->cq_head++;
+    return 0;
+}
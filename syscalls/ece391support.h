@@ -1,13 +1,51 @@
 #if !defined(ECE391SUPPORT_H)
 #define ECE391SUPPORT_H
 
+#include "ece391syscall.h"
+
 extern uint32_t ece391_strlen(const uint8_t* s);
 extern void ece391_strcpy(uint8_t* dst, const uint8_t* src);
 extern void ece391_fdputs(int32_t fd, const uint8_t* s);
+/* Writes n strings (at most IOV_MAX) to fd with a single ece391_writev */
+extern void ece391_fdputsv(int32_t fd, const uint8_t* const* strs, uint32_t n);
 extern int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2);
 extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/*
+ * Locks for threads and shared memory. Both stay in user space while
+ * uncontended and only call ece391_futex to sleep or wake a sleeper.
+ * Zero-filled objects are initialized.
+ */
+typedef struct ece391_mutex {
+    volatile uint32_t state;    /* 0 free, 1 locked, 2 locked with sleepers */
+} ece391_mutex_t;
+
+typedef struct ece391_cond {
+    volatile uint32_t seq;      /* bumped by every signal */
+    volatile uint32_t waiters;  /* threads inside ece391_cond_wait */
+} ece391_cond_t;
+
+extern void ece391_mutex_init(ece391_mutex_t* m);
+extern void ece391_mutex_lock(ece391_mutex_t* m);
+extern int32_t ece391_mutex_trylock(ece391_mutex_t* m);
+extern void ece391_mutex_unlock(ece391_mutex_t* m);
+extern void ece391_cond_init(ece391_cond_t* c);
+extern void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m);
+extern void ece391_cond_signal(ece391_cond_t* c);
+extern void ece391_cond_broadcast(ece391_cond_t* c);
+
+/*
+ * Submission ring helpers. ece391_ring_prep queues one request and fails
+ * if the ring is full; ece391_ring_submit hands everything queued to the
+ * kernel in one call; ece391_ring_reap takes the oldest completion and
+ * returns 0, or -1 if there is none.
+ */
+extern void ece391_ring_init(ece391_io_ring_t* ring);
+extern int32_t ece391_ring_prep(ece391_io_ring_t* ring, uint32_t op, int32_t fd, void* buf, int32_t nbytes, uint32_t user_data);
+extern int32_t ece391_ring_submit(ece391_io_ring_t* ring);
+extern int32_t ece391_ring_reap(ece391_io_ring_t* ring, ece391_io_cqe_t* cqe);
+
 #endif /* ECE391SUPPORT_H */
 
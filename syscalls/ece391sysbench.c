@@ -0,0 +1,72 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Null system call latency through INT $0x80 and through SYSENTER, in TSC
+ * cycles. The call is a read of fd -1, which the kernel turns away right
+ * after entering.
+ */
+
+#define CALLS 100000
+
+/* Low half of the TSC; a run is short enough not to wrap it twice */
+static uint32_t rdtsc (void)
+{
+    uint32_t lo, hi;
+
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+static uint32_t measure (int32_t use_sysenter)
+{
+    uint32_t i, start, cycles;
+    uint8_t c;
+
+    ece391_use_sysenter = use_sysenter;
+    start = rdtsc ();
+    for (i = 0; i < CALLS; i++)
+        (void)ece391_read (-1, &c, 1);
+    cycles = (rdtsc () - start) / CALLS;
+
+    put_num (cycles);
+    ece391_fdputs (1, (uint8_t*)" cycles per call\n");
+    return cycles;
+}
+
+int main ()
+{
+    uint8_t c;
+    uint32_t slow, fast;
+
+    /* the first call decides whether SYSENTER is there */
+    (void)ece391_read (-1, &c, 1);
+    if (1 != ece391_use_sysenter) {
+        ece391_fdputs (1, (uint8_t*)"no SYSENTER on this CPU\nint $0x80: ");
+        (void)measure (0);
+        return 0;
+    }
+
+    ece391_fdputs (1, (uint8_t*)"int $0x80: ");
+    slow = measure (0);
+    ece391_fdputs (1, (uint8_t*)"sysenter:  ");
+    fast = measure (1);
+
+    if (0 != fast) {
+        ece391_fdputs (1, (uint8_t*)"sysenter is ");
+        put_num (slow * 10 / fast / 10);
+        ece391_fdputs (1, (uint8_t*)".");
+        put_num (slow * 10 / fast % 10);
+        ece391_fdputs (1, (uint8_t*)"x as fast\n");
+    }
+    return 0;
+}
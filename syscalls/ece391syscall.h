@@ -22,6 +22,187 @@ extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/*
+ * Starts a thread running fn(arg) on the given stack (top address, inside
+ * the program's page). The thread shares memory and open files with the
+ * caller and halts with fn's return value when fn returns. Returns the
+ * thread's ID. A program halts only once all of its threads have.
+ */
+extern int32_t ece391_clone (int32_t (*fn)(void* arg), void* stack, void* arg);
+
+/*
+ * FUTEX_WAIT sleeps until a FUTEX_WAKE on addr if *addr still equals val,
+ * otherwise returns -1 at once. FUTEX_WAKE wakes up to val sleepers and
+ * returns how many it woke. addr must be 4 byte aligned.
+ */
+#define FUTEX_WAIT  0
+#define FUTEX_WAKE  1
+extern int32_t ece391_futex (uint32_t* addr, int32_t op, int32_t val);
+
+/*
+ * Creates a pipe: bytes written to fds[1] are read from fds[0]. Reads
+ * block while it is empty and return 0 once every write end is closed;
+ * writes block while it is full and fail once every read end is closed.
+ */
+extern int32_t ece391_pipe (int32_t* fds);
+
+/*
+ * Like ece391_execute, but the child's stdin and stdout are copies of
+ * the caller's in_fd and out_fd (-1 keeps the terminal). Threads may
+ * call it, so a program can run several children at once.
+ */
+extern int32_t ece391_execute_redirect (const uint8_t* command, int32_t in_fd, int32_t out_fd);
+
+/*
+ * Shared memory: ece391_shm_create finds the segment named key, creating
+ * a zeroed 16KB one if there is none, and returns its id. ece391_shm_map
+ * stores the segment's address in *addr. Every process using a segment
+ * sees the same memory; it is freed once all of them have halted.
+ */
+extern int32_t ece391_shm_create (uint32_t key);
+extern int32_t ece391_shm_map (int32_t id, uint8_t** addr);
+
+/*
+ * Message queues: ece391_mq_open opens the queue named name, creating an
+ * empty one if there is none, and returns an fd. Reads and writes on it
+ * move whole ece391_msg_t messages, as many as fit in nbytes, and return
+ * the bytes moved. Reads get the highest priority messages first. A read
+ * of an empty queue or a write to a full one (32 messages) waits up to
+ * timeout PIT ticks (10ms each), then returns 0; MQ_NOWAIT returns at once and
+ * MQ_FOREVER waits until it can move at least one message.
+ */
+#define MQ_MSG_DATA 56
+#define MQ_NOWAIT   0
+#define MQ_FOREVER  0xFFFFFFFF
+typedef struct ece391_msg {
+    uint32_t priority;
+    uint32_t len;
+    uint8_t data[MQ_MSG_DATA];
+} ece391_msg_t;
+extern int32_t ece391_mq_open (const uint8_t* name, uint32_t timeout);
+
+/*
+ * Waits until one of nfds (at most 16) fds is ready for the events asked
+ * for, or until timeout PIT ticks have passed. Sets revents in every
+ * entry and returns how many entries have any, 0 on timeout. POLLHUP,
+ * POLLERR and POLLNVAL are reported even if not asked for. An RTC fd is
+ * readable once a period has passed, stdin once a line has been entered.
+ */
+#define POLLIN      0x01
+#define POLLOUT     0x04
+#define POLLERR     0x08
+#define POLLHUP     0x10
+#define POLLNVAL    0x20
+#define POLL_NOWAIT     0
+#define POLL_FOREVER    0xFFFFFFFF
+typedef struct ece391_pollfd {
+    int32_t fd;
+    uint16_t events;
+    uint16_t revents;
+} ece391_pollfd_t;
+extern int32_t ece391_poll (ece391_pollfd_t* fds, uint32_t nfds, uint32_t timeout);
+
+/*
+ * Batched system calls: queue reads, writes and closes in the submission
+ * ring, then one ece391_io_enter runs up to to_submit of them in order
+ * and posts each result, with its user_data, in the completion ring. It
+ * returns how many it ran; it stops early if the completion ring is
+ * full. The rings live in the program's memory; ece391support wraps them.
+ */
+#define IO_RING_ENTRIES 64
+#define IO_OP_NOP       0
+#define IO_OP_READ      1
+#define IO_OP_WRITE     2
+#define IO_OP_CLOSE     3
+typedef struct ece391_io_sqe {
+    uint32_t op;
+    int32_t fd;
+    void* buf;
+    int32_t nbytes;
+    uint32_t user_data;
+} ece391_io_sqe_t;
+typedef struct ece391_io_cqe {
+    uint32_t user_data;
+    int32_t res;
+} ece391_io_cqe_t;
+typedef struct ece391_io_ring {
+    volatile uint32_t sq_head;      /* moved by the kernel */
+    volatile uint32_t sq_tail;      /* moved by the program */
+    volatile uint32_t cq_head;      /* moved by the program */
+    volatile uint32_t cq_tail;      /* moved by the kernel */
+    ece391_io_sqe_t sqes[IO_RING_ENTRIES];
+    ece391_io_cqe_t cqes[IO_RING_ENTRIES];
+} ece391_io_ring_t;
+extern int32_t ece391_io_enter (ece391_io_ring_t* ring, uint32_t to_submit);
+
+/*
+ * Vectored I/O: read into or write from up to IOV_MAX buffers in order
+ * with one system call. Both return the total bytes moved and stop at
+ * the first short transfer.
+ */
+#define IOV_MAX 16
+typedef struct ece391_iovec {
+    void* base;
+    int32_t len;
+} ece391_iovec_t;
+extern int32_t ece391_readv (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_writev (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+
+/*
+ * Writes up to count bytes of the regular file in_fd to out_fd from
+ * inside the kernel, without a user buffer. offset -1 starts at in_fd's
+ * position and advances it; otherwise the position is left alone.
+ * Returns the bytes sent, 0 at end of file.
+ */
+extern int32_t ece391_sendfile (int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count);
+
+/*
+ * Device specific requests on an fd. On a terminal fd TTY_SETMODE picks
+ * how reads behave: TTY_CANON (the default) echoes and edits a line and
+ * returns it after Enter; TTY_RAW returns the keys typed so far without
+ * echo or waiting, one byte each, arrows as ESC [ A..D and Ctrl+letter
+ * as its control character. The mode belongs to the fd.
+ */
+#define TTY_CANON   0
+#define TTY_RAW     1
+#define TTY_SETMODE 1
+#define TTY_GETMODE 2
+extern int32_t ece391_ioctl (int32_t fd, uint32_t request, uint32_t arg);
+
+/*
+ * Double-buffered vidmap: ece391_vidmap_buffered maps, at the address
+ * ece391_vidmap uses, a page private to the program that starts out as
+ * a copy of the screen. Nothing drawn there shows until
+ * ece391_vidmap_present, which draws the rows that changed since the
+ * last present and returns how many. ece391_vidmap goes back to drawing
+ * on the screen directly.
+ */
+extern int32_t ece391_vidmap_buffered (uint8_t** screen_start);
+extern int32_t ece391_vidmap_present (void);
+
+/*
+ * Maps the framebuffer into the program when the kernel was booted with
+ * video=WxHxBPP and fills in where it is and how it is laid out; -1 in
+ * text mode. Pixel (x, y) is at base + y * pitch + x * bpp / 8, 32 bpp
+ * pixels being 0x00RRGGBB. The console stops drawing until every
+ * program holding the framebuffer has halted.
+ */
+typedef struct ece391_fb_info {
+    uint8_t* base;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    uint32_t bpp;
+} ece391_fb_info_t;
+extern int32_t ece391_fbmap (ece391_fb_info_t* info);
+
+/*
+ * The wrappers enter the kernel with SYSENTER when the CPU supports it
+ * and with INT $0x80 otherwise; -1 until the first call decides. Set it
+ * to 0 to force INT $0x80.
+ */
+extern int32_t ece391_use_sysenter;
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
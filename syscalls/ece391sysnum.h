@@ -11,5 +11,21 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_CLONE   11
+#define SYS_FUTEX   12
+#define SYS_PIPE    13
+#define SYS_EXECUTE_REDIRECT  14
+#define SYS_SHM_CREATE  15
+#define SYS_SHM_MAP     16
+#define SYS_MQ_OPEN     17
+#define SYS_POLL        18
+#define SYS_IO_ENTER    19
+#define SYS_READV       20
+#define SYS_WRITEV      21
+#define SYS_SENDFILE    22
+#define SYS_IOCTL       23
+#define SYS_VIDMAP_BUFFERED 24
+#define SYS_VIDMAP_PRESENT  25
+#define SYS_FBMAP       26
 
 #endif /* ECE391SYSNUM_H */
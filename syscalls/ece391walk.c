@@ -0,0 +1,82 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Moves an @ around the screen with the arrow keys, q quits. Stdin is
+ * put in raw mode so every key arrives as it is pressed, poll sleeps
+ * until one does, and only the two cells that change are redrawn.
+ */
+
+#define ROWS 25
+#define COLS 80
+#define BUFSIZE 32
+
+/* Moves the cursor to row, col (from 1) and writes s there */
+static void put_at (int32_t row, int32_t col, const char* s)
+{
+    uint8_t num[12];
+
+    ece391_fdputs (1, (uint8_t*)"\033[");
+    ece391_fdputs (1, ece391_itoa (row, num, 10));
+    ece391_fdputs (1, (uint8_t*)";");
+    ece391_fdputs (1, ece391_itoa (col, num, 10));
+    ece391_fdputs (1, (uint8_t*)"H");
+    ece391_fdputs (1, (uint8_t*)s);
+}
+
+int main ()
+{
+    int32_t row = ROWS / 2, col = COLS / 2, cnt, i;
+    int32_t new_row, new_col;
+    uint8_t buf[BUFSIZE];
+    ece391_pollfd_t fds[1];
+
+    if (-1 == ece391_ioctl (0, TTY_SETMODE, TTY_RAW)) {
+        ece391_fdputs (1, (uint8_t*)"stdin is not a terminal\n");
+        return 2;
+    }
+
+    ece391_fdputs (1, (uint8_t*)"\033[2J");
+    put_at (1, 1, "arrows move, q quits");
+    put_at (row, col, "@");
+
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    while (1) {
+        if (-1 == ece391_poll (fds, 1, POLL_FOREVER))
+            break;
+        if (0 >= (cnt = ece391_read (0, buf, BUFSIZE)))
+            continue;
+
+        new_row = row;
+        new_col = col;
+        for (i = 0; i < cnt; i++) {
+            if ('q' == buf[i])
+                goto done;
+            /* arrows arrive as ESC [ A..D */
+            if (i + 2 < cnt && 0x1B == buf[i] && '[' == buf[i + 1]) {
+                switch (buf[i + 2]) {
+                    case 'A': if (new_row > 2) new_row--; break;
+                    case 'B': if (new_row < ROWS) new_row++; break;
+                    case 'C': if (new_col < COLS - 1) new_col++; break;
+                    case 'D': if (new_col > 1) new_col--; break;
+                }
+                i += 2;
+            }
+        }
+
+        if (new_row != row || new_col != col) {
+            put_at (row, col, " ");
+            put_at (new_row, new_col, "@");
+            row = new_row;
+            col = new_col;
+        }
+    }
+
+done:
+    (void)ece391_ioctl (0, TTY_SETMODE, TTY_CANON);
+    ece391_fdputs (1, (uint8_t*)"\033[2J\033[1;1H");
+    return 0;
+}